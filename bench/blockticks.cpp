@@ -0,0 +1,274 @@
+/*
+ * Benchmark for the scheduled block updates and random ticks.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/randombatch.h"
+#include "world/blockticker.h"
+#include "world/chunkcolumn.h"
+#include "world/regionticker.h"
+#include <boost/asio/io_service.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using cenisys::BlockId;
+using cenisys::BlockTicker;
+using cenisys::ChunkColumn;
+using cenisys::ChunkSection;
+using cenisys::RandomBatch;
+using cenisys::RegionTicker;
+using Clock = std::chrono::steady_clock;
+
+constexpr BlockId STONE = 1;
+constexpr BlockId GRASS = 2;
+constexpr BlockId DIRT = 3;
+//! Top of the dirt, covered by grass on every other column.
+constexpr unsigned SURFACE = 20;
+constexpr std::size_t TICKS = 20;
+//! Updates scheduled per tick, per column.
+constexpr double SCHEDULED_PER_COLUMN = 0.25;
+
+double milliseconds(Clock::duration time)
+{
+    return std::chrono::duration<double, std::milli>(time).count();
+}
+
+//!
+//! \brief A square of columns, each with a section of stone and one of
+//! dirt.
+//!
+//! Fewer sections than in a real world, so 100k columns fit in memory.
+//!
+struct World
+{
+    explicit World(std::size_t count)
+        : regions(ioService),
+          ticker(
+              [this](std::int32_t x, std::int32_t z) -> ChunkColumn * {
+                  auto it = columns.find({x, z});
+                  return it == columns.end() ? nullptr : it->second.get();
+              },
+              [this](std::int32_t x, unsigned y, std::int32_t z,
+                     BlockId block) {
+                  auto it = columns.find({x >> 4, z >> 4});
+                  if(it != columns.end())
+                      it->second->setBlock(x & 15, y, z & 15, block);
+              })
+    {
+        std::int32_t side = static_cast<std::int32_t>(std::sqrt(count));
+        for(std::int32_t z = 0; z < side; z++)
+        {
+            for(std::int32_t x = 0; x < side; x++)
+            {
+                auto column = std::make_unique<ChunkColumn>(x, z);
+                column->getWritableSection(0).fill(STONE);
+                BlockId top = (x + z) % 2 ? GRASS : DIRT;
+                for(unsigned y = 16; y <= SURFACE; y++)
+                {
+                    for(unsigned bz = 0; bz < 16; bz++)
+                    {
+                        for(unsigned bx = 0; bx < 16; bx++)
+                        {
+                            column->setBlock(bx, y, bz,
+                                             y == SURFACE ? top : DIRT);
+                        }
+                    }
+                }
+                regions.insert(*column);
+                columns[{x, z}] = std::move(column);
+            }
+        }
+        regions.setTicker(
+            [this](ChunkColumn &column, RegionTicker::Region &region) {
+                ticker.tickColumn(column, region);
+            });
+    }
+
+    //! Never run, so everything is ticked on this thread.
+    boost::asio::io_service ioService;
+    std::map<std::pair<std::int32_t, std::int32_t>,
+             std::unique_ptr<ChunkColumn>>
+        columns;
+    RegionTicker regions;
+    BlockTicker ticker;
+};
+
+//!
+//! \brief Ticks with a scheduled update on every fourth column.
+//!
+void ticks(World &world)
+{
+    std::mt19937 random(1);
+    std::vector<ChunkColumn *> columns;
+    for(auto &item : world.columns)
+        columns.push_back(item.second.get());
+    std::size_t perTick =
+        static_cast<std::size_t>(columns.size() * SCHEDULED_PER_COLUMN);
+
+    Clock::duration schedule = Clock::duration::zero();
+    Clock::duration tick = Clock::duration::zero();
+    BlockTicker::Stats before = world.ticker.getStats();
+    for(std::size_t round = 0; round < TICKS; round++)
+    {
+        Clock::time_point begin = Clock::now();
+        for(std::size_t i = 0; i < perTick; i++)
+        {
+            std::uint32_t value = random();
+            // Stone never reacts, so only the queues are measured
+            world.ticker.schedule(*columns[value % columns.size()],
+                                  value >> 20 & 15, value >> 24 & 15,
+                                  value >> 28 & 15, STONE,
+                                  1 + (value >> 12 & 15));
+        }
+        schedule += Clock::now() - begin;
+        begin = Clock::now();
+        world.ticker.nextTick();
+        world.regions.tick();
+        tick += Clock::now() - begin;
+    }
+    BlockTicker::Stats stats = world.ticker.getStats();
+    std::uint64_t randomTicks = stats.randomTicks - before.randomTicks;
+    std::uint64_t scheduled = stats.scheduled - before.scheduled;
+    std::uint64_t duplicates = stats.duplicates - before.duplicates;
+    std::cout << columns.size() << " columns: " << milliseconds(tick) / TICKS
+              << " ms per tick, " << randomTicks / TICKS << " random ticks in "
+              << (stats.sectionsTicked - before.sectionsTicked) / TICKS
+              << " sections, "
+              << (stats.sectionsSkipped - before.sectionsSkipped) / TICKS
+              << " skipped; " << (scheduled + duplicates) / TICKS
+              << " updates scheduled per tick, "
+              << milliseconds(schedule) * 1000000 / (scheduled + duplicates)
+              << " ns each, " << duplicates * 100 / (scheduled + duplicates)
+              << "% duplicates, "
+              << (stats.scheduledRun - before.scheduledRun) / TICKS
+              << " run per tick" << std::endl;
+}
+
+//!
+//! \brief Picking the blocks as BlockTicker does: only the tickable
+//! sections, from one batch of numbers a column.
+//!
+void batched(World &world)
+{
+    const ChunkColumn::BlockSet &ticked = BlockTicker::getRandomlyTicked();
+    constexpr unsigned COUNT = BlockTicker::DEFAULT_RANDOM_TICKS;
+    std::uint32_t randoms[ChunkColumn::SECTIONS * COUNT + RandomBatch::LANES];
+    std::uint64_t found = 0;
+    Clock::time_point begin = Clock::now();
+    for(std::size_t round = 0; round < TICKS; round++)
+    {
+        for(auto &item : world.columns)
+        {
+            ChunkColumn &column = *item.second;
+            std::uint16_t sections = column.getTickableSections(ticked);
+            if(!sections)
+                continue;
+            RandomBatch random(round << 32 ^ item.first.first << 16 ^
+                               item.first.second);
+            random.fill(randoms, ChunkColumn::SECTIONS * COUNT);
+            std::uint32_t *next = randoms;
+            for(std::size_t y = 0; y < ChunkColumn::SECTIONS; y++)
+            {
+                if(!(sections & (1 << y)))
+                    continue;
+                const ChunkSection &section = column.getSection(y);
+                for(unsigned i = 0; i < COUNT; i++)
+                {
+                    std::size_t index = *next++ & (ChunkSection::VOLUME - 1);
+                    BlockId block = section.getBlock(index);
+                    found += block < ticked.size() && ticked[block];
+                }
+            }
+        }
+    }
+    std::cout << world.columns.size() << " columns, tickable sections: "
+              << milliseconds(Clock::now() - begin) / TICKS
+              << " ms per tick just to pick the blocks, " << found / TICKS
+              << " to tick" << std::endl;
+}
+
+//!
+//! \brief What random ticks cost without the tickable sections and the
+//! batches: every section of every column, one generator call a block.
+//!
+void naive(World &world)
+{
+    std::mt19937 random(1);
+    const ChunkColumn::BlockSet &ticked = BlockTicker::getRandomlyTicked();
+    std::uint64_t found = 0;
+    Clock::time_point begin = Clock::now();
+    for(std::size_t round = 0; round < TICKS; round++)
+    {
+        for(auto &item : world.columns)
+        {
+            ChunkColumn &column = *item.second;
+            for(std::size_t y = 0; y < ChunkColumn::SECTIONS; y++)
+            {
+                if(!column.hasSection(y))
+                    continue;
+                const ChunkSection &section = column.getSection(y);
+                for(unsigned i = 0; i < BlockTicker::DEFAULT_RANDOM_TICKS;
+                    i++)
+                {
+                    std::size_t index = random() & (ChunkSection::VOLUME - 1);
+                    BlockId block = section.getBlock(index);
+                    found += block < ticked.size() && ticked[block];
+                }
+            }
+        }
+    }
+    std::cout << world.columns.size() << " columns, every section: "
+              << milliseconds(Clock::now() - begin) / TICKS
+              << " ms per tick just to pick the blocks, " << found / TICKS
+              << " to tick" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::size_t> counts;
+    for(int i = 1; i < argc; i++)
+        counts.push_back(std::atoi(argv[i]));
+    if(counts.empty())
+        counts = {10000, 100000};
+    std::cout << std::fixed << std::setprecision(2);
+    for(std::size_t count : counts)
+    {
+        World world(count);
+        // The first tick looks at every section
+        world.ticker.nextTick();
+        world.regions.tick();
+        ticks(world);
+        batched(world);
+        naive(world);
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Benchmark of the paletted chunk section storage.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunksection.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+using cenisys::BlockId;
+using cenisys::ChunkSection;
+
+//! Keeps the results alive so the loops are not optimized away.
+volatile std::uint64_t sink;
+
+template <typename Fn>
+double nanosecondsPer(std::size_t operations, Fn &&func)
+{
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - begin)
+               .count() /
+           operations;
+}
+
+//! A section using the given number of distinct ids.
+ChunkSection makeSection(std::size_t ids, std::mt19937 &random)
+{
+    ChunkSection section;
+    for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+        section.setBlock(i, static_cast<BlockId>(random() % ids));
+    return section;
+}
+
+void randomAccess(std::size_t rounds)
+{
+    std::mt19937 random(1);
+    std::vector<std::uint16_t> indices(1 << 16);
+    for(auto &item : indices)
+        item = static_cast<std::uint16_t>(random() % ChunkSection::VOLUME);
+    for(std::size_t ids : {1, 2, 4, 16, 256, 4096})
+    {
+        ChunkSection section = makeSection(ids, random);
+        double get = nanosecondsPer(rounds * indices.size(), [&] {
+            std::uint64_t sum = 0;
+            for(std::size_t round = 0; round < rounds; round++)
+            {
+                for(std::uint16_t index : indices)
+                    sum += section.getBlock(index);
+            }
+            sink = sum;
+        });
+        // Ids already in the palette, so no resizing happens
+        double set = nanosecondsPer(rounds * indices.size(), [&] {
+            for(std::size_t round = 0; round < rounds; round++)
+            {
+                for(std::uint16_t index : indices)
+                    section.setBlock(index, (index + round) % ids);
+            }
+        });
+        std::cout << "random access, " << std::setw(4) << ids << " ids ("
+                  << std::setw(2) << section.getBitsPerBlock()
+                  << " bits): get " << get << " ns, set " << set << " ns"
+                  << std::endl;
+    }
+}
+
+void fill(std::size_t rounds)
+{
+    ChunkSection section;
+    double loop = nanosecondsPer(rounds * ChunkSection::VOLUME, [&] {
+        for(std::size_t round = 0; round < rounds; round++)
+        {
+            for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+                section.setBlock(i, round % 4);
+        }
+    });
+    double whole = nanosecondsPer(rounds, [&] {
+        for(std::size_t round = 0; round < rounds; round++)
+            section.fill(round % 4);
+    });
+    std::cout << "full section: " << loop << " ns per block set, " << whole
+              << " ns per fill" << std::endl;
+}
+
+void paletteGrowth(std::size_t rounds)
+{
+    // Every new id widens the palette until all 16 bits are used
+    double grow = nanosecondsPer(rounds, [&] {
+        for(std::size_t round = 0; round < rounds; round++)
+        {
+            ChunkSection section;
+            for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+                section.setBlock(i, static_cast<BlockId>(i));
+            sink = section.getBitsPerBlock();
+        }
+    });
+    std::mt19937 random(2);
+    ChunkSection mixed = makeSection(300, random);
+    double compact = nanosecondsPer(rounds, [&] {
+        for(std::size_t round = 0; round < rounds; round++)
+        {
+            ChunkSection section(mixed);
+            for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+                section.setBlock(i, section.getBlock(i) % 10);
+            section.compact();
+            sink = section.getBitsPerBlock();
+        }
+    });
+    std::cout << "palette: " << grow / 1000 << " us to grow to "
+              << ChunkSection::MAX_BITS << " bits, " << compact / 1000
+              << " us to rewrite and compact 300 ids to 10" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t rounds = argc > 1 ? std::atoi(argv[1]) : 100;
+    std::cout << std::fixed << std::setprecision(2);
+    randomAccess(rounds);
+    fill(rounds * 10);
+    paletteGrowth(rounds);
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Benchmark of logging while consoles attach and detach.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server/server.h"
+#include <atomic>
+#include <boost/filesystem/operations.hpp>
+#include <boost/locale/generator.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+class NullConsole : public cenisys::ConsoleBackend
+{
+public:
+    void attach(cenisys::Console &console) {}
+    void detach() {}
+    void log(const boost::locale::format &content) { count++; }
+
+    std::atomic<std::size_t> count{0};
+};
+
+struct Result
+{
+    double messages;
+    double churn;
+};
+
+Result run(cenisys::Server &server, std::size_t threads,
+           std::chrono::milliseconds duration, bool churn)
+{
+    NullConsole sink;
+    auto sinkHandle = server.registerConsole(sink);
+    std::atomic_bool running(true);
+    std::atomic<std::size_t> churnCount(0);
+
+    std::vector<std::thread> loggers;
+    for(std::size_t i = 0; i < threads; i++)
+    {
+        loggers.emplace_back([&] {
+            while(running)
+                server.log(cenisys::Server::LogLevel::Info, "benchmark");
+        });
+    }
+    std::thread churner;
+    if(churn)
+    {
+        churner = std::thread([&] {
+            NullConsole console;
+            while(running)
+            {
+                server.unregisterConsole(server.registerConsole(console));
+                churnCount++;
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    running = false;
+    for(auto &item : loggers)
+        item.join();
+    if(churner.joinable())
+        churner.join();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    server.unregisterConsole(sinkHandle);
+    return {sink.count / seconds, churnCount / seconds};
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    std::chrono::milliseconds duration(argc > 2 ? std::atoi(argv[2]) : 2000);
+
+    boost::locale::generator localeGen;
+    std::locale::global(localeGen(""));
+    boost::filesystem::path dataDir =
+        boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path();
+    {
+        cenisys::Server server(dataDir, localeGen);
+        for(bool churn : {false, true})
+        {
+            Result result = run(server, threads, duration, churn);
+            std::cout << (churn ? "with churn:    " : "without churn: ")
+                      << static_cast<std::size_t>(result.messages)
+                      << " messages/s";
+            if(churn)
+                std::cout << ", " << static_cast<std::size_t>(result.churn)
+                          << " attach/detach/s";
+            std::cout << std::endl;
+        }
+    }
+    boost::filesystem::remove_all(dataDir);
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Benchmark for the entity systems.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entity/entity.h"
+#include "entity/entitymanager.h"
+#include <boost/asio/io_service.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using cenisys::BoundingBox;
+using cenisys::Entity;
+using cenisys::EntityManager;
+using cenisys::Vector3;
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t WARMUP_TICKS = 10;
+constexpr std::size_t TICKS = 100;
+//! High enough that nothing falls out of the world while measured.
+constexpr double HEIGHT = 1000;
+
+//! Falling mobs with health, items and sliding projectiles.
+struct Spawn
+{
+    Vector3 location;
+    Vector3 velocity;
+    EntityManager::Components components;
+};
+
+std::vector<Spawn> makeSpawns(std::size_t count)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> position(-256, 256);
+    std::uniform_real_distribution<double> speed(-0.5, 0.5);
+    std::vector<Spawn> result;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        EntityManager::Components components = EntityManager::VELOCITY |
+                                               EntityManager::BOUNDING_BOX;
+        switch(i % 3)
+        {
+        case 0:
+            components |= EntityManager::GRAVITY | EntityManager::HEALTH;
+            break;
+        case 1:
+            components |= EntityManager::GRAVITY;
+            break;
+        }
+        result.push_back({{position(random), HEIGHT, position(random)},
+                          {speed(random), speed(random), speed(random)},
+                          components});
+    }
+    return result;
+}
+
+//!
+//! \brief The same update, but every entity is an object on the heap.
+//!
+class Object
+{
+public:
+    explicit Object(const Spawn &spawn)
+        : _position(spawn.location), _velocity(spawn.velocity),
+          _box{spawn.location - Vector3{0.3, 0, 0.3},
+               spawn.location + Vector3{0.3, 1.8, 0.3}},
+          _health(EntityManager::DEFAULT_HEALTH),
+          _gravity((spawn.components & EntityManager::GRAVITY) != 0)
+    {
+    }
+    virtual ~Object() = default;
+
+    //! \return false once the entity should be removed.
+    virtual bool tick()
+    {
+        _position += _velocity;
+        _box += _velocity;
+        if(_gravity)
+            _velocity.y -= EntityManager::GRAVITY_ACCELERATION;
+        _velocity *= EntityManager::DRAG;
+        return _position.y >= EntityManager::DESPAWN_DEPTH && _health > 0;
+    }
+
+private:
+    Vector3 _position;
+    Vector3 _velocity;
+    BoundingBox _box;
+    double _health;
+    bool _gravity;
+};
+
+void objects(const std::vector<Spawn> &spawns)
+{
+    std::vector<std::unique_ptr<Object>> objects;
+    for(const Spawn &spawn : spawns)
+        objects.push_back(std::make_unique<Object>(spawn));
+    // Entities come and go, so they are not in the order they were made
+    std::shuffle(objects.begin(), objects.end(), std::mt19937(2));
+    std::size_t alive = 0;
+    Clock::time_point begin = Clock::now();
+    for(std::size_t i = 0; i < TICKS; i++)
+    {
+        alive = 0;
+        for(auto &object : objects)
+            alive += object->tick();
+    }
+    std::cout << spawns.size() << " objects: "
+              << std::chrono::duration<double, std::milli>(Clock::now() -
+                                                           begin)
+                         .count() /
+                     TICKS
+              << " mspt mean, " << alive << " alive" << std::endl;
+}
+
+void run(const std::vector<Spawn> &spawns, std::size_t threads)
+{
+    boost::asio::io_service ioService;
+    std::unique_ptr<boost::asio::io_service::work> work =
+        std::make_unique<boost::asio::io_service::work>(ioService);
+    std::vector<std::thread> workers;
+    for(std::size_t i = 1; i < threads; i++)
+        workers.emplace_back([&ioService] { ioService.run(); });
+
+    EntityManager entities(ioService);
+    entities.setThreads(threads);
+    for(const Spawn &spawn : spawns)
+    {
+        Entity entity = entities.spawn(spawn.location, spawn.components);
+        entity.setVelocity(spawn.velocity);
+        entity.setSize(0.6, 1.8);
+    }
+    for(std::size_t i = 0; i < WARMUP_TICKS; i++)
+        entities.tick();
+    std::vector<double> times;
+    for(std::size_t i = 0; i < TICKS; i++)
+    {
+        Clock::time_point begin = Clock::now();
+        entities.tick();
+        times.push_back(
+            std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                .count());
+    }
+    std::sort(times.begin(), times.end());
+    double total = 0;
+    for(double time : times)
+        total += time;
+    EntityManager::Stats stats = entities.getStats();
+    std::cout << stats.entities << " entities in " << stats.archetypes
+              << " archetypes, " << threads << " threads: "
+              << total / times.size() << " mspt mean, "
+              << times[times.size() * 95 / 100] << " p95, "
+              << stats.parallelTicks * 100 / stats.ticks
+              << "% ticks parallel, "
+              << stats.entities * 1000 / (total / times.size())
+              << " updates per second" << std::endl;
+
+    work.reset();
+    for(auto &item : workers)
+        item.join();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    std::vector<std::size_t> threads;
+    for(int i = 2; i < argc; i++)
+        threads.push_back(std::atoi(argv[i]));
+    if(threads.empty())
+    {
+        threads.push_back(1);
+        threads.push_back(
+            std::max<std::size_t>(std::thread::hardware_concurrency(), 2));
+    }
+    std::vector<Spawn> spawns = makeSpawns(count);
+    std::cout << std::fixed << std::setprecision(2);
+    objects(spawns);
+    for(std::size_t number : threads)
+        run(spawns, number);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Benchmark for the light engine.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "world/lightengine.h"
+#include "world/terraingenerator.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+
+namespace
+{
+
+using cenisys::BlockId;
+using cenisys::ChunkColumn;
+using cenisys::ChunkSection;
+using cenisys::LightEngine;
+using Clock = std::chrono::steady_clock;
+
+constexpr BlockId STONE = 1;
+constexpr BlockId TORCH = 50;
+//! Columns loaded in every direction from the origin.
+constexpr std::int32_t RADIUS = 3;
+
+double microseconds(Clock::duration time)
+{
+    return std::chrono::duration<double, std::micro>(time).count();
+}
+
+//! Generated and lit columns around the origin.
+struct World
+{
+    World()
+        : generator(1), engine([this](std::int32_t x, std::int32_t z) {
+              auto it = columns.find({x, z});
+              return it == columns.end() ? nullptr : it->second.get();
+          })
+    {
+        for(std::int32_t z = -RADIUS; z <= RADIUS; z++)
+        {
+            for(std::int32_t x = -RADIUS; x <= RADIUS; x++)
+            {
+                auto column = std::make_unique<ChunkColumn>(x, z);
+                generator.generate(*column);
+                LightEngine::lightColumn(*column);
+                columns[{x, z}] = std::move(column);
+                engine.columnLoaded(x, z);
+            }
+        }
+        engine.update();
+    }
+
+    void set(std::int32_t x, unsigned y, std::int32_t z, BlockId block)
+    {
+        ChunkColumn &column = *columns.at({x >> 4, z >> 4});
+        BlockId previous = column.getBlock(x & 15, y, z & 15);
+        column.setBlock(x & 15, y, z & 15, block);
+        engine.blockChanged(x, y, z, previous);
+    }
+
+    cenisys::TerrainGenerator generator;
+    std::map<std::pair<std::int32_t, std::int32_t>,
+             std::unique_ptr<ChunkColumn>>
+        columns;
+    LightEngine engine;
+};
+
+void torches(World &world, std::size_t rounds)
+{
+    std::mt19937 random(1);
+    Clock::duration place = Clock::duration::zero();
+    Clock::duration remove = Clock::duration::zero();
+    std::uint64_t nodes = 0;
+    for(std::size_t round = 0; round < rounds; round++)
+    {
+        // On the ground, away from the unloaded columns
+        std::int32_t x = static_cast<std::int32_t>(random() % 48) - 24;
+        std::int32_t z = static_cast<std::int32_t>(random() % 48) - 24;
+        unsigned y = world.generator.getHeight(x, z) + 1;
+        if(y < cenisys::TerrainGenerator::SEA_LEVEL + 1)
+            y = cenisys::TerrainGenerator::SEA_LEVEL + 1;
+        BlockId previous = world.columns.at({x >> 4, z >> 4})
+                               ->getBlock(x & 15, y, z & 15);
+        Clock::time_point begin = Clock::now();
+        world.set(x, y, z, TORCH);
+        LightEngine::Stats stats = world.engine.update();
+        place += Clock::now() - begin;
+        nodes += stats.increased + stats.decreased;
+        begin = Clock::now();
+        world.set(x, y, z, previous);
+        stats = world.engine.update();
+        remove += Clock::now() - begin;
+        nodes += stats.increased + stats.decreased;
+    }
+    std::cout << "torch: " << microseconds(place) / rounds
+              << " us to place, " << microseconds(remove) / rounds
+              << " us to remove, " << nodes / rounds / 2
+              << " blocks visited per update" << std::endl;
+}
+
+void structure(World &world, std::size_t size, bool batched)
+{
+    // A roof over the middle of the loaded area, two blocks thick
+    const unsigned y = 150;
+    std::int32_t start = -static_cast<std::int32_t>(size / 2);
+    std::int32_t end = start + static_cast<std::int32_t>(size);
+    std::uint64_t nodes = 0;
+    auto build = [&](BlockId block) {
+        Clock::time_point begin = Clock::now();
+        for(std::int32_t z = start; z < end; z++)
+        {
+            for(std::int32_t x = start; x < end; x++)
+            {
+                for(unsigned dy = 0; dy < 2; dy++)
+                {
+                    world.set(x, y + dy, z, block);
+                    if(!batched)
+                    {
+                        LightEngine::Stats stats = world.engine.update();
+                        nodes += stats.increased + stats.decreased;
+                    }
+                }
+            }
+        }
+        LightEngine::Stats stats = world.engine.update();
+        nodes += stats.increased + stats.decreased;
+        return Clock::now() - begin;
+    };
+    Clock::duration place = build(STONE);
+    Clock::duration remove = build(ChunkSection::AIR);
+    std::cout << (batched ? "roof in one tick:    " : "roof block by block: ")
+              << size << "x" << size << "x2, "
+              << microseconds(place) / 1000 << " ms to build, "
+              << microseconds(remove) / 1000 << " ms to remove, "
+              << nodes / 2 << " blocks visited each way" << std::endl;
+}
+
+void relight(World &world, std::size_t rounds)
+{
+    // What every change cost before: the columns lit from scratch
+    Clock::time_point begin = Clock::now();
+    for(std::size_t round = 0; round < rounds; round++)
+    {
+        for(auto &item : world.columns)
+            LightEngine::lightColumn(*item.second);
+        for(auto &item : world.columns)
+            world.engine.columnLoaded(item.first.first, item.first.second);
+        world.engine.update();
+    }
+    std::cout << "full relight: " << microseconds(Clock::now() - begin) /
+                                         rounds / world.columns.size()
+              << " us per column" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t rounds = argc > 1 ? std::atoi(argv[1]) : 1000;
+    std::cout << std::fixed << std::setprecision(2);
+    World world;
+    torches(world, rounds);
+    structure(world, 48, true);
+    structure(world, 48, false);
+    relight(world, rounds / 100 + 1);
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Benchmark for ticking the world region by region.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "world/regionticker.h"
+#include <boost/asio/io_service.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using cenisys::BlockId;
+using cenisys::ChunkColumn;
+using cenisys::ChunkSection;
+using cenisys::RegionTicker;
+using Clock = std::chrono::steady_clock;
+
+constexpr BlockId STONE = 1;
+constexpr BlockId GRASS = 2;
+constexpr BlockId DIRT = 3;
+//! Columns seen by a player in every direction.
+constexpr std::int32_t VIEW_DISTANCE = 6;
+//! Columns between two players, so they never share a region.
+constexpr std::int32_t SPACING = 64;
+//! Random blocks ticked per section, as in the game.
+constexpr unsigned RANDOM_TICKS = 3;
+constexpr std::size_t WARMUP_TICKS = 20;
+constexpr std::size_t TICKS = 100;
+
+//! Per column and tick, so any number of threads ticks the same blocks.
+std::uint32_t hash(std::int32_t x, std::int32_t z, std::uint64_t tick)
+{
+    std::uint64_t value = (std::uint64_t(std::uint32_t(x)) << 32) ^
+                          std::uint32_t(z) ^ (tick * 0x9e3779b97f4a7c15ull);
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    return static_cast<std::uint32_t>(value) | 1;
+}
+
+//! Stone up to y 60, then dirt with grass on every fourth column.
+std::unique_ptr<ChunkColumn> makeColumn(std::int32_t x, std::int32_t z)
+{
+    auto result = std::make_unique<ChunkColumn>(x, z);
+    for(std::size_t y = 0; y < 3; y++)
+        result->getWritableSection(y).fill(STONE);
+    for(unsigned y = 48; y < 64; y++)
+    {
+        for(unsigned bz = 0; bz < 16; bz++)
+        {
+            for(unsigned bx = 0; bx < 16; bx++)
+            {
+                BlockId block = y < 60 ? STONE : DIRT;
+                if(y == 63 && ((bx ^ bz) & 3) == 0)
+                    block = GRASS;
+                result->setBlock(bx, y, bz, block);
+            }
+        }
+    }
+    return result;
+}
+
+//! Columns seen by players far apart, ticked like grass spreading.
+struct World
+{
+    World(boost::asio::io_service &ioService, std::size_t players)
+        : ticker(ioService), tick(0), spread(0)
+    {
+        for(std::size_t player = 0; player < players; player++)
+        {
+            std::int32_t centerX =
+                static_cast<std::int32_t>(player % 8) * SPACING;
+            std::int32_t centerZ =
+                static_cast<std::int32_t>(player / 8) * SPACING;
+            for(std::int32_t dz = -VIEW_DISTANCE; dz <= VIEW_DISTANCE; dz++)
+            {
+                for(std::int32_t dx = -VIEW_DISTANCE; dx <= VIEW_DISTANCE;
+                    dx++)
+                {
+                    if(dx * dx + dz * dz > VIEW_DISTANCE * VIEW_DISTANCE)
+                        continue;
+                    auto column = makeColumn(centerX + dx, centerZ + dz);
+                    ticker.insert(*column);
+                    columns[{centerX + dx, centerZ + dz}] = std::move(column);
+                }
+            }
+        }
+        ticker.setTicker([this](ChunkColumn &column,
+                                RegionTicker::Region &region) {
+            randomTick(column, region);
+        });
+        ticker.setHandlers(
+            [this](std::int32_t, unsigned, std::int32_t, BlockId) {
+                spread++;
+            },
+            [this](std::int32_t x, unsigned y, std::int32_t z, BlockId block) {
+                ChunkColumn *column = get(x >> 4, z >> 4);
+                if(column)
+                    column->setBlock(x & 15, y, z & 15, block);
+            });
+    }
+
+    ChunkColumn *get(std::int32_t x, std::int32_t z)
+    {
+        auto it = columns.find({x, z});
+        return it == columns.end() ? nullptr : it->second.get();
+    }
+
+    void randomTick(ChunkColumn &column, RegionTicker::Region &region)
+    {
+        std::uint32_t random = hash(column.getX(), column.getZ(), tick);
+        for(std::size_t y = 0; y < ChunkColumn::SECTIONS; y++)
+        {
+            const ChunkSection &section = column.getSection(y);
+            if(section.isUniform() &&
+               section.getPalette()[0] == ChunkSection::AIR)
+                continue;
+            for(unsigned i = 0; i < RANDOM_TICKS; i++)
+            {
+                // xorshift32
+                random ^= random << 13;
+                random ^= random >> 17;
+                random ^= random << 5;
+                std::size_t index = random & (ChunkSection::VOLUME - 1);
+                if(section.getBlock(index) != GRASS)
+                    continue;
+                std::int32_t x = column.getX() * 16 + (index & 15) +
+                                 static_cast<std::int32_t>(random >> 12 & 3) -
+                                 1;
+                std::int32_t z = column.getZ() * 16 + (index >> 4 & 15) +
+                                 static_cast<std::int32_t>(random >> 14 & 3) -
+                                 1;
+                unsigned blockY = static_cast<unsigned>(
+                    y * ChunkSection::SIZE + (index >> 8));
+                ChunkColumn *target = region.getColumn(x >> 4, z >> 4);
+                if(!target)
+                {
+                    // Only set if it is still dirt by then
+                    region.post([this, x, blockY, z] {
+                        ChunkColumn *column = get(x >> 4, z >> 4);
+                        if(column &&
+                           column->getBlock(x & 15, blockY, z & 15) == DIRT)
+                            column->setBlock(x & 15, blockY, z & 15, GRASS);
+                    });
+                }
+                else if(target->getBlock(x & 15, blockY, z & 15) == DIRT &&
+                        target->getBlock(x & 15, blockY + 1, z & 15) ==
+                            ChunkSection::AIR)
+                {
+                    region.setBlock(x, blockY, z, GRASS);
+                }
+            }
+        }
+    }
+
+    RegionTicker ticker;
+    std::map<std::pair<std::int32_t, std::int32_t>,
+             std::unique_ptr<ChunkColumn>>
+        columns;
+    std::uint64_t tick;
+    std::uint64_t spread;
+};
+
+void run(std::size_t players, std::size_t threads)
+{
+    boost::asio::io_service ioService;
+    std::unique_ptr<boost::asio::io_service::work> work =
+        std::make_unique<boost::asio::io_service::work>(ioService);
+    std::vector<std::thread> workers;
+    for(std::size_t i = 1; i < threads; i++)
+        workers.emplace_back([&ioService] { ioService.run(); });
+
+    World world(ioService, players);
+    world.ticker.setThreads(threads);
+    for(; world.tick < WARMUP_TICKS; world.tick++)
+        world.ticker.tick();
+    std::vector<double> times;
+    for(std::size_t i = 0; i < TICKS; i++, world.tick++)
+    {
+        Clock::time_point begin = Clock::now();
+        world.ticker.tick();
+        times.push_back(
+            std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                .count());
+    }
+    std::sort(times.begin(), times.end());
+    double total = 0;
+    for(double time : times)
+        total += time;
+    RegionTicker::Stats stats = world.ticker.getStats();
+    std::cout << players << " players, " << stats.columns << " columns in "
+              << stats.regions << " regions, " << threads << " threads: "
+              << total / times.size() << " mspt mean, "
+              << times[times.size() * 95 / 100] << " p95, "
+              << stats.parallelTicks * 100 / stats.ticks
+              << "% ticks parallel, " << world.spread << " blocks spread, "
+              << stats.messages << " messages" << std::endl;
+
+    work.reset();
+    for(auto &item : workers)
+        item.join();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t players = argc > 1 ? std::atoi(argv[1]) : 64;
+    std::vector<std::size_t> threads;
+    for(int i = 2; i < argc; i++)
+        threads.push_back(std::atoi(argv[i]));
+    if(threads.empty())
+    {
+        threads.push_back(1);
+        threads.push_back(
+            std::max<std::size_t>(std::thread::hardware_concurrency(), 2));
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    for(std::size_t count : threads)
+        run(players, count);
+    return 0;
+}
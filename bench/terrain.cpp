@@ -0,0 +1,115 @@
+/*
+ * Benchmark for the noise and the terrain generator.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "world/simplexnoise.h"
+#include "world/terraingenerator.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+using cenisys::SimplexNoise;
+using cenisys::TerrainGenerator;
+
+//! Keeps the results alive so the loops are not optimized away.
+volatile float sink;
+
+template <typename Fn>
+double nanosecondsPer(std::size_t operations, Fn &&func)
+{
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - begin)
+               .count() /
+           operations;
+}
+
+void noise(std::size_t rounds)
+{
+    SimplexNoise noise(1);
+    const std::size_t size = 16;
+    const float step = 1.0f / 64;
+    std::vector<float> grid(size * size);
+    double single = nanosecondsPer(rounds * grid.size(), [&] {
+        float sum = 0;
+        for(std::size_t round = 0; round < rounds; round++)
+        {
+            for(std::size_t i = 0; i < size; i++)
+            {
+                for(std::size_t j = 0; j < size; j++)
+                    sum += noise.sample(round + j * step, i * step);
+            }
+        }
+        sink = sum;
+    });
+    double batched = nanosecondsPer(rounds * grid.size(), [&] {
+        float sum = 0;
+        for(std::size_t round = 0; round < rounds; round++)
+        {
+            noise.sampleGrid(round, 0, step, size, size, grid.data());
+            sum += grid[round % grid.size()];
+        }
+        sink = sum;
+    });
+    std::cout << "noise: " << single << " ns per single sample, " << batched
+              << " ns per sample in 16x16 grids ("
+              << SimplexNoise::getInstructionSet() << ", "
+              << single / batched << "x)" << std::endl;
+}
+
+void generate(std::size_t rounds)
+{
+    TerrainGenerator generator(1);
+    double column = nanosecondsPer(rounds, [&] {
+        for(std::size_t round = 0; round < rounds; round++)
+        {
+            cenisys::ChunkColumn column(static_cast<std::int32_t>(round), 0);
+            generator.generate(column);
+            sink = column.getBlock(0, 64, 0);
+        }
+    });
+    double biome = nanosecondsPer(rounds, [&] {
+        for(std::size_t round = 0; round < rounds; round++)
+        {
+            sink = static_cast<float>(generator.getBiome(
+                static_cast<std::int32_t>(round) * 16, 0));
+        }
+    });
+    std::cout << "terrain: " << column / 1000 << " us per column, "
+              << biome << " ns per biome lookup" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t rounds = argc > 1 ? std::atoi(argv[1]) : 1000;
+    std::cout << std::fixed << std::setprecision(2);
+    noise(rounds * 10);
+    generate(rounds);
+    return 0;
+}
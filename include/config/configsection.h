@@ -56,6 +56,11 @@ public:
     ConfigSection(Server &server, const boost::filesystem::path &filePath);
     ~ConfigSection();
 
+    //!
+    //! \brief Write the configuration back to the file.
+    //!
+    void save();
+
     bool getBool(const Path &path, bool defaultValue);
     int getInt(const Path &path, int defaultValue);
     unsigned int getUInt(const Path &path, unsigned int defaultValue);
@@ -0,0 +1,120 @@
+/*
+ * Handle of an entity.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_ENTITY_H
+#define CENISYS_ENTITY_H
+
+#include "util/vector3.h"
+#include <cstdint>
+
+namespace cenisys
+{
+
+class EntityManager;
+
+//!
+//! \brief Refers to an entity of the world.
+//!
+//! The data of the entities is kept by the EntityManager, a component per
+//! array, and an Entity is only a handle to it which is cheap to copy. A
+//! handle stays safe to use after its entity was removed: it is no longer
+//! valid, its getters return zero and its setters do nothing. Another
+//! entity reusing the storage never gets the same id.
+//!
+//! Only to be used from the game tick.
+//!
+class Entity
+{
+public:
+    //! Never the id of an entity.
+    static constexpr std::uint64_t INVALID_ID = 0;
+
+    //! A handle to no entity.
+    Entity() : _manager(nullptr), _id(INVALID_ID) {}
+    Entity(EntityManager &manager, std::uint64_t id)
+        : _manager(&manager), _id(id)
+    {
+    }
+
+    std::uint64_t getEntityId() const { return _id; }
+    //!
+    //! \brief Whether the entity is still in the world.
+    //!
+    bool isValid() const;
+    explicit operator bool() const { return isValid(); }
+
+    //! \return Position of the bottom center of the entity.
+    Vector3 getLocation() const;
+    //!
+    //! \brief Move the entity, with its bounding box.
+    //! \return false if the entity is not valid.
+    //!
+    bool teleport(const Vector3 &location);
+
+    //! \return Blocks moved per tick.
+    Vector3 getVelocity() const;
+    //!
+    //! \brief Set the blocks moved per tick, making the entity move.
+    //!
+    void setVelocity(const Vector3 &velocity);
+
+    bool hasGravity() const;
+    void setGravity(bool gravity);
+
+    //!
+    //! \return A box of no size at the location if the entity has no size.
+    //!
+    BoundingBox getBoundingBox() const;
+    //!
+    //! \brief Give the entity a box around its location.
+    //!
+    void setSize(double width, double height);
+
+    //!
+    //! \brief Whether the entity has health and dies without.
+    //!
+    bool isDamageable() const;
+    double getHealth() const;
+    //!
+    //! \brief Set the health of a damageable entity.
+    //!
+    //! The entity is removed by the next tick if none is left.
+    //!
+    void setHealth(double health);
+
+    //!
+    //! \brief Remove the entity from the world.
+    //!
+    void remove();
+
+    bool operator==(const Entity &other) const
+    {
+        return _manager == other._manager && _id == other._id;
+    }
+    bool operator!=(const Entity &other) const { return !(*this == other); }
+
+private:
+    EntityManager *_manager;
+    std::uint64_t _id;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_ENTITY_H
@@ -26,15 +26,17 @@
 #include <boost/asio/coroutine.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/locale/date_time.hpp>
 #include <boost/locale/format.hpp>
 #include <boost/locale/generator.hpp>
 #include <boost/locale/message.hpp>
 #include <boost/scope_exit.hpp>
+#include <chrono>
 #include <condition_variable>
-#include <forward_list>
 #include <future>
+#include <list>
 #include <locale>
 #include <map>
 #include <memory>
@@ -48,6 +50,10 @@ namespace cenisys
 class ConfigSection;
 class DefaultCommandHandlers;
 class CommandSender;
+class NetworkManager;
+class StartupProfiler;
+class TaskGraph;
+class World;
 
 class Server
 {
@@ -67,8 +73,16 @@ public:
                  std::tuple<boost::locale::message, CommandHandler>>;
     using RegisteredCommandHandler = CommandHandlerList::const_iterator;
 
-    using ConsoleList = std::forward_list<Console>;
-    using RegisteredConsole = ConsoleList::const_iterator;
+    //! Immutable once published; modified by copying.
+    using ConsoleList = std::vector<std::shared_ptr<Console>>;
+    using RegisteredConsole = const Console *;
+
+    using TickHandler = std::function<void()>;
+    using TickHandlerList = std::list<TickHandler>;
+    using RegisteredTickHandler = TickHandlerList::const_iterator;
+
+    //! Time between two game ticks.
+    static constexpr std::chrono::milliseconds TICK_INTERVAL{50};
 
     Server(const boost::filesystem::path &dataDir,
            boost::locale::generator &localeGen);
@@ -76,31 +90,70 @@ public:
 
     //!
     //! \brief Run the server. Blocks until termination.
-    //! \return 0 if successfully terminated.
+    //!
+    //! If the server does not stop within the configured shutdown timeout,
+    //! the outstanding handlers are reported and the io_service is stopped.
+    //! Threads which are still stuck are abandoned in that case.
+    //!
+    //! \return 0 if successfully terminated, 1 if the stop was forced, 2 if
+    //! a startup task failed.
     //!
     int run();
     //!
     //! \brief Terminate the server.
     //!
+    //! Starts the shutdown deadline on the first call.
+    //!
     void terminate();
 
+    //!
+    //! \brief Run a function on the io_service and wait for it.
+    //!
+    //! Never runs at the same time as a tick, another event or the startup
+    //! and shutdown tasks, so it may touch anything of the game tick.
+    //! Events posted before the server stops still run, unless they cannot
+    //! within the shutdown timeout.
+    //!
     template <typename Fn>
     void processEvent(Fn &&func)
     {
         std::promise<void> promise;
         std::future<void> future = promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(_stateLock);
+            _pendingEvents++;
+        }
         // HACK: asio cannot dispatch move-only handlers
         _ioService.dispatch([ this, func = std::forward<Fn>(func), &promise ] {
             BOOST_SCOPE_EXIT_ALL(&) { promise.set_value(); };
-            if(!lockTask())
+            if(!lockEvent())
                 return;
             BOOST_SCOPE_EXIT_ALL(&) { unlockTask(); };
+            RunningHandler handle = beginHandler("event");
+            BOOST_SCOPE_EXIT_ALL(&) { endHandler(handle); };
             func();
         });
         future.get();
     }
 
+    boost::asio::io_service &getIoService() { return _ioService; }
+    //!
+    //! \brief Number of threads running the io_service.
+    //!
+    //! Read from the configuration before the startup tasks run.
+    //!
+    std::size_t getThreadCount() const { return _threadCount; }
+
+    const boost::filesystem::path &getDataDir() const { return _dataDir; }
+    World &getWorld() { return *_world; }
+
     std::locale getLocale(std::string locale);
+    //!
+    //! \brief Run a command.
+    //!
+    //! Must be called from processEvent(), so commands run between two
+    //! ticks and may read the state of the game.
+    //!
     void dispatchCommand(CommandSender &sender, const std::string &command);
 
     RegisteredCommandHandler registerCommand(const std::string &command,
@@ -109,8 +162,29 @@ public:
     void unregisterCommand(RegisteredCommandHandler handle);
 
     RegisteredConsole registerConsole(ConsoleBackend &backend);
+    //!
+    //! \brief Remove a console. The backend is detached before returning.
+    //!
+    //! Must not be called while logging to the same console.
+    //!
     void unregisterConsole(RegisteredConsole handle);
 
+    //!
+    //! \brief Register a function to run on every game tick.
+    //!
+    //! Ticks never run concurrently with each other, events or the
+    //! startup and shutdown tasks.
+    //!
+    RegisteredTickHandler registerTickHandler(TickHandler &&handler);
+    void unregisterTickHandler(RegisteredTickHandler handle);
+    //!
+    //! \brief Run the tick handlers once, as a game tick does.
+    //!
+    //! For tools which drive the ticks themselves, with the "tick" startup
+    //! task removed. Must be called from processEvent().
+    //!
+    void runTickHandlers();
+
     template <typename T>
     void log(LogLevel level, const T &content)
     {
@@ -139,16 +213,70 @@ public:
             boost::locale::translate("{1}[{2}] [{3}] {4}{5}"));
         boost::locale::date_time time;
         message % color % time % levelText % content % TextFormat::Reset;
-        std::lock_guard<std::mutex> lock(_consoleListLock);
-        for(auto &console : _consoles)
-            console.log(message);
+        std::shared_ptr<const ConsoleList> consoles =
+            std::atomic_load(&_consoles);
+        for(const auto &console : *consoles)
+            console->log(message);
     }
 
     std::shared_ptr<ConfigSection> getConfig(const std::string &name);
 
+    //!
+    //! \brief Register a task to run when the server starts.
+    //! \param name Unique name of the task.
+    //! \param dependencies Tasks which must finish before this one.
+    //! \param task The function to run on the worker threads.
+    //! \return false if a task with the same name is already registered.
+    //!
+    bool registerStartupTask(const std::string &name,
+                             const std::vector<std::string> &dependencies,
+                             std::function<void()> &&task);
+    bool unregisterStartupTask(const std::string &name);
+    //!
+    //! \brief Register a task to run when the server stops.
+    //! \see registerStartupTask
+    //!
+    bool registerShutdownTask(const std::string &name,
+                              const std::vector<std::string> &dependencies,
+                              std::function<void()> &&task);
+    bool unregisterShutdownTask(const std::string &name);
+
 private:
+    using RunningHandlerList =
+        std::list<std::pair<std::string, std::chrono::steady_clock::time_point>>;
+    using RunningHandler = RunningHandlerList::iterator;
+
+    struct Worker
+    {
+        std::thread thread;
+        bool exited;
+    };
+
+    RunningHandler beginHandler(std::string description);
+    void endHandler(RunningHandler handle);
+
+    void spawnWorker();
+    void scheduleTick();
+    void tick();
+    void forceStop();
+
+    //!
+    //! \brief Wait until nothing else holds the state, then hold it for a
+    //! tick or an event.
+    //! \return false if the server is stopping.
+    //!
     bool lockTask();
     void unlockTask();
+    //!
+    //! \brief lockTask() for a posted event, counting it as dropped if the
+    //! server is stopping.
+    //!
+    bool lockEvent();
+    //!
+    //! \brief Whether events posted before the stop still wait for the lock,
+    //! and the shutdown timeout leaves time for them.
+    //!
+    bool eventsPending();
     enum class LockType : bool
     {
         Start = true,
@@ -158,8 +286,8 @@ private:
     bool lockCritical();
     void unlockCritical();
 
-    template <typename Handler, typename... Fn>
-    void asyncRunCritical(Handler &&handler, Fn &&... func);
+    template <typename Handler>
+    void asyncRunCritical(const TaskGraph &graph, Handler &&handler);
 
     void start(boost::asio::coroutine coroutine = {});
     void stop(boost::asio::coroutine coroutine = {});
@@ -167,29 +295,59 @@ private:
     std::mutex _stateLock;
     std::condition_variable _stateWait;
     std::size_t _counter;
-    bool _critical;
+    //! Events posted which did not get the lock yet; the stop waits for them.
+    std::size_t _pendingEvents;
+    //! Events given up because the server was stopping.
+    std::size_t _droppedEvents;
     bool _dropEvents;
+    bool _forceStop;
+
+    RunningHandlerList _runningHandlers;
+    std::mutex _runningHandlersLock;
+
+    std::list<Worker> _workers;
+    std::size_t _threadCount;
+    std::size_t _runningWorkers;
+    bool _stopRequested;
+    std::chrono::steady_clock::duration _shutdownTimeout;
+    std::chrono::steady_clock::time_point _stopDeadline;
+    std::mutex _workersLock;
+    std::condition_variable _workersWait;
 
     boost::filesystem::path _dataDir;
 
+    std::unique_ptr<StartupProfiler> _startupProfiler;
+    std::unique_ptr<TaskGraph> _startupTasks;
+    std::unique_ptr<TaskGraph> _shutdownTasks;
+    bool _startupFailed;
+
     boost::locale::generator &_localeGen;
 
     boost::asio::io_service _ioService;
     std::unique_ptr<boost::asio::io_service::work> _work;
-    std::vector<std::thread> _threads;
     boost::asio::signal_set _termSignals;
+    boost::asio::steady_timer _tickTimer;
+    std::chrono::steady_clock::time_point _nextTick;
 
     CommandHandlerList _commandList;
     std::mutex _commandListLock;
 
+    TickHandlerList _tickHandlers;
+    std::mutex _tickHandlersLock;
+
     ConfigManager _configManager;
     std::shared_ptr<ConfigSection> _config;
 
     RegisteredCommandHandler _helpCommand;
     std::unique_ptr<DefaultCommandHandlers> _defaultCommands;
+    std::unique_ptr<NetworkManager> _networkManager;
+    std::unique_ptr<World> _world;
 
-    ConsoleList _consoles;
+    std::shared_ptr<const ConsoleList> _consoles;
+    //! Serializes writers only; readers load the list atomically.
     std::mutex _consoleListLock;
+    //! Ready once the last list holding the console is gone.
+    std::map<RegisteredConsole, std::future<void>> _consoleDetached;
     std::shared_ptr<ConsoleBackend> _terminalConsole;
     RegisteredConsole _terminalConsoleHandle;
 };
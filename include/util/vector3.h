@@ -0,0 +1,109 @@
+/*
+ * Three dimensional vectors and boxes.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_VECTOR3_H
+#define CENISYS_VECTOR3_H
+
+namespace cenisys
+{
+
+//!
+//! \brief A position, a velocity or a size, in blocks.
+//!
+struct Vector3
+{
+    double x;
+    double y;
+    double z;
+
+    Vector3 &operator+=(const Vector3 &other)
+    {
+        x += other.x;
+        y += other.y;
+        z += other.z;
+        return *this;
+    }
+    Vector3 &operator-=(const Vector3 &other)
+    {
+        x -= other.x;
+        y -= other.y;
+        z -= other.z;
+        return *this;
+    }
+    Vector3 &operator*=(double factor)
+    {
+        x *= factor;
+        y *= factor;
+        z *= factor;
+        return *this;
+    }
+};
+
+inline Vector3 operator+(Vector3 left, const Vector3 &right)
+{
+    return left += right;
+}
+
+inline Vector3 operator-(Vector3 left, const Vector3 &right)
+{
+    return left -= right;
+}
+
+inline Vector3 operator*(Vector3 vector, double factor)
+{
+    return vector *= factor;
+}
+
+inline bool operator==(const Vector3 &left, const Vector3 &right)
+{
+    return left.x == right.x && left.y == right.y && left.z == right.z;
+}
+
+inline bool operator!=(const Vector3 &left, const Vector3 &right)
+{
+    return !(left == right);
+}
+
+//!
+//! \brief An axis aligned box, from its lowest to its highest corner.
+//!
+struct BoundingBox
+{
+    Vector3 min;
+    Vector3 max;
+
+    BoundingBox &operator+=(const Vector3 &offset)
+    {
+        min += offset;
+        max += offset;
+        return *this;
+    }
+
+    bool overlaps(const BoundingBox &other) const
+    {
+        return min.x < other.max.x && other.min.x < max.x &&
+               min.y < other.max.y && other.min.y < max.y &&
+               min.z < other.max.z && other.min.z < max.z;
+    }
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_VECTOR3_H
@@ -79,6 +79,12 @@ ConfigSection::ConfigSection(Server &server,
 
 ConfigSection::~ConfigSection()
 {
+    save();
+}
+
+void ConfigSection::save()
+{
+    std::lock_guard<std::mutex> lock(_lock);
     if(!boost::filesystem::exists(_filePath.parent_path()))
     {
         boost::system::error_code err;
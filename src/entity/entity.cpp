@@ -0,0 +1,109 @@
+/*
+ * Entity
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entity/entity.h"
+#include "entity/entitymanager.h"
+
+namespace cenisys
+{
+
+constexpr std::uint64_t Entity::INVALID_ID;
+
+bool Entity::isValid() const
+{
+    return _manager && _manager->isValid(_id);
+}
+
+Vector3 Entity::getLocation() const
+{
+    return _manager ? _manager->getPosition(_id) : Vector3{0, 0, 0};
+}
+
+bool Entity::teleport(const Vector3 &location)
+{
+    return _manager && _manager->setPosition(_id, location);
+}
+
+Vector3 Entity::getVelocity() const
+{
+    return _manager ? _manager->getVelocity(_id) : Vector3{0, 0, 0};
+}
+
+void Entity::setVelocity(const Vector3 &velocity)
+{
+    if(_manager)
+        _manager->setVelocity(_id, velocity);
+}
+
+bool Entity::hasGravity() const
+{
+    return _manager &&
+           (_manager->getComponents(_id) & EntityManager::GRAVITY);
+}
+
+void Entity::setGravity(bool gravity)
+{
+    if(!isValid())
+        return;
+    EntityManager::Components components = _manager->getComponents(_id);
+    // Falling needs a velocity
+    if(gravity)
+        components |= EntityManager::GRAVITY | EntityManager::VELOCITY;
+    else
+        components &= ~EntityManager::GRAVITY;
+    _manager->setComponents(_id, components);
+}
+
+BoundingBox Entity::getBoundingBox() const
+{
+    if(!_manager)
+        return {{0, 0, 0}, {0, 0, 0}};
+    return _manager->getBoundingBox(_id);
+}
+
+void Entity::setSize(double width, double height)
+{
+    if(_manager)
+        _manager->setSize(_id, width, height);
+}
+
+bool Entity::isDamageable() const
+{
+    return _manager && (_manager->getComponents(_id) & EntityManager::HEALTH);
+}
+
+double Entity::getHealth() const
+{
+    return _manager ? _manager->getHealth(_id) : 0;
+}
+
+void Entity::setHealth(double health)
+{
+    if(_manager)
+        _manager->setHealth(_id, health);
+}
+
+void Entity::remove()
+{
+    if(_manager)
+        _manager->remove(_id);
+}
+
+} // namespace cenisys
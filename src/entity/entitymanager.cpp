@@ -0,0 +1,376 @@
+/*
+ * EntityManager
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entity/entitymanager.h"
+#include "util/parallelrun.h"
+#include <algorithm>
+
+namespace cenisys
+{
+
+constexpr EntityManager::Components EntityManager::VELOCITY;
+constexpr EntityManager::Components EntityManager::BOUNDING_BOX;
+constexpr EntityManager::Components EntityManager::HEALTH;
+constexpr EntityManager::Components EntityManager::GRAVITY;
+constexpr std::size_t EntityManager::ARCHETYPES;
+constexpr double EntityManager::GRAVITY_ACCELERATION;
+constexpr double EntityManager::DRAG;
+constexpr double EntityManager::DESPAWN_DEPTH;
+constexpr double EntityManager::DEFAULT_HEALTH;
+constexpr std::size_t EntityManager::BATCH_SIZE;
+constexpr std::uint32_t EntityManager::NO_ROW;
+
+namespace
+{
+
+template <typename T>
+void eraseRow(std::vector<T> &values, std::size_t row)
+{
+    if(values.empty())
+        return;
+    values[row] = values.back();
+    values.pop_back();
+}
+
+std::uint32_t indexOf(std::uint64_t id)
+{
+    return static_cast<std::uint32_t>(id);
+}
+
+std::uint32_t generationOf(std::uint64_t id)
+{
+    return static_cast<std::uint32_t>(id >> 32);
+}
+
+} // namespace
+
+EntityManager::EntityManager(boost::asio::io_service &ioService)
+    : _ioService(ioService), _threads(1), _size(0),
+      _stats{0, 0, 0, 0, 0, 0, 0, std::chrono::steady_clock::duration::zero()}
+{
+}
+
+Entity EntityManager::spawn(const Vector3 &location, Components components)
+{
+    components &= ARCHETYPES - 1;
+    std::uint32_t index;
+    if(_free.empty())
+    {
+        index = static_cast<std::uint32_t>(_slots.size());
+        // Zero is the generation of no entity
+        _slots.push_back({1, 0, NO_ROW});
+    }
+    else
+    {
+        index = _free.back();
+        _free.pop_back();
+    }
+    addRow(index, components, location, nullptr, 0);
+    _size++;
+    _stats.spawned++;
+    return Entity(*this, (std::uint64_t(_slots[index].generation) << 32) |
+                             index);
+}
+
+Entity EntityManager::getEntity(std::uint64_t id)
+{
+    return find(id) ? Entity(*this, id) : Entity();
+}
+
+EntityManager::Components
+EntityManager::getComponents(std::uint64_t id) const
+{
+    const Slot *slot = find(id);
+    return slot ? slot->archetype : 0;
+}
+
+void EntityManager::setComponents(std::uint64_t id, Components components)
+{
+    components &= ARCHETYPES - 1;
+    Slot *slot = find(id);
+    if(!slot || slot->archetype == components)
+        return;
+    Components from = slot->archetype;
+    std::size_t row = slot->row;
+    const Archetype &archetype = _archetypes[from];
+    addRow(indexOf(id), components, archetype.positions[row], &archetype, row);
+    removeRow(from, row);
+}
+
+void EntityManager::remove(std::uint64_t id)
+{
+    Slot *slot = find(id);
+    if(!slot)
+        return;
+    removeRow(slot->archetype, slot->row);
+    slot->row = NO_ROW;
+    // Handles to the entity stop matching
+    if(++slot->generation == 0)
+        slot->generation = 1;
+    _free.push_back(indexOf(id));
+    _size--;
+}
+
+Vector3 EntityManager::getPosition(std::uint64_t id) const
+{
+    const Slot *slot = find(id);
+    if(!slot)
+        return {0, 0, 0};
+    return _archetypes[slot->archetype].positions[slot->row];
+}
+
+bool EntityManager::setPosition(std::uint64_t id, const Vector3 &position)
+{
+    Slot *slot = find(id);
+    if(!slot)
+        return false;
+    Archetype &archetype = _archetypes[slot->archetype];
+    Vector3 offset = position - archetype.positions[slot->row];
+    archetype.positions[slot->row] = position;
+    if(slot->archetype & BOUNDING_BOX)
+        archetype.boxes[slot->row] += offset;
+    return true;
+}
+
+Vector3 EntityManager::getVelocity(std::uint64_t id) const
+{
+    const Slot *slot = find(id);
+    if(!slot || !(slot->archetype & VELOCITY))
+        return {0, 0, 0};
+    return _archetypes[slot->archetype].velocities[slot->row];
+}
+
+void EntityManager::setVelocity(std::uint64_t id, const Vector3 &velocity)
+{
+    Slot *slot = find(id);
+    if(!slot)
+        return;
+    if(!(slot->archetype & VELOCITY))
+        setComponents(id, slot->archetype | VELOCITY);
+    _archetypes[slot->archetype].velocities[slot->row] = velocity;
+}
+
+BoundingBox EntityManager::getBoundingBox(std::uint64_t id) const
+{
+    const Slot *slot = find(id);
+    if(!slot)
+        return {{0, 0, 0}, {0, 0, 0}};
+    const Archetype &archetype = _archetypes[slot->archetype];
+    if(!(slot->archetype & BOUNDING_BOX))
+    {
+        const Vector3 &position = archetype.positions[slot->row];
+        return {position, position};
+    }
+    return archetype.boxes[slot->row];
+}
+
+void EntityManager::setSize(std::uint64_t id, double width, double height)
+{
+    Slot *slot = find(id);
+    if(!slot)
+        return;
+    if(!(slot->archetype & BOUNDING_BOX))
+        setComponents(id, slot->archetype | BOUNDING_BOX);
+    Archetype &archetype = _archetypes[slot->archetype];
+    const Vector3 &position = archetype.positions[slot->row];
+    archetype.boxes[slot->row] = {
+        position - Vector3{width / 2, 0, width / 2},
+        position + Vector3{width / 2, height, width / 2}};
+}
+
+double EntityManager::getHealth(std::uint64_t id) const
+{
+    const Slot *slot = find(id);
+    if(!slot || !(slot->archetype & HEALTH))
+        return 0;
+    return _archetypes[slot->archetype].health[slot->row];
+}
+
+void EntityManager::setHealth(std::uint64_t id, double health)
+{
+    Slot *slot = find(id);
+    if(slot && (slot->archetype & HEALTH))
+        _archetypes[slot->archetype].health[slot->row] = health;
+}
+
+void EntityManager::tick()
+{
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    std::vector<Batch> batches;
+    for(std::size_t i = 0; i < ARCHETYPES; i++)
+    {
+        Components components = static_cast<Components>(i);
+        std::size_t size = _archetypes[i].slots.size();
+        // Only moving entities have anything to update
+        if(!(components & VELOCITY))
+            continue;
+        for(std::size_t first = 0; first < size; first += BATCH_SIZE)
+        {
+            batches.push_back(
+                {components, first, std::min(first + BATCH_SIZE, size)});
+        }
+    }
+
+    std::size_t threads = std::min(_threads, batches.size());
+    threads = std::max<std::size_t>(threads, 1);
+    ParallelRun::run(
+        _ioService, threads, batches.size(),
+        [this, &batches](std::size_t index) { update(batches[index]); });
+    // Changes where the entities are stored, so only on this thread
+    despawn();
+
+    _stats.ticks++;
+    if(threads > 1)
+        _stats.parallelTicks++;
+    _stats.threads = threads;
+    _stats.lastTick = std::chrono::steady_clock::now() - begin;
+}
+
+EntityManager::Stats EntityManager::getStats() const
+{
+    Stats result = _stats;
+    result.entities = _size;
+    result.archetypes = static_cast<std::size_t>(
+        std::count_if(_archetypes.begin(), _archetypes.end(),
+                      [](const Archetype &archetype) {
+                          return !archetype.slots.empty();
+                      }));
+    return result;
+}
+
+const EntityManager::Slot *EntityManager::find(std::uint64_t id) const
+{
+    std::uint32_t index = indexOf(id);
+    if(index >= _slots.size())
+        return nullptr;
+    const Slot &slot = _slots[index];
+    if(slot.row == NO_ROW || slot.generation != generationOf(id))
+        return nullptr;
+    return &slot;
+}
+
+EntityManager::Slot *EntityManager::find(std::uint64_t id)
+{
+    return const_cast<Slot *>(
+        static_cast<const EntityManager *>(this)->find(id));
+}
+
+void EntityManager::addRow(std::uint32_t index, Components components,
+                           const Vector3 &position, const Archetype *from,
+                           std::size_t fromRow)
+{
+    Archetype &archetype = _archetypes[components];
+    Components had = from ? _slots[index].archetype : 0;
+    archetype.slots.push_back(index);
+    archetype.positions.push_back(position);
+    if(components & VELOCITY)
+    {
+        archetype.velocities.push_back(
+            had & VELOCITY ? from->velocities[fromRow] : Vector3{0, 0, 0});
+    }
+    if(components & BOUNDING_BOX)
+    {
+        archetype.boxes.push_back(had & BOUNDING_BOX
+                                      ? from->boxes[fromRow]
+                                      : BoundingBox{position, position});
+    }
+    if(components & HEALTH)
+    {
+        archetype.health.push_back(had & HEALTH ? from->health[fromRow]
+                                                : DEFAULT_HEALTH);
+    }
+    _slots[index].archetype = components;
+    _slots[index].row = static_cast<std::uint32_t>(archetype.slots.size() - 1);
+}
+
+void EntityManager::removeRow(Components components, std::size_t row)
+{
+    Archetype &archetype = _archetypes[components];
+    std::uint32_t moved = archetype.slots.back();
+    eraseRow(archetype.slots, row);
+    eraseRow(archetype.positions, row);
+    eraseRow(archetype.velocities, row);
+    eraseRow(archetype.boxes, row);
+    eraseRow(archetype.health, row);
+    // Unless the last row was removed itself
+    if(row < archetype.slots.size())
+        _slots[moved].row = static_cast<std::uint32_t>(row);
+}
+
+void EntityManager::update(const Batch &batch)
+{
+    Archetype &archetype = _archetypes[batch.components];
+    moveEntities(archetype, batch.begin, batch.end);
+    if(batch.components & GRAVITY)
+        applyGravity(archetype, batch.begin, batch.end);
+    applyDrag(archetype, batch.begin, batch.end);
+}
+
+void EntityManager::moveEntities(Archetype &archetype, std::size_t begin,
+                                 std::size_t end)
+{
+    Vector3 *positions = archetype.positions.data();
+    const Vector3 *velocities = archetype.velocities.data();
+    for(std::size_t i = begin; i < end; i++)
+        positions[i] += velocities[i];
+    if(archetype.boxes.empty())
+        return;
+    BoundingBox *boxes = archetype.boxes.data();
+    for(std::size_t i = begin; i < end; i++)
+        boxes[i] += velocities[i];
+}
+
+void EntityManager::applyGravity(Archetype &archetype, std::size_t begin,
+                                 std::size_t end)
+{
+    Vector3 *velocities = archetype.velocities.data();
+    for(std::size_t i = begin; i < end; i++)
+        velocities[i].y -= GRAVITY_ACCELERATION;
+}
+
+void EntityManager::applyDrag(Archetype &archetype, std::size_t begin,
+                              std::size_t end)
+{
+    Vector3 *velocities = archetype.velocities.data();
+    for(std::size_t i = begin; i < end; i++)
+        velocities[i] *= DRAG;
+}
+
+void EntityManager::despawn()
+{
+    for(std::size_t i = 0; i < ARCHETYPES; i++)
+    {
+        Archetype &archetype = _archetypes[i];
+        bool damageable = (i & HEALTH) != 0;
+        // Backwards, so the rows moved into holes were already looked at
+        for(std::size_t row = archetype.slots.size(); row-- > 0;)
+        {
+            if(archetype.positions[row].y >= DESPAWN_DEPTH &&
+               !(damageable && archetype.health[row] <= 0))
+                continue;
+            std::uint32_t index = archetype.slots[row];
+            remove((std::uint64_t(_slots[index].generation) << 32) | index);
+            _stats.despawned++;
+        }
+    }
+}
+
+} // namespace cenisys
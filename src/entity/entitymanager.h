@@ -0,0 +1,217 @@
+/*
+ * EntityManager
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_ENTITYMANAGER_H
+#define CENISYS_ENTITYMANAGER_H
+
+#include "entity/entity.h"
+#include "util/vector3.h"
+#include <boost/asio/io_service.hpp>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief Keeps the entities of the world and runs their systems.
+//!
+//! Every entity has a position, and any of the other components: a
+//! velocity, a bounding box, health and gravity. The entities with the same
+//! components form an archetype, which keeps every component in an array of
+//! its own, so a system only walks over the arrays it needs and leaves the
+//! others out of the cache. Giving an entity a component or taking it away
+//! moves it to another archetype. Removing one moves the last entity of its
+//! archetype into the hole.
+//!
+//! Every tick runs these systems:
+//! - movement: entities with a velocity move by it, with their box;
+//! - gravity: entities with gravity fall faster, then the velocities slow
+//!   down by DRAG;
+//! - despawn: entities below DESPAWN_DEPTH, and those out of health, are
+//!   removed.
+//!
+//! Movement and gravity only touch the entity they update, so the
+//! archetypes are cut into batches of BATCH_SIZE entities which the
+//! threads of the io_service update at the same time. The tick thread
+//! works on them too, and is only helped when there is more than a batch.
+//!
+//! Entities are handed out as Entity handles, which carry an id made of
+//! the index of the entity and a generation bumped whenever the index is
+//! freed.
+//!
+//! Everything belongs to the game tick.
+//!
+class EntityManager
+{
+public:
+    //! Which components an entity has, besides its position.
+    using Components = std::uint8_t;
+    static constexpr Components VELOCITY = 1 << 0;
+    static constexpr Components BOUNDING_BOX = 1 << 1;
+    static constexpr Components HEALTH = 1 << 2;
+    static constexpr Components GRAVITY = 1 << 3;
+    static constexpr std::size_t ARCHETYPES = 1 << 4;
+
+    //! Added to the downward velocity every tick, as in the game.
+    static constexpr double GRAVITY_ACCELERATION = 0.08;
+    //! What is left of a velocity after a tick.
+    static constexpr double DRAG = 0.98;
+    //! Entities falling below this height are removed.
+    static constexpr double DESPAWN_DEPTH = -64;
+    //! Health of a new damageable entity.
+    static constexpr double DEFAULT_HEALTH = 20;
+    //! Entities a thread updates at once.
+    static constexpr std::size_t BATCH_SIZE = 4096;
+
+    struct Stats
+    {
+        std::size_t entities;
+        //! Archetypes with entities in them.
+        std::size_t archetypes;
+        std::uint64_t spawned;
+        std::uint64_t despawned;
+        std::uint64_t ticks;
+        //! Ticks which had help from other threads.
+        std::uint64_t parallelTicks;
+        //! Threads which updated entities in the last tick.
+        std::size_t threads;
+        std::chrono::steady_clock::duration lastTick;
+    };
+
+    explicit EntityManager(boost::asio::io_service &ioService);
+    EntityManager(const EntityManager &) = delete;
+    EntityManager &operator=(const EntityManager &) = delete;
+
+    //!
+    //! \brief Set how many threads, the tick thread included, update the
+    //! entities.
+    //!
+    void setThreads(std::size_t threads) { _threads = threads ? threads : 1; }
+    std::size_t getThreads() const { return _threads; }
+
+    //!
+    //! \brief Add an entity at rest, with full health and a box of no size.
+    //!
+    Entity spawn(const Vector3 &location, Components components);
+    //! \return An invalid handle if the entity was removed.
+    Entity getEntity(std::uint64_t id);
+    std::size_t size() const { return _size; }
+
+    bool isValid(std::uint64_t id) const { return find(id) != nullptr; }
+    //! \return 0 if the entity was removed.
+    Components getComponents(std::uint64_t id) const;
+    //!
+    //! \brief Give an entity exactly these components.
+    //!
+    //! The components it keeps keep their values, the new ones start as in
+    //! spawn().
+    //!
+    void setComponents(std::uint64_t id, Components components);
+    void remove(std::uint64_t id);
+
+    Vector3 getPosition(std::uint64_t id) const;
+    bool setPosition(std::uint64_t id, const Vector3 &position);
+    Vector3 getVelocity(std::uint64_t id) const;
+    //! Gives the entity a velocity if it had none.
+    void setVelocity(std::uint64_t id, const Vector3 &velocity);
+    BoundingBox getBoundingBox(std::uint64_t id) const;
+    //! Gives the entity a box if it had none.
+    void setSize(std::uint64_t id, double width, double height);
+    double getHealth(std::uint64_t id) const;
+    //! Only for entities with health.
+    void setHealth(std::uint64_t id, double health);
+
+    //!
+    //! \brief Run the systems over every entity.
+    //!
+    void tick();
+
+    Stats getStats() const;
+
+private:
+    //! Where an entity is stored.
+    struct Slot
+    {
+        std::uint32_t generation;
+        Components archetype;
+        //! NO_ROW while the slot is free.
+        std::uint32_t row;
+    };
+    //! The entities with the same components, a component per array.
+    struct Archetype
+    {
+        //! Index of the slot of every entity.
+        std::vector<std::uint32_t> slots;
+        std::vector<Vector3> positions;
+        //! The arrays of the components the archetype lacks stay empty.
+        std::vector<Vector3> velocities;
+        std::vector<BoundingBox> boxes;
+        std::vector<double> health;
+    };
+    //! Entities of an archetype a thread updates at once.
+    struct Batch
+    {
+        Components components;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    static constexpr std::uint32_t NO_ROW = ~std::uint32_t(0);
+
+    const Slot *find(std::uint64_t id) const;
+    Slot *find(std::uint64_t id);
+    //!
+    //! \brief Add a row to an archetype, with the components of the entity
+    //! which has them and the defaults for the others.
+    //!
+    void addRow(std::uint32_t index, Components components,
+                const Vector3 &position, const Archetype *from,
+                std::size_t fromRow);
+    //!
+    //! \brief Fill the hole of a row with the last one.
+    //!
+    void removeRow(Components components, std::size_t row);
+
+    void update(const Batch &batch);
+    static void moveEntities(Archetype &archetype, std::size_t begin,
+                             std::size_t end);
+    static void applyGravity(Archetype &archetype, std::size_t begin,
+                             std::size_t end);
+    static void applyDrag(Archetype &archetype, std::size_t begin,
+                          std::size_t end);
+    void despawn();
+
+    boost::asio::io_service &_ioService;
+    std::size_t _threads;
+    std::array<Archetype, ARCHETYPES> _archetypes;
+    std::vector<Slot> _slots;
+    //! Indices of the free slots.
+    std::vector<std::uint32_t> _free;
+    std::size_t _size;
+    Stats _stats;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_ENTITYMANAGER_H
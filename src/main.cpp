@@ -84,6 +84,11 @@ int main(int argc, char *argv[])
     std::unique_ptr<cenisys::Server> server =
         std::make_unique<cenisys::Server>(dataDir[0], localeGen);
     int ret = server->run();
+    if(ret == 1)
+    {
+        // Abandoned threads may still be using the server
+        server.release();
+    }
     std::locale::global(oldLoc);
     return ret;
 }
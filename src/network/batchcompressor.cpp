@@ -0,0 +1,162 @@
+/*
+ * BatchCompressor
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/batchcompressor.h"
+#include "network/binarystream.h"
+#include "network/mcpepackets.h"
+#include <algorithm>
+#include <new>
+
+namespace cenisys
+{
+
+constexpr int BatchCompressor::MAX_LEVEL;
+constexpr int BatchCompressor::MIN_LEVEL;
+
+BatchCompressor::BatchCompressor(boost::asio::io_service &ioService,
+                                 std::size_t threads)
+    : _ioService(ioService), _threads(std::max<std::size_t>(threads, 1)),
+      _pending(0)
+{
+}
+
+BatchCompressor::~BatchCompressor()
+{
+    for(const auto &item : _deflaters)
+        deflateEnd(&item->stream);
+}
+
+void BatchCompressor::compress(std::vector<PacketBuffer> &&packets,
+                               Handler &&handler)
+{
+    _pending.fetch_add(1, std::memory_order_relaxed);
+    _ioService.post([this, packets = std::move(packets),
+                     handler = std::move(handler)]() {
+        // Sample the level when the work starts, as the queue may have
+        // drained in the meantime
+        PacketBuffer batch = compressNow(packets, getLevel());
+        _pending.fetch_sub(1, std::memory_order_relaxed);
+        handler(batch);
+    });
+}
+
+PacketBuffer BatchCompressor::compressNow(
+    const std::vector<PacketBuffer> &packets, int level)
+{
+    std::size_t total = 0;
+    for(const auto &item : packets)
+        total += BinaryWriter::varSize(item.size()) + item.size();
+
+    std::unique_ptr<Deflater> deflater = acquire(level);
+    z_stream &stream = deflater->stream;
+    std::vector<std::uint8_t> &output = deflater->output;
+    output.resize(deflateBound(&stream, total));
+    stream.next_out = output.data();
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    auto feed = [&](const std::uint8_t *data, std::size_t size, int flush) {
+        stream.next_in = const_cast<Bytef *>(data);
+        stream.avail_in = static_cast<uInt>(size);
+        while(true)
+        {
+            int result = deflate(&stream, flush);
+            if(result == Z_STREAM_END ||
+               (flush == Z_NO_FLUSH && stream.avail_in == 0))
+                break;
+            // The bound should always be enough, but never overrun it
+            std::size_t used = output.size() - stream.avail_out;
+            output.resize(output.size() * 2);
+            stream.next_out = output.data() + used;
+            stream.avail_out = static_cast<uInt>(output.size() - used);
+        }
+    };
+    for(const auto &item : packets)
+    {
+        std::uint8_t length[10];
+        BinaryWriter writer(length, sizeof(length));
+        writer.writeVarU64(item.size());
+        feed(length, writer.size(), Z_NO_FLUSH);
+        feed(item.data(), item.size(), Z_NO_FLUSH);
+    }
+    feed(nullptr, 0, Z_FINISH);
+
+    std::size_t size = stream.total_out;
+    PacketBuffer result =
+        PacketBuffer::allocate(2 + BinaryWriter::varSize(size) + size);
+    BinaryWriter writer(result.data(), result.size());
+    writer.writeU8(mcpe::GAME_PACKET);
+    writer.writeU8(mcpe::BATCH_PACKET);
+    writer.writeVarU64(size);
+    writer.writeBytes(output.data(), size);
+    release(std::move(deflater));
+    return result;
+}
+
+int BatchCompressor::getLevel() const
+{
+    return levelForDepth(getPending(), _threads);
+}
+
+int BatchCompressor::levelForDepth(std::size_t pending, std::size_t threads)
+{
+    std::size_t depth = pending / std::max<std::size_t>(threads, 1);
+    if(depth >= static_cast<std::size_t>(MAX_LEVEL - MIN_LEVEL))
+        return MIN_LEVEL;
+    return MAX_LEVEL - static_cast<int>(depth);
+}
+
+std::unique_ptr<BatchCompressor::Deflater> BatchCompressor::acquire(int level)
+{
+    std::unique_ptr<Deflater> result;
+    {
+        std::lock_guard<std::mutex> lock(_deflatersLock);
+        if(!_deflaters.empty())
+        {
+            result = std::move(_deflaters.back());
+            _deflaters.pop_back();
+        }
+    }
+    if(!result)
+    {
+        result = std::make_unique<Deflater>();
+        result->stream.zalloc = Z_NULL;
+        result->stream.zfree = Z_NULL;
+        result->stream.opaque = Z_NULL;
+        if(deflateInit(&result->stream, level) != Z_OK)
+            throw std::bad_alloc();
+        result->level = level;
+    }
+    else if(result->level != level)
+    {
+        // Nothing is buffered after a reset, so this cannot flush anything
+        deflateParams(&result->stream, level, Z_DEFAULT_STRATEGY);
+        result->level = level;
+    }
+    return result;
+}
+
+void BatchCompressor::release(std::unique_ptr<Deflater> &&deflater)
+{
+    deflateReset(&deflater->stream);
+    std::lock_guard<std::mutex> lock(_deflatersLock);
+    _deflaters.push_back(std::move(deflater));
+}
+
+} // namespace cenisys
@@ -0,0 +1,111 @@
+/*
+ * BatchCompressor
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_BATCHCOMPRESSOR_H
+#define CENISYS_BATCHCOMPRESSOR_H
+
+#include "network/packetbuffer.h"
+#include <atomic>
+#include <boost/asio/io_service.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <zlib.h>
+
+namespace cenisys
+{
+
+//!
+//! \brief Compresses game packets into MCPE batch packets.
+//!
+//! Batches are compressed on the threads running the io_service, with
+//! z_streams reused from a pool. The result is a complete RakNet packet
+//! which can be queued for any number of sessions without copying, so a
+//! broadcast is only compressed once.
+//!
+//! The compression level drops as batches queue up, trading bandwidth for
+//! latency when the workers cannot keep up.
+//!
+class BatchCompressor
+{
+public:
+    using Handler = std::function<void(const PacketBuffer &)>;
+
+    static constexpr int MAX_LEVEL = 6;
+    static constexpr int MIN_LEVEL = 1;
+
+    //!
+    //! \param threads Number of threads running the io_service.
+    //!
+    BatchCompressor(boost::asio::io_service &ioService, std::size_t threads);
+    ~BatchCompressor();
+    BatchCompressor(const BatchCompressor &) = delete;
+    BatchCompressor &operator=(const BatchCompressor &) = delete;
+
+    //!
+    //! \brief Compress the packets on a worker thread.
+    //! \param handler Called from the worker thread with the batch.
+    //!
+    void compress(std::vector<PacketBuffer> &&packets, Handler &&handler);
+    //!
+    //! \brief Compress the packets on the calling thread.
+    //!
+    PacketBuffer compressNow(const std::vector<PacketBuffer> &packets,
+                             int level);
+
+    //! Batches waiting for or being compressed.
+    std::size_t getPending() const
+    {
+        return _pending.load(std::memory_order_relaxed);
+    }
+    //! Level the next batch will be compressed with.
+    int getLevel() const;
+    //!
+    //! \brief Level for a number of pending batches.
+    //!
+    //! The level drops by one for every batch each thread has queued.
+    //!
+    static int levelForDepth(std::size_t pending, std::size_t threads);
+
+private:
+    //! A z_stream must not move once initialized.
+    struct Deflater
+    {
+        z_stream stream;
+        int level;
+        std::vector<std::uint8_t> output;
+    };
+
+    std::unique_ptr<Deflater> acquire(int level);
+    void release(std::unique_ptr<Deflater> &&deflater);
+
+    boost::asio::io_service &_ioService;
+    std::size_t _threads;
+    std::atomic<std::size_t> _pending;
+    std::mutex _deflatersLock;
+    std::vector<std::unique_ptr<Deflater>> _deflaters;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_BATCHCOMPRESSOR_H
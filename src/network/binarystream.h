@@ -0,0 +1,252 @@
+/*
+ * Binary readers and writers over fixed buffers.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_BINARYSTREAM_H
+#define CENISYS_BINARYSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace cenisys
+{
+
+//!
+//! \brief Reads binary data from a buffer it does not own.
+//!
+//! Reading past the end sets a failure flag instead of throwing; the values
+//! returned after that are zero.
+//!
+class BinaryReader
+{
+public:
+    BinaryReader(const std::uint8_t *data, std::size_t size)
+        : _data(data), _size(size), _pos(0), _ok(true)
+    {
+    }
+
+    bool ok() const { return _ok; }
+    //!
+    //! \brief Mark the data as invalid, for checks done by the caller.
+    //!
+    void fail() { _ok = false; }
+    std::size_t position() const { return _pos; }
+    std::size_t remaining() const { return _size - _pos; }
+    const std::uint8_t *current() const { return _data + _pos; }
+
+    //!
+    //! \brief Skip some bytes and return a pointer to them.
+    //! \return nullptr if there are not enough bytes.
+    //!
+    const std::uint8_t *readBytes(std::size_t size)
+    {
+        if(!_ok || remaining() < size)
+        {
+            _ok = false;
+            return nullptr;
+        }
+        const std::uint8_t *result = _data + _pos;
+        _pos += size;
+        return result;
+    }
+
+    std::uint8_t readU8() { return static_cast<std::uint8_t>(readBE(1)); }
+    std::uint16_t readU16() { return static_cast<std::uint16_t>(readBE(2)); }
+    std::uint16_t readU16LE()
+    {
+        return static_cast<std::uint16_t>(readLE(2));
+    }
+    std::uint32_t readU24LE()
+    {
+        return static_cast<std::uint32_t>(readLE(3));
+    }
+    std::uint32_t readU32() { return static_cast<std::uint32_t>(readBE(4)); }
+    std::uint32_t readU32LE()
+    {
+        return static_cast<std::uint32_t>(readLE(4));
+    }
+    std::uint64_t readU64() { return readBE(8); }
+    float readF32LE()
+    {
+        std::uint32_t bits = readU32LE();
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+    //!
+    //! \brief Read an unsigned LEB128 number of at most 32 bits.
+    //!
+    std::uint32_t readVarU32()
+    {
+        return static_cast<std::uint32_t>(readVar(32));
+    }
+    std::uint64_t readVarU64() { return readVar(64); }
+
+private:
+    std::uint64_t readVar(unsigned bits)
+    {
+        std::uint64_t result = 0;
+        for(unsigned shift = 0; shift < bits; shift += 7)
+        {
+            if(!_ok || remaining() == 0)
+                break;
+            std::uint8_t byte = _data[_pos++];
+            result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if(!(byte & 0x80))
+                return result;
+        }
+        // Truncated or too long
+        _ok = false;
+        return 0;
+    }
+    std::uint64_t readBE(std::size_t size)
+    {
+        const std::uint8_t *bytes = readBytes(size);
+        std::uint64_t result = 0;
+        for(std::size_t i = 0; bytes && i < size; i++)
+            result = (result << 8) | bytes[i];
+        return result;
+    }
+    std::uint64_t readLE(std::size_t size)
+    {
+        const std::uint8_t *bytes = readBytes(size);
+        std::uint64_t result = 0;
+        for(std::size_t i = size; bytes && i > 0; i--)
+            result = (result << 8) | bytes[i - 1];
+        return result;
+    }
+
+    const std::uint8_t *_data;
+    std::size_t _size;
+    std::size_t _pos;
+    bool _ok;
+};
+
+//!
+//! \brief Writes binary data into a fixed buffer it does not own.
+//!
+//! Writing past the end sets a failure flag; nothing is written after that.
+//!
+class BinaryWriter
+{
+public:
+    BinaryWriter(std::uint8_t *data, std::size_t capacity)
+        : _data(data), _capacity(capacity), _pos(0), _ok(true)
+    {
+    }
+
+    bool ok() const { return _ok; }
+    std::size_t size() const { return _pos; }
+    std::size_t remaining() const { return _capacity - _pos; }
+    std::uint8_t *data() const { return _data; }
+
+    //!
+    //! \brief Reserve some bytes and return a pointer to them.
+    //! \return nullptr if there is not enough space.
+    //!
+    std::uint8_t *skip(std::size_t size)
+    {
+        if(!_ok || remaining() < size)
+        {
+            _ok = false;
+            return nullptr;
+        }
+        std::uint8_t *result = _data + _pos;
+        _pos += size;
+        return result;
+    }
+
+    void writeBytes(const void *data, std::size_t size)
+    {
+        if(std::uint8_t *target = skip(size))
+            std::memcpy(target, data, size);
+    }
+
+    void writeU8(std::uint8_t value) { writeBE(value, 1); }
+    void writeU16(std::uint16_t value) { writeBE(value, 2); }
+    void writeU16LE(std::uint16_t value) { writeLE(value, 2); }
+    void writeU24LE(std::uint32_t value) { writeLE(value, 3); }
+    void writeU32(std::uint32_t value) { writeBE(value, 4); }
+    void writeU32LE(std::uint32_t value) { writeLE(value, 4); }
+    void writeU64(std::uint64_t value) { writeBE(value, 8); }
+    void writeF32LE(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        writeU32LE(bits);
+    }
+    //!
+    //! \brief Write an unsigned LEB128 number.
+    //!
+    void writeVarU64(std::uint64_t value)
+    {
+        std::uint8_t bytes[10];
+        std::size_t size = 0;
+        do
+        {
+            bytes[size] = static_cast<std::uint8_t>(value & 0x7f);
+            value >>= 7;
+            if(value)
+                bytes[size] |= 0x80;
+            size++;
+        } while(value);
+        writeBytes(bytes, size);
+    }
+
+    //!
+    //! \brief Number of bytes of an unsigned LEB128 number.
+    //!
+    static std::size_t varSize(std::uint64_t value)
+    {
+        std::size_t result = 1;
+        while(value >>= 7)
+            result++;
+        return result;
+    }
+
+private:
+    void writeBE(std::uint64_t value, std::size_t size)
+    {
+        std::uint8_t *bytes = skip(size);
+        for(std::size_t i = size; bytes && i > 0; i--)
+        {
+            bytes[i - 1] = static_cast<std::uint8_t>(value);
+            value >>= 8;
+        }
+    }
+    void writeLE(std::uint64_t value, std::size_t size)
+    {
+        std::uint8_t *bytes = skip(size);
+        for(std::size_t i = 0; bytes && i < size; i++)
+        {
+            bytes[i] = static_cast<std::uint8_t>(value);
+            value >>= 8;
+        }
+    }
+
+    std::uint8_t *_data;
+    std::size_t _capacity;
+    std::size_t _pos;
+    bool _ok;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_BINARYSTREAM_H
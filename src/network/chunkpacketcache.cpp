@@ -0,0 +1,277 @@
+/*
+ * ChunkPacketCache
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/chunkpacketcache.h"
+#include "network/batchcompressor.h"
+#include "network/binarystream.h"
+#include "network/mcpepackets.h"
+#include "world/chunkcolumn.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace cenisys
+{
+
+constexpr std::size_t ChunkPacketCache::SECTION_BYTES;
+constexpr std::size_t ChunkPacketCache::TAIL_BYTES;
+constexpr std::uint8_t ChunkPacketCache::DEFAULT_BIOME;
+constexpr int ChunkPacketCache::FAST_LEVEL;
+
+namespace
+{
+
+bool isEmpty(const ChunkSection &section)
+{
+    return section.isUniform() && section.getPalette()[0] == ChunkSection::AIR;
+}
+
+//!
+//! \brief Write nibbles in XZY order.
+//!
+void transpose(const NibbleArray<ChunkSection::VOLUME> &nibbles,
+               std::uint8_t *output)
+{
+    const std::uint8_t *data = nibbles.data();
+    const std::size_t bytes = NibbleArray<ChunkSection::VOLUME>::BYTES;
+    // Light is mostly uniform, and then the order does not matter
+    if(std::all_of(data, data + bytes,
+                   [first = data[0]](std::uint8_t byte) {
+                       return byte == first;
+                   }))
+    {
+        std::memset(output, data[0], bytes);
+        return;
+    }
+    for(unsigned x = 0; x < 16; x++)
+    {
+        for(unsigned z = 0; z < 16; z++)
+        {
+            for(unsigned y = 0; y < 16; y += 2)
+            {
+                std::size_t index = ChunkSection::index(x, y, z);
+                output[((x << 8) | (z << 4) | y) >> 1] =
+                    static_cast<std::uint8_t>(
+                        nibbles.get(index) |
+                        (nibbles.get(index + 256) << 4));
+            }
+        }
+    }
+}
+
+} // namespace
+
+ChunkPacketCache::ChunkPacketCache(BatchCompressor &compressor)
+    : _compressor(compressor), _version(0),
+      _recompressed(std::make_shared<MpscQueue<Recompressed>>()),
+      _stats{0, 0, 0, 0, 0, 0, 0}
+{
+}
+
+const ChunkPacketCache::Batch &ChunkPacketCache::get(ChunkColumn &column)
+{
+    Key key(column.getX(), column.getZ());
+    auto result = _entries.insert({key, {}});
+    Entry &entry = result.first->second;
+    std::uint16_t dirty = column.getDirtySections();
+    if(!result.second && !dirty && entry.batch.data)
+    {
+        _stats.hits++;
+        return entry.batch;
+    }
+    _stats.misses++;
+    if(result.second)
+    {
+        _stats.columns++;
+        dirty = ChunkColumn::ALL_SECTIONS;
+    }
+    _stats.bytes -= entry.payload.size() + entry.batch.data.size();
+    // Seeded payloads are up to date
+    if(dirty)
+        _stats.sectionsEncoded += update(column, dirty, entry.payload);
+    column.clearDirtySections();
+
+    mcpe::FullChunkDataPacket packet{
+        column.getX(), column.getZ(),
+        boost::string_ref(reinterpret_cast<const char *>(entry.payload.data()),
+                          entry.payload.size())};
+    std::vector<PacketBuffer> packets{
+        PacketBuffer::allocate(mcpe::packetSize(packet))};
+    BinaryWriter writer(packets[0].data(), packets[0].size());
+    mcpe::encodePacket(writer, packet);
+    entry.batch.data = _compressor.compressNow(packets, FAST_LEVEL);
+    entry.batch.uncompressed =
+        BinaryWriter::varSize(packets[0].size()) + packets[0].size();
+    entry.version = ++_version;
+    _stats.bytes += entry.payload.size() + entry.batch.data.size();
+
+    // Sent many times, so worth a better level off the tick
+    std::shared_ptr<MpscQueue<Recompressed>> recompressed = _recompressed;
+    std::uint64_t version = entry.version;
+    _compressor.compress(
+        std::move(packets),
+        [recompressed, key, version](const PacketBuffer &batch) {
+            recompressed->push({key, version, batch});
+        });
+    return entry.batch;
+}
+
+void ChunkPacketCache::seed(ChunkColumn &column,
+                            std::vector<std::uint8_t> &&payload)
+{
+    auto result = _entries.insert({{column.getX(), column.getZ()}, {}});
+    Entry &entry = result.first->second;
+    if(result.second)
+        _stats.columns++;
+    _stats.bytes -= entry.payload.size() + entry.batch.data.size();
+    entry.payload = std::move(payload);
+    entry.batch = {};
+    entry.version = ++_version;
+    _stats.bytes += entry.payload.size();
+    _stats.seeded++;
+    column.clearDirtySections();
+}
+
+void ChunkPacketCache::tick()
+{
+    Recompressed item;
+    while(_recompressed->pop(item))
+    {
+        auto it = _entries.find(item.key);
+        // Changed or forgotten since
+        if(it == _entries.end() || it->second.version != item.version)
+            continue;
+        Batch &batch = it->second.batch;
+        _stats.bytes -= batch.data.size();
+        batch.data = std::move(item.batch);
+        _stats.bytes += batch.data.size();
+        _stats.recompressed++;
+    }
+}
+
+void ChunkPacketCache::remove(std::int32_t x, std::int32_t z)
+{
+    auto it = _entries.find({x, z});
+    if(it == _entries.end())
+        return;
+    _stats.bytes -= it->second.payload.size() + it->second.batch.data.size();
+    _stats.columns--;
+    _entries.erase(it);
+}
+
+std::vector<std::uint8_t> ChunkPacketCache::encode(const ChunkColumn &column)
+{
+    std::vector<std::uint8_t> result;
+    update(column, ChunkColumn::ALL_SECTIONS, result);
+    return result;
+}
+
+std::size_t ChunkPacketCache::update(const ChunkColumn &column,
+                                     std::uint16_t dirty,
+                                     std::vector<std::uint8_t> &payload)
+{
+    std::size_t sections = ChunkColumn::SECTIONS;
+    while(sections > 0 && isEmpty(column.getSection(sections - 1)))
+        sections--;
+    std::size_t size = 1 + sections * SECTION_BYTES + TAIL_BYTES;
+    if(payload.size() != size)
+    {
+        payload.resize(size);
+        dirty = ChunkColumn::ALL_SECTIONS;
+    }
+    payload[0] = static_cast<std::uint8_t>(sections);
+    std::size_t result = 0;
+    for(std::size_t y = 0; y < sections; y++)
+    {
+        if(!(dirty & (1 << y)))
+            continue;
+        encodeSection(column.getSection(y),
+                      payload.data() + 1 + y * SECTION_BYTES);
+        result++;
+    }
+    encodeTail(column, sections, payload.data() + 1 + sections * SECTION_BYTES);
+    return result;
+}
+
+void ChunkPacketCache::encodeSection(const ChunkSection &section,
+                                     std::uint8_t *output)
+{
+    const std::size_t nibbles = NibbleArray<ChunkSection::VOLUME>::BYTES;
+    std::uint8_t *blocks = output + 1;
+    output[0] = 0;
+    if(section.isUniform())
+    {
+        std::memset(blocks, static_cast<std::uint8_t>(section.getPalette()[0]),
+                    ChunkSection::VOLUME);
+    }
+    else
+    {
+        for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+        {
+            // YZX to XZY
+            blocks[((i & 15) << 8) | (i & 0xf0) | (i >> 8)] =
+                static_cast<std::uint8_t>(section.getBlock(i));
+        }
+    }
+    std::uint8_t *meta = blocks + ChunkSection::VOLUME;
+    transpose(section.getMetaArray(), meta);
+    transpose(section.getSkyLightArray(), meta + nibbles);
+    transpose(section.getBlockLightArray(), meta + nibbles * 2);
+}
+
+void ChunkPacketCache::encodeTail(const ChunkColumn &column,
+                                  std::size_t sections, std::uint8_t *output)
+{
+    // Above the highest block of every column, indexed ZX
+    std::array<std::uint16_t, 256> heights{};
+    std::size_t found = 0;
+    for(std::size_t y = sections; y > 0 && found < heights.size(); y--)
+    {
+        const ChunkSection &section = column.getSection(y - 1);
+        if(isEmpty(section))
+            continue;
+        for(std::size_t i = 0; i < heights.size(); i++)
+        {
+            if(heights[i])
+                continue;
+            for(std::size_t dy = ChunkSection::SIZE; dy > 0; dy--)
+            {
+                if(section.getBlock(((dy - 1) << 8) | i) != ChunkSection::AIR)
+                {
+                    heights[i] = static_cast<std::uint16_t>(
+                        (y - 1) * ChunkSection::SIZE + dy);
+                    found++;
+                    break;
+                }
+            }
+        }
+    }
+    BinaryWriter writer(output, TAIL_BYTES);
+    for(std::uint16_t height : heights)
+        writer.writeU16LE(height);
+    std::uint8_t biomes[256];
+    std::memset(biomes, DEFAULT_BIOME, sizeof(biomes));
+    writer.writeBytes(biomes, sizeof(biomes));
+    // No border blocks, no extra data
+    writer.writeU8(0);
+    writer.writeVarU64(0);
+}
+
+} // namespace cenisys
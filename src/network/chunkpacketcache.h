@@ -0,0 +1,166 @@
+/*
+ * ChunkPacketCache
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_CHUNKPACKETCACHE_H
+#define CENISYS_CHUNKPACKETCACHE_H
+
+#include "network/packetbuffer.h"
+#include "util/mpscqueue.h"
+#include "world/chunksection.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace cenisys
+{
+
+class BatchCompressor;
+class ChunkColumn;
+
+//!
+//! \brief Full chunk packets of the columns, compressed once for every
+//! viewer.
+//!
+//! The payload of a column keeps its encoded sections. When the column is
+//! sent again, only the sections it marked dirty since are encoded again,
+//! and the packet is compressed again only if any were. Otherwise the
+//! cached batch is shared by every session it is sent to. The payload of a
+//! column loaded by the chunk pipeline may be encoded by it, and seeded.
+//!
+//! A packet is compressed on the tick at a fast level, as the column must
+//! go out before the blocks changed in it, and then again by the workers of
+//! the BatchCompressor. tick() swaps in the smaller batches they made, for
+//! the sends after.
+//!
+//! The payload holds the sections up to the highest one with blocks, each
+//! as a version byte, then the block ids, the metadata, the sky light and
+//! the block light in XZY order. The height map, the biomes and empty
+//! lists of border blocks and extra data follow.
+//!
+//! Must only be used by the game tick.
+//!
+class ChunkPacketCache
+{
+public:
+    //! Encoded size of a section.
+    static constexpr std::size_t SECTION_BYTES =
+        1 + ChunkSection::VOLUME + ChunkSection::VOLUME / 2 * 3;
+    //! Encoded size of everything after the sections.
+    static constexpr std::size_t TAIL_BYTES = 256 * 2 + 256 + 1 + 1;
+    //! Plains, until the columns keep their biomes.
+    static constexpr std::uint8_t DEFAULT_BIOME = 1;
+    //! Level of the batches compressed on the tick.
+    static constexpr int FAST_LEVEL = 1;
+
+    struct Batch
+    {
+        PacketBuffer data;
+        //! Size of the packet before compression.
+        std::size_t uncompressed;
+    };
+
+    struct Stats
+    {
+        //! Batches sent as they were cached.
+        std::uint64_t hits;
+        //! Batches which had to be compressed first.
+        std::uint64_t misses;
+        //! Batches swapped for the ones compressed by the workers.
+        std::uint64_t recompressed;
+        std::uint64_t sectionsEncoded;
+        //! Payloads encoded by the chunk pipeline.
+        std::uint64_t seeded;
+        std::size_t columns;
+        //! Payloads and batches held.
+        std::size_t bytes;
+    };
+
+    explicit ChunkPacketCache(BatchCompressor &compressor);
+
+    //!
+    //! \brief The batch holding the full chunk packet of a column.
+    //!
+    //! Clears the dirty sections of the column.
+    //!
+    const Batch &get(ChunkColumn &column);
+    //!
+    //! \brief Take the payload of a column made by encode() elsewhere.
+    //!
+    //! Clears the dirty sections of the column.
+    //!
+    void seed(ChunkColumn &column, std::vector<std::uint8_t> &&payload);
+    //!
+    //! \brief Use the batches the workers compressed again since.
+    //!
+    void tick();
+    //!
+    //! \brief Forget a column, such as when it is unloaded.
+    //!
+    void remove(std::int32_t x, std::int32_t z);
+    const Stats &getStats() const { return _stats; }
+
+    //!
+    //! \brief Encode the payload of a column from scratch.
+    //!
+    static std::vector<std::uint8_t> encode(const ChunkColumn &column);
+
+private:
+    using Key = std::pair<std::int32_t, std::int32_t>;
+    struct Entry
+    {
+        std::vector<std::uint8_t> payload;
+        Batch batch;
+        //! Changes whenever the batch is compressed on the tick.
+        std::uint64_t version;
+    };
+    //! A batch compressed by a worker.
+    struct Recompressed
+    {
+        Key key;
+        std::uint64_t version;
+        PacketBuffer batch;
+    };
+
+    //!
+    //! \brief Bring a payload up to date.
+    //! \param dirty Sections to encode again, unless the count changed.
+    //! \return Number of sections encoded.
+    //!
+    static std::size_t update(const ChunkColumn &column, std::uint16_t dirty,
+                              std::vector<std::uint8_t> &payload);
+    static void encodeSection(const ChunkSection &section,
+                              std::uint8_t *output);
+    static void encodeTail(const ChunkColumn &column, std::size_t sections,
+                           std::uint8_t *output);
+
+    BatchCompressor &_compressor;
+    std::map<Key, Entry> _entries;
+    std::uint64_t _version;
+    //! Shared with the workers, which may finish after the cache is gone.
+    std::shared_ptr<MpscQueue<Recompressed>> _recompressed;
+    Stats _stats;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_CHUNKPACKETCACHE_H
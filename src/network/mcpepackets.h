@@ -0,0 +1,224 @@
+/*
+ * MCPE game packets
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_MCPEPACKETS_H
+#define CENISYS_MCPEPACKETS_H
+
+#include "network/packetcodec.h"
+#include <cstdint>
+
+namespace cenisys
+{
+namespace mcpe
+{
+
+//! Game packets are wrapped in RakNet packets starting with this id.
+constexpr std::uint8_t GAME_PACKET = 0xfe;
+//! Game packets compressed together, each prefixed by its length.
+constexpr std::uint8_t BATCH_PACKET = 0x06;
+constexpr std::int32_t PROTOCOL_VERSION = 100;
+
+struct LoginPacket
+{
+    static constexpr std::uint8_t ID = 0x01;
+    std::int32_t protocol;
+    std::uint8_t edition;
+    //! Compressed chain and client data.
+    boost::string_ref payload;
+};
+
+template <>
+struct PacketSchema<LoginPacket>
+    : Fields<CENISYS_PACKET_FIELD(LoginPacket, Int32, protocol),
+             CENISYS_PACKET_FIELD(LoginPacket, U8, edition),
+             CENISYS_PACKET_FIELD(LoginPacket, String, payload)>
+{
+};
+
+struct PlayStatusPacket
+{
+    enum Status : std::int32_t
+    {
+        LoginSuccess = 0,
+        LoginFailedClient = 1,
+        LoginFailedServer = 2,
+        PlayerSpawn = 3,
+    };
+
+    static constexpr std::uint8_t ID = 0x02;
+    std::int32_t status;
+};
+
+template <>
+struct PacketSchema<PlayStatusPacket>
+    : Fields<CENISYS_PACKET_FIELD(PlayStatusPacket, Int32, status)>
+{
+};
+
+struct DisconnectPacket
+{
+    static constexpr std::uint8_t ID = 0x05;
+    bool hideScreen;
+    boost::string_ref message;
+};
+
+template <>
+struct PacketSchema<DisconnectPacket>
+    : Fields<CENISYS_PACKET_FIELD(DisconnectPacket, Bool, hideScreen),
+             CENISYS_PACKET_FIELD(DisconnectPacket, String, message)>
+{
+};
+
+//!
+//! \brief A chat message.
+//!
+//! Only the text types carrying a source are covered.
+//!
+struct TextPacket
+{
+    enum Type : std::uint8_t
+    {
+        Chat = 1,
+        Whisper = 6,
+        Announcement = 8,
+    };
+
+    static constexpr std::uint8_t ID = 0x0a;
+    std::uint8_t type;
+    boost::string_ref source;
+    boost::string_ref message;
+};
+
+template <>
+struct PacketSchema<TextPacket>
+    : Fields<CENISYS_PACKET_FIELD(TextPacket, U8, type),
+             CENISYS_PACKET_FIELD(TextPacket, String, source),
+             CENISYS_PACKET_FIELD(TextPacket, String, message)>
+{
+};
+
+struct SetTimePacket
+{
+    static constexpr std::uint8_t ID = 0x0b;
+    std::int32_t time;
+    bool started;
+};
+
+template <>
+struct PacketSchema<SetTimePacket>
+    : Fields<CENISYS_PACKET_FIELD(SetTimePacket, VarInt32, time),
+             CENISYS_PACKET_FIELD(SetTimePacket, Bool, started)>
+{
+};
+
+struct MovePlayerPacket
+{
+    enum Mode : std::uint8_t
+    {
+        Normal = 0,
+        Reset = 1,
+        Rotation = 2,
+    };
+
+    static constexpr std::uint8_t ID = 0x14;
+    std::uint64_t runtimeId;
+    Vector3 position;
+    float pitch;
+    float yaw;
+    float headYaw;
+    std::uint8_t mode;
+    bool onGround;
+};
+
+template <>
+struct PacketSchema<MovePlayerPacket>
+    : Fields<CENISYS_PACKET_FIELD(MovePlayerPacket, VarUInt64, runtimeId),
+             CENISYS_PACKET_FIELD(MovePlayerPacket, Vector3Codec, position),
+             CENISYS_PACKET_FIELD(MovePlayerPacket, Float, pitch),
+             CENISYS_PACKET_FIELD(MovePlayerPacket, Float, yaw),
+             CENISYS_PACKET_FIELD(MovePlayerPacket, Float, headYaw),
+             CENISYS_PACKET_FIELD(MovePlayerPacket, U8, mode),
+             CENISYS_PACKET_FIELD(MovePlayerPacket, Bool, onGround)>
+{
+};
+
+struct RemoveBlockPacket
+{
+    static constexpr std::uint8_t ID = 0x16;
+    BlockPosition position;
+};
+
+template <>
+struct PacketSchema<RemoveBlockPacket>
+    : Fields<CENISYS_PACKET_FIELD(RemoveBlockPacket, BlockPositionCodec,
+                                  position)>
+{
+};
+
+struct UpdateBlockPacket
+{
+    enum Flags : std::uint32_t
+    {
+        Neighbors = 1,
+        Network = 2,
+        Priority = 8,
+    };
+
+    static constexpr std::uint8_t ID = 0x17;
+    BlockPosition position;
+    std::uint32_t blockId;
+    //! Flags in the high nibble, metadata in the low one.
+    std::uint32_t flagsAndMeta;
+};
+
+template <>
+struct PacketSchema<UpdateBlockPacket>
+    : Fields<CENISYS_PACKET_FIELD(UpdateBlockPacket, BlockPositionCodec,
+                                  position),
+             CENISYS_PACKET_FIELD(UpdateBlockPacket, VarUInt32, blockId),
+             CENISYS_PACKET_FIELD(UpdateBlockPacket, VarUInt32, flagsAndMeta)>
+{
+};
+
+//!
+//! \brief A column of sections with its height map and biomes.
+//!
+//! The payload is encoded by ChunkPacketCache.
+//!
+struct FullChunkDataPacket
+{
+    static constexpr std::uint8_t ID = 0x3a;
+    std::int32_t chunkX;
+    std::int32_t chunkZ;
+    boost::string_ref payload;
+};
+
+template <>
+struct PacketSchema<FullChunkDataPacket>
+    : Fields<CENISYS_PACKET_FIELD(FullChunkDataPacket, VarInt32, chunkX),
+             CENISYS_PACKET_FIELD(FullChunkDataPacket, VarInt32, chunkZ),
+             CENISYS_PACKET_FIELD(FullChunkDataPacket, String, payload)>
+{
+};
+
+} // namespace mcpe
+} // namespace cenisys
+
+#endif // CENISYS_MCPEPACKETS_H
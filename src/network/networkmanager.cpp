@@ -0,0 +1,719 @@
+/*
+ * NetworkManager
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/networkmanager.h"
+#include "command/commandsender.h"
+#include "config/configsection.h"
+#include "network/mcpepackets.h"
+#include "world/chunkcolumn.h"
+#include "world/world.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/asio/ip/address.hpp>
+#include <boost/locale/format.hpp>
+#include <boost/locale/message.hpp>
+#include <future>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace cenisys
+{
+
+constexpr std::size_t NetworkManager::POOL_BLOCK_SIZE;
+constexpr std::size_t NetworkManager::POOL_SLAB_BLOCKS;
+constexpr std::size_t NetworkManager::POOL_MAX_BLOCKS;
+constexpr std::size_t NetworkManager::WORST_SESSIONS;
+
+namespace
+{
+
+double percentOf(std::uint64_t part, std::uint64_t whole)
+{
+    return whole ? part * 100.0 / whole : 0;
+}
+
+//! Resent and lost datagrams over all of them.
+double lossRate(const RakNetSession::Telemetry &session)
+{
+    const Reliability::Stats &stats = session.reliability;
+    return percentOf(stats.datagramsResent + stats.datagramsLost,
+                     stats.datagramsSent + stats.datagramsReceived +
+                         stats.datagramsLost);
+}
+
+double toMilliseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+NetworkManager::NetworkManager(Server &server)
+    : _server(server),
+      _packetPool(POOL_BLOCK_SIZE, POOL_SLAB_BLOCKS, POOL_MAX_BLOCKS),
+      _blockUpdates(0), _blockBatches(0), _chunkStats{},
+      _captures(std::make_shared<CaptureList>()),
+      _captureFileHandle(nullptr)
+{
+    registerGameHandlers(_dispatcher, _server.getWorld());
+    // Packets are handed to the world as soon as sessions open
+    _server.registerStartupTask("network", {"world"}, [this] { start(); });
+    _server.registerShutdownTask("network", {}, [this] { stop(); });
+}
+
+NetworkManager::~NetworkManager()
+{
+    _server.unregisterStartupTask("network");
+    _server.unregisterShutdownTask("network");
+}
+
+void NetworkManager::open(RakNetSession &session)
+{
+    _events.push({SessionEvent::Type::Open, session.shared_from_this(), {},
+                  std::chrono::steady_clock::now()});
+}
+
+void NetworkManager::receive(RakNetSession &session,
+                             const PacketBuffer &packet)
+{
+    // TODO: Decode the game packets here, on the thread of the session
+    _events.push({SessionEvent::Type::Receive, session.shared_from_this(),
+                  packet, std::chrono::steady_clock::now()});
+}
+
+void NetworkManager::close(RakNetSession &session)
+{
+    _events.push({SessionEvent::Type::Close, session.shared_from_this(), {},
+                  std::chrono::steady_clock::now()});
+}
+
+BufferPool::Stats NetworkManager::getPoolStats() const
+{
+    BufferPool::Stats result = _packetPool.getStats();
+    for(const auto &shard : _shards)
+        result += shard->listener->getBufferPool().getStats();
+    return result;
+}
+
+RakNetListener::SendStats NetworkManager::getSendStats() const
+{
+    RakNetListener::SendStats result{};
+    for(const auto &shard : _shards)
+        result += shard->listener->getSendStats();
+    return result;
+}
+
+std::vector<RakNetSession::Telemetry> NetworkManager::getTelemetry()
+{
+    // The counters are plain fields, so they are read by their own thread
+    std::vector<std::vector<RakNetSession::Telemetry>> shards(_shards.size());
+    std::vector<std::future<void>> done;
+    for(std::size_t i = 0; i < _shards.size(); i++)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        done.push_back(promise->get_future());
+        Shard &shard = *_shards[i];
+        std::vector<RakNetSession::Telemetry> &result = shards[i];
+        shard.ioService.post([&shard, &result, promise] {
+            RakNetSession::Clock::time_point now = RakNetSession::Clock::now();
+            shard.listener->forEachSession([&](const RakNetSession &session) {
+                result.push_back(session.getTelemetry(now));
+            });
+            promise->set_value();
+        });
+    }
+    std::vector<RakNetSession::Telemetry> result;
+    for(std::size_t i = 0; i < shards.size(); i++)
+    {
+        done[i].wait();
+        result.insert(result.end(), shards[i].begin(), shards[i].end());
+    }
+    return result;
+}
+
+void NetworkManager::broadcast(
+    std::vector<std::shared_ptr<RakNetSession>> &&sessions,
+    std::vector<PacketBuffer> &&packets)
+{
+    std::size_t uncompressed = 0;
+    for(const auto &item : packets)
+        uncompressed += BinaryWriter::varSize(item.size()) + item.size();
+    _compressor->compress(std::move(packets),
+                          [sessions = std::move(sessions),
+                           uncompressed](const PacketBuffer &batch) {
+                              for(const auto &item : sessions)
+                                  item->sendBatch(batch, uncompressed);
+                          });
+}
+
+void NetworkManager::registerGameHandlers(PacketDispatcher &dispatcher,
+                                          World &world)
+{
+    // Logins and chat are only decoded, as there are no players yet
+    auto decodeOnly = [](std::uint64_t session, const auto &packet) {};
+    dispatcher.registerHandler<mcpe::LoginPacket>(decodeOnly);
+    dispatcher.registerHandler<mcpe::TextPacket>(decodeOnly);
+    // Players see the columns around them and break blocks
+    dispatcher.registerHandler<mcpe::MovePlayerPacket>(
+        [&world](std::uint64_t session, const mcpe::MovePlayerPacket &packet) {
+            world.setViewer(session, packet.position.x, packet.position.y,
+                            packet.position.z);
+        });
+    dispatcher.registerHandler<mcpe::RemoveBlockPacket>(
+        [&world](std::uint64_t session,
+                 const mcpe::RemoveBlockPacket &packet) {
+            // Only by players who moved in, and close enough to the block
+            if(!world.inReach(session, packet.position.x, packet.position.y,
+                              packet.position.z))
+                return;
+            world.setBlock(packet.position.x, packet.position.y,
+                           packet.position.z, ChunkSection::AIR);
+        });
+}
+
+NetworkManager::RegisteredCapture
+NetworkManager::registerCapture(PacketCaptureBackend &backend)
+{
+    std::lock_guard<std::mutex> lock(_captureListLock);
+    // Not owned; released by whoever drops the last list holding it
+    auto released = std::make_shared<std::promise<void>>();
+    std::shared_ptr<PacketCaptureBackend> capture(
+        &backend,
+        [released](PacketCaptureBackend *) { released->set_value(); });
+    _captureReleased.insert({&backend, released->get_future()});
+    auto captures = std::make_shared<CaptureList>(*_captures);
+    captures->push_back(std::move(capture));
+    std::atomic_store(&_captures,
+                      std::shared_ptr<const CaptureList>(std::move(captures)));
+    return &backend;
+}
+
+void NetworkManager::unregisterCapture(NetworkManager::RegisteredCapture handle)
+{
+    std::future<void> released;
+    {
+        std::lock_guard<std::mutex> lock(_captureListLock);
+        auto it = _captureReleased.find(handle);
+        if(it == _captureReleased.end())
+            return;
+        released = std::move(it->second);
+        _captureReleased.erase(it);
+        auto captures = std::make_shared<CaptureList>();
+        for(const auto &item : *_captures)
+        {
+            if(item.get() != handle)
+                captures->push_back(item);
+        }
+        std::atomic_store(
+            &_captures,
+            std::shared_ptr<const CaptureList>(std::move(captures)));
+    }
+    // Wait for a tick still holding an old list
+    released.wait();
+}
+
+void NetworkManager::start()
+{
+    std::shared_ptr<ConfigSection> config = _server.getConfig("cenisys");
+    ConfigSection::Path path = ConfigSection::Path() / "network";
+    if(!config->getBool(path / "enable", true))
+        return;
+
+    // Every thread gets its own socket if the kernel can balance them
+    std::size_t shards = 1;
+#if defined(SO_REUSEPORT)
+    shards = _server.getThreadCount();
+#endif
+
+    RakNetListener::Options options;
+    options.endpoint = boost::asio::ip::udp::endpoint(
+        boost::asio::ip::address::from_string(
+            config->getString(path / "address", "0.0.0.0")),
+        static_cast<unsigned short>(config->getUInt(path / "port", 19132)));
+    options.guid = std::mt19937_64(std::random_device()())();
+    options.motd = config->getString(path / "motd", "Cenisys Server");
+    options.maxSessions = config->getUInt(path / "max-players", 20);
+    options.sessionCount = std::make_shared<std::atomic<std::size_t>>(0);
+    options.sessionIds = std::make_shared<std::atomic<std::uint64_t>>(0);
+    options.maxMtu = config->getUInt(path / "mtu", raknet::MAX_MTU);
+    options.timeout =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(
+                config->getDouble(path / "timeout", 10)));
+    options.reusePort = shards > 1;
+    options.segmentationOffload =
+        config->getBool(path / "segmentation-offload", true);
+
+    if(!_compressor)
+    {
+        _compressor = std::make_unique<BatchCompressor>(
+            _server.getIoService(), _server.getThreadCount());
+        _chunkPackets = std::make_unique<ChunkPacketCache>(*_compressor);
+    }
+    _server.getWorld().setSenders(
+        [this](ChunkColumn &column, const std::vector<std::uint64_t> &viewers) {
+            sendColumn(column, viewers);
+        },
+        [this](const ChunkColumn &column,
+               const std::vector<std::uint16_t> &blocks,
+               const std::vector<std::uint64_t> &viewers) {
+            sendBlocks(column, blocks, viewers);
+        });
+    _server.getWorld().setUnloadHandler(
+        [this](std::int32_t x, std::int32_t z) {
+            _chunkPackets->remove(x, z);
+        });
+    // The payloads of the columns are encoded by the pipeline workers
+    _server.getWorld().setSerializer(ChunkPacketCache::encode);
+    _server.getWorld().setLoadHandler(
+        [this](ChunkColumn &column, std::vector<std::uint8_t> &&data) {
+            _chunkPackets->seed(column, std::move(data));
+        });
+    _tickHandler = _server.registerTickHandler([this] { tick(); });
+    for(std::size_t i = 0; i < shards; i++)
+    {
+        _shards.push_back(std::make_unique<Shard>());
+        Shard &shard = *_shards.back();
+        shard.listener =
+            std::make_shared<RakNetListener>(shard.ioService, options, *this);
+        // Bind the other sockets to the same port if it was chosen randomly
+        options.endpoint = shard.listener->getLocalEndpoint();
+        shard.listener->start();
+        shard.work =
+            std::make_unique<boost::asio::io_service::work>(shard.ioService);
+        shard.thread = std::thread([&shard] { shard.ioService.run(); });
+    }
+    _poolCommand = _server.registerCommand(
+        "netpool", boost::locale::translate("Show the packet pool statistics"),
+        [this](CommandSender &sender, const std::string &command) {
+            BufferPool::Stats stats = getPoolStats();
+            std::size_t hitRate =
+                stats.allocations ? stats.hits * 100 / stats.allocations : 0;
+            sender.sendMessage(
+                boost::locale::format(boost::locale::translate(
+                    "Packet buffers: {1} in use, {2} at most, {3} pooled")) %
+                stats.inUse % stats.highWater % stats.blocks);
+            sender.sendMessage(
+                boost::locale::format(boost::locale::translate(
+                    "Allocations: {1}, {2}% recycled, {3} from the heap")) %
+                stats.allocations % hitRate % stats.fallbacks);
+        });
+    _ioCommand = _server.registerCommand(
+        "netio", boost::locale::translate("Show the socket send statistics"),
+        [this](CommandSender &sender, const std::string &command) {
+            RakNetListener::SendStats stats = getSendStats();
+            double perFlush = stats.flushes ? static_cast<double>(
+                                                  stats.datagrams) /
+                                                  stats.flushes
+                                            : 0;
+            double perCall = stats.syscalls ? static_cast<double>(
+                                                  stats.datagrams) /
+                                                  stats.syscalls
+                                            : 0;
+            sender.sendMessage(
+                boost::locale::format(boost::locale::translate(
+                    "Sent {1} datagrams in {2} system calls over {3} "
+                    "flushes")) %
+                stats.datagrams % stats.syscalls % stats.flushes);
+            sender.sendMessage(
+                boost::locale::format(boost::locale::translate(
+                    "{1,num=fixed,p=1} datagrams per flush, "
+                    "{2,num=fixed,p=1} per system call, {3} segmented by "
+                    "the kernel")) %
+                perFlush % perCall % stats.segmented);
+        });
+    _captureCommand = _server.registerCommand(
+        "netcapture",
+        boost::locale::translate(
+            "Capture the received packets to a file, or stop without one"),
+        [this](CommandSender &sender, const std::string &command) {
+            std::string::size_type begin = command.find(' ');
+            captureTo(sender, begin == std::string::npos
+                                  ? std::string()
+                                  : command.substr(begin + 1));
+        });
+    _statsCommand = _server.registerCommand(
+        "netstats",
+        boost::locale::translate(
+            "Show the network statistics of a session, given by its id, "
+            "address or address:port, or of the worst ones"),
+        [this](CommandSender &sender, const std::string &command) {
+            std::string::size_type begin = command.find(' ');
+            showTelemetry(sender, begin == std::string::npos
+                                      ? std::string()
+                                      : command.substr(begin + 1));
+        });
+    _server.log(Server::LogLevel::Info,
+                boost::locale::format(boost::locale::translate(
+                    "Listening on {1} with {2} socket.",
+                    "Listening on {1} with {2} sockets.", shards)) %
+                    options.endpoint % shards);
+}
+
+void NetworkManager::stop()
+{
+    if(_shards.empty())
+        return;
+    _server.unregisterCommand(_poolCommand);
+    _server.unregisterCommand(_ioCommand);
+    _server.unregisterCommand(_captureCommand);
+    _server.unregisterCommand(_statsCommand);
+    for(const auto &shard : _shards)
+    {
+        shard->ioService.post([&shard] {
+            if(shard->listener)
+                shard->listener->stop();
+        });
+        shard->work.reset();
+    }
+    for(const auto &shard : _shards)
+    {
+        if(shard->thread.joinable())
+            shard->thread.join();
+    }
+    // Handle the last close events before the sessions go away
+    tick();
+    _server.getWorld().setSenders({}, {});
+    _server.getWorld().setUnloadHandler({});
+    // The serializer stays, as the pipeline may still be running it
+    _server.getWorld().setLoadHandler({});
+    _sessions.clear();
+    logStats(Server::LogLevel::Debug);
+    {
+        std::lock_guard<std::mutex> lock(_captureFileLock);
+        if(_captureFile)
+        {
+            unregisterCapture(_captureFileHandle);
+            _captureFile.reset();
+        }
+    }
+    _shards.clear();
+    _server.unregisterTickHandler(_tickHandler);
+}
+
+void NetworkManager::tick()
+{
+    std::shared_ptr<const CaptureList> captures = std::atomic_load(&_captures);
+    SessionEvent event;
+    while(_events.pop(event))
+    {
+        switch(event.type)
+        {
+        case SessionEvent::Type::Open:
+        {
+            for(const auto &item : *captures)
+                item->openSession(event.time, event.session->getId());
+            _sessions[event.session->getId()] = event.session;
+            _server.log(Server::LogLevel::Debug,
+                        boost::locale::format(boost::locale::translate(
+                            "Session opened from {1} with MTU {2}")) %
+                            event.session->getEndpoint() %
+                            event.session->getMtu());
+            break;
+        }
+        case SessionEvent::Type::Receive:
+        {
+            std::uint64_t id = event.session->getId();
+            for(const auto &item : *captures)
+                item->receive(event.time, id, event.data);
+            if(!_dispatcher.dispatch(id, event.data))
+            {
+                _server.log(Server::LogLevel::Debug,
+                            boost::locale::format(boost::locale::translate(
+                                "Malformed packet from {1}")) %
+                                event.session->getEndpoint());
+            }
+            break;
+        }
+        case SessionEvent::Type::Close:
+        {
+            for(const auto &item : *captures)
+                item->closeSession(event.time, event.session->getId());
+            _server.getWorld().removeViewer(event.session->getId());
+            _sessions.erase(event.session->getId());
+            _server.log(Server::LogLevel::Debug,
+                        boost::locale::format(boost::locale::translate(
+                            "Session {1} closed")) %
+                            event.session->getEndpoint());
+            break;
+        }
+        }
+    }
+    if(!captures->empty())
+    {
+        std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        for(const auto &item : *captures)
+            item->endTick(now);
+    }
+    _tickArena.reset();
+    if(_chunkPackets)
+    {
+        _chunkPackets->tick();
+        std::lock_guard<std::mutex> lock(_chunkStatsLock);
+        _chunkStats = {_chunkPackets->getStats(), _blockUpdates,
+                       _blockBatches};
+    }
+}
+
+void NetworkManager::sendColumn(ChunkColumn &column,
+                                const std::vector<std::uint64_t> &viewers)
+{
+    for(std::uint64_t id : viewers)
+    {
+        auto it = _sessions.find(id);
+        if(it == _sessions.end())
+            continue;
+        // Looked up per session, so every send after the first is a hit
+        const ChunkPacketCache::Batch &batch = _chunkPackets->get(column);
+        it->second->sendBatch(batch.data, batch.uncompressed);
+    }
+}
+
+void NetworkManager::sendBlocks(const ChunkColumn &column,
+                                const std::vector<std::uint16_t> &blocks,
+                                const std::vector<std::uint64_t> &viewers)
+{
+    std::vector<PacketBuffer> packets;
+    std::size_t uncompressed = 0;
+    for(std::uint16_t index : blocks)
+    {
+        unsigned x = index & 15, y = index >> 8, z = (index >> 4) & 15;
+        mcpe::UpdateBlockPacket packet{
+            {column.getX() * 16 + static_cast<std::int32_t>(x), y,
+             column.getZ() * 16 + static_cast<std::int32_t>(z)},
+            column.getBlock(x, y, z),
+            ((mcpe::UpdateBlockPacket::Neighbors |
+              mcpe::UpdateBlockPacket::Network)
+             << 4) |
+                column.getMeta(x, y, z)};
+        packets.push_back(mcpe::encodePacket(_packetPool, packet));
+        std::size_t size = packets.back().size();
+        uncompressed += BinaryWriter::varSize(size) + size;
+    }
+    // Compressed here rather than by a worker, so it cannot overtake a
+    // column sent later
+    PacketBuffer batch =
+        _compressor->compressNow(packets, _compressor->getLevel());
+    for(std::uint64_t id : viewers)
+    {
+        auto it = _sessions.find(id);
+        if(it != _sessions.end())
+            it->second->sendBatch(batch, uncompressed);
+    }
+    _blockUpdates += blocks.size();
+    _blockBatches++;
+}
+
+NetworkManager::ChunkStats NetworkManager::getChunkStats() const
+{
+    std::lock_guard<std::mutex> lock(_chunkStatsLock);
+    return _chunkStats;
+}
+
+void NetworkManager::logStats(Server::LogLevel level)
+{
+    BufferPool::Stats stats = getPoolStats();
+    _server.log(level, boost::locale::format(boost::locale::translate(
+                           "Packet pool: {1} allocations, {2} recycled, {3} "
+                           "from the heap, at most {4} in use")) %
+                           stats.allocations % stats.hits % stats.fallbacks %
+                           stats.highWater);
+    RakNetListener::SendStats sendStats = getSendStats();
+    _server.log(level, boost::locale::format(boost::locale::translate(
+                           "Sockets: {1} datagrams in {2} system calls over "
+                           "{3} flushes")) %
+                           sendStats.datagrams % sendStats.syscalls %
+                           sendStats.flushes);
+    if(_chunkPackets)
+    {
+        ChunkStats chunks = getChunkStats();
+        _server.log(level, boost::locale::format(boost::locale::translate(
+                               "Chunk packets: {1} sent, {2} compressed, "
+                               "{3} sections encoded; {4} block updates in "
+                               "{5} batches")) %
+                               (chunks.packets.hits + chunks.packets.misses) %
+                               chunks.packets.misses %
+                               chunks.packets.sectionsEncoded %
+                               chunks.blockUpdates % chunks.blockBatches);
+    }
+}
+
+void NetworkManager::captureTo(CommandSender &sender, const std::string &file)
+{
+    std::lock_guard<std::mutex> lock(_captureFileLock);
+    if(_captureFile)
+    {
+        unregisterCapture(_captureFileHandle);
+        _captureFile->close();
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Capture stopped after {1} records, {2} bytes")) %
+            _captureFile->getRecords() % _captureFile->getBytes());
+        _captureFile.reset();
+    }
+    if(file.empty())
+        return;
+    auto capture = std::make_unique<PacketCaptureFile>();
+    if(!capture->open(file))
+    {
+        sender.sendMessage(boost::locale::format(boost::locale::translate(
+                               "Cannot write the capture to {1}")) %
+                           file);
+        return;
+    }
+    _captureFile = std::move(capture);
+    _captureFileHandle = registerCapture(*_captureFile);
+    sender.sendMessage(boost::locale::format(boost::locale::translate(
+                           "Capturing the received packets to {1}")) %
+                       file);
+}
+
+void NetworkManager::showTelemetry(CommandSender &sender,
+                                   const std::string &session)
+{
+    std::vector<RakNetSession::Telemetry> sessions = getTelemetry();
+    if(!session.empty())
+    {
+        // By id or endpoint, as sessions have no player names
+        auto it = std::find_if(
+            sessions.begin(), sessions.end(),
+            [&session](const RakNetSession::Telemetry &item) {
+                std::ostringstream endpoint;
+                endpoint << item.endpoint;
+                return std::to_string(item.id) == session ||
+                       endpoint.str() == session ||
+                       item.endpoint.address().to_string() == session;
+            });
+        if(it == sessions.end())
+        {
+            sender.sendMessage(boost::locale::format(boost::locale::translate(
+                                   "No session {1}")) %
+                               session);
+            return;
+        }
+        const Reliability::Stats &stats = it->reliability;
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Session {1} from {2}, connected for {3,num=fixed,p=0} s")) %
+            it->id % it->endpoint %
+            std::chrono::duration<double>(it->connected).count());
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Round trip {1,num=fixed,p=1} ms, {2} packets queued, "
+                "{3} datagrams in flight")) %
+            toMilliseconds(it->roundTrip) % it->queued % it->inFlight);
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Sent {1} datagrams, {2,num=fixed,p=1} KiB, "
+                "{3,num=fixed,p=1}% resent")) %
+            stats.datagramsSent % (stats.bytesSent / 1024.0) %
+            percentOf(stats.datagramsResent, stats.datagramsSent));
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Received {1} datagrams, {2,num=fixed,p=1} KiB, "
+                "{3,num=fixed,p=1}% lost")) %
+            stats.datagramsReceived % (stats.bytesReceived / 1024.0) %
+            percentOf(stats.datagramsLost,
+                      stats.datagramsReceived + stats.datagramsLost));
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Batches compressed to {1,num=fixed,p=1}% of "
+                "{2,num=fixed,p=1} KiB")) %
+            percentOf(it->batchBytes, it->batchRawBytes) %
+            (it->batchRawBytes / 1024.0));
+        return;
+    }
+
+    Reliability::Stats total{};
+    std::uint64_t batchBytes = 0;
+    std::uint64_t batchRawBytes = 0;
+    RakNetSession::Clock::duration roundTrips{};
+    for(const auto &item : sessions)
+    {
+        total.datagramsSent += item.reliability.datagramsSent;
+        total.datagramsResent += item.reliability.datagramsResent;
+        total.datagramsReceived += item.reliability.datagramsReceived;
+        total.datagramsLost += item.reliability.datagramsLost;
+        total.bytesSent += item.reliability.bytesSent;
+        total.bytesReceived += item.reliability.bytesReceived;
+        batchBytes += item.batchBytes;
+        batchRawBytes += item.batchRawBytes;
+        roundTrips += item.roundTrip;
+    }
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "{1} sessions, mean round trip {2,num=fixed,p=1} ms")) %
+        sessions.size() %
+        (sessions.empty() ? 0 : toMilliseconds(roundTrips) / sessions.size()));
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Sent {1,num=fixed,p=1} KiB, {2,num=fixed,p=1}% resent; "
+            "received {3,num=fixed,p=1} KiB, {4,num=fixed,p=1}% lost; "
+            "batches compressed to {5,num=fixed,p=1}%")) %
+        (total.bytesSent / 1024.0) %
+        percentOf(total.datagramsResent, total.datagramsSent) %
+        (total.bytesReceived / 1024.0) %
+        percentOf(total.datagramsLost,
+                  total.datagramsReceived + total.datagramsLost) %
+        percentOf(batchBytes, batchRawBytes));
+    if(_chunkPackets)
+    {
+        ChunkStats chunks = getChunkStats();
+        const ChunkPacketCache::Stats &packets = chunks.packets;
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Chunk packets: {1} columns cached in {2,num=fixed,p=1} KiB, "
+                "{3,num=fixed,p=1}% of {4} sends hit, {5} sections "
+                "encoded, {6} columns encoded while loading, {7} batches "
+                "recompressed")) %
+            packets.columns % (packets.bytes / 1024.0) %
+            percentOf(packets.hits, packets.hits + packets.misses) %
+            (packets.hits + packets.misses) % packets.sectionsEncoded %
+            packets.seeded % packets.recompressed);
+        sender.sendMessage(boost::locale::format(boost::locale::translate(
+                               "Block updates: {1} in {2} batches")) %
+                           chunks.blockUpdates % chunks.blockBatches);
+    }
+
+    // Worst first by loss, then by round trip
+    std::size_t shown = std::min(sessions.size(), WORST_SESSIONS);
+    std::partial_sort(
+        sessions.begin(), sessions.begin() + shown, sessions.end(),
+        [](const RakNetSession::Telemetry &a,
+           const RakNetSession::Telemetry &b) {
+            double lossA = lossRate(a);
+            double lossB = lossRate(b);
+            return lossA != lossB ? lossA > lossB : a.roundTrip > b.roundTrip;
+        });
+    for(std::size_t i = 0; i < shown; i++)
+    {
+        const RakNetSession::Telemetry &item = sessions[i];
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "  Session {1} from {2}: {3,num=fixed,p=1} ms, "
+                "{4,num=fixed,p=1}% lost or resent, {5} queued")) %
+            item.id % item.endpoint % toMilliseconds(item.roundTrip) %
+            lossRate(item) % (item.queued + item.inFlight));
+    }
+}
+
+} // namespace cenisys
@@ -0,0 +1,239 @@
+/*
+ * NetworkManager
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_NETWORKMANAGER_H
+#define CENISYS_NETWORKMANAGER_H
+
+#include "network/batchcompressor.h"
+#include "network/chunkpacketcache.h"
+#include "network/packetbuffer.h"
+#include "network/packetcapture.h"
+#include "network/packetdispatcher.h"
+#include "network/raknetlistener.h"
+#include "network/raknetsession.h"
+#include "server/server.h"
+#include "util/arena.h"
+#include "util/mpscqueue.h"
+#include <boost/asio/io_service.hpp>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief Owns the network listeners of the server.
+//!
+//! The listeners are opened and closed by the startup and shutdown tasks
+//! named "network", while the world is open.
+//!
+//! One listener is opened per server thread, all bound to the same port with
+//! SO_REUSEPORT. The kernel spreads the clients over the sockets by address,
+//! and each socket is served by its own thread, so a session is only ever
+//! touched by one thread. Session events reach the game tick through a
+//! lock-free queue.
+//!
+//! The game packets of the sessions go through a PacketDispatcher, and may
+//! be recorded by capture backends for replaying them with cenisys-replay.
+//!
+//! The columns the world sends are taken from a ChunkPacketCache, and
+//! changed blocks are sent in one batch per column, shared by its viewers.
+//!
+class NetworkManager : public RakNetSessionHandler
+{
+public:
+    //! Blocks of the pool for outgoing packets.
+    static constexpr std::size_t POOL_BLOCK_SIZE = 2048;
+    static constexpr std::size_t POOL_SLAB_BLOCKS = 256;
+    static constexpr std::size_t POOL_MAX_BLOCKS = 16384;
+    //! Sessions listed by netstats without a session.
+    static constexpr std::size_t WORST_SESSIONS = 5;
+
+    //! Immutable once published; modified by copying.
+    using CaptureList = std::vector<std::shared_ptr<PacketCaptureBackend>>;
+    using RegisteredCapture = const PacketCaptureBackend *;
+
+    NetworkManager(Server &server);
+    ~NetworkManager();
+
+    void open(RakNetSession &session);
+    void receive(RakNetSession &session, const PacketBuffer &packet);
+    void close(RakNetSession &session);
+
+    //!
+    //! \brief Pool for the packets sent by the game tick.
+    //!
+    //! Must only be allocated from by tick handlers.
+    //!
+    BufferPool &getPacketPool() { return _packetPool; }
+    //!
+    //! \brief Scratch memory for encoding, reset after every tick.
+    //!
+    Arena &getTickArena() { return _tickArena; }
+    //!
+    //! \brief Statistics of the outgoing pool and every receive pool.
+    //!
+    BufferPool::Stats getPoolStats() const;
+    //!
+    //! \brief Send statistics of every listener.
+    //!
+    RakNetListener::SendStats getSendStats() const;
+    //!
+    //! \brief Counters of every session.
+    //!
+    //! Collected on the thread of every shard. Must not be called from a
+    //! shard thread, nor while stopping.
+    //!
+    std::vector<RakNetSession::Telemetry> getTelemetry();
+    //!
+    //! \brief Compressor of outgoing batches, available once started.
+    //!
+    BatchCompressor &getBatchCompressor() { return *_compressor; }
+
+    //!
+    //! \brief Send game packets to many sessions.
+    //!
+    //! The packets are compressed into one batch on a worker thread, which
+    //! is then shared by every session.
+    //!
+    void broadcast(std::vector<std::shared_ptr<RakNetSession>> &&sessions,
+                   std::vector<PacketBuffer> &&packets);
+
+    //!
+    //! \brief Dispatcher of the game packets, used by the tick.
+    //!
+    PacketDispatcher &getPacketDispatcher() { return _dispatcher; }
+    //!
+    //! \brief Register the handlers of the game packets.
+    //!
+    //! They act on the world from the game tick. Shared with cenisys-replay,
+    //! which gives them a world that is never started, so replays run the
+    //! same handlers as the server without loading any column.
+    //!
+    static void registerGameHandlers(PacketDispatcher &dispatcher,
+                                     World &world);
+
+    //!
+    //! \brief Record the session events from the next tick on.
+    //!
+    RegisteredCapture registerCapture(PacketCaptureBackend &backend);
+    //!
+    //! \brief Stop recording. No tick uses the backend once this returns.
+    //!
+    //! Must not be called from a tick.
+    //!
+    void unregisterCapture(RegisteredCapture handle);
+
+private:
+    struct Shard
+    {
+        boost::asio::io_service ioService;
+        std::unique_ptr<boost::asio::io_service::work> work;
+        std::shared_ptr<RakNetListener> listener;
+        std::thread thread;
+    };
+
+    //! Counters of the columns and blocks sent, as of the last tick.
+    struct ChunkStats
+    {
+        ChunkPacketCache::Stats packets;
+        std::uint64_t blockUpdates;
+        std::uint64_t blockBatches;
+    };
+
+    struct SessionEvent
+    {
+        enum class Type
+        {
+            Open,
+            Receive,
+            Close,
+        };
+        Type type;
+        std::shared_ptr<RakNetSession> session;
+        PacketBuffer data;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    void start();
+    void stop();
+    void tick();
+    void sendColumn(ChunkColumn &column,
+                    const std::vector<std::uint64_t> &viewers);
+    void sendBlocks(const ChunkColumn &column,
+                    const std::vector<std::uint16_t> &blocks,
+                    const std::vector<std::uint64_t> &viewers);
+    //!
+    //! \brief The chunk counters, which the tick copies for the commands.
+    //!
+    ChunkStats getChunkStats() const;
+    void logStats(Server::LogLevel level);
+    //!
+    //! \brief Write the captured traffic to a file, or stop if empty.
+    //!
+    void captureTo(CommandSender &sender, const std::string &file);
+    //!
+    //! \brief Show one session, or the totals and the worst sessions.
+    //! \param session Id, address or address:port, or empty.
+    //!
+    void showTelemetry(CommandSender &sender, const std::string &session);
+
+    Server &_server;
+    //! Outlives the shards, as their sessions may still hold its packets.
+    BufferPool _packetPool;
+    Arena _tickArena;
+    //! Kept until destruction, as batches may still be in flight.
+    std::unique_ptr<BatchCompressor> _compressor;
+    std::vector<std::unique_ptr<Shard>> _shards;
+    MpscQueue<SessionEvent> _events;
+    //! Open sessions by id, as seen by the tick.
+    std::map<std::uint64_t, std::shared_ptr<RakNetSession>> _sessions;
+    std::unique_ptr<ChunkPacketCache> _chunkPackets;
+    //! Changed blocks sent, and the batches they were sent in.
+    std::uint64_t _blockUpdates;
+    std::uint64_t _blockBatches;
+    //! Copied at the end of every tick.
+    ChunkStats _chunkStats;
+    mutable std::mutex _chunkStatsLock;
+    PacketDispatcher _dispatcher;
+    std::shared_ptr<const CaptureList> _captures;
+    std::mutex _captureListLock;
+    //! Ready once the last list holding the backend is gone.
+    std::map<RegisteredCapture, std::future<void>> _captureReleased;
+    //! Capture started with the netcapture command.
+    std::unique_ptr<PacketCaptureFile> _captureFile;
+    RegisteredCapture _captureFileHandle;
+    std::mutex _captureFileLock;
+    Server::RegisteredTickHandler _tickHandler;
+    Server::RegisteredCommandHandler _poolCommand;
+    Server::RegisteredCommandHandler _ioCommand;
+    Server::RegisteredCommandHandler _captureCommand;
+    Server::RegisteredCommandHandler _statsCommand;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_NETWORKMANAGER_H
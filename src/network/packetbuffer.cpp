@@ -0,0 +1,177 @@
+/*
+ * PacketBuffer
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/packetbuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace cenisys
+{
+
+PacketBuffer PacketBuffer::allocate(std::size_t size)
+{
+    void *memory = ::operator new(sizeof(Block) + size);
+    Block *block = new(memory) Block;
+    block->references.store(1, std::memory_order_relaxed);
+    block->size = size;
+    block->capacity = size;
+    block->pool = nullptr;
+    block->next = nullptr;
+    return PacketBuffer(block);
+}
+
+PacketBuffer PacketBuffer::copy(const std::uint8_t *data, std::size_t size)
+{
+    PacketBuffer result = allocate(size);
+    std::memcpy(result.data(), data, size);
+    return result;
+}
+
+void PacketBuffer::release()
+{
+    if(!_block)
+        return;
+    if(_block->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        if(_block->pool)
+        {
+            _block->pool->release(_block);
+        }
+        else
+        {
+            _block->~Block();
+            ::operator delete(_block);
+        }
+    }
+    _block = nullptr;
+}
+
+BufferPool::Stats &BufferPool::Stats::operator+=(const Stats &other)
+{
+    allocations += other.allocations;
+    hits += other.hits;
+    fallbacks += other.fallbacks;
+    inUse += other.inUse;
+    highWater += other.highWater;
+    blocks += other.blocks;
+    return *this;
+}
+
+BufferPool::BufferPool(std::size_t blockSize, std::size_t blocksPerSlab,
+                       std::size_t maxBlocks)
+    : _blockSize(blockSize), _blocksPerSlab(blocksPerSlab),
+      _maxBlocks(maxBlocks), _free(nullptr), _released(nullptr),
+      _allocations(0), _hits(0), _fallbacks(0), _inUse(0), _highWater(0),
+      _blocks(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    // The blocks are plain memory in the slabs
+}
+
+PacketBuffer BufferPool::allocate(std::size_t size)
+{
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    if(size > _blockSize)
+    {
+        _fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return PacketBuffer::allocate(size);
+    }
+
+    if(!_free)
+        _free = _released.exchange(nullptr, std::memory_order_acquire);
+    if(_free)
+        _hits.fetch_add(1, std::memory_order_relaxed);
+    else if(_blocks.load(std::memory_order_relaxed) < _maxBlocks)
+        addSlab();
+    if(!_free)
+    {
+        _fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return PacketBuffer::allocate(size);
+    }
+
+    PacketBuffer::Block *block = _free;
+    _free = block->next;
+    block->references.store(1, std::memory_order_relaxed);
+    block->size = size;
+    std::size_t inUse = _inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(inUse > _highWater.load(std::memory_order_relaxed))
+        _highWater.store(inUse, std::memory_order_relaxed);
+    return PacketBuffer(block);
+}
+
+PacketBuffer BufferPool::copy(const std::uint8_t *data, std::size_t size)
+{
+    PacketBuffer result = allocate(size);
+    std::memcpy(result.data(), data, size);
+    return result;
+}
+
+BufferPool::Stats BufferPool::getStats() const
+{
+    Stats result;
+    result.allocations = _allocations.load(std::memory_order_relaxed);
+    result.hits = _hits.load(std::memory_order_relaxed);
+    result.fallbacks = _fallbacks.load(std::memory_order_relaxed);
+    result.inUse = _inUse.load(std::memory_order_relaxed);
+    result.highWater = _highWater.load(std::memory_order_relaxed);
+    result.blocks = _blocks.load(std::memory_order_relaxed);
+    return result;
+}
+
+void BufferPool::addSlab()
+{
+    std::size_t stride = sizeof(PacketBuffer::Block) + _blockSize;
+    stride = (stride + alignof(std::max_align_t) - 1) /
+             alignof(std::max_align_t) * alignof(std::max_align_t);
+    std::size_t count =
+        std::min(_blocksPerSlab,
+                 _maxBlocks - _blocks.load(std::memory_order_relaxed));
+    _slabs.emplace_back(new std::uint8_t[stride * count]);
+    std::uint8_t *slab = _slabs.back().get();
+    for(std::size_t i = count; i > 0; i--)
+    {
+        auto *block = new(slab + (i - 1) * stride) PacketBuffer::Block;
+        block->capacity = _blockSize;
+        block->pool = this;
+        block->next = _free;
+        _free = block;
+    }
+    _blocks.fetch_add(count, std::memory_order_relaxed);
+}
+
+void BufferPool::release(PacketBuffer::Block *block)
+{
+    _inUse.fetch_sub(1, std::memory_order_relaxed);
+    // Pushing onto a stack which is only ever emptied as a whole is free of
+    // the ABA problem
+    PacketBuffer::Block *head = _released.load(std::memory_order_relaxed);
+    do
+    {
+        block->next = head;
+    } while(!_released.compare_exchange_weak(head, block,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+}
+
+} // namespace cenisys
@@ -0,0 +1,167 @@
+/*
+ * PacketBuffer
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_PACKETBUFFER_H
+#define CENISYS_PACKETBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cenisys
+{
+
+class BufferPool;
+
+//!
+//! \brief Reference counted byte buffer, usually from a BufferPool.
+//!
+//! Copies share the same bytes. The buffer goes back to its pool when the
+//! last copy is destroyed, which may happen on any thread.
+//!
+class PacketBuffer
+{
+public:
+    PacketBuffer() : _block(nullptr) {}
+    PacketBuffer(const PacketBuffer &other) : _block(other._block)
+    {
+        if(_block)
+            _block->references.fetch_add(1, std::memory_order_relaxed);
+    }
+    PacketBuffer(PacketBuffer &&other) : _block(other._block)
+    {
+        other._block = nullptr;
+    }
+    PacketBuffer &operator=(PacketBuffer other)
+    {
+        std::swap(_block, other._block);
+        return *this;
+    }
+    ~PacketBuffer() { release(); }
+
+    //!
+    //! \brief Allocate a buffer from the heap, without a pool.
+    //!
+    static PacketBuffer allocate(std::size_t size);
+    //!
+    //! \brief Allocate a buffer from the heap holding a copy of the data.
+    //!
+    static PacketBuffer copy(const std::uint8_t *data, std::size_t size);
+
+    explicit operator bool() const { return _block != nullptr; }
+    std::uint8_t *data() const
+    {
+        return reinterpret_cast<std::uint8_t *>(_block + 1);
+    }
+    std::size_t size() const { return _block ? _block->size : 0; }
+    std::size_t capacity() const { return _block ? _block->capacity : 0; }
+    //!
+    //! \brief Change the size. It must not exceed the capacity.
+    //!
+    void resize(std::size_t size) { _block->size = size; }
+
+private:
+    friend class BufferPool;
+
+    struct Block
+    {
+        std::atomic<std::uint32_t> references;
+        std::size_t size;
+        std::size_t capacity;
+        //! nullptr for heap blocks.
+        BufferPool *pool;
+        //! Link in the free lists of the pool.
+        Block *next;
+    };
+
+    explicit PacketBuffer(Block *block) : _block(block) {}
+    void release();
+
+    Block *_block;
+};
+
+//!
+//! \brief Slab allocator of fixed-size packet buffers.
+//!
+//! Buffers must be allocated by one thread at a time, but can be released
+//! from any thread without locking. Requests larger than the block size or
+//! beyond the block limit fall back to the heap.
+//!
+//! The pool must outlive its buffers.
+//!
+class BufferPool
+{
+public:
+    struct Stats
+    {
+        std::size_t allocations;
+        //! Allocations served by a recycled block.
+        std::size_t hits;
+        //! Allocations which went to the heap.
+        std::size_t fallbacks;
+        std::size_t inUse;
+        std::size_t highWater;
+        //! Blocks carved from the slabs so far.
+        std::size_t blocks;
+
+        Stats &operator+=(const Stats &other);
+    };
+
+    BufferPool(std::size_t blockSize, std::size_t blocksPerSlab,
+               std::size_t maxBlocks);
+    ~BufferPool();
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    PacketBuffer allocate(std::size_t size);
+    PacketBuffer copy(const std::uint8_t *data, std::size_t size);
+
+    std::size_t getBlockSize() const { return _blockSize; }
+    //! Can be called from any thread.
+    Stats getStats() const;
+
+private:
+    friend class PacketBuffer;
+
+    void addSlab();
+    void release(PacketBuffer::Block *block);
+
+    std::size_t _blockSize;
+    std::size_t _blocksPerSlab;
+    std::size_t _maxBlocks;
+    std::vector<std::unique_ptr<std::uint8_t[]>> _slabs;
+    //! Only touched by the allocating thread.
+    PacketBuffer::Block *_free;
+    //! Blocks released since the last refill of _free.
+    std::atomic<PacketBuffer::Block *> _released;
+
+    std::atomic<std::size_t> _allocations;
+    std::atomic<std::size_t> _hits;
+    std::atomic<std::size_t> _fallbacks;
+    std::atomic<std::size_t> _inUse;
+    std::atomic<std::size_t> _highWater;
+    std::atomic<std::size_t> _blocks;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_PACKETBUFFER_H
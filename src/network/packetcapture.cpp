@@ -0,0 +1,225 @@
+/*
+ * PacketCaptureBackend
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/packetcapture.h"
+#include "network/raknet.h"
+#include "network/reliability.h"
+#include <algorithm>
+#include <iterator>
+
+namespace cenisys
+{
+
+constexpr char PacketCaptureFile::MAGIC[4];
+constexpr std::uint8_t PacketCaptureFile::VERSION;
+constexpr std::size_t PacketCaptureFile::BUFFER_SIZE;
+
+PacketCaptureFile::PacketCaptureFile()
+    : _started(false), _records(0), _bytes(0)
+{
+}
+
+PacketCaptureFile::~PacketCaptureFile()
+{
+    close();
+}
+
+bool PacketCaptureFile::open(const boost::filesystem::path &file)
+{
+    close();
+    _file.open(file, std::ios::binary | std::ios::trunc);
+    if(!_file)
+        return false;
+    _buffer.reserve(BUFFER_SIZE * 2);
+    _buffer.assign(std::begin(MAGIC), std::end(MAGIC));
+    _buffer.push_back(VERSION);
+    _started = false;
+    _records = 0;
+    _bytes = 0;
+    return true;
+}
+
+void PacketCaptureFile::close()
+{
+    if(!_file.is_open())
+        return;
+    flush();
+    _file.close();
+}
+
+void PacketCaptureFile::openSession(Clock::time_point time,
+                                    std::uint64_t session)
+{
+    writeHeader(PacketCaptureRecord::Type::Open, time);
+    writeVar(session);
+}
+
+void PacketCaptureFile::receive(Clock::time_point time, std::uint64_t session,
+                                const PacketBuffer &packet)
+{
+    writeHeader(PacketCaptureRecord::Type::Receive, time);
+    writeVar(session);
+    writeVar(packet.size());
+    _buffer.insert(_buffer.end(), packet.data(),
+                   packet.data() + packet.size());
+    if(_buffer.size() >= BUFFER_SIZE)
+        flush();
+}
+
+void PacketCaptureFile::closeSession(Clock::time_point time,
+                                     std::uint64_t session)
+{
+    writeHeader(PacketCaptureRecord::Type::Close, time);
+    writeVar(session);
+}
+
+void PacketCaptureFile::endTick(Clock::time_point time)
+{
+    writeHeader(PacketCaptureRecord::Type::Tick, time);
+    if(_buffer.size() >= BUFFER_SIZE)
+        flush();
+}
+
+void PacketCaptureFile::writeHeader(PacketCaptureRecord::Type type,
+                                    Clock::time_point time)
+{
+    if(!_started)
+    {
+        _last = time;
+        _started = true;
+    }
+    // Packets are stamped on the threads of the sockets, so times of
+    // different shards may go slightly backwards
+    std::chrono::microseconds delta(0);
+    if(time > _last)
+    {
+        delta = std::chrono::duration_cast<std::chrono::microseconds>(
+            time - _last);
+        _last += delta;
+    }
+    _buffer.push_back(static_cast<std::uint8_t>(type));
+    writeVar(static_cast<std::uint64_t>(delta.count()));
+    _records++;
+}
+
+void PacketCaptureFile::writeVar(std::uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        _buffer.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    _buffer.push_back(static_cast<std::uint8_t>(value));
+}
+
+void PacketCaptureFile::flush()
+{
+    if(_buffer.empty() || !_file.is_open())
+        return;
+    _file.write(reinterpret_cast<const char *>(_buffer.data()),
+                static_cast<std::streamsize>(_buffer.size()));
+    _file.flush();
+    _bytes += _buffer.size();
+    _buffer.clear();
+}
+
+PacketCaptureReader::PacketCaptureReader() : _time(0), _fail(false)
+{
+}
+
+bool PacketCaptureReader::open(const boost::filesystem::path &file)
+{
+    _file.open(file, std::ios::binary);
+    _time = std::chrono::microseconds(0);
+    _fail = false;
+    char header[sizeof(PacketCaptureFile::MAGIC) + 1];
+    if(!_file.read(header, sizeof(header)))
+        return false;
+    return std::equal(std::begin(PacketCaptureFile::MAGIC),
+                      std::end(PacketCaptureFile::MAGIC), header) &&
+           static_cast<std::uint8_t>(header[sizeof(header) - 1]) ==
+               PacketCaptureFile::VERSION;
+}
+
+bool PacketCaptureReader::next(PacketCaptureRecord &record)
+{
+    // The largest packet the reliability layer can reassemble
+    constexpr std::size_t maxPacket =
+        Reliability::MAX_SPLIT_COUNT * raknet::MAX_MTU;
+
+    int type = _file.get();
+    if(type == std::char_traits<char>::eof())
+        return false;
+    std::uint64_t delta;
+    if(!readVar(delta))
+        return false;
+    _time += std::chrono::microseconds(delta);
+    record.type = static_cast<PacketCaptureRecord::Type>(type);
+    record.time = _time;
+    record.session = 0;
+    record.packet = PacketBuffer();
+    switch(record.type)
+    {
+    case PacketCaptureRecord::Type::Open:
+    case PacketCaptureRecord::Type::Close:
+        return readVar(record.session);
+    case PacketCaptureRecord::Type::Receive:
+    {
+        std::uint64_t size;
+        if(!readVar(record.session) || !readVar(size))
+            return false;
+        if(size > maxPacket)
+        {
+            _fail = true;
+            return false;
+        }
+        record.packet = PacketBuffer::allocate(size);
+        if(!_file.read(reinterpret_cast<char *>(record.packet.data()),
+                       static_cast<std::streamsize>(size)))
+        {
+            _fail = true;
+            return false;
+        }
+        return true;
+    }
+    case PacketCaptureRecord::Type::Tick:
+        return true;
+    }
+    _fail = true;
+    return false;
+}
+
+bool PacketCaptureReader::readVar(std::uint64_t &value)
+{
+    value = 0;
+    for(unsigned shift = 0; shift < 64; shift += 7)
+    {
+        int byte = _file.get();
+        if(byte == std::char_traits<char>::eof())
+            break;
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return true;
+    }
+    _fail = true;
+    return false;
+}
+
+} // namespace cenisys
@@ -0,0 +1,162 @@
+/*
+ * PacketCaptureBackend
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_PACKETCAPTURE_H
+#define CENISYS_PACKETCAPTURE_H
+
+#include "network/packetbuffer.h"
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief Receives the traffic handed to the game.
+//!
+//! Called on the game tick, in the order the game sees the events.
+//!
+class PacketCaptureBackend
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual ~PacketCaptureBackend() = default;
+
+    virtual void openSession(Clock::time_point time, std::uint64_t session) = 0;
+    virtual void receive(Clock::time_point time, std::uint64_t session,
+                         const PacketBuffer &packet) = 0;
+    virtual void closeSession(Clock::time_point time,
+                              std::uint64_t session) = 0;
+    //!
+    //! \brief Called after the events of a tick were handled.
+    //!
+    virtual void endTick(Clock::time_point time) = 0;
+};
+
+//!
+//! \brief An event read back from a capture.
+//!
+struct PacketCaptureRecord
+{
+    enum class Type : std::uint8_t
+    {
+        Open = 1,
+        Receive = 2,
+        Close = 3,
+        Tick = 4,
+    };
+
+    Type type;
+    //! Time since the first record.
+    std::chrono::microseconds time;
+    //! Unset for ticks.
+    std::uint64_t session;
+    //! Only set for received packets.
+    PacketBuffer packet;
+};
+
+//!
+//! \brief Writes the captured traffic to a compact file.
+//!
+//! The file starts with MAGIC and VERSION. Every record is its type byte,
+//! the microseconds since the previous record as a varint, then the session
+//! as a varint unless it is a tick. Received packets follow as a varint
+//! length and the bytes.
+//!
+class PacketCaptureFile : public PacketCaptureBackend
+{
+public:
+    static constexpr char MAGIC[4] = {'C', 'N', 'C', 'P'};
+    static constexpr std::uint8_t VERSION = 1;
+    //! Records are written out in blocks of at least this size.
+    static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+
+    PacketCaptureFile();
+    ~PacketCaptureFile();
+
+    //!
+    //! \brief Start writing to a new file.
+    //! \return false if the file cannot be created.
+    //!
+    bool open(const boost::filesystem::path &file);
+    //!
+    //! \brief Write the buffered records and close the file.
+    //!
+    void close();
+    std::uint64_t getRecords() const { return _records; }
+    std::uint64_t getBytes() const { return _bytes; }
+
+    void openSession(Clock::time_point time, std::uint64_t session);
+    void receive(Clock::time_point time, std::uint64_t session,
+                 const PacketBuffer &packet);
+    void closeSession(Clock::time_point time, std::uint64_t session);
+    void endTick(Clock::time_point time);
+
+private:
+    void writeHeader(PacketCaptureRecord::Type type, Clock::time_point time);
+    void writeVar(std::uint64_t value);
+    void flush();
+
+    boost::filesystem::ofstream _file;
+    std::vector<std::uint8_t> _buffer;
+    Clock::time_point _last;
+    bool _started;
+    std::uint64_t _records;
+    std::uint64_t _bytes;
+};
+
+//!
+//! \brief Reads the records written by PacketCaptureFile.
+//!
+class PacketCaptureReader
+{
+public:
+    PacketCaptureReader();
+
+    //!
+    //! \brief Open a capture and check its header.
+    //! \return false if the file cannot be read or is not a capture.
+    //!
+    bool open(const boost::filesystem::path &file);
+    //!
+    //! \brief Read the next record.
+    //! \return false at the end of the capture or if it is corrupt.
+    //!
+    bool next(PacketCaptureRecord &record);
+    //!
+    //! \brief Whether reading stopped on a corrupt or truncated record.
+    //!
+    bool fail() const { return _fail; }
+
+private:
+    bool readVar(std::uint64_t &value);
+
+    boost::filesystem::ifstream _file;
+    std::chrono::microseconds _time;
+    bool _fail;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_PACKETCAPTURE_H
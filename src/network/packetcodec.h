@@ -0,0 +1,475 @@
+/*
+ * Packet schema codecs
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_PACKETCODEC_H
+#define CENISYS_PACKETCODEC_H
+
+#include "network/binarystream.h"
+#include "network/packetbuffer.h"
+#include <boost/utility/string_ref.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+//!
+//! \brief Declare a field of a packet schema.
+//!
+#define CENISYS_PACKET_FIELD(Packet, Codec, member)                            \
+    ::cenisys::mcpe::Field<Codec, decltype(&Packet::member), &Packet::member>
+
+namespace cenisys
+{
+namespace mcpe
+{
+
+//!
+//! \brief Layout of a packet, given as a specialization deriving from Fields.
+//!
+//! A packet is a plain struct with a static constexpr std::uint8_t ID. Its
+//! schema lists the fields in wire order:
+//!
+//!     template <>
+//!     struct PacketSchema<SetTimePacket>
+//!         : Fields<CENISYS_PACKET_FIELD(SetTimePacket, VarInt32, time),
+//!                  CENISYS_PACKET_FIELD(SetTimePacket, Bool, started)>
+//!     {
+//!     };
+//!
+template <typename Packet>
+struct PacketSchema;
+
+// Codecs describe how one value is put on the wire. Each has a Value type,
+// the smallest encoded size MIN_SIZE, and static size, write and read
+// functions. Invalid data is reported through BinaryReader::fail().
+
+struct U8
+{
+    using Value = std::uint8_t;
+    static constexpr std::size_t MIN_SIZE = 1;
+    static std::size_t size(Value value) { return 1; }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeU8(value);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        value = reader.readU8();
+    }
+};
+
+struct Bool
+{
+    using Value = bool;
+    static constexpr std::size_t MIN_SIZE = 1;
+    static std::size_t size(Value value) { return 1; }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeU8(value ? 1 : 0);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        value = reader.readU8() != 0;
+    }
+};
+
+//! Signed 32-bit big endian integer.
+struct Int32
+{
+    using Value = std::int32_t;
+    static constexpr std::size_t MIN_SIZE = 4;
+    static std::size_t size(Value value) { return 4; }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeU32(static_cast<std::uint32_t>(value));
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        value = static_cast<std::int32_t>(reader.readU32());
+    }
+};
+
+//! Little endian IEEE 754 single.
+struct Float
+{
+    using Value = float;
+    static constexpr std::size_t MIN_SIZE = 4;
+    static std::size_t size(Value value) { return 4; }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeF32LE(value);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        value = reader.readF32LE();
+    }
+};
+
+struct VarUInt32
+{
+    using Value = std::uint32_t;
+    static constexpr std::size_t MIN_SIZE = 1;
+    static std::size_t size(Value value)
+    {
+        return BinaryWriter::varSize(value);
+    }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeVarU64(value);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        value = reader.readVarU32();
+    }
+};
+
+//! Signed varint, zigzag encoded.
+struct VarInt32
+{
+    using Value = std::int32_t;
+    static constexpr std::size_t MIN_SIZE = 1;
+    static std::uint32_t encode(Value value)
+    {
+        return (static_cast<std::uint32_t>(value) << 1) ^
+               static_cast<std::uint32_t>(value >> 31);
+    }
+    static std::size_t size(Value value)
+    {
+        return BinaryWriter::varSize(encode(value));
+    }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeVarU64(encode(value));
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        std::uint32_t raw = reader.readVarU32();
+        value = static_cast<std::int32_t>(raw >> 1) ^
+                -static_cast<std::int32_t>(raw & 1);
+    }
+};
+
+struct VarUInt64
+{
+    using Value = std::uint64_t;
+    static constexpr std::size_t MIN_SIZE = 1;
+    static std::size_t size(Value value)
+    {
+        return BinaryWriter::varSize(value);
+    }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeVarU64(value);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        value = reader.readVarU64();
+    }
+};
+
+//!
+//! \brief Varint length followed by the bytes.
+//!
+//! Decoded strings point into the received packet, which must be kept
+//! alive as long as they are used.
+//!
+struct String
+{
+    using Value = boost::string_ref;
+    static constexpr std::size_t MIN_SIZE = 1;
+    static std::size_t size(Value value)
+    {
+        return BinaryWriter::varSize(value.size()) + value.size();
+    }
+    static void write(BinaryWriter &writer, Value value)
+    {
+        writer.writeVarU64(value.size());
+        writer.writeBytes(value.data(), value.size());
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        std::uint32_t length = reader.readVarU32();
+        const std::uint8_t *data = reader.readBytes(length);
+        value = data ? Value(reinterpret_cast<const char *>(data), length)
+                     : Value();
+    }
+};
+
+struct Vector3
+{
+    float x;
+    float y;
+    float z;
+
+    bool operator==(const Vector3 &other) const
+    {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct Vector3Codec
+{
+    using Value = Vector3;
+    static constexpr std::size_t MIN_SIZE = 12;
+    static std::size_t size(const Value &value) { return 12; }
+    static void write(BinaryWriter &writer, const Value &value)
+    {
+        writer.writeF32LE(value.x);
+        writer.writeF32LE(value.y);
+        writer.writeF32LE(value.z);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        value.x = reader.readF32LE();
+        value.y = reader.readF32LE();
+        value.z = reader.readF32LE();
+    }
+};
+
+struct BlockPosition
+{
+    std::int32_t x;
+    std::uint32_t y;
+    std::int32_t z;
+
+    bool operator==(const BlockPosition &other) const
+    {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+//! Signed x and z, unsigned y.
+struct BlockPositionCodec
+{
+    using Value = BlockPosition;
+    static constexpr std::size_t MIN_SIZE = 3;
+    static std::size_t size(const Value &value)
+    {
+        return VarInt32::size(value.x) + VarUInt32::size(value.y) +
+               VarInt32::size(value.z);
+    }
+    static void write(BinaryWriter &writer, const Value &value)
+    {
+        VarInt32::write(writer, value.x);
+        VarUInt32::write(writer, value.y);
+        VarInt32::write(writer, value.z);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        VarInt32::read(reader, value.x);
+        VarUInt32::read(reader, value.y);
+        VarInt32::read(reader, value.z);
+    }
+};
+
+//!
+//! \brief Varint count followed by the elements.
+//!
+template <typename Codec>
+struct Vector
+{
+    using Value = std::vector<typename Codec::Value>;
+    static constexpr std::size_t MIN_SIZE = 1;
+    static std::size_t size(const Value &value)
+    {
+        std::size_t result = BinaryWriter::varSize(value.size());
+        for(const auto &item : value)
+            result += Codec::size(item);
+        return result;
+    }
+    static void write(BinaryWriter &writer, const Value &value)
+    {
+        writer.writeVarU64(value.size());
+        for(const auto &item : value)
+            Codec::write(writer, item);
+    }
+    static void read(BinaryReader &reader, Value &value)
+    {
+        std::uint32_t count = reader.readVarU32();
+        // Never allocate more than the data could possibly hold
+        if(count > reader.remaining() / Codec::MIN_SIZE)
+        {
+            reader.fail();
+            return;
+        }
+        value.resize(count);
+        for(auto &item : value)
+        {
+            Codec::read(reader, item);
+            if(!reader.ok())
+                return;
+        }
+    }
+};
+
+template <typename Codec>
+constexpr std::size_t Vector<Codec>::MIN_SIZE;
+
+template <typename Codec, typename Member, Member member>
+struct Field;
+
+//!
+//! \brief Binds a codec to a member of the packet.
+//!
+template <typename Codec, typename Packet, typename T, T Packet::*member>
+struct Field<Codec, T Packet::*, member>
+{
+    static_assert(std::is_same<T, typename Codec::Value>::value,
+                  "The member does not have the type of the codec");
+    static constexpr std::size_t MIN_SIZE = Codec::MIN_SIZE;
+
+    static std::size_t size(const Packet &packet)
+    {
+        return Codec::size(packet.*member);
+    }
+    static void write(BinaryWriter &writer, const Packet &packet)
+    {
+        Codec::write(writer, packet.*member);
+    }
+    static void read(BinaryReader &reader, Packet &packet)
+    {
+        Codec::read(reader, packet.*member);
+    }
+    static bool equal(const Packet &a, const Packet &b)
+    {
+        return a.*member == b.*member;
+    }
+};
+
+//!
+//! \brief Sum of the arguments, usable in constant expressions.
+//!
+constexpr std::size_t sum() { return 0; }
+template <typename... Rest>
+constexpr std::size_t sum(std::size_t first, Rest... rest)
+{
+    return first + sum(rest...);
+}
+
+//!
+//! \brief The fields of a packet, in wire order.
+//!
+template <typename... Field>
+struct Fields
+{
+    //! Smallest encoded size of the fields.
+    static constexpr std::size_t MIN_SIZE = sum(Field::MIN_SIZE...);
+
+    template <typename Packet>
+    static std::size_t size(const Packet &packet)
+    {
+        std::size_t result = 0;
+        // Braced lists are evaluated in order
+        int expand[] = {0, (result += Field::size(packet), 0)...};
+        static_cast<void>(expand);
+        return result;
+    }
+
+    template <typename Packet>
+    static void write(BinaryWriter &writer, const Packet &packet)
+    {
+        int expand[] = {0, (Field::write(writer, packet), 0)...};
+        static_cast<void>(expand);
+    }
+
+    template <typename Packet>
+    static void read(BinaryReader &reader, Packet &packet)
+    {
+        if(reader.remaining() < MIN_SIZE)
+        {
+            reader.fail();
+            return;
+        }
+        int expand[] = {0, (Field::read(reader, packet), 0)...};
+        static_cast<void>(expand);
+    }
+
+    template <typename Packet>
+    static bool equal(const Packet &a, const Packet &b)
+    {
+        bool result = true;
+        int expand[] = {0, (result = result && Field::equal(a, b), 0)...};
+        static_cast<void>(expand);
+        return result;
+    }
+};
+
+template <typename... Field>
+constexpr std::size_t Fields<Field...>::MIN_SIZE;
+
+//!
+//! \brief Encoded size of the packet, including its id.
+//!
+template <typename Packet>
+std::size_t packetSize(const Packet &packet)
+{
+    return 1 + PacketSchema<Packet>::size(packet);
+}
+
+//!
+//! \brief Write the id and the fields of the packet.
+//!
+template <typename Packet>
+void encodePacket(BinaryWriter &writer, const Packet &packet)
+{
+    writer.writeU8(Packet::ID);
+    PacketSchema<Packet>::write(writer, packet);
+}
+
+//!
+//! \brief Encode the packet into a buffer of the exact size.
+//!
+template <typename Packet>
+PacketBuffer encodePacket(BufferPool &pool, const Packet &packet)
+{
+    PacketBuffer result = pool.allocate(packetSize(packet));
+    BinaryWriter writer(result.data(), result.size());
+    encodePacket(writer, packet);
+    return result;
+}
+
+//!
+//! \brief Read a packet, starting with its id.
+//! \return false if the id does not match or the data is truncated or
+//! invalid. Trailing bytes are ignored.
+//!
+template <typename Packet>
+bool decodePacket(BinaryReader &reader, Packet &packet)
+{
+    if(reader.readU8() != Packet::ID)
+        reader.fail();
+    if(reader.ok())
+        PacketSchema<Packet>::read(reader, packet);
+    return reader.ok();
+}
+
+//!
+//! \brief Compare every field of two packets.
+//!
+template <typename Packet>
+bool packetsEqual(const Packet &a, const Packet &b)
+{
+    return PacketSchema<Packet>::equal(a, b);
+}
+
+} // namespace mcpe
+} // namespace cenisys
+
+#endif // CENISYS_PACKETCODEC_H
@@ -0,0 +1,171 @@
+/*
+ * PacketDispatcher
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/packetdispatcher.h"
+#include "network/mcpepackets.h"
+#include <algorithm>
+#include <new>
+
+namespace cenisys
+{
+
+constexpr std::size_t PacketDispatcher::MAX_BATCH_SIZE;
+
+PacketDispatcher::PacketDispatcher() : _batchSize(0)
+{
+    resetStats();
+    _inflater.zalloc = Z_NULL;
+    _inflater.zfree = Z_NULL;
+    _inflater.opaque = Z_NULL;
+    _inflater.next_in = Z_NULL;
+    _inflater.avail_in = 0;
+    if(inflateInit(&_inflater) != Z_OK)
+        throw std::bad_alloc();
+}
+
+PacketDispatcher::~PacketDispatcher()
+{
+    inflateEnd(&_inflater);
+}
+
+void PacketDispatcher::registerHandler(std::uint8_t id, Handler &&handler)
+{
+    _handlers[id] = std::move(handler);
+}
+
+void PacketDispatcher::unregisterHandler(std::uint8_t id)
+{
+    _handlers[id] = nullptr;
+}
+
+bool PacketDispatcher::dispatch(std::uint64_t session,
+                                const PacketBuffer &packet)
+{
+    BinaryReader reader(packet.data(), packet.size());
+    if(reader.readU8() != mcpe::GAME_PACKET || reader.remaining() == 0)
+    {
+        _malformed++;
+        return false;
+    }
+    if(*reader.current() != mcpe::BATCH_PACKET)
+        return handle(session, reader.current(), reader.remaining());
+
+    reader.readU8();
+    std::uint32_t size = reader.readVarU32();
+    const std::uint8_t *compressed = reader.readBytes(size);
+    Clock::time_point start = Clock::now();
+    bool inflated = compressed && inflateBatch(compressed, size);
+    record(mcpe::BATCH_PACKET, start);
+    if(!inflated)
+    {
+        _malformed++;
+        return false;
+    }
+    BinaryReader packets(_batch.data(), _batchSize);
+    bool result = true;
+    while(packets.remaining() > 0)
+    {
+        std::uint32_t packetSize = packets.readVarU32();
+        const std::uint8_t *data = packets.readBytes(packetSize);
+        if(!data)
+        {
+            _malformed++;
+            return false;
+        }
+        result = handle(session, data, packetSize) && result;
+    }
+    return result;
+}
+
+void PacketDispatcher::resetStats()
+{
+    _stats.fill({0, Clock::duration::zero(), Clock::duration::zero()});
+    _unhandled = 0;
+    _malformed = 0;
+}
+
+bool PacketDispatcher::handle(std::uint64_t session, const std::uint8_t *data,
+                              std::size_t size)
+{
+    // Batches may not nest
+    if(size == 0 || data[0] == mcpe::BATCH_PACKET)
+    {
+        _malformed++;
+        return false;
+    }
+    const Handler &handler = _handlers[data[0]];
+    if(!handler)
+    {
+        _unhandled++;
+        return true;
+    }
+    BinaryReader reader(data, size);
+    Clock::time_point start = Clock::now();
+    handler(session, reader);
+    record(data[0], start);
+    if(!reader.ok())
+    {
+        _malformed++;
+        return false;
+    }
+    return true;
+}
+
+bool PacketDispatcher::inflateBatch(const std::uint8_t *data,
+                                    std::size_t size)
+{
+    inflateReset(&_inflater);
+    _inflater.next_in = const_cast<Bytef *>(data);
+    _inflater.avail_in = static_cast<uInt>(size);
+    _batchSize = 0;
+    while(true)
+    {
+        if(_batchSize == _batch.size())
+        {
+            if(_batch.size() >= MAX_BATCH_SIZE)
+                return false;
+            _batch.resize(std::min(
+                MAX_BATCH_SIZE, std::max<std::size_t>(_batch.size() * 2,
+                                                      size * 4 + 1024)));
+        }
+        _inflater.next_out = _batch.data() + _batchSize;
+        _inflater.avail_out = static_cast<uInt>(_batch.size() - _batchSize);
+        int result = inflate(&_inflater, Z_NO_FLUSH);
+        _batchSize = _batch.size() - _inflater.avail_out;
+        if(result == Z_STREAM_END)
+            return true;
+        // Without room left, an error only means the output is full
+        if(result != Z_OK && !(result == Z_BUF_ERROR && !_inflater.avail_out))
+            return false;
+        if(_inflater.avail_in == 0 && _inflater.avail_out != 0)
+            return false;
+    }
+}
+
+void PacketDispatcher::record(std::uint8_t id, Clock::time_point start)
+{
+    Clock::duration elapsed = Clock::now() - start;
+    HandlerStats &stats = _stats[id];
+    stats.count++;
+    stats.total += elapsed;
+    stats.max = std::max(stats.max, elapsed);
+}
+
+} // namespace cenisys
@@ -0,0 +1,122 @@
+/*
+ * PacketDispatcher
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_PACKETDISPATCHER_H
+#define CENISYS_PACKETDISPATCHER_H
+
+#include "network/binarystream.h"
+#include "network/packetbuffer.h"
+#include "network/packetcodec.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <zlib.h>
+
+namespace cenisys
+{
+
+//!
+//! \brief Hands the game packets of a session to their handlers.
+//!
+//! Unwraps game packets and batches, then calls the handler registered for
+//! the id of every packet. The time spent in every handler is recorded per
+//! id, and the time spent inflating batches under BATCH_PACKET.
+//!
+//! Used by the game tick only, so it is not thread-safe.
+//!
+class PacketDispatcher
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    //!
+    //! \brief Handles one packet. The reader starts at the packet id.
+    //!
+    //! Handlers mark the packet as malformed by failing the reader.
+    //!
+    using Handler =
+        std::function<void(std::uint64_t session, BinaryReader &reader)>;
+
+    struct HandlerStats
+    {
+        std::uint64_t count;
+        Clock::duration total;
+        Clock::duration max;
+    };
+
+    //! Largest batch accepted once inflated.
+    static constexpr std::size_t MAX_BATCH_SIZE = 1 << 21;
+
+    PacketDispatcher();
+    ~PacketDispatcher();
+    PacketDispatcher(const PacketDispatcher &) = delete;
+    PacketDispatcher &operator=(const PacketDispatcher &) = delete;
+
+    void registerHandler(std::uint8_t id, Handler &&handler);
+    //!
+    //! \brief Register a handler taking the decoded packet.
+    //!
+    //! Packets which fail to decode count as malformed.
+    //!
+    template <typename Packet, typename Fn>
+    void registerHandler(Fn &&handler)
+    {
+        registerHandler(Packet::ID, [handler = std::forward<Fn>(handler)](
+                                        std::uint64_t session,
+                                        BinaryReader &reader) {
+            Packet packet;
+            if(mcpe::decodePacket(reader, packet))
+                handler(session, packet);
+        });
+    }
+    void unregisterHandler(std::uint8_t id);
+
+    //!
+    //! \brief Dispatch a packet received from a session.
+    //! \return false if the packet or one in its batch is malformed.
+    //!
+    bool dispatch(std::uint64_t session, const PacketBuffer &packet);
+
+    const HandlerStats &getStats(std::uint8_t id) const { return _stats[id]; }
+    //! Packets without a handler.
+    std::uint64_t getUnhandled() const { return _unhandled; }
+    std::uint64_t getMalformed() const { return _malformed; }
+    void resetStats();
+
+private:
+    bool handle(std::uint64_t session, const std::uint8_t *data,
+                std::size_t size);
+    bool inflateBatch(const std::uint8_t *data, std::size_t size);
+    void record(std::uint8_t id, Clock::time_point start);
+
+    std::array<Handler, 256> _handlers;
+    std::array<HandlerStats, 256> _stats;
+    std::uint64_t _unhandled;
+    std::uint64_t _malformed;
+    z_stream _inflater;
+    //! Inflated batch, reused between packets.
+    std::vector<std::uint8_t> _batch;
+    std::size_t _batchSize;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_PACKETDISPATCHER_H
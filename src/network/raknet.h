@@ -0,0 +1,206 @@
+/*
+ * Constants and helpers of the RakNet protocol.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_RAKNET_H
+#define CENISYS_RAKNET_H
+
+#include "network/binarystream.h"
+#include <boost/asio/ip/udp.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+namespace cenisys
+{
+
+namespace raknet
+{
+
+enum MessageId : std::uint8_t
+{
+    ConnectedPing = 0x00,
+    UnconnectedPing = 0x01,
+    UnconnectedPingOpenConnections = 0x02,
+    ConnectedPong = 0x03,
+    OpenConnectionRequest1 = 0x05,
+    OpenConnectionReply1 = 0x06,
+    OpenConnectionRequest2 = 0x07,
+    OpenConnectionReply2 = 0x08,
+    ConnectionRequest = 0x09,
+    ConnectionRequestAccepted = 0x10,
+    NewIncomingConnection = 0x13,
+    NoFreeIncomingConnections = 0x14,
+    DisconnectionNotification = 0x15,
+    IncompatibleProtocolVersion = 0x19,
+    UnconnectedPong = 0x1c,
+    GamePacket = 0xfe,
+};
+
+//! Flags in the first byte of a connected datagram.
+enum DatagramFlag : std::uint8_t
+{
+    Valid = 0x80,
+    Ack = 0x40,
+    Nack = 0x20,
+    NeedsBAndAs = 0x04,
+};
+
+//! Delivery guarantee of an encapsulated packet.
+enum class Reliability : std::uint8_t
+{
+    Unreliable = 0,
+    UnreliableSequenced = 1,
+    Reliable = 2,
+    ReliableOrdered = 3,
+    ReliableSequenced = 4,
+};
+
+inline bool isReliable(Reliability reliability)
+{
+    return reliability == Reliability::Reliable ||
+           reliability == Reliability::ReliableOrdered ||
+           reliability == Reliability::ReliableSequenced;
+}
+
+//! Sequenced packets carry an order index as well.
+inline bool isOrdered(Reliability reliability)
+{
+    return reliability == Reliability::UnreliableSequenced ||
+           reliability == Reliability::ReliableOrdered ||
+           reliability == Reliability::ReliableSequenced;
+}
+
+inline bool isSequenced(Reliability reliability)
+{
+    return reliability == Reliability::UnreliableSequenced ||
+           reliability == Reliability::ReliableSequenced;
+}
+
+//! Flag in the header of an encapsulated packet which is split.
+constexpr std::uint8_t SPLIT_FLAG = 0x10;
+constexpr std::size_t ORDER_CHANNELS = 32;
+//! Header of a connected datagram: flags and sequence number.
+constexpr std::size_t DATAGRAM_HEADER_SIZE = 4;
+//! Largest header of an encapsulated packet.
+constexpr std::size_t MAX_FRAME_HEADER_SIZE = 23;
+
+//!
+//! \brief Difference of two 24 bit sequence numbers, aware of wrap around.
+//!
+inline std::int32_t sequenceDiff(std::uint32_t a, std::uint32_t b)
+{
+    return static_cast<std::int32_t>((a - b) << 8) >> 8;
+}
+
+constexpr std::uint32_t SEQUENCE_MASK = 0xffffff;
+
+constexpr std::uint8_t PROTOCOL_VERSION = 8;
+constexpr std::size_t UDP_HEADER_SIZE = 28;
+constexpr std::size_t MIN_MTU = 400;
+constexpr std::size_t MAX_MTU = 1492;
+
+constexpr std::uint8_t OFFLINE_MESSAGE_ID[16] = {
+    0x00, 0xff, 0xff, 0x00, 0xfe, 0xfe, 0xfe, 0xfe,
+    0xfd, 0xfd, 0xfd, 0xfd, 0x12, 0x34, 0x56, 0x78};
+
+inline bool readMagic(BinaryReader &reader)
+{
+    const std::uint8_t *magic = reader.readBytes(sizeof(OFFLINE_MESSAGE_ID));
+    return magic && std::memcmp(magic, OFFLINE_MESSAGE_ID,
+                                sizeof(OFFLINE_MESSAGE_ID)) == 0;
+}
+
+inline void writeMagic(BinaryWriter &writer)
+{
+    writer.writeBytes(OFFLINE_MESSAGE_ID, sizeof(OFFLINE_MESSAGE_ID));
+}
+
+inline boost::asio::ip::udp::endpoint readAddress(BinaryReader &reader)
+{
+    std::uint8_t version = reader.readU8();
+    if(version == 4)
+    {
+        boost::asio::ip::address_v4::bytes_type bytes;
+        for(auto &item : bytes)
+            item = ~reader.readU8();
+        std::uint16_t port = reader.readU16();
+        return {boost::asio::ip::address_v4(bytes), port};
+    }
+    if(version == 6)
+    {
+        reader.readU16LE(); // Address family
+        std::uint16_t port = reader.readU16();
+        reader.readU32(); // Flow info
+        boost::asio::ip::address_v6::bytes_type bytes;
+        for(auto &item : bytes)
+            item = reader.readU8();
+        std::uint32_t scope = reader.readU32();
+        return {boost::asio::ip::address_v6(bytes, scope), port};
+    }
+    reader.readBytes(reader.remaining() + 1);
+    return {};
+}
+
+inline void writeAddress(BinaryWriter &writer,
+                         const boost::asio::ip::udp::endpoint &endpoint)
+{
+    if(endpoint.address().is_v4())
+    {
+        writer.writeU8(4);
+        for(auto item : endpoint.address().to_v4().to_bytes())
+            writer.writeU8(~item);
+        writer.writeU16(endpoint.port());
+    }
+    else
+    {
+        boost::asio::ip::address_v6 address = endpoint.address().to_v6();
+        writer.writeU8(6);
+        writer.writeU16LE(23); // AF_INET6 as used by the reference client
+        writer.writeU16(endpoint.port());
+        writer.writeU32(0);
+        for(auto item : address.to_bytes())
+            writer.writeU8(item);
+        writer.writeU32(static_cast<std::uint32_t>(address.scope_id()));
+    }
+}
+
+struct EndpointHash
+{
+    std::size_t operator()(const boost::asio::ip::udp::endpoint &endpoint) const
+    {
+        // FNV-1a over the raw socket address
+        const auto *data =
+            reinterpret_cast<const std::uint8_t *>(endpoint.data());
+        std::uint64_t hash = 14695981039346656037ull;
+        for(std::size_t i = 0; i < endpoint.size(); i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return static_cast<std::size_t>(hash);
+    }
+};
+
+} // namespace raknet
+
+} // namespace cenisys
+
+#endif // CENISYS_RAKNET_H
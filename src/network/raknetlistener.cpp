@@ -0,0 +1,528 @@
+/*
+ * RakNetListener
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/raknetlistener.h"
+#include <algorithm>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <cerrno>
+#include <cstring>
+#if defined(HAVE_UDP_SEGMENT)
+#include <netinet/udp.h>
+#endif
+
+namespace
+{
+
+// MCPE protocol shown in the unconnected pong
+constexpr auto MCPE_PROTOCOL = "100";
+constexpr auto MCPE_VERSION = "1.0.0";
+
+void writeDecimal(cenisys::BinaryWriter &writer, std::size_t value)
+{
+    char digits[20];
+    std::size_t count = 0;
+    do
+    {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    while(count > 0)
+        writer.writeU8(static_cast<std::uint8_t>(digits[--count]));
+}
+
+} // namespace
+
+namespace cenisys
+{
+
+constexpr std::size_t RakNetListener::BATCH_SIZE;
+constexpr std::size_t RakNetListener::BUFFER_SIZE;
+constexpr std::size_t RakNetListener::POOL_SLAB_BLOCKS;
+constexpr std::size_t RakNetListener::POOL_MAX_BLOCKS;
+constexpr std::size_t RakNetListener::SEND_BATCH_SIZE;
+constexpr std::size_t RakNetListener::MAX_SEGMENTS;
+constexpr std::size_t RakNetListener::MAX_SEGMENTED_SIZE;
+constexpr std::chrono::steady_clock::duration RakNetListener::UPDATE_INTERVAL;
+
+RakNetListener::SendStats &RakNetListener::SendStats::
+operator+=(const SendStats &other)
+{
+    flushes += other.flushes;
+    syscalls += other.syscalls;
+    datagrams += other.datagrams;
+    segmented += other.segmented;
+    return *this;
+}
+
+RakNetListener::RakNetListener(boost::asio::io_service &ioService,
+                               const RakNetListener::Options &options,
+                               RakNetSessionHandler &handler)
+    : _bufferPool(BUFFER_SIZE, POOL_SLAB_BLOCKS, POOL_MAX_BLOCKS),
+      _socket(ioService), _updateTimer(ioService), _options(options),
+      _handler(handler), _running(false),
+      _sendData(SEND_BATCH_SIZE * BUFFER_SIZE), _segmentation(false),
+      _flushes(0), _syscalls(0), _datagrams(0), _segmented(0)
+{
+    if(!_options.sessionCount)
+        _options.sessionCount = std::make_shared<std::atomic<std::size_t>>(0);
+    if(!_options.sessionIds)
+        _options.sessionIds = std::make_shared<std::atomic<std::uint64_t>>(0);
+    _socket.open(_options.endpoint.protocol());
+    if(_options.reusePort)
+    {
+#if defined(SO_REUSEPORT)
+        using ReusePort =
+            boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                        SO_REUSEPORT>;
+        _socket.set_option(ReusePort(true));
+#else
+        throw boost::system::system_error(
+            boost::asio::error::operation_not_supported);
+#endif
+    }
+    _socket.bind(_options.endpoint);
+    _options.maxMtu =
+        std::max(raknet::MIN_MTU, std::min(raknet::MAX_MTU, _options.maxMtu));
+    _pongPrefix = std::string("MCPE;") + _options.motd + ';' + MCPE_PROTOCOL +
+                  ';' + MCPE_VERSION + ';';
+    _socket.non_blocking(true);
+    _sessions.reserve(_options.maxSessions);
+#if defined(HAVE_RECVMMSG)
+    for(std::size_t i = 0; i < BATCH_SIZE; i++)
+    {
+        _vectors[i].iov_base = _receiveBuffers[i].data();
+        _vectors[i].iov_len = BUFFER_SIZE;
+    }
+#endif
+    _sendQueue.reserve(SEND_BATCH_SIZE);
+#if defined(HAVE_SENDMMSG) && defined(HAVE_UDP_SEGMENT)
+    // Kernels without UDP_SEGMENT reject the option
+    if(_options.segmentationOffload)
+    {
+        int segment = 0;
+        socklen_t length = sizeof(segment);
+        _segmentation = getsockopt(_socket.native_handle(), SOL_UDP,
+                                   UDP_SEGMENT, &segment, &length) == 0;
+    }
+#endif
+}
+
+RakNetListener::~RakNetListener()
+{
+}
+
+void RakNetListener::start()
+{
+    _running = true;
+    asyncReceive();
+    asyncUpdate();
+}
+
+void RakNetListener::stop()
+{
+    if(!_running)
+        return;
+    _running = false;
+    RakNetSession::Clock::time_point now = RakNetSession::Clock::now();
+    for(const auto &item : _sessions)
+    {
+        item.second->disconnect(now);
+        _handler.close(*item.second);
+    }
+    flush();
+    boost::system::error_code ec;
+    _socket.close(ec);
+    _updateTimer.cancel(ec);
+    *_options.sessionCount -= _sessions.size();
+    _sessions.clear();
+}
+
+boost::asio::ip::udp::endpoint RakNetListener::getLocalEndpoint() const
+{
+    return _socket.local_endpoint();
+}
+
+std::size_t RakNetListener::getSessionCount() const
+{
+    return *_options.sessionCount;
+}
+
+RakNetListener::SendStats RakNetListener::getSendStats() const
+{
+    SendStats result;
+    result.flushes = _flushes.load(std::memory_order_relaxed);
+    result.syscalls = _syscalls.load(std::memory_order_relaxed);
+    result.datagrams = _datagrams.load(std::memory_order_relaxed);
+    result.segmented = _segmented.load(std::memory_order_relaxed);
+    return result;
+}
+
+void RakNetListener::sendTo(const boost::asio::ip::udp::endpoint &endpoint,
+                            const std::uint8_t *data, std::size_t size)
+{
+    if(size > BUFFER_SIZE)
+        return;
+    if(_sendQueue.size() == SEND_BATCH_SIZE)
+        flush();
+    std::size_t offset = _sendQueue.empty() ? 0
+                                            : _sendQueue.back().offset +
+                                                  _sendQueue.back().size;
+    std::memcpy(_sendData.data() + offset, data, size);
+    _sendQueue.push_back({endpoint, offset, size});
+}
+
+void RakNetListener::flush()
+{
+    if(_sendQueue.empty())
+        return;
+    _flushes.fetch_add(1, std::memory_order_relaxed);
+    _datagrams.fetch_add(_sendQueue.size(), std::memory_order_relaxed);
+#if defined(HAVE_SENDMMSG)
+    std::size_t first = 0;
+    while(first < _sendQueue.size())
+        first = sendMessages(first);
+#else
+    for(const auto &item : _sendQueue)
+    {
+        boost::system::error_code ec;
+        // Datagrams are dropped when the socket buffer is full
+        _socket.send_to(
+            boost::asio::buffer(_sendData.data() + item.offset, item.size),
+            item.endpoint, 0, ec);
+        _syscalls.fetch_add(1, std::memory_order_relaxed);
+    }
+#endif
+    _sendQueue.clear();
+}
+
+#if defined(HAVE_SENDMMSG)
+std::size_t RakNetListener::sendMessages(std::size_t first)
+{
+    // Build one message per datagram, or per run of datagrams to the same
+    // client which the kernel can split again: equal sizes, except for a
+    // shorter last one
+    std::size_t count = 0;
+    for(std::size_t i = first; i < _sendQueue.size(); count++)
+    {
+        const QueuedDatagram &head = _sendQueue[i];
+        std::size_t end = i + 1;
+        std::size_t total = head.size;
+        while(_segmentation && end < _sendQueue.size() &&
+              end - i < MAX_SEGMENTS &&
+              _sendQueue[end - 1].size == head.size &&
+              _sendQueue[end].size <= head.size &&
+              total + _sendQueue[end].size <= MAX_SEGMENTED_SIZE &&
+              _sendQueue[end].endpoint == head.endpoint)
+        {
+            total += _sendQueue[end].size;
+            end++;
+        }
+
+        msghdr &header = _sendMessages[count].msg_hdr;
+        header = {};
+        header.msg_name = const_cast<sockaddr *>(head.endpoint.data());
+        header.msg_namelen = static_cast<socklen_t>(head.endpoint.size());
+        _sendVectors[count].iov_base = _sendData.data() + head.offset;
+        _sendVectors[count].iov_len = total;
+        header.msg_iov = &_sendVectors[count];
+        header.msg_iovlen = 1;
+#if defined(HAVE_UDP_SEGMENT)
+        if(end - i > 1)
+        {
+            header.msg_control = _sendControls[count].buffer;
+            header.msg_controllen = sizeof(_sendControls[count].buffer);
+            cmsghdr *control = CMSG_FIRSTHDR(&header);
+            control->cmsg_level = SOL_UDP;
+            control->cmsg_type = UDP_SEGMENT;
+            control->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+            std::uint16_t segment = static_cast<std::uint16_t>(head.size);
+            std::memcpy(CMSG_DATA(control), &segment, sizeof(segment));
+        }
+#endif
+        _sendFirsts[count] = i;
+        i = end;
+    }
+
+    for(std::size_t sent = 0; sent < count;)
+    {
+        int result = sendmmsg(_socket.native_handle(), &_sendMessages[sent],
+                              static_cast<unsigned int>(count - sent), 0);
+        _syscalls.fetch_add(1, std::memory_order_relaxed);
+        if(result > 0)
+        {
+            for(std::size_t end = sent + result; sent < end; sent++)
+            {
+                if(!_sendMessages[sent].msg_hdr.msg_control)
+                    continue;
+                std::size_t next = sent + 1 < count ? _sendFirsts[sent + 1]
+                                                    : _sendQueue.size();
+                _segmented.fetch_add(next - _sendFirsts[sent],
+                                     std::memory_order_relaxed);
+            }
+            continue;
+        }
+        if(errno == EINTR)
+            continue;
+        // Datagrams are dropped when the socket buffer is full
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        if(_sendMessages[sent].msg_hdr.msg_control)
+        {
+            // The device cannot segment; send the rest one by one
+            _segmentation = false;
+            return _sendFirsts[sent];
+        }
+        // Errors of a single client, such as an ICMP unreachable, must not
+        // hold back the others
+        sent++;
+    }
+    return _sendQueue.size();
+}
+#endif
+
+void RakNetListener::asyncReceive()
+{
+    _socket.async_receive(
+        boost::asio::null_buffers(),
+        [ this, self(shared_from_this()) ](const boost::system::error_code &ec,
+                                           std::size_t bytes_transferred) {
+            if(ec == boost::asio::error::operation_aborted || !_running)
+                return;
+            receiveBatch();
+            flush();
+            asyncReceive();
+        });
+}
+
+void RakNetListener::asyncUpdate()
+{
+    _updateTimer.expires_from_now(UPDATE_INTERVAL);
+    _updateTimer.async_wait([ this, self(shared_from_this()) ](
+        const boost::system::error_code &ec) {
+        if(ec == boost::asio::error::operation_aborted || !_running)
+            return;
+        RakNetSession::Clock::time_point now = RakNetSession::Clock::now();
+        for(auto it = _sessions.begin(); it != _sessions.end();)
+        {
+            RakNetSession &session = *it->second;
+            if(session.isClosed() ||
+               session.getLastReceive() < now - _options.timeout)
+            {
+                _handler.close(session);
+                it = _sessions.erase(it);
+                (*_options.sessionCount)--;
+            }
+            else
+            {
+                session.update(now);
+                ++it;
+            }
+        }
+        flush();
+        asyncUpdate();
+    });
+}
+
+void RakNetListener::receiveBatch()
+{
+#if defined(HAVE_RECVMMSG)
+    for(;;)
+    {
+        for(std::size_t i = 0; i < BATCH_SIZE; i++)
+        {
+            msghdr &header = _messages[i].msg_hdr;
+            header = {};
+            header.msg_name = &_addresses[i];
+            header.msg_namelen = sizeof(_addresses[i]);
+            header.msg_iov = &_vectors[i];
+            header.msg_iovlen = 1;
+        }
+        int count = recvmmsg(_socket.native_handle(), _messages.data(),
+                             BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            break;
+        for(int i = 0; i < count; i++)
+        {
+            boost::asio::ip::udp::endpoint endpoint;
+            std::size_t length = _messages[i].msg_hdr.msg_namelen;
+            if(length > endpoint.capacity())
+                continue;
+            std::memcpy(endpoint.data(), &_addresses[i], length);
+            endpoint.resize(length);
+            handleDatagram(endpoint, _receiveBuffers[i].data(),
+                           _messages[i].msg_len);
+        }
+        if(static_cast<std::size_t>(count) < BATCH_SIZE)
+            break;
+    }
+#else
+    for(std::size_t i = 0; i < BATCH_SIZE; i++)
+    {
+        boost::system::error_code ec;
+        boost::asio::ip::udp::endpoint endpoint;
+        std::size_t size = _socket.receive_from(
+            boost::asio::buffer(_receiveBuffers[0]), endpoint, 0, ec);
+        if(ec)
+            break;
+        handleDatagram(endpoint, _receiveBuffers[0].data(), size);
+    }
+#endif
+}
+
+void RakNetListener::handleDatagram(
+    const boost::asio::ip::udp::endpoint &endpoint, const std::uint8_t *data,
+    std::size_t size)
+{
+    if(size == 0)
+        return;
+    if(data[0] & raknet::Valid)
+    {
+        auto it = _sessions.find(endpoint);
+        if(it == _sessions.end())
+            return;
+        it->second->receive(data, size, RakNetSession::Clock::now());
+        return;
+    }
+
+    BinaryReader reader(data + 1, size - 1);
+    switch(data[0])
+    {
+    case raknet::UnconnectedPing:
+    case raknet::UnconnectedPingOpenConnections:
+        handleUnconnectedPing(endpoint, reader);
+        break;
+    case raknet::OpenConnectionRequest1:
+        handleOpenConnectionRequest1(endpoint, reader, size);
+        break;
+    case raknet::OpenConnectionRequest2:
+        handleOpenConnectionRequest2(endpoint, reader);
+        break;
+    default:
+        break;
+    }
+}
+
+void RakNetListener::handleUnconnectedPing(
+    const boost::asio::ip::udp::endpoint &endpoint, BinaryReader &reader)
+{
+    std::uint64_t time = reader.readU64();
+    if(!raknet::readMagic(reader))
+        return;
+
+    BinaryWriter writer(_sendBuffer.data(), _sendBuffer.size());
+    writer.writeU8(raknet::UnconnectedPong);
+    writer.writeU64(time);
+    writer.writeU64(_options.guid);
+    raknet::writeMagic(writer);
+    std::uint8_t *length = writer.skip(2);
+    std::size_t begin = writer.size();
+    writer.writeBytes(_pongPrefix.data(), _pongPrefix.size());
+    writeDecimal(writer, *_options.sessionCount);
+    writer.writeU8(';');
+    writeDecimal(writer, _options.maxSessions);
+    if(!writer.ok())
+        return;
+    std::size_t stringSize = writer.size() - begin;
+    length[0] = static_cast<std::uint8_t>(stringSize >> 8);
+    length[1] = static_cast<std::uint8_t>(stringSize);
+    sendTo(endpoint, writer.data(), writer.size());
+}
+
+void RakNetListener::handleOpenConnectionRequest1(
+    const boost::asio::ip::udp::endpoint &endpoint, BinaryReader &reader,
+    std::size_t size)
+{
+    if(!raknet::readMagic(reader))
+        return;
+    std::uint8_t protocol = reader.readU8();
+    if(!reader.ok())
+        return;
+
+    BinaryWriter writer(_sendBuffer.data(), _sendBuffer.size());
+    if(protocol != raknet::PROTOCOL_VERSION)
+    {
+        writer.writeU8(raknet::IncompatibleProtocolVersion);
+        writer.writeU8(raknet::PROTOCOL_VERSION);
+        raknet::writeMagic(writer);
+        writer.writeU64(_options.guid);
+    }
+    else
+    {
+        // The request is padded to the MTU the client is trying
+        std::size_t mtu =
+            std::min(size + raknet::UDP_HEADER_SIZE, _options.maxMtu);
+        writer.writeU8(raknet::OpenConnectionReply1);
+        raknet::writeMagic(writer);
+        writer.writeU64(_options.guid);
+        writer.writeU8(0); // No security
+        writer.writeU16(static_cast<std::uint16_t>(mtu));
+    }
+    sendTo(endpoint, writer.data(), writer.size());
+}
+
+void RakNetListener::handleOpenConnectionRequest2(
+    const boost::asio::ip::udp::endpoint &endpoint, BinaryReader &reader)
+{
+    if(!raknet::readMagic(reader))
+        return;
+    raknet::readAddress(reader);
+    std::size_t mtu = reader.readU16();
+    std::uint64_t guid = reader.readU64();
+    if(!reader.ok() || mtu < raknet::MIN_MTU)
+        return;
+    mtu = std::min(mtu, _options.maxMtu);
+
+    BinaryWriter writer(_sendBuffer.data(), _sendBuffer.size());
+    auto it = _sessions.find(endpoint);
+    if(it == _sessions.end())
+    {
+        // Reserve a slot first, other listeners may be racing for it
+        if(_options.sessionCount->fetch_add(1) >= _options.maxSessions)
+        {
+            (*_options.sessionCount)--;
+            writer.writeU8(raknet::NoFreeIncomingConnections);
+            raknet::writeMagic(writer);
+            writer.writeU64(_options.guid);
+            sendTo(endpoint, writer.data(), writer.size());
+            return;
+        }
+        it = _sessions
+                 .emplace(endpoint,
+                          std::make_shared<RakNetSession>(
+                              *this, _handler, (*_options.sessionIds)++,
+                              endpoint, guid, mtu,
+                              RakNetSession::Clock::now()))
+                 .first;
+        _handler.open(*it->second);
+    }
+    // Replies to retransmitted requests are sent again
+    writer.writeU8(raknet::OpenConnectionReply2);
+    raknet::writeMagic(writer);
+    writer.writeU64(_options.guid);
+    raknet::writeAddress(writer, endpoint);
+    writer.writeU16(static_cast<std::uint16_t>(it->second->getMtu()));
+    writer.writeU8(0); // No encryption
+    sendTo(endpoint, writer.data(), writer.size());
+}
+
+} // namespace cenisys
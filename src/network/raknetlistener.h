@@ -0,0 +1,246 @@
+/*
+ * RakNetListener
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_RAKNETLISTENER_H
+#define CENISYS_RAKNETLISTENER_H
+
+#include "config.h"
+#include "network/packetbuffer.h"
+#include "network/raknet.h"
+#include "network/raknetsession.h"
+#include <array>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+#include <sys/socket.h>
+#endif
+
+namespace cenisys
+{
+
+//!
+//! \brief Accepts RakNet clients on a UDP socket.
+//!
+//! Unconnected pings and the offline handshake are answered from fixed
+//! buffers. Datagrams of connected clients are passed to the session handler.
+//!
+//! The io_service must be run by a single thread. Every handler call and
+//! session of the listener stays on that thread.
+//!
+class RakNetListener : public std::enable_shared_from_this<RakNetListener>
+{
+public:
+    struct Options
+    {
+        boost::asio::ip::udp::endpoint endpoint;
+        std::uint64_t guid;
+        //! Name shown in the server list.
+        std::string motd;
+        //! Limit for all the listeners sharing sessionCount.
+        std::size_t maxSessions;
+        //! Sessions of all the listeners on the same port. Created by the
+        //! listener if empty.
+        std::shared_ptr<std::atomic<std::size_t>> sessionCount;
+        //! Next session id of all the listeners on the same port. Created
+        //! by the listener if empty.
+        std::shared_ptr<std::atomic<std::uint64_t>> sessionIds;
+        std::size_t maxMtu;
+        //! Sessions are closed after receiving nothing for this long.
+        std::chrono::steady_clock::duration timeout;
+        //! Let several listeners share the endpoint with SO_REUSEPORT.
+        bool reusePort;
+        //! Send runs of datagrams to the same client as one buffer with
+        //! UDP_SEGMENT, if the kernel supports it.
+        bool segmentationOffload;
+    };
+
+    struct SendStats
+    {
+        std::size_t flushes;
+        std::size_t syscalls;
+        std::size_t datagrams;
+        //! Datagrams which were sent as a part of a larger buffer.
+        std::size_t segmented;
+
+        SendStats &operator+=(const SendStats &other);
+    };
+
+    //! Number of datagrams received with one system call.
+    static constexpr std::size_t BATCH_SIZE = 32;
+    static constexpr std::size_t BUFFER_SIZE = 2048;
+    //! Blocks carved at once from the heap by the packet pool.
+    static constexpr std::size_t POOL_SLAB_BLOCKS = 256;
+    //! Blocks of the packet pool before it falls back to the heap.
+    static constexpr std::size_t POOL_MAX_BLOCKS = 16384;
+    //! Datagrams queued before the send queue is flushed.
+    static constexpr std::size_t SEND_BATCH_SIZE = 64;
+    //! Limits of the kernel for one UDP_SEGMENT buffer.
+    static constexpr std::size_t MAX_SEGMENTS = 64;
+    static constexpr std::size_t MAX_SEGMENTED_SIZE = 60000;
+    //! Time between two updates of the sessions.
+    static constexpr std::chrono::steady_clock::duration UPDATE_INTERVAL =
+        Reliability::TIMER_RESOLUTION;
+
+    //!
+    //! \brief Bind the socket.
+    //! \throws boost::system::system_error if the socket cannot be bound, or
+    //! if reusePort is set and the platform does not support it.
+    //!
+    RakNetListener(boost::asio::io_service &ioService, const Options &options,
+                   RakNetSessionHandler &handler);
+    ~RakNetListener();
+
+    //!
+    //! \brief Start receiving datagrams.
+    //!
+    void start();
+    //!
+    //! \brief Disconnect every session and close the socket.
+    //!
+    //! Must be called from the thread running the io_service.
+    //!
+    void stop();
+
+    boost::asio::ip::udp::endpoint getLocalEndpoint() const;
+    //!
+    //! \brief Sessions of all the listeners sharing the counter.
+    //!
+    std::size_t getSessionCount() const;
+    //!
+    //! \brief Pool of the received packets.
+    //!
+    //! Allocation is restricted to the thread of the listener.
+    //!
+    BufferPool &getBufferPool() { return _bufferPool; }
+    const BufferPool &getBufferPool() const { return _bufferPool; }
+
+    //!
+    //! \brief Queue a datagram.
+    //!
+    //! The queue is flushed after every update and every batch of received
+    //! datagrams, or once it is full.
+    //!
+    void sendTo(const boost::asio::ip::udp::endpoint &endpoint,
+                const std::uint8_t *data, std::size_t size);
+    //!
+    //! \brief Send the queued datagrams, with as few system calls as
+    //! possible.
+    //!
+    void flush();
+
+    //!
+    //! \brief Call a function with every session.
+    //!
+    //! Must be called from the thread running the io_service.
+    //!
+    template <typename Fn>
+    void forEachSession(Fn &&func) const
+    {
+        for(const auto &item : _sessions)
+            func(*item.second);
+    }
+
+    //! Can be called from any thread.
+    SendStats getSendStats() const;
+    //! True if UDP_SEGMENT is used for sending.
+    bool isSegmentationEnabled() const { return _segmentation; }
+
+private:
+    using SessionMap = std::unordered_map<boost::asio::ip::udp::endpoint,
+                                          std::shared_ptr<RakNetSession>,
+                                          raknet::EndpointHash>;
+
+    void asyncReceive();
+    void asyncUpdate();
+    void receiveBatch();
+    void handleDatagram(const boost::asio::ip::udp::endpoint &endpoint,
+                        const std::uint8_t *data, std::size_t size);
+    void handleUnconnectedPing(const boost::asio::ip::udp::endpoint &endpoint,
+                               BinaryReader &reader);
+    void handleOpenConnectionRequest1(
+        const boost::asio::ip::udp::endpoint &endpoint, BinaryReader &reader,
+        std::size_t size);
+    void handleOpenConnectionRequest2(
+        const boost::asio::ip::udp::endpoint &endpoint, BinaryReader &reader);
+#if defined(HAVE_SENDMMSG)
+    std::size_t sendMessages(std::size_t first);
+#endif
+
+    struct QueuedDatagram
+    {
+        boost::asio::ip::udp::endpoint endpoint;
+        //! Position in _sendData.
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    //! Declared first, as sessions and their packets must be gone before it.
+    BufferPool _bufferPool;
+    boost::asio::ip::udp::socket _socket;
+    boost::asio::steady_timer _updateTimer;
+    Options _options;
+    //! Start of the unconnected pong string, without the player counts.
+    std::string _pongPrefix;
+    RakNetSessionHandler &_handler;
+
+    SessionMap _sessions;
+    bool _running;
+
+    std::array<std::array<std::uint8_t, BUFFER_SIZE>, BATCH_SIZE>
+        _receiveBuffers;
+    std::array<std::uint8_t, BUFFER_SIZE> _sendBuffer;
+#if defined(HAVE_RECVMMSG)
+    std::array<mmsghdr, BATCH_SIZE> _messages;
+    std::array<iovec, BATCH_SIZE> _vectors;
+    std::array<sockaddr_storage, BATCH_SIZE> _addresses;
+#endif
+
+    //! Queued datagrams, one after another.
+    std::vector<std::uint8_t> _sendData;
+    std::vector<QueuedDatagram> _sendQueue;
+    bool _segmentation;
+#if defined(HAVE_SENDMMSG)
+    union ControlBuffer
+    {
+        char buffer[CMSG_SPACE(sizeof(std::uint16_t))];
+        cmsghdr alignment;
+    };
+    std::array<mmsghdr, SEND_BATCH_SIZE> _sendMessages;
+    std::array<iovec, SEND_BATCH_SIZE> _sendVectors;
+    std::array<ControlBuffer, SEND_BATCH_SIZE> _sendControls;
+    //! First datagram of every message.
+    std::array<std::size_t, SEND_BATCH_SIZE> _sendFirsts;
+#endif
+    std::atomic<std::size_t> _flushes;
+    std::atomic<std::size_t> _syscalls;
+    std::atomic<std::size_t> _datagrams;
+    std::atomic<std::size_t> _segmented;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_RAKNETLISTENER_H
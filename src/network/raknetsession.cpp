@@ -0,0 +1,174 @@
+/*
+ * RakNetSession
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/raknetsession.h"
+#include "network/raknetlistener.h"
+#include <array>
+
+namespace cenisys
+{
+
+RakNetSession::RakNetSession(RakNetListener &listener,
+                             RakNetSessionHandler &handler, std::uint64_t id,
+                             const boost::asio::ip::udp::endpoint &endpoint,
+                             std::uint64_t guid, std::size_t mtu,
+                             Clock::time_point now)
+    : _listener(listener), _handler(handler), _id(id), _endpoint(endpoint),
+      _guid(guid), _mtu(mtu), _start(now), _lastReceive(now), _closed(false),
+      _reliability(listener.getBufferPool(), mtu, now,
+                   [this](const std::uint8_t *data, std::size_t size) {
+                       _listener.sendTo(_endpoint, data, size);
+                   },
+                   [this](const PacketBuffer &packet) {
+                       handlePacket(packet);
+                   }),
+      _batchBytes(0), _batchRawBytes(0)
+{
+}
+
+RakNetSession::Telemetry
+RakNetSession::getTelemetry(Clock::time_point now) const
+{
+    Telemetry result;
+    result.id = _id;
+    result.endpoint = _endpoint;
+    result.connected = now - _start;
+    result.roundTrip = _reliability.getRoundTripTime();
+    result.reliability = _reliability.getStats();
+    result.queued = _reliability.getQueuedPackets();
+    result.inFlight = _reliability.getDatagramsInFlight();
+    result.batchBytes = _batchBytes;
+    result.batchRawBytes = _batchRawBytes;
+    return result;
+}
+
+void RakNetSession::sendPacket(const PacketBuffer &packet,
+                               raknet::Reliability reliability,
+                               std::uint8_t channel)
+{
+    OutgoingPacket outgoing;
+    outgoing.data = packet;
+    outgoing.reliability = reliability;
+    outgoing.channel = channel;
+    _outgoing.push(std::move(outgoing));
+}
+
+void RakNetSession::sendBatch(const PacketBuffer &batch,
+                              std::size_t uncompressed)
+{
+    OutgoingPacket outgoing;
+    outgoing.data = batch;
+    outgoing.reliability = raknet::Reliability::ReliableOrdered;
+    outgoing.uncompressed = uncompressed;
+    _outgoing.push(std::move(outgoing));
+}
+
+void RakNetSession::receive(const std::uint8_t *data, std::size_t size,
+                            Clock::time_point now)
+{
+    _lastReceive = now;
+    _reliability.receive(data, size, now);
+}
+
+void RakNetSession::update(Clock::time_point now)
+{
+    OutgoingPacket packet;
+    while(_outgoing.pop(packet))
+    {
+        if(packet.uncompressed)
+        {
+            _batchBytes += packet.data.size();
+            _batchRawBytes += packet.uncompressed;
+        }
+        _reliability.send(packet.data, packet.reliability, packet.channel);
+        packet.data = PacketBuffer();
+    }
+    _reliability.update(now);
+}
+
+void RakNetSession::disconnect(Clock::time_point now)
+{
+    std::uint8_t id = raknet::DisconnectionNotification;
+    _reliability.send(&id, 1, raknet::Reliability::ReliableOrdered);
+    _reliability.update(now);
+    _closed = true;
+}
+
+void RakNetSession::handlePacket(const PacketBuffer &packet)
+{
+    const std::uint8_t *data = packet.data();
+    std::size_t size = packet.size();
+    // Replies are built on the stack; the reliability layer copies them
+    std::array<std::uint8_t, 256> buffer;
+    BinaryWriter writer(buffer.data(), buffer.size());
+    BinaryReader reader(data + 1, size - 1);
+    std::uint64_t uptime =
+        std::chrono::duration_cast<std::chrono::milliseconds>(_lastReceive -
+                                                              _start)
+            .count();
+    switch(data[0])
+    {
+    case raknet::ConnectedPing:
+    {
+        std::uint64_t time = reader.readU64();
+        if(!reader.ok())
+            return;
+        writer.writeU8(raknet::ConnectedPong);
+        writer.writeU64(time);
+        writer.writeU64(uptime);
+        sendControl(writer, raknet::Reliability::Unreliable);
+        break;
+    }
+    case raknet::ConnectionRequest:
+    {
+        reader.readU64(); // Client GUID
+        std::uint64_t time = reader.readU64();
+        if(!reader.ok())
+            return;
+        writer.writeU8(raknet::ConnectionRequestAccepted);
+        raknet::writeAddress(writer, _endpoint);
+        writer.writeU16(0); // System index
+        boost::asio::ip::udp::endpoint unused(boost::asio::ip::udp::v4(), 0);
+        for(int i = 0; i < 10; i++)
+            raknet::writeAddress(writer, unused);
+        writer.writeU64(time);
+        writer.writeU64(uptime);
+        sendControl(writer, raknet::Reliability::Reliable);
+        break;
+    }
+    case raknet::NewIncomingConnection:
+        break;
+    case raknet::DisconnectionNotification:
+        _closed = true;
+        break;
+    default:
+        _handler.receive(*this, packet);
+        break;
+    }
+}
+
+void RakNetSession::sendControl(const BinaryWriter &writer,
+                                raknet::Reliability reliability)
+{
+    if(writer.ok())
+        _reliability.send(writer.data(), writer.size(), reliability);
+}
+
+} // namespace cenisys
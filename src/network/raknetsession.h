@@ -0,0 +1,179 @@
+/*
+ * RakNetSession
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_RAKNETSESSION_H
+#define CENISYS_RAKNETSESSION_H
+
+#include "network/raknet.h"
+#include "network/packetbuffer.h"
+#include "network/reliability.h"
+#include "util/mpscqueue.h"
+#include <boost/asio/ip/udp.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace cenisys
+{
+
+class RakNetListener;
+class RakNetSessionHandler;
+
+//!
+//! \brief A client which completed the offline handshake.
+//!
+//! Sessions are owned by their listener and must not outlive it. Everything
+//! but sendPacket must be called from the thread of the listener.
+//!
+//! The connected handshake, pings and disconnects are handled here; all
+//! other packets are passed to the session handler.
+//!
+class RakNetSession : public std::enable_shared_from_this<RakNetSession>
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    //!
+    //! \brief A snapshot of the counters of a session.
+    //!
+    struct Telemetry
+    {
+        std::uint64_t id;
+        boost::asio::ip::udp::endpoint endpoint;
+        Clock::duration connected;
+        Clock::duration roundTrip;
+        Reliability::Stats reliability;
+        //! Packets waiting for room in the send window.
+        std::size_t queued;
+        std::size_t inFlight;
+        //! Game batches sent, and their size before compression.
+        std::uint64_t batchBytes;
+        std::uint64_t batchRawBytes;
+    };
+
+    //!
+    //! \param id Unique among the listeners sharing the port.
+    //!
+    RakNetSession(RakNetListener &listener, RakNetSessionHandler &handler,
+                  std::uint64_t id,
+                  const boost::asio::ip::udp::endpoint &endpoint,
+                  std::uint64_t guid, std::size_t mtu, Clock::time_point now);
+
+    const boost::asio::ip::udp::endpoint &getEndpoint() const
+    {
+        return _endpoint;
+    }
+    std::uint64_t getId() const { return _id; }
+    std::uint64_t getGuid() const { return _guid; }
+    std::size_t getMtu() const { return _mtu; }
+    Clock::time_point getLastReceive() const { return _lastReceive; }
+    //! True once the client disconnected.
+    bool isClosed() const { return _closed; }
+    const Reliability &getReliability() const { return _reliability; }
+    Telemetry getTelemetry(Clock::time_point now) const;
+
+    //!
+    //! \brief Queue a packet for the client.
+    //!
+    //! Can be called from any thread. The packet is sent on the next update.
+    //! The buffer is shared, so one packet can be queued for many sessions.
+    //!
+    void sendPacket(const PacketBuffer &packet,
+                    raknet::Reliability reliability =
+                        raknet::Reliability::ReliableOrdered,
+                    std::uint8_t channel = 0);
+    //!
+    //! \brief Queue a game batch, counting its compression ratio.
+    //! \param uncompressed Size of the packets in the batch.
+    //!
+    void sendBatch(const PacketBuffer &batch, std::size_t uncompressed);
+
+    //!
+    //! \brief Process a connected datagram from the client.
+    //!
+    void receive(const std::uint8_t *data, std::size_t size,
+                 Clock::time_point now);
+    //!
+    //! \brief Send the queued packets, acknowledgements and resends.
+    //!
+    void update(Clock::time_point now);
+    //!
+    //! \brief Tell the client the session is closed and flush.
+    //!
+    void disconnect(Clock::time_point now);
+
+private:
+    struct OutgoingPacket
+    {
+        PacketBuffer data;
+        raknet::Reliability reliability = raknet::Reliability::Reliable;
+        std::uint8_t channel = 0;
+        //! Size before compression if this is a batch.
+        std::size_t uncompressed = 0;
+    };
+
+    void handlePacket(const PacketBuffer &packet);
+    void sendControl(const BinaryWriter &writer,
+                     raknet::Reliability reliability);
+
+    RakNetListener &_listener;
+    RakNetSessionHandler &_handler;
+    std::uint64_t _id;
+    boost::asio::ip::udp::endpoint _endpoint;
+    std::uint64_t _guid;
+    std::size_t _mtu;
+    Clock::time_point _start;
+    Clock::time_point _lastReceive;
+    bool _closed;
+    Reliability _reliability;
+    MpscQueue<OutgoingPacket> _outgoing;
+    std::uint64_t _batchBytes;
+    std::uint64_t _batchRawBytes;
+};
+
+//!
+//! \brief Receives the events of the sessions of a listener.
+//!
+class RakNetSessionHandler
+{
+public:
+    virtual ~RakNetSessionHandler() = default;
+
+    //!
+    //! \brief Called when the offline handshake of a session is finished.
+    //!
+    virtual void open(RakNetSession &session) = 0;
+    //!
+    //! \brief Called for every packet received from a session.
+    //! \param packet The packet, starting with its id. It can be kept beyond
+    //! the call without copying.
+    //!
+    virtual void receive(RakNetSession &session,
+                         const PacketBuffer &packet) = 0;
+    //!
+    //! \brief Called before a session is destroyed.
+    //!
+    virtual void close(RakNetSession &session) = 0;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_RAKNETSESSION_H
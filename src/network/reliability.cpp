@@ -0,0 +1,616 @@
+/*
+ * Reliability
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/reliability.h"
+#include <algorithm>
+#include <cstring>
+
+namespace cenisys
+{
+
+constexpr std::size_t Reliability::WINDOW_SIZE;
+constexpr std::size_t Reliability::MAX_SPLIT_PACKETS;
+constexpr std::size_t Reliability::MAX_SPLIT_COUNT;
+constexpr Reliability::Clock::duration Reliability::TIMER_RESOLUTION;
+constexpr Reliability::Clock::duration Reliability::MIN_RESEND_TIMEOUT;
+constexpr Reliability::Clock::duration Reliability::MAX_RESEND_TIMEOUT;
+
+Reliability::Reliability(BufferPool &pool, std::size_t mtu,
+                         Clock::time_point now, Callback &&output,
+                         Deliver &&deliver)
+    : _pool(pool), _mtu(mtu - raknet::UDP_HEADER_SIZE),
+      _output(std::move(output)),
+      _deliver(std::move(deliver)), _buffer(_mtu), _nextSequence(0),
+      _nextMessageIndex(0), _nextSplitId(0), _sent(WINDOW_SIZE), _inFlight(0),
+      _resendTimers(TIMER_RESOLUTION, 256, now), _smoothedRtt(0),
+      _rttVariance(0), _resendTimeout(std::chrono::milliseconds(500)),
+      _hasRttSample(false), _expectedSequence(0), _messageBase(0), _stats{}
+{
+    for(auto &item : _sent)
+        item.inFlight = false;
+    _messageReceived.fill(false);
+    for(auto &item : _splits)
+        item.active = false;
+}
+
+void Reliability::receive(const std::uint8_t *data, std::size_t size,
+                          Clock::time_point now)
+{
+    if(size == 0)
+        return;
+    _stats.bytesReceived += size;
+    std::uint8_t flags = data[0];
+    BinaryReader reader(data + 1, size - 1);
+    if(flags & raknet::Ack)
+    {
+        receiveAck(reader, false, now);
+        return;
+    }
+    if(flags & raknet::Nack)
+    {
+        receiveAck(reader, true, now);
+        return;
+    }
+    if(!(flags & raknet::Valid))
+        return;
+
+    std::uint32_t sequence = reader.readU24LE();
+    if(!reader.ok())
+        return;
+    _stats.datagramsReceived++;
+    std::int32_t diff = raknet::sequenceDiff(sequence, _expectedSequence);
+    if(diff >= 0)
+    {
+        // Everything skipped is reported lost, but at most one window
+        std::int32_t missing =
+            std::min(diff, static_cast<std::int32_t>(WINDOW_SIZE));
+        for(std::int32_t i = diff - missing; i < diff; i++)
+            _nacks.push_back((_expectedSequence + i) & raknet::SEQUENCE_MASK);
+        _stats.datagramsLost += missing;
+        _expectedSequence = (sequence + 1) & raknet::SEQUENCE_MASK;
+    }
+    else
+    {
+        // Late, do not ask for it any more
+        auto late = std::remove(_nacks.begin(), _nacks.end(), sequence);
+        if(late != _nacks.end() && _stats.datagramsLost > 0)
+            _stats.datagramsLost--;
+        _nacks.erase(late, _nacks.end());
+    }
+
+    // Datagrams with a frame which could not be taken yet are not
+    // acknowledged, so they are sent again
+    bool accepted = true;
+    Frame frame{};
+    while(reader.remaining() > 0 && readFrame(reader, frame))
+        accepted = receiveFrame(frame) && accepted;
+    if(accepted)
+        _acks.push_back(sequence);
+}
+
+bool Reliability::send(const std::uint8_t *data, std::size_t size,
+                       raknet::Reliability reliability, std::uint8_t channel)
+{
+    return send(_pool.copy(data, size), reliability, channel);
+}
+
+bool Reliability::send(const PacketBuffer &packet,
+                       raknet::Reliability reliability, std::uint8_t channel)
+{
+    std::size_t size = packet.size();
+    if(size == 0 || channel >= raknet::ORDER_CHANNELS)
+        return false;
+    Channel &state = _channels[channel];
+    Frame frame;
+    frame.reliability = reliability;
+    frame.messageIndex = 0;
+    frame.sequenceIndex = 0;
+    frame.orderIndex = 0;
+    frame.channel = channel;
+    frame.split = false;
+    frame.buffer = packet;
+    frame.offset = 0;
+    frame.length = size;
+    if(raknet::isSequenced(reliability))
+    {
+        frame.orderIndex = state.sendOrderIndex;
+        frame.sequenceIndex = state.sendSequenceIndex;
+        state.sendSequenceIndex =
+            (state.sendSequenceIndex + 1) & raknet::SEQUENCE_MASK;
+    }
+    else if(raknet::isOrdered(reliability))
+    {
+        frame.orderIndex = state.sendOrderIndex;
+        state.sendOrderIndex =
+            (state.sendOrderIndex + 1) & raknet::SEQUENCE_MASK;
+        state.sendSequenceIndex = 0;
+    }
+
+    std::size_t room =
+        _mtu - raknet::DATAGRAM_HEADER_SIZE - frameHeaderSize(frame);
+    if(size <= room)
+    {
+        if(raknet::isReliable(reliability))
+        {
+            frame.messageIndex = _nextMessageIndex;
+            _nextMessageIndex =
+                (_nextMessageIndex + 1) & raknet::SEQUENCE_MASK;
+        }
+        _sendQueue.push_back(std::move(frame));
+        return true;
+    }
+
+    // Every part must arrive for the packet to be reassembled
+    if(reliability == raknet::Reliability::Unreliable)
+        frame.reliability = raknet::Reliability::Reliable;
+    else if(reliability == raknet::Reliability::UnreliableSequenced)
+        frame.reliability = raknet::Reliability::ReliableSequenced;
+    frame.split = true;
+    room = _mtu - raknet::DATAGRAM_HEADER_SIZE - frameHeaderSize(frame);
+    std::size_t count = (size + room - 1) / room;
+    if(count > MAX_SPLIT_COUNT)
+        return false;
+    frame.splitCount = static_cast<std::uint32_t>(count);
+    frame.splitId = _nextSplitId++;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        frame.splitIndex = static_cast<std::uint32_t>(i);
+        frame.messageIndex = _nextMessageIndex;
+        _nextMessageIndex = (_nextMessageIndex + 1) & raknet::SEQUENCE_MASK;
+        frame.offset = i * room;
+        frame.length = std::min(size - frame.offset, room);
+        _sendQueue.push_back(frame);
+    }
+    return true;
+}
+
+void Reliability::update(Clock::time_point now)
+{
+    sendAcks(_acks, raknet::Valid | raknet::Ack);
+    sendAcks(_nacks, raknet::Valid | raknet::Nack);
+
+    bool expired = false;
+    _resendTimers.advance(now, [this, &expired](std::uint32_t sequence) {
+        SentDatagram &sent = _sent[sequence % WINDOW_SIZE];
+        if(!sent.inFlight || sent.sequence != sequence)
+            return;
+        queueResend(sequence);
+        expired = true;
+    });
+    // Back off once per burst of losses, the next RTT sample resets it
+    if(expired)
+        _resendTimeout = std::min(_resendTimeout * 2, MAX_RESEND_TIMEOUT);
+
+    flushSendQueue(now);
+}
+
+std::size_t Reliability::frameHeaderSize(const Frame &frame)
+{
+    std::size_t size = 3;
+    if(raknet::isReliable(frame.reliability))
+        size += 3;
+    if(raknet::isSequenced(frame.reliability))
+        size += 3;
+    if(raknet::isOrdered(frame.reliability))
+        size += 4;
+    if(frame.split)
+        size += 10;
+    return size;
+}
+
+void Reliability::writeFrame(BinaryWriter &writer, const Frame &frame)
+{
+    writer.writeU8(static_cast<std::uint8_t>(
+        static_cast<std::uint8_t>(frame.reliability) << 5 |
+        (frame.split ? raknet::SPLIT_FLAG : 0)));
+    writer.writeU16(static_cast<std::uint16_t>(frame.length * 8));
+    if(raknet::isReliable(frame.reliability))
+        writer.writeU24LE(frame.messageIndex);
+    if(raknet::isSequenced(frame.reliability))
+        writer.writeU24LE(frame.sequenceIndex);
+    if(raknet::isOrdered(frame.reliability))
+    {
+        writer.writeU24LE(frame.orderIndex);
+        writer.writeU8(frame.channel);
+    }
+    if(frame.split)
+    {
+        writer.writeU32(frame.splitCount);
+        writer.writeU16(frame.splitId);
+        writer.writeU32(frame.splitIndex);
+    }
+    writer.writeBytes(frame.buffer.data() + frame.offset, frame.length);
+}
+
+bool Reliability::readFrame(BinaryReader &reader, Frame &frame)
+{
+    std::uint8_t flags = reader.readU8();
+    std::uint8_t type = flags >> 5;
+    // The variants with an ack receipt are handled like the plain ones
+    if(type == 5)
+        type = 0;
+    else if(type == 6)
+        type = 2;
+    else if(type == 7)
+        type = 3;
+    frame.reliability = static_cast<raknet::Reliability>(type);
+    frame.split = flags & raknet::SPLIT_FLAG;
+    std::size_t length = (reader.readU16() + 7) / 8;
+    if(raknet::isReliable(frame.reliability))
+        frame.messageIndex = reader.readU24LE();
+    if(raknet::isSequenced(frame.reliability))
+        frame.sequenceIndex = reader.readU24LE();
+    if(raknet::isOrdered(frame.reliability))
+    {
+        frame.orderIndex = reader.readU24LE();
+        frame.channel = reader.readU8();
+    }
+    if(frame.split)
+    {
+        frame.splitCount = reader.readU32();
+        frame.splitId = reader.readU16();
+        frame.splitIndex = reader.readU32();
+        if(frame.splitCount == 0 || frame.splitCount > MAX_SPLIT_COUNT ||
+           frame.splitIndex >= frame.splitCount)
+            return false;
+    }
+    const std::uint8_t *payload = reader.readBytes(length);
+    if(!reader.ok() || length == 0)
+        return false;
+    frame.buffer = _pool.copy(payload, length);
+    frame.offset = 0;
+    frame.length = length;
+    return true;
+}
+
+void Reliability::receiveAck(BinaryReader &reader, bool nack,
+                             Clock::time_point now)
+{
+    std::size_t count = reader.readU16();
+    for(std::size_t i = 0; i < count; i++)
+    {
+        bool single = reader.readU8() != 0;
+        std::uint32_t start = reader.readU24LE();
+        std::uint32_t end = single ? start : reader.readU24LE();
+        if(!reader.ok())
+            return;
+        std::int32_t length = raknet::sequenceDiff(end, start);
+        if(length < 0 || length >= static_cast<std::int32_t>(WINDOW_SIZE))
+            continue;
+        for(std::int32_t j = 0; j <= length; j++)
+        {
+            std::uint32_t sequence = (start + j) & raknet::SEQUENCE_MASK;
+            SentDatagram &sent = _sent[sequence % WINDOW_SIZE];
+            if(!sent.inFlight || sent.sequence != sequence)
+                continue;
+            if(nack)
+            {
+                queueResend(sequence);
+                continue;
+            }
+            // Resends use new sequence numbers, so every sample is exact
+            sampleRtt(now - sent.sendTime);
+            sent.inFlight = false;
+            sent.body.clear();
+            _inFlight--;
+        }
+    }
+}
+
+bool Reliability::receiveFrame(Frame &frame)
+{
+    // Everything is checked before the frame is taken, so a frame which is
+    // refused can be accepted when it is sent again
+    bool &received = _messageReceived[frame.messageIndex % WINDOW_SIZE];
+    bool reliable = raknet::isReliable(frame.reliability);
+    if(reliable)
+    {
+        std::int32_t diff =
+            raknet::sequenceDiff(frame.messageIndex, _messageBase);
+        if(diff < 0 || (diff < static_cast<std::int32_t>(WINDOW_SIZE) &&
+                        received))
+            return true; // Duplicate
+        if(diff >= static_cast<std::int32_t>(WINDOW_SIZE))
+            return false;
+    }
+    if(raknet::isOrdered(frame.reliability) &&
+       !raknet::isSequenced(frame.reliability) &&
+       (frame.channel >= raknet::ORDER_CHANNELS ||
+        raknet::sequenceDiff(frame.orderIndex,
+                             _channels[frame.channel].receiveOrderIndex) >=
+            static_cast<std::int32_t>(WINDOW_SIZE)))
+        return false;
+
+    SplitPacket *packet = nullptr;
+    if(frame.split)
+    {
+        SplitPacket *unused = nullptr;
+        for(auto &item : _splits)
+        {
+            if(item.active && item.id == frame.splitId)
+            {
+                packet = &item;
+                break;
+            }
+            if(!item.active && !unused)
+                unused = &item;
+        }
+        if(!packet && !unused)
+            return false;
+        if(packet && (frame.splitCount != packet->parts.size() ||
+                      packet->parts[frame.splitIndex]))
+            return true; // Malformed or duplicate
+        if(!packet)
+        {
+            packet = unused;
+            packet->active = true;
+            packet->id = frame.splitId;
+            packet->received = 0;
+            packet->parts.clear();
+            packet->parts.resize(frame.splitCount);
+        }
+    }
+
+    if(reliable)
+    {
+        received = true;
+        while(_messageReceived[_messageBase % WINDOW_SIZE])
+        {
+            _messageReceived[_messageBase % WINDOW_SIZE] = false;
+            _messageBase = (_messageBase + 1) & raknet::SEQUENCE_MASK;
+        }
+    }
+    if(!packet)
+    {
+        receiveAssembled(frame);
+        return true;
+    }
+
+    packet->parts[frame.splitIndex] = std::move(frame.buffer);
+    if(++packet->received < packet->parts.size())
+        return true;
+
+    std::size_t size = 0;
+    for(const auto &item : packet->parts)
+        size += item.size();
+    frame.buffer = _pool.allocate(size);
+    frame.offset = 0;
+    frame.length = size;
+    std::uint8_t *target = frame.buffer.data();
+    for(const auto &item : packet->parts)
+    {
+        std::memcpy(target, item.data(), item.size());
+        target += item.size();
+    }
+    packet->active = false;
+    packet->parts.clear();
+    frame.split = false;
+    receiveAssembled(frame);
+    return true;
+}
+
+void Reliability::receiveAssembled(Frame &frame)
+{
+    if(!raknet::isOrdered(frame.reliability))
+    {
+        _deliver(frame.buffer);
+        return;
+    }
+    if(frame.channel >= raknet::ORDER_CHANNELS)
+        return;
+    Channel &channel = _channels[frame.channel];
+    std::int32_t diff =
+        raknet::sequenceDiff(frame.orderIndex, channel.receiveOrderIndex);
+
+    if(raknet::isSequenced(frame.reliability))
+    {
+        // Only packets newer than the last delivered one are wanted
+        std::int32_t order = raknet::sequenceDiff(
+            frame.orderIndex, channel.receiveSequencedOrderIndex);
+        if(diff < 0 || order < 0 ||
+           (order == 0 && raknet::sequenceDiff(
+                              frame.sequenceIndex,
+                              channel.receiveSequenceIndex) < 0))
+            return;
+        channel.receiveSequencedOrderIndex = frame.orderIndex;
+        channel.receiveSequenceIndex =
+            (frame.sequenceIndex + 1) & raknet::SEQUENCE_MASK;
+        _deliver(frame.buffer);
+        return;
+    }
+
+    if(diff < 0 || diff >= static_cast<std::int32_t>(WINDOW_SIZE))
+        return;
+    if(diff > 0)
+    {
+        if(!channel.pending)
+        {
+            channel.pending =
+                std::make_unique<std::array<PacketBuffer, WINDOW_SIZE>>();
+        }
+        (*channel.pending)[frame.orderIndex % WINDOW_SIZE] =
+            std::move(frame.buffer);
+        return;
+    }
+
+    _deliver(frame.buffer);
+    channel.receiveOrderIndex =
+        (channel.receiveOrderIndex + 1) & raknet::SEQUENCE_MASK;
+    // Then everything which was waiting for it
+    while(channel.pending)
+    {
+        PacketBuffer &next =
+            (*channel.pending)[channel.receiveOrderIndex % WINDOW_SIZE];
+        if(!next)
+            break;
+        _deliver(next);
+        next = PacketBuffer();
+        channel.receiveOrderIndex =
+            (channel.receiveOrderIndex + 1) & raknet::SEQUENCE_MASK;
+    }
+}
+
+void Reliability::queueResend(std::uint32_t sequence)
+{
+    SentDatagram &sent = _sent[sequence % WINDOW_SIZE];
+    sent.inFlight = false;
+    _inFlight--;
+    _resendQueue.push_back(std::move(sent.body));
+    sent.body.clear();
+}
+
+bool Reliability::sendDatagram(std::vector<std::uint8_t> &body, bool reliable,
+                               Clock::time_point now)
+{
+    std::uint32_t sequence = _nextSequence;
+    SentDatagram &sent = _sent[sequence % WINDOW_SIZE];
+    // The window is full until the oldest datagram is acknowledged
+    if(reliable && sent.inFlight)
+        return false;
+    _nextSequence = (_nextSequence + 1) & raknet::SEQUENCE_MASK;
+
+    BinaryWriter writer(_buffer.data(), _buffer.size());
+    writer.writeU8(raknet::Valid | raknet::NeedsBAndAs);
+    writer.writeU24LE(sequence);
+    writer.writeBytes(body.data(), body.size());
+    _output(writer.data(), writer.size());
+    _stats.datagramsSent++;
+    _stats.bytesSent += writer.size();
+
+    if(reliable)
+    {
+        sent.sequence = sequence;
+        sent.inFlight = true;
+        sent.sendTime = now;
+        // Keep the body for resending and recycle the old buffer
+        sent.body.swap(body);
+        _inFlight++;
+        _resendTimers.schedule(sequence, now + _resendTimeout);
+    }
+    body.clear();
+    return true;
+}
+
+void Reliability::flushSendQueue(Clock::time_point now)
+{
+    // Lost datagrams go first, the receiver may be waiting for them
+    while(!_resendQueue.empty())
+    {
+        if(!sendDatagram(_resendQueue.front(), true, now))
+            return;
+        _resendQueue.pop_front();
+        _stats.datagramsResent++;
+    }
+
+    std::vector<std::uint8_t> body;
+    while(!_sendQueue.empty())
+    {
+        bool reliable = raknet::isReliable(_sendQueue.front().reliability);
+        if(reliable && _sent[_nextSequence % WINDOW_SIZE].inFlight)
+            return;
+        // Reliable and unreliable frames never share a datagram, so that
+        // resending does not duplicate unreliable packets
+        body.resize(_mtu - raknet::DATAGRAM_HEADER_SIZE);
+        BinaryWriter writer(body.data(), body.size());
+        while(!_sendQueue.empty())
+        {
+            const Frame &frame = _sendQueue.front();
+            if(raknet::isReliable(frame.reliability) != reliable ||
+               frameHeaderSize(frame) + frame.length >
+                   writer.remaining())
+                break;
+            writeFrame(writer, frame);
+            _sendQueue.pop_front();
+        }
+        body.resize(writer.size());
+        sendDatagram(body, reliable, now);
+    }
+}
+
+void Reliability::sendAcks(std::vector<std::uint32_t> &sequences,
+                           std::uint8_t flags)
+{
+    if(sequences.empty())
+        return;
+    std::sort(sequences.begin(), sequences.end());
+    sequences.erase(std::unique(sequences.begin(), sequences.end()),
+                    sequences.end());
+
+    // Consecutive sequence numbers are coalesced into ranges
+    std::size_t i = 0;
+    while(i < sequences.size())
+    {
+        BinaryWriter writer(_buffer.data(), _buffer.size());
+        writer.writeU8(flags);
+        std::uint8_t *count = writer.skip(2);
+        std::uint16_t records = 0;
+        // A range record takes 7 bytes
+        while(i < sequences.size() && writer.remaining() >= 7)
+        {
+            std::uint32_t start = sequences[i];
+            std::uint32_t end = start;
+            while(i + 1 < sequences.size() && sequences[i + 1] == end + 1)
+                end = sequences[++i];
+            i++;
+            if(start == end)
+            {
+                writer.writeU8(1);
+                writer.writeU24LE(start);
+            }
+            else
+            {
+                writer.writeU8(0);
+                writer.writeU24LE(start);
+                writer.writeU24LE(end);
+            }
+            records++;
+        }
+        count[0] = static_cast<std::uint8_t>(records >> 8);
+        count[1] = static_cast<std::uint8_t>(records);
+        _output(writer.data(), writer.size());
+        _stats.bytesSent += writer.size();
+    }
+    sequences.clear();
+}
+
+void Reliability::sampleRtt(Clock::duration rtt)
+{
+    // RFC 6298
+    if(!_hasRttSample)
+    {
+        _smoothedRtt = rtt;
+        _rttVariance = rtt / 2;
+        _hasRttSample = true;
+    }
+    else
+    {
+        Clock::duration error =
+            _smoothedRtt > rtt ? _smoothedRtt - rtt : rtt - _smoothedRtt;
+        _rttVariance = (_rttVariance * 3 + error) / 4;
+        _smoothedRtt = (_smoothedRtt * 7 + rtt) / 8;
+    }
+    _resendTimeout =
+        _smoothedRtt + std::max<Clock::duration>(TIMER_RESOLUTION,
+                                                 _rttVariance * 4);
+    _resendTimeout = std::max(MIN_RESEND_TIMEOUT,
+                              std::min(_resendTimeout, MAX_RESEND_TIMEOUT));
+}
+
+} // namespace cenisys
@@ -0,0 +1,223 @@
+/*
+ * Reliability
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_RELIABILITY_H
+#define CENISYS_RELIABILITY_H
+
+#include "network/binarystream.h"
+#include "network/packetbuffer.h"
+#include "network/raknet.h"
+#include "util/timingwheel.h"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief The RakNet reliability layer of one connection.
+//!
+//! Turns datagrams into packets and packets into datagrams. It does no I/O
+//! and reads no clock itself, so it can be driven by a simulated network.
+//!
+//! Datagrams in flight, received message indices and out of order packets
+//! are kept in fixed-size rings indexed by their sequence numbers. Resends
+//! are timed by a timing wheel with the timeout derived from the measured
+//! round trip time.
+//!
+class Reliability
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    //! Receives a datagram to send; only valid during the call.
+    using Callback = std::function<void(const std::uint8_t *, std::size_t)>;
+    //! Receives a complete packet.
+    using Deliver = std::function<void(const PacketBuffer &)>;
+
+    struct Stats
+    {
+        //! Datagrams carrying frames, including resends.
+        std::uint64_t datagramsSent;
+        std::uint64_t datagramsResent;
+        std::uint64_t datagramsReceived;
+        //! Datagrams skipped by the client which never arrived late.
+        std::uint64_t datagramsLost;
+        //! Every datagram, including acknowledgements.
+        std::uint64_t bytesSent;
+        std::uint64_t bytesReceived;
+    };
+
+    //! Number of sequence numbers tracked by every ring.
+    static constexpr std::size_t WINDOW_SIZE = 1024;
+    //! Concurrently reassembled split packets.
+    static constexpr std::size_t MAX_SPLIT_PACKETS = 16;
+    static constexpr std::size_t MAX_SPLIT_COUNT = 512;
+    static constexpr Clock::duration TIMER_RESOLUTION =
+        std::chrono::milliseconds(10);
+    static constexpr Clock::duration MIN_RESEND_TIMEOUT =
+        std::chrono::milliseconds(50);
+    static constexpr Clock::duration MAX_RESEND_TIMEOUT =
+        std::chrono::seconds(3);
+
+    //!
+    //! \param pool Received packets are stored in buffers from this pool.
+    //! \param mtu Largest datagram including the UDP/IP headers.
+    //! \param output Called for every datagram to send.
+    //! \param deliver Called for every received packet, in order where
+    //! required.
+    //!
+    Reliability(BufferPool &pool, std::size_t mtu, Clock::time_point now,
+                Callback &&output, Deliver &&deliver);
+
+    //!
+    //! \brief Process a received connected datagram.
+    //!
+    void receive(const std::uint8_t *data, std::size_t size,
+                 Clock::time_point now);
+    //!
+    //! \brief Queue a packet. It is sent on the next update.
+    //! \return false if the packet is too large or the channel is invalid.
+    //!
+    //! The buffer is shared, not copied; split parts refer to slices of it.
+    //!
+    bool send(const PacketBuffer &packet, raknet::Reliability reliability,
+              std::uint8_t channel = 0);
+    bool send(const std::uint8_t *data, std::size_t size,
+              raknet::Reliability reliability, std::uint8_t channel = 0);
+    //!
+    //! \brief Send the ACKs, NACKs, resends and queued packets.
+    //!
+    void update(Clock::time_point now);
+
+    Clock::duration getRoundTripTime() const { return _smoothedRtt; }
+    Clock::duration getResendTimeout() const { return _resendTimeout; }
+    std::size_t getDatagramsInFlight() const { return _inFlight; }
+    //! Packets waiting for room in the send window.
+    std::size_t getQueuedPackets() const
+    {
+        return _sendQueue.size() + _resendQueue.size();
+    }
+    const Stats &getStats() const { return _stats; }
+
+private:
+    struct Frame
+    {
+        raknet::Reliability reliability;
+        std::uint32_t messageIndex;
+        std::uint32_t sequenceIndex;
+        std::uint32_t orderIndex;
+        std::uint8_t channel;
+        bool split;
+        std::uint32_t splitCount;
+        std::uint16_t splitId;
+        std::uint32_t splitIndex;
+        //! The payload is a slice of the buffer.
+        PacketBuffer buffer;
+        std::size_t offset;
+        std::size_t length;
+    };
+
+    struct SentDatagram
+    {
+        std::uint32_t sequence;
+        bool inFlight;
+        Clock::time_point sendTime;
+        //! Encoded frames, without the datagram header.
+        std::vector<std::uint8_t> body;
+    };
+
+    struct SplitPacket
+    {
+        bool active;
+        std::uint16_t id;
+        std::uint32_t received;
+        std::vector<PacketBuffer> parts;
+    };
+
+    struct Channel
+    {
+        std::uint32_t sendOrderIndex = 0;
+        std::uint32_t sendSequenceIndex = 0;
+        std::uint32_t receiveOrderIndex = 0;
+        //! Order index of the last delivered sequenced packet.
+        std::uint32_t receiveSequencedOrderIndex = 0;
+        std::uint32_t receiveSequenceIndex = 0;
+        //! Packets received ahead of receiveOrderIndex. Allocated on demand.
+        std::unique_ptr<std::array<PacketBuffer, WINDOW_SIZE>> pending;
+    };
+
+    static std::size_t frameHeaderSize(const Frame &frame);
+    static void writeFrame(BinaryWriter &writer, const Frame &frame);
+    bool readFrame(BinaryReader &reader, Frame &frame);
+
+    void receiveAck(BinaryReader &reader, bool nack, Clock::time_point now);
+    //! \return false if the frame cannot be taken now.
+    bool receiveFrame(Frame &frame);
+    void receiveAssembled(Frame &frame);
+
+    void queueResend(std::uint32_t sequence);
+    bool sendDatagram(std::vector<std::uint8_t> &body, bool reliable,
+                      Clock::time_point now);
+    void flushSendQueue(Clock::time_point now);
+    void sendAcks(std::vector<std::uint32_t> &sequences, std::uint8_t flags);
+    void sampleRtt(Clock::duration rtt);
+
+    BufferPool &_pool;
+    std::size_t _mtu;
+    Callback _output;
+    Deliver _deliver;
+    std::vector<std::uint8_t> _buffer;
+
+    // Sending
+    std::uint32_t _nextSequence;
+    std::uint32_t _nextMessageIndex;
+    std::uint16_t _nextSplitId;
+    std::vector<SentDatagram> _sent;
+    std::size_t _inFlight;
+    std::deque<Frame> _sendQueue;
+    //! Bodies of lost datagrams, sent again with a new sequence number.
+    std::deque<std::vector<std::uint8_t>> _resendQueue;
+    TimingWheel<std::uint32_t> _resendTimers;
+    Clock::duration _smoothedRtt;
+    Clock::duration _rttVariance;
+    Clock::duration _resendTimeout;
+    bool _hasRttSample;
+
+    // Receiving
+    std::uint32_t _expectedSequence;
+    std::vector<std::uint32_t> _acks;
+    std::vector<std::uint32_t> _nacks;
+    std::uint32_t _messageBase;
+    std::array<bool, WINDOW_SIZE> _messageReceived;
+    std::array<SplitPacket, MAX_SPLIT_PACKETS> _splits;
+    std::array<Channel, raknet::ORDER_CHANNELS> _channels;
+
+    Stats _stats;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_RELIABILITY_H
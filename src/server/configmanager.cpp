@@ -24,6 +24,7 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/locale/format.hpp>
 #include <boost/locale/message.hpp>
+#include <vector>
 #include <yaml-cpp/parser.h>
 
 namespace cenisys
@@ -53,4 +54,19 @@ std::shared_ptr<ConfigSection> ConfigManager::getConfig(const std::string &name)
     return result;
 }
 
+void ConfigManager::saveAll()
+{
+    std::vector<std::shared_ptr<ConfigSection>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(_loadedConfigLock);
+        for(const auto &item : _loadedConfig)
+        {
+            if(auto config = item.second.lock())
+                loaded.push_back(std::move(config));
+        }
+    }
+    for(const auto &config : loaded)
+        config->save();
+}
+
 } // namespace cenisys
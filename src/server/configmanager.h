@@ -38,6 +38,10 @@ public:
     ConfigManager(Server &server, const boost::filesystem::path &basepath);
     ~ConfigManager();
     std::shared_ptr<ConfigSection> getConfig(const std::string &name);
+    //!
+    //! \brief Write every loaded configuration back to its file.
+    //!
+    void saveAll();
 
 private:
     Server &_server;
@@ -24,46 +24,192 @@
 #include "command/commandsender.h"
 #include "command/defaultcommandhandlers.h"
 #include "config/configsection.h"
+#include "network/networkmanager.h"
 #include "server/server.h"
+#include "server/startupprofiler.h"
+#include "server/taskgraph.h"
 #include "server/terminal/posixasyncterminalconsole.h"
 #include "server/terminal/threadedterminalconsole.h"
+#include "world/world.h"
 #include <boost/locale/format.hpp>
 #include <boost/locale/generator.hpp>
 #include <boost/locale/message.hpp>
+#include <chrono>
+#include <exception>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <locale>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 namespace cenisys
 {
 
+namespace
+{
+
+bool checkTaskGraphResult(Server &server, const TaskGraph::Result &result)
+{
+    if(!result.error)
+    {
+        std::string path;
+        for(const auto &item : result.criticalPath)
+            path += (path.empty() ? "" : " -> ") + item;
+        server.log(Server::LogLevel::Debug,
+                   boost::locale::format(boost::locale::translate(
+                       "Tasks finished in {1} ms, critical path: {2}")) %
+                       std::chrono::duration<double, std::milli>(
+                           result.duration)
+                           .count() %
+                       path);
+        return true;
+    }
+    try
+    {
+        std::rethrow_exception(result.error);
+    }
+    catch(const std::exception &e)
+    {
+        server.log(Server::LogLevel::Severe,
+                   boost::locale::format(
+                       boost::locale::translate("Task {1} failed: {2}")) %
+                       result.failedTask % e.what());
+    }
+    catch(...)
+    {
+        server.log(Server::LogLevel::Severe,
+                   boost::locale::format(boost::locale::translate(
+                       "Task {1} failed with an unknown error")) %
+                       result.failedTask);
+    }
+    return false;
+}
+
+} // namespace
+
+constexpr std::chrono::milliseconds Server::TICK_INTERVAL;
+
 Server::Server(const boost::filesystem::path &dataDir,
                boost::locale::generator &localeGen)
-    : _counter(0), _dataDir(dataDir), _localeGen(localeGen),
-      _termSignals(_ioService, SIGINT, SIGTERM),
-      _configManager(*this, _dataDir / "config")
+    : _counter(0), _pendingEvents(0), _droppedEvents(0), _dropEvents(false),
+      _forceStop(false), _threadCount(1), _runningWorkers(0),
+      _stopRequested(false), _shutdownTimeout(std::chrono::seconds(30)),
+      _dataDir(dataDir),
+      _startupTasks(std::make_unique<TaskGraph>()),
+      _shutdownTasks(std::make_unique<TaskGraph>()), _startupFailed(false),
+      _localeGen(localeGen), _termSignals(_ioService, SIGINT, SIGTERM),
+      _tickTimer(_ioService), _configManager(*this, _dataDir / "config"),
+      _helpCommand(_commandList.end()),
+      _consoles(std::make_shared<ConsoleList>())
 {
+    registerStartupTask("work", {}, [this] {
+        _work = std::make_unique<boost::asio::io_service::work>(_ioService);
+    });
+    registerStartupTask("help", {}, [this] {
+        _helpCommand = registerCommand(
+            "help", boost::locale::translate("Display this help"),
+            [this](CommandSender &sender, const std::string &command) {
+                sender.sendMessage(
+                    boost::locale::translate("List of commands:"));
+                // TODO: Paging and more
+                for(const auto &item : _commandList)
+                {
+                    sender.sendMessage(
+                        boost::locale::format("/{1}: {2}") % item.first %
+                        std::get<boost::locale::message>(item.second));
+                }
+            });
+    });
+    registerStartupTask("default-commands", {}, [this] {
+        _defaultCommands = std::make_unique<DefaultCommandHandlers>(*this);
+    });
+    registerStartupTask("tick", {"work"}, [this] {
+        _nextTick = std::chrono::steady_clock::now();
+        scheduleTick();
+    });
+
+    registerShutdownTask("default-commands", {},
+                         [this] { _defaultCommands.reset(); });
+    registerShutdownTask("tick", {}, [this] {
+        boost::system::error_code ec;
+        _tickTimer.cancel(ec);
+    });
+    registerShutdownTask("help", {}, [this] {
+        if(_helpCommand != _commandList.end())
+            unregisterCommand(_helpCommand);
+        _helpCommand = _commandList.end();
+    });
+
+    // The network manager hands the game packets over to the world
+    _world = std::make_unique<World>(*this);
+    _networkManager = std::make_unique<NetworkManager>(*this);
 }
 
 Server::~Server()
 {
+    // Threads abandoned by a forced stop
+    for(auto &item : _workers)
+        item.thread.join();
 }
 
 int Server::run()
 {
     _ioService.post([this] { start(); });
-    _ioService.run();
-    // TODO: Currently there's no way to terminate threads in io_service.
-    for(auto &item : _threads)
+    spawnWorker();
+
+    std::unique_lock<std::mutex> lock(_workersLock);
+    _workersWait.wait(
+        lock, [this] { return _runningWorkers == 0 || _stopRequested; });
+    bool forced = !_workersWait.wait_until(
+        lock, _stopDeadline, [this] { return _runningWorkers == 0; });
+    if(forced)
+    {
+        lock.unlock();
+        forceStop();
+        lock.lock();
+        // Threads which are not stuck leave as soon as they notice
+        _workersWait.wait_for(lock, std::chrono::milliseconds(100),
+                              [this] { return _runningWorkers == 0; });
+    }
+    for(auto it = _workers.begin(); it != _workers.end();)
+    {
+        if(it->exited)
+        {
+            it->thread.join();
+            it = _workers.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    if(!_workers.empty())
     {
-        item.join();
+        log(LogLevel::Warning,
+            boost::locale::format(boost::locale::translate(
+                "Abandoning {1} stuck thread.", "Abandoning {1} stuck threads.",
+                _workers.size())) %
+                _workers.size());
     }
-    return 0;
+    if(forced)
+        return 1;
+    // Set by the startup tasks, which are all done once the workers left
+    return _startupFailed ? 2 : 0;
 }
 
 void Server::terminate()
 {
+    {
+        std::lock_guard<std::mutex> lock(_workersLock);
+        if(!_stopRequested)
+        {
+            _stopRequested = true;
+            _stopDeadline = std::chrono::steady_clock::now() + _shutdownTimeout;
+        }
+    }
+    _workersWait.notify_all();
     _ioService.post([this] { stop(); });
 }
 
@@ -79,6 +225,8 @@ void Server::dispatchCommand(CommandSender &sender, const std::string &command)
     const auto &it = _commandList.find(commandName);
     if(it != _commandList.end())
     {
+        RunningHandler handle = beginHandler("command " + commandName);
+        BOOST_SCOPE_EXIT_ALL(&) { endHandler(handle); };
         std::get<Server::CommandHandler>(it->second)(sender, command);
         return;
     }
@@ -108,14 +256,63 @@ void Server::unregisterCommand(Server::RegisteredCommandHandler handle)
 Server::RegisteredConsole Server::registerConsole(ConsoleBackend &backend)
 {
     std::lock_guard<std::mutex> lock(_consoleListLock);
-    _consoles.emplace_front(*this, backend);
-    return _consoles.before_begin();
+    // Detached by whoever drops the last list holding it
+    auto detached = std::make_shared<std::promise<void>>();
+    std::shared_ptr<Console> console(new Console(*this, backend),
+                                     [detached](Console *item) {
+                                         delete item;
+                                         detached->set_value();
+                                     });
+    _consoleDetached.insert({console.get(), detached->get_future()});
+    auto consoles = std::make_shared<ConsoleList>(*_consoles);
+    consoles->push_back(console);
+    std::atomic_store(&_consoles,
+                      std::shared_ptr<const ConsoleList>(std::move(consoles)));
+    return console.get();
 }
 
 void Server::unregisterConsole(Server::RegisteredConsole handle)
 {
-    std::lock_guard<std::mutex> lock(_consoleListLock);
-    _consoles.erase_after(handle);
+    std::future<void> detached;
+    {
+        std::lock_guard<std::mutex> lock(_consoleListLock);
+        auto it = _consoleDetached.find(handle);
+        if(it == _consoleDetached.end())
+            return;
+        detached = std::move(it->second);
+        _consoleDetached.erase(it);
+        auto consoles = std::make_shared<ConsoleList>();
+        for(const auto &item : *_consoles)
+        {
+            if(item.get() != handle)
+                consoles->push_back(item);
+        }
+        std::atomic_store(
+            &_consoles,
+            std::shared_ptr<const ConsoleList>(std::move(consoles)));
+    }
+    // Loggers may still hold an old list, and others may register meanwhile
+    detached.wait();
+}
+
+Server::RegisteredTickHandler
+Server::registerTickHandler(Server::TickHandler &&handler)
+{
+    std::lock_guard<std::mutex> lock(_tickHandlersLock);
+    return _tickHandlers.insert(_tickHandlers.end(), std::move(handler));
+}
+
+void Server::unregisterTickHandler(Server::RegisteredTickHandler handle)
+{
+    std::lock_guard<std::mutex> lock(_tickHandlersLock);
+    _tickHandlers.erase(handle);
+}
+
+void Server::runTickHandlers()
+{
+    std::lock_guard<std::mutex> lock(_tickHandlersLock);
+    for(const auto &handler : _tickHandlers)
+        handler();
 }
 
 std::shared_ptr<ConfigSection> Server::getConfig(const std::string &name)
@@ -123,14 +320,141 @@ std::shared_ptr<ConfigSection> Server::getConfig(const std::string &name)
     return _configManager.getConfig(name);
 }
 
+bool Server::registerStartupTask(const std::string &name,
+                                 const std::vector<std::string> &dependencies,
+                                 std::function<void()> &&task)
+{
+    return _startupTasks->addTask(
+        name, dependencies, [ this, name, task = std::move(task) ] {
+            RunningHandler handle = beginHandler("startup task " + name);
+            BOOST_SCOPE_EXIT_ALL(&) { endHandler(handle); };
+            task();
+        });
+}
+
+bool Server::unregisterStartupTask(const std::string &name)
+{
+    return _startupTasks->removeTask(name);
+}
+
+bool Server::registerShutdownTask(const std::string &name,
+                                  const std::vector<std::string> &dependencies,
+                                  std::function<void()> &&task)
+{
+    return _shutdownTasks->addTask(
+        name, dependencies, [ this, name, task = std::move(task) ] {
+            RunningHandler handle = beginHandler("shutdown task " + name);
+            BOOST_SCOPE_EXIT_ALL(&) { endHandler(handle); };
+            task();
+        });
+}
+
+bool Server::unregisterShutdownTask(const std::string &name)
+{
+    return _shutdownTasks->removeTask(name);
+}
+
+Server::RunningHandler Server::beginHandler(std::string description)
+{
+    std::lock_guard<std::mutex> lock(_runningHandlersLock);
+    return _runningHandlers.emplace(_runningHandlers.end(),
+                                    std::move(description),
+                                    std::chrono::steady_clock::now());
+}
+
+void Server::endHandler(Server::RunningHandler handle)
+{
+    std::lock_guard<std::mutex> lock(_runningHandlersLock);
+    _runningHandlers.erase(handle);
+}
+
+void Server::spawnWorker()
+{
+    std::lock_guard<std::mutex> lock(_workersLock);
+    _workers.emplace_back();
+    Worker &worker = _workers.back();
+    worker.exited = false;
+    _runningWorkers++;
+    worker.thread = std::thread([this, &worker] {
+        _ioService.run();
+        {
+            std::lock_guard<std::mutex> lock(_workersLock);
+            worker.exited = true;
+            _runningWorkers--;
+        }
+        _workersWait.notify_all();
+    });
+}
+
+void Server::scheduleTick()
+{
+    _nextTick += TICK_INTERVAL;
+    // Skip the ticks we are late for instead of running them back to back
+    auto now = std::chrono::steady_clock::now();
+    if(_nextTick < now)
+        _nextTick = now;
+    _tickTimer.expires_at(_nextTick);
+    _tickTimer.async_wait([this](const boost::system::error_code &ec) {
+        if(ec == boost::asio::error::operation_aborted)
+            return;
+        tick();
+    });
+}
+
+void Server::tick()
+{
+    // Ticks stop for good once the server is stopping
+    if(!lockTask())
+        return;
+    BOOST_SCOPE_EXIT_ALL(&) { unlockTask(); };
+    {
+        RunningHandler handle = beginHandler("tick");
+        BOOST_SCOPE_EXIT_ALL(&) { endHandler(handle); };
+        runTickHandlers();
+    }
+    scheduleTick();
+}
+
+void Server::forceStop()
+{
+    log(LogLevel::Warning,
+        boost::locale::format(boost::locale::translate(
+            "Server did not stop within {1} seconds, forcing termination.")) %
+            std::chrono::duration<double>(_shutdownTimeout).count());
+    {
+        std::lock_guard<std::mutex> lock(_runningHandlersLock);
+        auto now = std::chrono::steady_clock::now();
+        for(const auto &item : _runningHandlers)
+        {
+            log(LogLevel::Warning,
+                boost::locale::format(boost::locale::translate(
+                    "Handler still running after {1} ms: {2}")) %
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        now - item.second)
+                        .count() %
+                    item.first);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_stateLock);
+        _forceStop = true;
+    }
+    // Wake up everyone waiting for a lock so they can give up
+    _stateWait.notify_all();
+    _ioService.stop();
+}
+
 bool Server::lockTask()
 {
     std::unique_lock<std::mutex> lock(_stateLock);
     std::size_t ret = 1;
     if(_dropEvents)
         return false;
-    while(_critical && _counter != 0)
+    // Exclusive too: ticks and events all touch the game state
+    while(_counter != 0)
     {
+        if(_forceStop)
+            return false;
         if(ret)
         {
             lock.unlock();
@@ -143,9 +467,8 @@ bool Server::lockTask()
             ret = 1;
         }
     }
-    if(_dropEvents)
+    if(_dropEvents || _forceStop)
         return false;
-    _critical = false;
     _counter++;
     return true;
 }
@@ -156,10 +479,32 @@ void Server::unlockTask()
     if(--_counter == 0)
     {
         lock.unlock();
-        _stateWait.notify_one();
+        _stateWait.notify_all();
     }
 }
 
+bool Server::lockEvent()
+{
+    bool locked = lockTask();
+    std::lock_guard<std::mutex> lock(_stateLock);
+    _pendingEvents--;
+    if(!locked && _dropEvents)
+        _droppedEvents++;
+    return locked;
+}
+
+bool Server::eventsPending()
+{
+    std::chrono::steady_clock::time_point deadline;
+    {
+        std::lock_guard<std::mutex> lock(_workersLock);
+        deadline = _stopDeadline;
+    }
+    std::lock_guard<std::mutex> lock(_stateLock);
+    return _pendingEvents != 0 && !_dropEvents &&
+           std::chrono::steady_clock::now() < deadline;
+}
+
 template <Server::LockType type>
 bool Server::lockCritical()
 {
@@ -169,6 +514,8 @@ bool Server::lockCritical()
         return false;
     while(_counter != 0)
     {
+        if(_forceStop)
+            return false;
         if(ret)
         {
             lock.unlock();
@@ -183,7 +530,6 @@ bool Server::lockCritical()
     }
     if(type == LockType::Stop && _dropEvents)
         return false;
-    _critical = true;
     _counter++;
     if(type == LockType::Start)
     {
@@ -206,45 +552,38 @@ void Server::unlockCritical()
     }
 }
 
-template <typename Handler, typename... Fn>
-void Server::asyncRunCritical(Handler &&handler, Fn &&... func)
+template <typename Handler>
+void Server::asyncRunCritical(const TaskGraph &graph, Handler &&handler)
 {
-    {
-        // Simpler lock since we're holding already
-        std::lock_guard<std::mutex> lock(_stateLock);
-        _counter += sizeof...(func);
-    }
-    // TODO: C++17 fold expressions
-    // HACK: GCC bug
-    auto lambda = [this, handler](auto &&func) {
-        _ioService.post(
-            [ this, func = std::forward<decltype(func)>(func), handler ] {
-                BOOST_SCOPE_EXIT_ALL(&)
-                {
-                    std::unique_lock<std::mutex> lock(_stateLock);
-                    if(--_counter == 1)
-                    {
-                        lock.unlock();
-                        handler();
-                    }
-                };
-                func();
-
-            });
-    };
-    int dummy[] = {0, (lambda(std::forward<Fn>(func)), 0)...};
-    // Notify all threads to make them poll for handlers again
-    _stateWait.notify_all();
+    graph.asyncRun(
+        [this](std::function<void()> &&func) {
+            _ioService.post(std::move(func));
+            // Notify all threads to make them poll for handlers again
+            _stateWait.notify_all();
+        },
+        std::forward<Handler>(handler));
 }
 
 void Server::start(boost::asio::coroutine coroutine)
 {
     BOOST_ASIO_CORO_REENTER(coroutine)
     {
+        _startupProfiler = std::make_unique<StartupProfiler>();
+        _startupProfiler->beginPhase("lock");
         lockCritical<LockType::Start>();
 
+        _startupProfiler->beginPhase("config");
         _config = _configManager.getConfig("cenisys");
+        {
+            double timeout = _config->getDouble(
+                ConfigSection::Path() / "shutdown" / "timeout", 30);
+            std::lock_guard<std::mutex> lock(_workersLock);
+            _shutdownTimeout =
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(timeout));
+        }
 
+        _startupProfiler->beginPhase("console");
         if(_config->getBool(ConfigSection::Path() / "console" / "enable", true))
         {
         setColor:
@@ -296,6 +635,7 @@ void Server::start(boost::asio::coroutine coroutine)
                                 "Starting Cenisys {1}.")) %
                                 SERVER_VERSION);
 
+        _startupProfiler->beginPhase("threads");
         {
             std::size_t threads =
                 _config->getUInt(ConfigSection::Path() / "threads", 0);
@@ -303,43 +643,37 @@ void Server::start(boost::asio::coroutine coroutine)
                 threads = std::thread::hardware_concurrency();
             if(threads == 0)
                 threads = 1;
+            _threadCount = threads;
             log(LogLevel::Info, boost::locale::format(boost::locale::translate(
                                     "Spinning up {1} thread.",
                                     "Spinning up {1} threads.", threads)) %
                                     threads);
             for(std::size_t i = 1; i < threads; i++)
             {
-                _threads.emplace_back([this] { _ioService.run(); });
+                spawnWorker();
             }
         }
 
+        _startupProfiler->beginPhase("tasks");
         BOOST_ASIO_CORO_YIELD asyncRunCritical(
-            [this, coroutine] { start(coroutine); },
-            [this] {
-                _work =
-                    std::make_unique<boost::asio::io_service::work>(_ioService);
-            },
-            [this] {
-                _helpCommand = registerCommand(
-                    "help", boost::locale::translate("Display this help"),
-                    [this](CommandSender &sender, const std::string &command) {
-                        sender.sendMessage(
-                            boost::locale::translate("List of commands:"));
-                        // TODO: Paging and more
-                        for(const auto &item : _commandList)
-                        {
-                            sender.sendMessage(
-                                boost::locale::format("/{1}: {2}") %
-                                item.first %
-                                std::get<boost::locale::message>(item.second));
-                        }
-                    });
-            },
-            [this] {
-                _defaultCommands =
-                    std::make_unique<DefaultCommandHandlers>(*this);
+            *_startupTasks,
+            [this, coroutine](const TaskGraph::Result &result) {
+                _startupProfiler->addTasks(result);
+                _startupFailed = !checkTaskGraphResult(*this, result);
+                start(coroutine);
             });
 
+        if(_startupFailed)
+        {
+            log(LogLevel::Severe,
+                boost::locale::translate("Failed to start the server."));
+            _startupProfiler.reset();
+            unlockCritical();
+            terminate();
+            return;
+        }
+
+        _startupProfiler->beginPhase("signals");
         _termSignals.async_wait(
             [this](const boost::system::error_code &ec, int signal) {
                 if(ec == boost::asio::error::operation_aborted)
@@ -347,7 +681,17 @@ void Server::start(boost::asio::coroutine coroutine)
                 terminate();
             });
 
+        _startupProfiler->finish();
         log(LogLevel::Info, boost::locale::translate("Server ready."));
+        _startupProfiler->report(*this);
+        if(!_startupProfiler->writeJson(_dataDir / "startup.json"))
+        {
+            log(LogLevel::Warning,
+                boost::locale::format(boost::locale::translate(
+                    "Failed to write startup report to {1}")) %
+                    (_dataDir / "startup.json"));
+        }
+        _startupProfiler.reset();
 
         unlockCritical();
     }
@@ -357,6 +701,13 @@ void Server::stop(boost::asio::coroutine coroutine)
 {
     BOOST_ASIO_CORO_REENTER(coroutine)
     {
+        // Events posted before the stop go first. Waiting for them here
+        // could block those waiting further down the stack of this thread.
+        if(eventsPending())
+        {
+            _ioService.post([this] { stop(); });
+            return;
+        }
         if(!lockCritical<LockType::Stop>())
             return;
 
@@ -365,10 +716,29 @@ void Server::stop(boost::asio::coroutine coroutine)
         _termSignals.cancel();
 
         BOOST_ASIO_CORO_YIELD asyncRunCritical(
-            [this, coroutine] { stop(coroutine); },
-            [this] { _defaultCommands.reset(); },
-            [this] { unregisterCommand(_helpCommand); },
-            [this] { _work.reset(); });
+            *_shutdownTasks,
+            [this, coroutine](const TaskGraph::Result &result) {
+                checkTaskGraphResult(*this, result);
+                stop(coroutine);
+            });
+
+        // Always let the threads finish, even if some task failed
+        _work.reset();
+        _configManager.saveAll();
+
+        std::size_t dropped;
+        {
+            std::lock_guard<std::mutex> lock(_stateLock);
+            dropped = _droppedEvents;
+        }
+        if(dropped)
+        {
+            log(LogLevel::Warning,
+                boost::locale::format(boost::locale::translate(
+                    "Dropped {1} event while stopping.",
+                    "Dropped {1} events while stopping.", dropped)) %
+                    dropped);
+        }
 
         log(LogLevel::Info,
             boost::locale::translate("Server successfully terminated."));
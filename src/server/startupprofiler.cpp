@@ -0,0 +1,195 @@
+/*
+ * StartupProfiler
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server/startupprofiler.h"
+#include "config.h"
+#include "server/server.h"
+#include "util/cputime.h"
+#include <algorithm>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/locale/format.hpp>
+#include <boost/locale/message.hpp>
+
+namespace
+{
+
+double toMilliseconds(std::chrono::nanoseconds duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+std::string escapeJson(const std::string &str)
+{
+    std::string result;
+    for(char c : str)
+    {
+        if(c == '"' || c == '\\')
+            result += '\\';
+        result += c;
+    }
+    return result;
+}
+
+void writeSamples(std::ostream &out,
+                  const std::vector<cenisys::StartupProfiler::Sample> &samples)
+{
+    out << '[';
+    bool first = true;
+    for(const auto &item : samples)
+    {
+        if(!first)
+            out << ',';
+        first = false;
+        out << "\n    {\"name\": \"" << escapeJson(item.name)
+            << "\", \"start_ms\": " << toMilliseconds(item.start)
+            << ", \"wall_ms\": " << toMilliseconds(item.wall)
+            << ", \"cpu_ms\": " << toMilliseconds(item.cpu) << '}';
+    }
+    out << "\n  ]";
+}
+
+} // namespace
+
+namespace cenisys
+{
+
+StartupProfiler::StartupProfiler()
+    : _wallStart(Clock::now()), _cpuStart(processCpuTime()),
+      _criticalPathLength(std::chrono::nanoseconds::zero())
+{
+}
+
+void StartupProfiler::beginPhase(const std::string &name)
+{
+    Clock::time_point wallNow = Clock::now();
+    std::chrono::nanoseconds cpuNow = processCpuTime();
+    endPhase(wallNow, cpuNow);
+    _phaseName = name;
+    _phaseWallStart = wallNow;
+    _phaseCpuStart = cpuNow;
+}
+
+void StartupProfiler::finish()
+{
+    Clock::time_point wallNow = Clock::now();
+    std::chrono::nanoseconds cpuNow = processCpuTime();
+    endPhase(wallNow, cpuNow);
+    _total = {"total", std::chrono::nanoseconds::zero(), wallNow - _wallStart,
+              cpuNow - _cpuStart};
+    std::lock_guard<std::mutex> lock(_tasksLock);
+    std::sort(_tasks.begin(), _tasks.end(),
+              [](const Sample &lhs, const Sample &rhs) {
+                  return lhs.start < rhs.start;
+              });
+}
+
+void StartupProfiler::addTask(const std::string &name, Clock::time_point start,
+                              std::chrono::nanoseconds wall,
+                              std::chrono::nanoseconds cpu)
+{
+    std::lock_guard<std::mutex> lock(_tasksLock);
+    _tasks.push_back({name, start - _wallStart, wall, cpu});
+}
+
+void StartupProfiler::addTasks(const TaskGraph::Result &result)
+{
+    for(const auto &item : result.tasks)
+        addTask(item.name, item.start, item.end - item.start, item.cpu);
+    std::lock_guard<std::mutex> lock(_tasksLock);
+    _criticalPath.insert(_criticalPath.end(), result.criticalPath.begin(),
+                         result.criticalPath.end());
+    _criticalPathLength += result.duration;
+}
+
+void StartupProfiler::report(Server &server)
+{
+    server.log(Server::LogLevel::Info,
+               boost::locale::format(boost::locale::translate(
+                   "Startup took {1} ms ({2} ms CPU time).")) %
+                   toMilliseconds(_total.wall) % toMilliseconds(_total.cpu));
+    for(const auto &item : _phases)
+    {
+        server.log(Server::LogLevel::Info,
+                   boost::locale::format(boost::locale::translate(
+                       "  Phase {1}: {2} ms ({3} ms CPU time)")) %
+                       item.name % toMilliseconds(item.wall) %
+                       toMilliseconds(item.cpu));
+    }
+    std::lock_guard<std::mutex> lock(_tasksLock);
+    for(const auto &item : _tasks)
+    {
+        server.log(Server::LogLevel::Info,
+                   boost::locale::format(boost::locale::translate(
+                       "  Task {1}: {2} ms ({3} ms CPU time)")) %
+                       item.name % toMilliseconds(item.wall) %
+                       toMilliseconds(item.cpu));
+    }
+    if(!_criticalPath.empty())
+    {
+        std::string path;
+        for(const auto &item : _criticalPath)
+            path += (path.empty() ? "" : " -> ") + item;
+        server.log(Server::LogLevel::Info,
+                   boost::locale::format(boost::locale::translate(
+                       "  Critical path: {1} ({2} ms)")) %
+                       path % toMilliseconds(_criticalPathLength));
+    }
+}
+
+bool StartupProfiler::writeJson(const boost::filesystem::path &file)
+{
+    boost::filesystem::ofstream out(file);
+    if(!out)
+        return false;
+    out.imbue(std::locale::classic());
+    out << "{\n  \"version\": \"" << escapeJson(SERVER_VERSION) << "\",\n"
+        << "  \"total\": {\"wall_ms\": " << toMilliseconds(_total.wall)
+        << ", \"cpu_ms\": " << toMilliseconds(_total.cpu) << "},\n"
+        << "  \"phases\": ";
+    writeSamples(out, _phases);
+    out << ",\n  \"tasks\": ";
+    {
+        std::lock_guard<std::mutex> lock(_tasksLock);
+        writeSamples(out, _tasks);
+        out << ",\n  \"critical_path\": {\"wall_ms\": "
+            << toMilliseconds(_criticalPathLength) << ", \"tasks\": [";
+        bool first = true;
+        for(const auto &item : _criticalPath)
+        {
+            out << (first ? "" : ", ") << '"' << escapeJson(item) << '"';
+            first = false;
+        }
+        out << "]}";
+    }
+    out << "\n}\n";
+    return static_cast<bool>(out);
+}
+
+void StartupProfiler::endPhase(Clock::time_point wallNow,
+                               std::chrono::nanoseconds cpuNow)
+{
+    if(_phaseName.empty())
+        return;
+    _phases.push_back({std::move(_phaseName), _phaseWallStart - _wallStart,
+                       wallNow - _phaseWallStart, cpuNow - _phaseCpuStart});
+    _phaseName.clear();
+}
+
+} // namespace cenisys
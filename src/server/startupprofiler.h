@@ -0,0 +1,99 @@
+/*
+ * StartupProfiler
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_STARTUPPROFILER_H
+#define CENISYS_STARTUPPROFILER_H
+
+#include "server/taskgraph.h"
+#include <boost/filesystem/path.hpp>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cenisys
+{
+
+class Server;
+
+class StartupProfiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Sample
+    {
+        std::string name;
+        //! Offset from the beginning of the startup.
+        std::chrono::nanoseconds start;
+        std::chrono::nanoseconds wall;
+        std::chrono::nanoseconds cpu;
+    };
+
+    StartupProfiler();
+
+    //!
+    //! \brief Begin a new sequential phase, ending the current one if any.
+    //! \param name Name of the phase.
+    //!
+    void beginPhase(const std::string &name);
+    //!
+    //! \brief End the current phase and the whole measurement.
+    //!
+    void finish();
+
+    void addTask(const std::string &name, Clock::time_point start,
+                 std::chrono::nanoseconds wall, std::chrono::nanoseconds cpu);
+    //!
+    //! \brief Record every task and the critical path of a task graph run.
+    //!
+    void addTasks(const TaskGraph::Result &result);
+
+    //!
+    //! \brief Log the collected samples at Info level.
+    //!
+    void report(Server &server);
+    //!
+    //! \brief Dump the collected samples as JSON.
+    //! \return true if the file is successfully written.
+    //!
+    bool writeJson(const boost::filesystem::path &file);
+
+private:
+    void endPhase(Clock::time_point wallNow, std::chrono::nanoseconds cpuNow);
+
+    Clock::time_point _wallStart;
+    std::chrono::nanoseconds _cpuStart;
+
+    std::string _phaseName;
+    Clock::time_point _phaseWallStart;
+    std::chrono::nanoseconds _phaseCpuStart;
+
+    Sample _total;
+    std::vector<Sample> _phases;
+    std::vector<Sample> _tasks;
+    std::mutex _tasksLock;
+    std::vector<std::string> _criticalPath;
+    std::chrono::nanoseconds _criticalPathLength;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_STARTUPPROFILER_H
@@ -0,0 +1,236 @@
+/*
+ * TaskGraph
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server/taskgraph.h"
+#include "util/cputime.h"
+#include <memory>
+#include <stdexcept>
+
+namespace cenisys
+{
+
+namespace
+{
+
+struct RunState
+{
+    struct Node
+    {
+        std::string name;
+        TaskGraph::Task task;
+        std::vector<std::size_t> dependencies;
+        std::vector<std::size_t> dependents;
+        std::size_t pending;
+        bool finished;
+        TaskGraph::Sample sample;
+    };
+
+    std::vector<Node> nodes;
+    std::mutex lock;
+    std::size_t running;
+    std::size_t remaining;
+    bool failed;
+    TaskGraph::Clock::time_point start;
+    TaskGraph::Result result;
+    TaskGraph::Executor executor;
+    TaskGraph::Handler handler;
+};
+
+void complete(RunState &state)
+{
+    TaskGraph::Result &result = state.result;
+    const RunState::Node *current = nullptr;
+    for(const auto &node : state.nodes)
+    {
+        if(node.finished &&
+           (!current || node.sample.end > current->sample.end))
+            current = &node;
+    }
+    result.duration = current ? current->sample.end - state.start
+                              : std::chrono::nanoseconds::zero();
+    // Walk back through the dependency which finished last
+    while(current)
+    {
+        result.criticalPath.insert(result.criticalPath.begin(), current->name);
+        const RunState::Node *next = nullptr;
+        for(std::size_t index : current->dependencies)
+        {
+            const RunState::Node &node = state.nodes[index];
+            if(!next || node.sample.end > next->sample.end)
+                next = &node;
+        }
+        current = next;
+    }
+    state.handler(result);
+}
+
+void schedule(const std::shared_ptr<RunState> &state, std::size_t index)
+{
+    state->executor([state, index] {
+        RunState::Node &node = state->nodes[index];
+        std::exception_ptr error;
+        node.sample.name = node.name;
+        node.sample.start = TaskGraph::Clock::now();
+        std::chrono::nanoseconds cpuStart = threadCpuTime();
+        try
+        {
+            node.task();
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+        node.sample.cpu = threadCpuTime() - cpuStart;
+        node.sample.end = TaskGraph::Clock::now();
+
+        std::vector<std::size_t> ready;
+        std::unique_lock<std::mutex> lock(state->lock);
+        node.finished = true;
+        state->result.tasks.push_back(node.sample);
+        state->running--;
+        state->remaining--;
+        if(error && !state->failed)
+        {
+            state->failed = true;
+            state->result.failedTask = node.name;
+            state->result.error = error;
+        }
+        if(!state->failed)
+        {
+            for(std::size_t dependent : node.dependents)
+            {
+                if(--state->nodes[dependent].pending == 0)
+                    ready.push_back(dependent);
+            }
+        }
+        state->running += ready.size();
+        bool done = state->running == 0 &&
+                    (state->failed || state->remaining == 0);
+        lock.unlock();
+
+        for(std::size_t item : ready)
+            schedule(state, item);
+        if(done)
+            complete(*state);
+    });
+}
+
+} // namespace
+
+bool TaskGraph::addTask(const std::string &name,
+                        const std::vector<std::string> &dependencies,
+                        TaskGraph::Task &&task)
+{
+    std::lock_guard<std::mutex> lock(_nodesLock);
+    return _nodes.insert({name, Node{dependencies, std::move(task)}}).second;
+}
+
+bool TaskGraph::removeTask(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(_nodesLock);
+    return _nodes.erase(name) != 0;
+}
+
+void TaskGraph::asyncRun(const TaskGraph::Executor &executor,
+                         TaskGraph::Handler &&handler) const
+{
+    auto state = std::make_shared<RunState>();
+    state->running = 0;
+    state->failed = false;
+    state->start = Clock::now();
+    state->executor = executor;
+    state->handler = std::move(handler);
+    {
+        std::lock_guard<std::mutex> lock(_nodesLock);
+        std::map<std::string, std::size_t> indices;
+        for(const auto &item : _nodes)
+        {
+            indices.insert({item.first, state->nodes.size()});
+            state->nodes.push_back({item.first, item.second.task, {}, {},
+                                    item.second.dependencies.size(), false,
+                                    {}});
+        }
+        for(const auto &item : _nodes)
+        {
+            std::size_t index = indices[item.first];
+            for(const std::string &dependency : item.second.dependencies)
+            {
+                auto it = indices.find(dependency);
+                if(it == indices.end())
+                {
+                    state->result.failedTask = item.first;
+                    state->result.error =
+                        std::make_exception_ptr(std::invalid_argument(
+                            "unknown dependency " + dependency));
+                    state->handler(state->result);
+                    return;
+                }
+                state->nodes[index].dependencies.push_back(it->second);
+                state->nodes[it->second].dependents.push_back(index);
+            }
+        }
+    }
+    state->remaining = state->nodes.size();
+
+    // Reject cycles before anything runs
+    std::vector<std::size_t> pending, ready;
+    for(std::size_t i = 0; i < state->nodes.size(); i++)
+    {
+        pending.push_back(state->nodes[i].pending);
+        if(pending[i] == 0)
+            ready.push_back(i);
+    }
+    std::size_t initial = ready.size();
+    for(std::size_t i = 0; i < ready.size(); i++)
+    {
+        for(std::size_t dependent : state->nodes[ready[i]].dependents)
+        {
+            if(--pending[dependent] == 0)
+                ready.push_back(dependent);
+        }
+    }
+    if(ready.size() != state->nodes.size())
+    {
+        for(std::size_t i = 0; i < pending.size(); i++)
+        {
+            if(pending[i] != 0)
+            {
+                state->result.failedTask = state->nodes[i].name;
+                break;
+            }
+        }
+        state->result.error = std::make_exception_ptr(
+            std::invalid_argument("dependency cycle detected"));
+        state->handler(state->result);
+        return;
+    }
+    if(state->nodes.empty())
+    {
+        complete(*state);
+        return;
+    }
+
+    state->running = initial;
+    ready.resize(initial);
+    for(std::size_t item : ready)
+        schedule(state, item);
+}
+
+} // namespace cenisys
@@ -0,0 +1,107 @@
+/*
+ * TaskGraph
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_TASKGRAPH_H
+#define CENISYS_TASKGRAPH_H
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief A set of named tasks with dependencies between them.
+//!
+//! Tasks are run with as much parallelism as the dependencies allow. When a
+//! task throws, no further tasks are started and the completion handler is
+//! called once the running ones have finished.
+//!
+class TaskGraph
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+    using Executor = std::function<void(std::function<void()> &&)>;
+
+    struct Sample
+    {
+        std::string name;
+        Clock::time_point start;
+        Clock::time_point end;
+        std::chrono::nanoseconds cpu;
+    };
+
+    struct Result
+    {
+        //! Samples of finished tasks, in order of completion.
+        std::vector<Sample> tasks;
+        //! The chain of tasks which determined the total duration.
+        std::vector<std::string> criticalPath;
+        std::chrono::nanoseconds duration;
+        //! Name of the failed task, empty if everything succeeded.
+        std::string failedTask;
+        std::exception_ptr error;
+    };
+
+    using Handler = std::function<void(const Result &)>;
+
+    //!
+    //! \brief Add a task.
+    //! \param name Unique name of the task.
+    //! \param dependencies Names of tasks which must finish before this one.
+    //! \param task The function to run.
+    //! \return false if a task with the same name already exists.
+    //!
+    bool addTask(const std::string &name,
+                 const std::vector<std::string> &dependencies, Task &&task);
+    //!
+    //! \brief Remove a task.
+    //! \return false if there is no such task.
+    //!
+    bool removeTask(const std::string &name);
+
+    //!
+    //! \brief Run every task in the graph.
+    //! \param executor Used to schedule the tasks, possibly in parallel.
+    //! \param handler Called on the thread running the last task, or
+    //! immediately if the graph is empty or invalid.
+    //!
+    void asyncRun(const Executor &executor, Handler &&handler) const;
+
+private:
+    struct Node
+    {
+        std::vector<std::string> dependencies;
+        Task task;
+    };
+
+    std::map<std::string, Node> _nodes;
+    mutable std::mutex _nodesLock;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_TASKGRAPH_H
@@ -62,7 +62,7 @@ private:
 
     boost::asio::streambuf _readBuffer;
 
-    boost::asio::strand _writeStrand;
+    boost::asio::io_service::strand _writeStrand;
     boost::asio::streambuf _writeBuffer;
 };
 
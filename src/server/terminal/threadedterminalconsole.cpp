@@ -18,10 +18,16 @@
  * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "server/terminal/threadedterminalconsole.h"
+#include "config.h"
 #include "server/server.h"
 #include "server/terminal/terminalcolor.h"
 #include <boost/locale/format.hpp>
 #include <iostream>
+#if defined(UNIX)
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 namespace cenisys
 {
@@ -50,33 +56,69 @@ void ThreadedTerminalConsole::detach()
     lock.unlock();
     _writeQueueNotifier.notify_all();
     _writeThread.join();
+#if !defined(UNIX)
     if(std::cin)
     {
         std::cerr
             << boost::locale::translate("Please press Enter to continue…").str()
             << std::endl;
     }
+#endif
     _readThread.join();
     _console = nullptr;
 }
 
 void ThreadedTerminalConsole::readWorker()
 {
+#if defined(UNIX)
+    // Poll with a timeout so detach() never waits for input
+    std::string pending;
+    while(_running)
+    {
+        pollfd fd = {STDIN_FILENO, POLLIN, 0};
+        int ret = poll(&fd, 1, 100);
+        if(ret == 0 || (ret < 0 && errno == EINTR))
+            continue;
+        char buf[1024];
+        ssize_t size = ret < 0 ? -1 : read(STDIN_FILENO, buf, sizeof(buf));
+        if(size < 0 && errno == EINTR)
+            continue;
+        if(size <= 0)
+        {
+            _console->getServer().terminate();
+            break;
+        }
+        pending.append(buf, size);
+        std::string::size_type pos;
+        while((pos = pending.find('\n')) != std::string::npos)
+        {
+            std::string line = pending.substr(0, pos);
+            pending.erase(0, pos + 1);
+            if(!line.empty())
+                dispatch(std::move(line));
+        }
+    }
+#else
     while(_running)
     {
         std::string buf;
         std::getline(std::cin, buf);
         if(!buf.empty())
-            _console->getServer().processEvent([ this, buf = std::move(buf) ] {
-                _console->getServer().dispatchCommand(*_console,
-                                                      std::move(buf));
-            });
+            dispatch(std::move(buf));
         if(!std::cin)
         {
             _console->getServer().terminate();
             break;
         }
     }
+#endif
+}
+
+void ThreadedTerminalConsole::dispatch(std::string &&command)
+{
+    _console->getServer().processEvent([ this, buf = std::move(command) ] {
+        _console->getServer().dispatchCommand(*_console, std::move(buf));
+    });
 }
 
 void ThreadedTerminalConsole::writeWorker()
@@ -48,6 +48,7 @@ public:
 private:
     void readWorker();
     void writeWorker();
+    void dispatch(std::string &&command);
 
     bool _enableColor;
 
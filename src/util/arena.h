@@ -0,0 +1,131 @@
+/*
+ * Arena
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_ARENA_H
+#define CENISYS_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief Bump allocator for scratch memory which dies all at once.
+//!
+//! Nothing is freed or destructed individually; reset() makes all the
+//! memory available again and keeps the chunks for the next round.
+//!
+class Arena
+{
+public:
+    explicit Arena(std::size_t chunkSize = 64 * 1024)
+        : _chunkSize(chunkSize), _current(0), _offset(0), _used(0)
+    {
+    }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(std::size_t size,
+                   std::size_t alignment = alignof(std::max_align_t))
+    {
+        for(; _current < _chunks.size(); _current++, _offset = 0)
+        {
+            Chunk &chunk = _chunks[_current];
+            std::size_t begin = (_offset + alignment - 1) / alignment *
+                                alignment;
+            if(begin + size <= chunk.size)
+            {
+                _offset = begin + size;
+                _used += size;
+                return chunk.data.get() + begin;
+            }
+        }
+        // Chunks are allocated aligned for any type
+        std::size_t chunkSize = size > _chunkSize ? size : _chunkSize;
+        _chunks.push_back({std::unique_ptr<std::uint8_t[]>(
+                               new std::uint8_t[chunkSize]),
+                           chunkSize});
+        _current = _chunks.size() - 1;
+        _offset = size;
+        _used += size;
+        return _chunks.back().data.get();
+    }
+
+    //!
+    //! \brief Allocate uninitialized room for trivial objects.
+    //!
+    template <typename T>
+    T *allocateArray(std::size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "Arena never runs destructors");
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    //!
+    //! \brief Release everything allocated so far.
+    //!
+    //! Chunks larger than the regular size are returned to the heap.
+    //!
+    void reset()
+    {
+        for(auto it = _chunks.begin(); it != _chunks.end();)
+        {
+            if(it->size > _chunkSize)
+                it = _chunks.erase(it);
+            else
+                ++it;
+        }
+        _current = 0;
+        _offset = 0;
+        _used = 0;
+    }
+
+    //! Bytes handed out since the last reset.
+    std::size_t getUsed() const { return _used; }
+    std::size_t getCapacity() const
+    {
+        std::size_t result = 0;
+        for(const auto &item : _chunks)
+            result += item.size;
+        return result;
+    }
+
+private:
+    struct Chunk
+    {
+        std::unique_ptr<std::uint8_t[]> data;
+        std::size_t size;
+    };
+
+    std::size_t _chunkSize;
+    std::vector<Chunk> _chunks;
+    std::size_t _current;
+    std::size_t _offset;
+    std::size_t _used;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_ARENA_H
@@ -0,0 +1,78 @@
+/*
+ * Helpers for measuring CPU time.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_CPUTIME_H
+#define CENISYS_CPUTIME_H
+
+#include "config.h"
+#include <chrono>
+#include <ctime>
+#if defined(UNIX)
+#include <time.h>
+#endif
+
+namespace cenisys
+{
+
+namespace detail
+{
+inline std::chrono::nanoseconds readCpuClock(int id)
+{
+#if defined(UNIX)
+    timespec value;
+    if(clock_gettime(id, &value) == 0)
+        return std::chrono::seconds(value.tv_sec) +
+               std::chrono::nanoseconds(value.tv_nsec);
+#endif
+    return std::chrono::nanoseconds(
+        static_cast<std::chrono::nanoseconds::rep>(
+            std::clock() * (1000000000.0 / CLOCKS_PER_SEC)));
+}
+} // namespace detail
+
+//!
+//! \brief CPU time consumed by the whole process.
+//!
+inline std::chrono::nanoseconds processCpuTime()
+{
+#if defined(UNIX)
+    return detail::readCpuClock(CLOCK_PROCESS_CPUTIME_ID);
+#else
+    return detail::readCpuClock(0);
+#endif
+}
+
+//!
+//! \brief CPU time consumed by the calling thread.
+//!
+//! Falls back to the process CPU time where per-thread clocks are unavailable.
+//!
+inline std::chrono::nanoseconds threadCpuTime()
+{
+#if defined(UNIX)
+    return detail::readCpuClock(CLOCK_THREAD_CPUTIME_ID);
+#else
+    return detail::readCpuClock(0);
+#endif
+}
+
+} // namespace cenisys
+
+#endif // CENISYS_CPUTIME_H
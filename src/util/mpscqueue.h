@@ -0,0 +1,93 @@
+/*
+ * MpscQueue
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_MPSCQUEUE_H
+#define CENISYS_MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace cenisys
+{
+
+//!
+//! \brief Unbounded lock-free queue with many producers and one consumer.
+//!
+//! Pushing never blocks and is wait-free. Only one thread may pop at a time.
+//! T must be default constructible.
+//!
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : _head(new Node), _tail(_head.load()) {}
+    ~MpscQueue()
+    {
+        T value;
+        while(pop(value))
+            ;
+        delete _tail;
+    }
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void push(T &&value)
+    {
+        Node *node = new Node(std::move(value));
+        Node *previous = _head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    //!
+    //! \brief Take the oldest element.
+    //!
+    //! An element whose push is still in progress may not be visible yet.
+    //!
+    //! \return false if the queue is empty.
+    //!
+    bool pop(T &value)
+    {
+        Node *tail = _tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if(!next)
+            return false;
+        value = std::move(next->value);
+        // The popped node becomes the new stub
+        _tail = next;
+        delete tail;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next(nullptr) {}
+        explicit Node(T &&value) : next(nullptr), value(std::move(value)) {}
+        std::atomic<Node *> next;
+        T value;
+    };
+
+    std::atomic<Node *> _head;
+    Node *_tail;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_MPSCQUEUE_H
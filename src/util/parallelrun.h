@@ -0,0 +1,122 @@
+/*
+ * ParallelRun
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_PARALLELRUN_H
+#define CENISYS_PARALLELRUN_H
+
+#include <atomic>
+#include <boost/asio/io_service.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace cenisys
+{
+
+//!
+//! \brief Runs numbered jobs on the calling thread and helpers posted to an
+//! io_service.
+//!
+//! Every thread claims the next job through an atomic index until none is
+//! left, so helpers which start late have nothing to do and return. The
+//! calling thread waits for every job, as helpers may still be running the
+//! last ones, and then rethrows the first exception of a job.
+//!
+class ParallelRun
+{
+public:
+    //! Called with the index of the job.
+    using Job = std::function<void(std::size_t index)>;
+
+    //!
+    //! \brief Run the jobs 0 to count - 1.
+    //! \param threads Threads to run them on, including the calling one.
+    //!
+    static void run(boost::asio::io_service &ioService, std::size_t threads,
+                    std::size_t count, Job &&job)
+    {
+        // Shared with the helpers, which may only start after the return
+        auto run = std::make_shared<ParallelRun>(count, std::move(job));
+        for(std::size_t i = 1; i < threads; i++)
+            ioService.post([run] { run->work(); });
+        run->work();
+        {
+            std::unique_lock<std::mutex> lock(run->_mutex);
+            run->_finished.wait(
+                lock, [&run] { return run->_done == run->_count; });
+        }
+        if(run->_error)
+            std::rethrow_exception(run->_error);
+    }
+
+    ParallelRun(std::size_t count, Job &&job)
+        : _count(count), _job(std::move(job)), _next(0), _done(0)
+    {
+    }
+    ParallelRun(const ParallelRun &) = delete;
+    ParallelRun &operator=(const ParallelRun &) = delete;
+
+private:
+    //!
+    //! \brief Run jobs until none is left.
+    //!
+    void work()
+    {
+        std::size_t finished = 0;
+        for(;;)
+        {
+            std::size_t index = _next.fetch_add(1, std::memory_order_relaxed);
+            if(index >= _count)
+                break;
+            try
+            {
+                _job(index);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(!_error)
+                    _error = std::current_exception();
+            }
+            finished++;
+        }
+        if(!finished)
+            return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done += finished;
+        if(_done == _count)
+            _finished.notify_all();
+    }
+
+    const std::size_t _count;
+    Job _job;
+    std::atomic<std::size_t> _next;
+    std::mutex _mutex;
+    std::condition_variable _finished;
+    std::size_t _done;
+    std::exception_ptr _error;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_PARALLELRUN_H
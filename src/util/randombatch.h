@@ -0,0 +1,88 @@
+/*
+ * RandomBatch
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_RANDOMBATCH_H
+#define CENISYS_RANDOMBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cenisys
+{
+
+//!
+//! \brief Fast random numbers, made a batch at a time.
+//!
+//! Runs LANES independent xorshift32 generators side by side. A step of
+//! all lanes is a few shifts and xors on a small array, which the compiler
+//! turns into vector instructions, so a batch costs about as much as a
+//! couple of numbers from a single generator. Good enough to pick blocks,
+//! not for anything an attacker may want to predict.
+//!
+class RandomBatch
+{
+public:
+    static constexpr std::size_t LANES = 8;
+
+    explicit RandomBatch(std::uint64_t seed) { reseed(seed); }
+
+    //!
+    //! \brief Start over from a seed, spread over the lanes by splitmix64.
+    //!
+    void reseed(std::uint64_t seed)
+    {
+        for(std::size_t lane = 0; lane < LANES; lane++)
+        {
+            seed += 0x9e3779b97f4a7c15ull;
+            std::uint64_t value = seed;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+            value ^= value >> 31;
+            // Zero would stay zero
+            _state[lane] = static_cast<std::uint32_t>(value) | 1;
+        }
+    }
+
+    //!
+    //! \brief Write count numbers, rounded up to a multiple of LANES.
+    //!
+    void fill(std::uint32_t *output, std::size_t count)
+    {
+        for(std::size_t i = 0; i < count; i += LANES)
+        {
+            for(std::size_t lane = 0; lane < LANES; lane++)
+            {
+                std::uint32_t value = _state[lane];
+                value ^= value << 13;
+                value ^= value >> 17;
+                value ^= value << 5;
+                _state[lane] = value;
+                output[i + lane] = value;
+            }
+        }
+    }
+
+private:
+    alignas(32) std::uint32_t _state[LANES];
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_RANDOMBATCH_H
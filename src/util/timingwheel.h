@@ -0,0 +1,129 @@
+/*
+ * TimingWheel
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_TIMINGWHEEL_H
+#define CENISYS_TIMINGWHEEL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief Hashed timing wheel for many short timers.
+//!
+//! Scheduling is O(1). Timers fire up to one resolution late. Timers cannot
+//! be cancelled; the owner ignores the ids it no longer cares about.
+//!
+template <typename Id>
+class TimingWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimingWheel(Clock::duration resolution, std::size_t slots,
+                Clock::time_point now)
+        : _resolution(resolution), _origin(now), _currentTick(0),
+          _slots(slots)
+    {
+    }
+
+    void schedule(Id id, Clock::time_point deadline)
+    {
+        std::uint64_t tick = deadline > _origin
+                                 ? (deadline - _origin) / _resolution
+                                 : 0;
+        // Timers in the past fire on the next advance
+        if(tick < _currentTick)
+            tick = _currentTick;
+        _slots[tick % _slots.size()].push_back({id, tick});
+    }
+
+    //!
+    //! \brief Fire the timers which are due.
+    //! \param expired Called with the id of every fired timer. It may
+    //! schedule new timers.
+    //!
+    template <typename Fn>
+    void advance(Clock::time_point now, Fn &&expired)
+    {
+        if(now < _origin)
+            return;
+        std::uint64_t nowTick = (now - _origin) / _resolution;
+        // Only whole ticks in the past are processed. The current tick is
+        // moved first, so timers scheduled while firing are not lost.
+        if(nowTick > _currentTick + _slots.size())
+        {
+            // Visit every slot once, with every timer in them due
+            std::uint64_t first = _currentTick;
+            _currentTick = nowTick;
+            for(std::size_t i = 0; i < _slots.size(); i++)
+                fire(first + i, nowTick - 1, expired);
+            return;
+        }
+        while(_currentTick < nowTick)
+        {
+            std::uint64_t tick = _currentTick++;
+            fire(tick, tick, expired);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        Id id;
+        std::uint64_t tick;
+    };
+
+    template <typename Fn>
+    void fire(std::uint64_t tick, std::uint64_t due, Fn &expired)
+    {
+        std::vector<Entry> &slot = _slots[tick % _slots.size()];
+        _firing.clear();
+        for(std::size_t i = 0; i < slot.size();)
+        {
+            if(slot[i].tick <= due)
+            {
+                _firing.push_back(slot[i].id);
+                slot[i] = slot.back();
+                slot.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+        for(const auto &id : _firing)
+            expired(id);
+    }
+
+    Clock::duration _resolution;
+    Clock::time_point _origin;
+    std::uint64_t _currentTick;
+    std::vector<std::vector<Entry>> _slots;
+    std::vector<Id> _firing;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_TIMINGWHEEL_H
@@ -0,0 +1,258 @@
+/*
+ * BlockTicker
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/blockticker.h"
+#include "util/randombatch.h"
+#include "world/lightengine.h"
+#include <algorithm>
+
+namespace cenisys
+{
+
+constexpr unsigned BlockTicker::DEFAULT_RANDOM_TICKS;
+constexpr unsigned BlockTicker::MAX_RANDOM_TICKS;
+constexpr unsigned BlockTicker::FALL_DELAY;
+
+namespace
+{
+
+constexpr BlockId GRASS = 2;
+constexpr BlockId DIRT = 3;
+constexpr BlockId MYCELIUM = 110;
+//! Grass dies under blocks more opaque than this, and cannot spread there.
+constexpr std::uint8_t MAX_COVER_OPACITY = 2;
+
+struct Properties
+{
+    ChunkColumn::BlockSet randomlyTicked;
+    ChunkColumn::BlockSet falling;
+    //! Falling blocks replace these.
+    ChunkColumn::BlockSet replaceable;
+};
+
+Properties makeProperties()
+{
+    Properties result;
+    result.randomlyTicked.set(GRASS);
+    result.randomlyTicked.set(MYCELIUM);
+    // Sand and gravel
+    result.falling.set(12);
+    result.falling.set(13);
+    // Air, water, lava and fire
+    for(BlockId block : {0, 8, 9, 10, 11, 51})
+        result.replaceable.set(block);
+    return result;
+}
+
+const Properties PROPERTIES = makeProperties();
+
+bool has(const ChunkColumn::BlockSet &blocks, BlockId block)
+{
+    return block < blocks.size() && blocks[block];
+}
+
+//! Dirt with light coming in from above.
+bool canSpreadTo(const ChunkColumn &column, unsigned x, unsigned y,
+                 unsigned z)
+{
+    if(column.getBlock(x, y, z) != DIRT)
+        return false;
+    return y + 1 >= ChunkColumn::HEIGHT ||
+           LightEngine::getOpacity(column.getBlock(x, y + 1, z)) <=
+               MAX_COVER_OPACITY;
+}
+
+//! Mixes the column and the tick into a seed.
+std::uint64_t seedOf(std::int32_t x, std::int32_t z, std::uint64_t tick)
+{
+    std::uint64_t result = (std::uint64_t(std::uint32_t(x)) << 32) |
+                           std::uint32_t(z);
+    return result ^ (tick * 0xd6e8feb86659fd93ull);
+}
+
+} // namespace
+
+BlockTicker::BlockTicker(ColumnLookup &&lookup, BlockSetter &&setter)
+    : _lookup(std::move(lookup)), _setter(std::move(setter)),
+      _randomTicks(DEFAULT_RANDOM_TICKS), _tick(0)
+{
+}
+
+void BlockTicker::tickColumn(ChunkColumn &column, RegionTicker::Region &region)
+{
+    std::uint64_t now = _tick;
+    std::size_t run = column.getScheduledTicks().runDue(
+        now, [&](const ScheduledTicks::Tick &tick) {
+            unsigned x = tick.position & 15;
+            unsigned z = (tick.position >> 4) & 15;
+            unsigned y = tick.position >> 8;
+            // Replaced since it was scheduled
+            if(column.getBlock(x, y, z) == tick.block)
+                scheduledTick(column, region, x, y, z, tick.block);
+        });
+    if(run)
+        _counters.scheduledRun.fetch_add(run, std::memory_order_relaxed);
+
+    std::uint16_t sections =
+        column.getTickableSections(PROPERTIES.randomlyTicked);
+    std::uint64_t skipped = 0;
+    for(std::size_t y = 0; y < ChunkColumn::SECTIONS; y++)
+    {
+        if(column.hasSection(y) && !(sections & (1 << y)))
+            skipped++;
+    }
+    if(skipped)
+        _counters.sectionsSkipped.fetch_add(skipped,
+                                            std::memory_order_relaxed);
+    if(!sections || !_randomTicks)
+        return;
+
+    std::uint32_t randoms[ChunkColumn::SECTIONS * MAX_RANDOM_TICKS];
+    std::size_t ticked = 0;
+    for(std::uint16_t bits = sections; bits; bits &= bits - 1)
+        ticked++;
+    RandomBatch random(seedOf(column.getX(), column.getZ(), now));
+    random.fill(randoms, ticked * _randomTicks);
+
+    std::uint32_t *next = randoms;
+    std::int32_t baseX = column.getX() * 16;
+    std::int32_t baseZ = column.getZ() * 16;
+    for(std::size_t y = 0; y < ChunkColumn::SECTIONS; y++)
+    {
+        if(!(sections & (1 << y)))
+            continue;
+        for(unsigned i = 0; i < _randomTicks; i++)
+        {
+            std::uint32_t value = *next++;
+            std::size_t index = value & (ChunkSection::VOLUME - 1);
+            // Fetched again, as a tick may have copied the section
+            BlockId block = column.getSection(y).getBlock(index);
+            if(!has(PROPERTIES.randomlyTicked, block))
+                continue;
+            randomTick(region, baseX + static_cast<std::int32_t>(index & 15),
+                       static_cast<unsigned>(y * 16 + (index >> 8)),
+                       baseZ + static_cast<std::int32_t>((index >> 4) & 15),
+                       block, value >> 12);
+        }
+    }
+    _counters.sectionsTicked.fetch_add(ticked, std::memory_order_relaxed);
+    _counters.randomTicks.fetch_add(ticked * _randomTicks,
+                                    std::memory_order_relaxed);
+}
+
+void BlockTicker::blockChanged(std::int32_t x, unsigned y, std::int32_t z)
+{
+    ChunkColumn *column = _lookup(x >> 4, z >> 4);
+    if(!column)
+        return;
+    // The block itself and the one it may have held up
+    for(unsigned by = y; by <= y + 1 && by < ChunkColumn::HEIGHT; by++)
+    {
+        BlockId block = column->getBlock(x & 15, by, z & 15);
+        if(has(PROPERTIES.falling, block))
+            schedule(*column, x & 15, by, z & 15, block, FALL_DELAY);
+    }
+}
+
+void BlockTicker::schedule(ChunkColumn &column, unsigned x, unsigned y,
+                           unsigned z, BlockId block, unsigned delay)
+{
+    std::uint16_t position = static_cast<std::uint16_t>((y << 8) | (z << 4) |
+                                                        x);
+    if(column.getScheduledTicks().schedule(position, block,
+                                           _tick + std::max(delay, 1u)))
+        _counters.scheduled.fetch_add(1, std::memory_order_relaxed);
+    else
+        _counters.duplicates.fetch_add(1, std::memory_order_relaxed);
+}
+
+BlockTicker::Stats BlockTicker::getStats() const
+{
+    return {_counters.randomTicks.load(std::memory_order_relaxed),
+            _counters.sectionsTicked.load(std::memory_order_relaxed),
+            _counters.sectionsSkipped.load(std::memory_order_relaxed),
+            _counters.scheduled.load(std::memory_order_relaxed),
+            _counters.duplicates.load(std::memory_order_relaxed),
+            _counters.scheduledRun.load(std::memory_order_relaxed)};
+}
+
+const ChunkColumn::BlockSet &BlockTicker::getRandomlyTicked()
+{
+    return PROPERTIES.randomlyTicked;
+}
+
+void BlockTicker::randomTick(RegionTicker::Region &region, std::int32_t x,
+                             unsigned y, std::int32_t z, BlockId block,
+                             std::uint32_t random)
+{
+    // Only grass and mycelium for now
+    ChunkColumn &column = *region.getColumn(x >> 4, z >> 4);
+    if(y + 1 < ChunkColumn::HEIGHT &&
+       LightEngine::getOpacity(column.getBlock(x & 15, y + 1, z & 15)) >
+           MAX_COVER_OPACITY)
+    {
+        region.setBlock(x, y, z, DIRT);
+        return;
+    }
+    // Anywhere in a 3x5x3 box, from three below to one above
+    std::int32_t dx = static_cast<std::int32_t>(random % 3) - 1;
+    std::int32_t dy = static_cast<std::int32_t>(random / 3 % 5) - 3;
+    std::int32_t dz = static_cast<std::int32_t>(random / 15 % 3) - 1;
+    if(dy < 0 && y < static_cast<unsigned>(-dy))
+        return;
+    spread(region, x + dx, static_cast<unsigned>(y + dy), z + dz, block);
+}
+
+void BlockTicker::scheduledTick(ChunkColumn &column,
+                                RegionTicker::Region &region, unsigned x,
+                                unsigned y, unsigned z, BlockId block)
+{
+    // Only falling blocks for now
+    if(!has(PROPERTIES.falling, block) || y == 0 ||
+       !has(PROPERTIES.replaceable, column.getBlock(x, y - 1, z)))
+        return;
+    std::int32_t worldX = column.getX() * 16 + static_cast<std::int32_t>(x);
+    std::int32_t worldZ = column.getZ() * 16 + static_cast<std::int32_t>(z);
+    // Scheduled again below once the change comes in
+    region.setBlock(worldX, y, worldZ, ChunkSection::AIR);
+    region.setBlock(worldX, y - 1, worldZ, block);
+}
+
+void BlockTicker::spread(RegionTicker::Region &region, std::int32_t x,
+                         unsigned y, std::int32_t z, BlockId block)
+{
+    if(y >= ChunkColumn::HEIGHT)
+        return;
+    ChunkColumn *column = region.getColumn(x >> 4, z >> 4);
+    if(column)
+    {
+        if(canSpreadTo(*column, x & 15, y, z & 15))
+            region.setBlock(x, y, z, block);
+        return;
+    }
+    // Looked at again once the other region is done
+    region.post([this, x, y, z, block] {
+        ChunkColumn *column = _lookup(x >> 4, z >> 4);
+        if(column && canSpreadTo(*column, x & 15, y, z & 15))
+            _setter(x, y, z, block);
+    });
+}
+
+} // namespace cenisys
@@ -0,0 +1,147 @@
+/*
+ * BlockTicker
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_BLOCKTICKER_H
+#define CENISYS_BLOCKTICKER_H
+
+#include "world/chunkcolumn.h"
+#include "world/regionticker.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace cenisys
+{
+
+//!
+//! \brief Runs the scheduled block updates and random ticks of columns.
+//!
+//! Every tick, a column runs the updates due in its ScheduledTicks, then
+//! ticks a few random blocks in each of its sections holding a block that
+//! reacts to random ticks; the other sections are skipped without looking
+//! at their blocks. The random positions of a column are drawn at once
+//! from a RandomBatch seeded by the column and the tick, so the same
+//! blocks are picked on any number of threads.
+//!
+//! Columns are ticked by the RegionTicker, and only reach the columns of
+//! their region. Updates of other columns wait for the end of the tick.
+//!
+//! The blocks are a few built in ones: grass and mycelium spread over dirt
+//! which light reaches from above and turn into dirt when covered, while
+//! sand and gravel fall. Changing a block schedules an update of it and of the
+//! block above.
+//!
+class BlockTicker
+{
+public:
+    //! Blocks randomly ticked per section and tick, as in the game.
+    static constexpr unsigned DEFAULT_RANDOM_TICKS = 3;
+    static constexpr unsigned MAX_RANDOM_TICKS = 16;
+    //! Ticks a falling block waits before moving down.
+    static constexpr unsigned FALL_DELAY = 2;
+
+    //! \return nullptr if the column is not loaded.
+    using ColumnLookup =
+        std::function<ChunkColumn *(std::int32_t x, std::int32_t z)>;
+    //! Sets a block with everything which comes with it.
+    using BlockSetter = std::function<void(std::int32_t x, unsigned y,
+                                           std::int32_t z, BlockId block)>;
+
+    struct Stats
+    {
+        std::uint64_t randomTicks;
+        //! Sections with blocks which were randomly ticked.
+        std::uint64_t sectionsTicked;
+        //! Sections with blocks which had nothing to tick.
+        std::uint64_t sectionsSkipped;
+        std::uint64_t scheduled;
+        //! Updates scheduled again before they ran.
+        std::uint64_t duplicates;
+        std::uint64_t scheduledRun;
+    };
+
+    BlockTicker(ColumnLookup &&lookup, BlockSetter &&setter);
+    BlockTicker(const BlockTicker &) = delete;
+    BlockTicker &operator=(const BlockTicker &) = delete;
+
+    void setRandomTicks(unsigned count)
+    {
+        _randomTicks = count < MAX_RANDOM_TICKS ? count : MAX_RANDOM_TICKS;
+    }
+    unsigned getRandomTicks() const { return _randomTicks; }
+
+    //!
+    //! \brief Start the next tick. Not while columns are ticked.
+    //!
+    void nextTick() { _tick++; }
+    std::uint64_t getTick() const { return _tick; }
+
+    //!
+    //! \brief Tick a column. May run on any thread.
+    //!
+    void tickColumn(ChunkColumn &column, RegionTicker::Region &region);
+
+    //!
+    //! \brief Schedule the updates a changed block causes. Tick thread only.
+    //!
+    void blockChanged(std::int32_t x, unsigned y, std::int32_t z);
+
+    //!
+    //! \brief Schedule an update of a block in a column.
+    //! \param delay Ticks from now, at least one.
+    //!
+    void schedule(ChunkColumn &column, unsigned x, unsigned y, unsigned z,
+                  BlockId block, unsigned delay);
+
+    Stats getStats() const;
+
+    //! Blocks which react to random ticks.
+    static const ChunkColumn::BlockSet &getRandomlyTicked();
+
+private:
+    struct Counters
+    {
+        std::atomic<std::uint64_t> randomTicks{0};
+        std::atomic<std::uint64_t> sectionsTicked{0};
+        std::atomic<std::uint64_t> sectionsSkipped{0};
+        std::atomic<std::uint64_t> scheduled{0};
+        std::atomic<std::uint64_t> duplicates{0};
+        std::atomic<std::uint64_t> scheduledRun{0};
+    };
+
+    void randomTick(RegionTicker::Region &region, std::int32_t x, unsigned y,
+                    std::int32_t z, BlockId block, std::uint32_t random);
+    void scheduledTick(ChunkColumn &column, RegionTicker::Region &region,
+                       unsigned x, unsigned y, unsigned z, BlockId block);
+    //! Grass and mycelium taking over a dirt block.
+    void spread(RegionTicker::Region &region, std::int32_t x, unsigned y,
+                std::int32_t z, BlockId block);
+
+    ColumnLookup _lookup;
+    BlockSetter _setter;
+    unsigned _randomTicks;
+    std::uint64_t _tick;
+    Counters _counters;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_BLOCKTICKER_H
@@ -0,0 +1,253 @@
+/*
+ * ChunkCache
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcache.h"
+#include "world/chunkcolumn.h"
+#include "world/worldstorage.h"
+#include <limits>
+
+namespace cenisys
+{
+
+ChunkCache::ChunkCache(WorldStorage &storage, std::size_t budget)
+    : _storage(storage), _budget(budget),
+      _hand(std::numeric_limits<std::int32_t>::min(),
+            std::numeric_limits<std::int32_t>::min()),
+      _bytes(0), _referenced(0), _evicted(0), _writtenBack(0),
+      _writing(std::make_shared<Writing>())
+{
+}
+
+void ChunkCache::insert(std::unique_ptr<ChunkColumn> column)
+{
+    Key key(column->getX(), column->getZ());
+    std::size_t bytes = column->getMemoryUsage();
+    Entry &entry = _columns[key];
+    if(entry.column)
+        _bytes -= entry.bytes;
+    else
+        entry.references = 0;
+    entry.column = std::move(column);
+    entry.bytes = bytes;
+    entry.used = true;
+    _bytes += bytes;
+}
+
+void ChunkCache::setReferences(std::int32_t x, std::int32_t z,
+                               std::size_t count)
+{
+    auto it = _columns.find({x, z});
+    if(it == _columns.end())
+        return;
+    Entry &entry = it->second;
+    if(!entry.references && count)
+        _referenced++;
+    else if(entry.references && !count)
+    {
+        _referenced--;
+        // Just seen, so it waits a round like any other used column
+        entry.used = true;
+    }
+    entry.references = count;
+}
+
+void ChunkCache::markUsed(std::int32_t x, std::int32_t z)
+{
+    auto it = _columns.find({x, z});
+    if(it != _columns.end())
+        it->second.used = true;
+}
+
+bool ChunkCache::save()
+{
+    if(_saving && !_saving->finished)
+        return false;
+    auto saving = std::make_shared<Saving>();
+    std::vector<std::shared_ptr<const ChunkColumn>> snapshots;
+    for(auto &item : _columns)
+    {
+        ChunkColumn &column = *item.second.column;
+        if(!column.getUnsavedSections())
+            continue;
+        snapshots.push_back(column.snapshot());
+        column.markSaved();
+        saving->columns.insert(item.first);
+    }
+    // Before the handlers may count anything
+    saving->total = snapshots.size();
+    std::atomic_store(&_saving, saving);
+    for(auto &item : snapshots)
+    {
+        Key key(item->getX(), item->getZ());
+        _storage.save(std::move(item), [saving, key](bool result) {
+            if(result)
+            {
+                saving->written++;
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(saving->mutex);
+                saving->failedColumns.push_back(key);
+            }
+            saving->failed++;
+        });
+    }
+    return true;
+}
+
+bool ChunkCache::finishSave()
+{
+    if(!_saving || _saving->finished || isSaving())
+        return false;
+    std::lock_guard<std::mutex> lock(_saving->mutex);
+    for(const Key &key : _saving->failedColumns)
+        markUnsaved(key.first, key.second);
+    _saving->finished = true;
+    return true;
+}
+
+bool ChunkCache::isSaving() const
+{
+    SaveStats stats = getSaveStats();
+    return stats.written + stats.failed < stats.total;
+}
+
+ChunkCache::SaveStats ChunkCache::getSaveStats() const
+{
+    std::shared_ptr<Saving> saving = std::atomic_load(&_saving);
+    if(!saving)
+        return {0, 0, 0};
+    return {saving->total, saving->written, saving->failed};
+}
+
+void ChunkCache::markUnsaved(std::int32_t x, std::int32_t z)
+{
+    auto it = _columns.find({x, z});
+    if(it != _columns.end())
+        it->second.column->markUnsaved();
+}
+
+void ChunkCache::updateMemory()
+{
+    _bytes = 0;
+    for(auto &item : _columns)
+    {
+        item.second.bytes = item.second.column->getMemoryUsage();
+        _bytes += item.second.bytes;
+    }
+}
+
+std::size_t ChunkCache::evict(const EvictHandler &handler)
+{
+    std::size_t result = 0;
+    // The first round may only clear the used bits
+    std::size_t steps = _columns.size() * 2;
+    auto it = _columns.lower_bound(_hand);
+    while(_bytes > _budget && _referenced < _columns.size() && steps-- > 0)
+    {
+        if(it == _columns.end())
+            it = _columns.begin();
+        Entry &entry = it->second;
+        if(entry.references)
+        {
+            ++it;
+            continue;
+        }
+        if(entry.used)
+        {
+            entry.used = false;
+            ++it;
+            continue;
+        }
+        handler(*entry.column);
+        _bytes -= entry.bytes;
+        _evicted++;
+        result++;
+        std::unique_ptr<ChunkColumn> column = std::move(entry.column);
+        // Marked saved before the running save wrote it, which may fail
+        bool saving = _saving && !_saving->finished &&
+                      _saving->columns.count(it->first);
+        it = _columns.erase(it);
+        if(column->getUnsavedSections() || saving)
+            writeBack(std::move(column));
+    }
+    if(it != _columns.end())
+        _hand = it->first;
+    else
+        _hand = Key(std::numeric_limits<std::int32_t>::min(),
+                    std::numeric_limits<std::int32_t>::min());
+    return result;
+}
+
+std::size_t ChunkCache::takeBackFailed(const LoadHandler &handler)
+{
+    std::vector<std::shared_ptr<const ChunkColumn>> failed;
+    {
+        std::lock_guard<std::mutex> lock(_writing->mutex);
+        failed.swap(_writing->failedColumns);
+    }
+    for(const auto &item : failed)
+    {
+        ChunkColumn *loaded = get(item->getX(), item->getZ());
+        // Loaded again meanwhile, from what the storage kept of it
+        if(loaded)
+        {
+            loaded->markUnsaved();
+            continue;
+        }
+        insert(std::make_unique<ChunkColumn>(*item));
+        loaded = get(item->getX(), item->getZ());
+        loaded->markUnsaved();
+        handler(*loaded);
+    }
+    return failed.size();
+}
+
+ChunkCache::Stats ChunkCache::getStats() const
+{
+    return {_columns.size(),
+            _referenced,
+            _bytes,
+            _evicted,
+            _writtenBack,
+            _writing->pending.load(std::memory_order_relaxed),
+            _writing->failed.load(std::memory_order_relaxed)};
+}
+
+void ChunkCache::writeBack(std::unique_ptr<ChunkColumn> column)
+{
+    _writtenBack++;
+    std::shared_ptr<Writing> writing = _writing;
+    writing->pending.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<const ChunkColumn> saved(std::move(column));
+    _storage.save(saved, [writing, saved](bool result) {
+        if(!result)
+        {
+            {
+                std::lock_guard<std::mutex> lock(writing->mutex);
+                writing->failedColumns.push_back(saved);
+            }
+            writing->failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        writing->pending.fetch_sub(1, std::memory_order_relaxed);
+    });
+}
+
+} // namespace cenisys
@@ -0,0 +1,219 @@
+/*
+ * ChunkCache
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_CHUNKCACHE_H
+#define CENISYS_CHUNKCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace cenisys
+{
+
+class ChunkColumn;
+class WorldStorage;
+
+//!
+//! \brief The loaded columns of a world, kept within a memory budget.
+//!
+//! Columns seen by a viewer are referenced and never evicted. Once the
+//! columns take more memory than the budget, the others are evicted in
+//! CLOCK order: a hand sweeps over the columns, passing those used since
+//! it last came by for another round and evicting the rest.
+//!
+//! Evicted columns with unsaved sections, or in a save which may still
+//! fail, are written back to the storage, which keeps them until written,
+//! so loading them again meanwhile gets the latest blocks. Those which
+//! could not be written are held until takeBackFailed() loads them again,
+//! to be written once evicted again.
+//!
+//! The memory of the columns is summed up again by updateMemory(), as
+//! sections grow and shrink without the cache seeing it.
+//!
+//! The changed columns which stay loaded are saved by save(), from
+//! snapshots which only share their sections, so the game goes on while the
+//! storage writes them. The columns a save could not write are marked
+//! unsaved again by finishSave() once it completed.
+//!
+//! Belongs to the game tick, except the write-back and save counters, which
+//! are updated by the storage workers and may be read from any thread.
+//!
+class ChunkCache
+{
+public:
+    //! Called before an evicted column is dropped.
+    using EvictHandler = std::function<void(const ChunkColumn &)>;
+    //! Called after a column was added.
+    using LoadHandler = std::function<void(ChunkColumn &)>;
+
+    struct Stats
+    {
+        std::size_t columns;
+        std::size_t referenced;
+        std::size_t bytes;
+        std::uint64_t evicted;
+        //! Evicted columns written back, including the pending ones.
+        std::uint64_t writtenBack;
+        std::size_t writing;
+        //! Write-backs which failed, and were taken back to try again.
+        std::uint64_t failed;
+    };
+
+    //! Progress of a save.
+    struct SaveStats
+    {
+        std::size_t total;
+        std::size_t written;
+        std::size_t failed;
+    };
+
+    ChunkCache(WorldStorage &storage, std::size_t budget);
+    ChunkCache(const ChunkCache &) = delete;
+    ChunkCache &operator=(const ChunkCache &) = delete;
+
+    std::size_t getBudget() const { return _budget; }
+    void setBudget(std::size_t budget) { _budget = budget; }
+
+    //! \return nullptr if the column is not loaded.
+    ChunkColumn *get(std::int32_t x, std::int32_t z) const
+    {
+        auto it = _columns.find({x, z});
+        return it == _columns.end() ? nullptr : it->second.column.get();
+    }
+    bool contains(std::int32_t x, std::int32_t z) const
+    {
+        return _columns.count({x, z}) != 0;
+    }
+    std::size_t size() const { return _columns.size(); }
+
+    //!
+    //! \brief Add a loaded column, unreferenced.
+    //!
+    void insert(std::unique_ptr<ChunkColumn> column);
+    //!
+    //! \brief Set the number of viewers seeing a column.
+    //!
+    void setReferences(std::int32_t x, std::int32_t z, std::size_t count);
+    //!
+    //! \brief Give a column another round before it can be evicted.
+    //!
+    void markUsed(std::int32_t x, std::int32_t z);
+    //!
+    //! \brief Start writing the columns with unsaved sections, which are
+    //! then marked saved.
+    //! \return false if the last save was not finished yet.
+    //!
+    bool save();
+    //!
+    //! \brief Have the columns the last save could not write saved again,
+    //! once it completed.
+    //! \return true if the save was finished by this call.
+    //!
+    bool finishSave();
+    //!
+    //! \brief Whether the storage is still writing the last save.
+    //!
+    bool isSaving() const;
+    //! \return The progress of the running or last save.
+    SaveStats getSaveStats() const;
+    //!
+    //! \brief Have a column saved again, if it is still loaded.
+    //!
+    void markUnsaved(std::int32_t x, std::int32_t z);
+    //!
+    //! \brief Sum up the memory of the columns again.
+    //!
+    void updateMemory();
+    //!
+    //! \brief Evict unreferenced columns until they fit into the budget.
+    //! \return Number of columns evicted.
+    //!
+    std::size_t evict(const EvictHandler &handler);
+    //!
+    //! \brief Load the evicted columns which could not be written back
+    //! again, unsaved, so they are saved like the loaded ones.
+    //! \param handler Called for every column which was not loaded again
+    //! in the meantime.
+    //! \return Number of columns taken back.
+    //!
+    std::size_t takeBackFailed(const LoadHandler &handler);
+
+    Stats getStats() const;
+
+private:
+    using Key = std::pair<std::int32_t, std::int32_t>;
+    struct Entry
+    {
+        std::unique_ptr<ChunkColumn> column;
+        std::size_t references;
+        std::size_t bytes;
+        bool used;
+    };
+    //! Shared with the save handlers.
+    struct Writing
+    {
+        std::atomic<std::size_t> pending{0};
+        std::atomic<std::uint64_t> failed{0};
+        std::mutex mutex;
+        //! Columns which could not be written, to be taken back.
+        std::vector<std::shared_ptr<const ChunkColumn>> failedColumns;
+    };
+    //! A save, shared with its save handlers.
+    struct Saving
+    {
+        std::atomic<std::size_t> total{0};
+        std::atomic<std::size_t> written{0};
+        std::atomic<std::size_t> failed{0};
+        std::mutex mutex;
+        //! Columns which could not be written.
+        std::vector<Key> failedColumns;
+        //! Columns being written, only used by the game tick.
+        std::set<Key> columns;
+        //! Set by finishSave(), on the game tick.
+        bool finished = false;
+    };
+
+    void writeBack(std::unique_ptr<ChunkColumn> column);
+
+    WorldStorage &_storage;
+    std::size_t _budget;
+    std::map<Key, Entry> _columns;
+    //! Next column the hand looks at.
+    Key _hand;
+    std::size_t _bytes;
+    std::size_t _referenced;
+    std::uint64_t _evicted;
+    std::uint64_t _writtenBack;
+    std::shared_ptr<Writing> _writing;
+    //! Last save, or nullptr. Loaded atomically off the game tick.
+    std::shared_ptr<Saving> _saving;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_CHUNKCACHE_H
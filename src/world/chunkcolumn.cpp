@@ -0,0 +1,159 @@
+/*
+ * ChunkColumn
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "network/binarystream.h"
+
+namespace cenisys
+{
+
+constexpr std::size_t ChunkColumn::SECTIONS;
+constexpr std::size_t ChunkColumn::HEIGHT;
+constexpr std::uint16_t ChunkColumn::ALL_SECTIONS;
+
+const ChunkSection ChunkColumn::EMPTY;
+
+ChunkColumn::ChunkColumn(std::int32_t x, std::int32_t z)
+    : _x(x), _z(z), _dirty(ALL_SECTIONS), _unsaved(ALL_SECTIONS),
+      _unscanned(ALL_SECTIONS), _tickable(0)
+{
+    _sections.fill(&EMPTY);
+}
+
+ChunkColumn::ChunkColumn(const ChunkColumn &other)
+    : _x(other._x), _z(other._z), _dirty(ALL_SECTIONS),
+      _unsaved(other._unsaved), _unscanned(ALL_SECTIONS), _tickable(0),
+      _scheduledTicks(other._scheduledTicks)
+{
+    _sections.fill(&EMPTY);
+    for(std::size_t i = 0; i < SECTIONS; i++)
+    {
+        if(other._owned[i])
+        {
+            _owned[i] = std::make_shared<ChunkSection>(*other._owned[i]);
+            _sections[i] = _owned[i].get();
+        }
+    }
+}
+
+std::shared_ptr<const ChunkColumn> ChunkColumn::snapshot() const
+{
+    auto result = std::make_shared<ChunkColumn>(_x, _z);
+    result->_sections = _sections;
+    result->_owned = _owned;
+    result->_unsaved = _unsaved;
+    return result;
+}
+
+std::uint16_t ChunkColumn::getTickableSections(const BlockSet &blocks)
+{
+    for(std::size_t y = 0; _unscanned; y++)
+    {
+        std::uint16_t bit = static_cast<std::uint16_t>(1 << y);
+        if(!(_unscanned & bit))
+            continue;
+        _unscanned &= ~bit;
+        _tickable &= ~bit;
+        // Palettes may keep ids no longer used, which only costs a look
+        for(BlockId block : _sections[y]->getPalette())
+        {
+            if(block < blocks.size() && blocks[block])
+            {
+                _tickable |= bit;
+                break;
+            }
+        }
+    }
+    return _tickable;
+}
+
+std::size_t ChunkColumn::getSerializedSize() const
+{
+    std::size_t result = 2;
+    for(const auto &item : _owned)
+    {
+        if(item)
+            result += item->getSerializedSize();
+    }
+    return result;
+}
+
+void ChunkColumn::write(BinaryWriter &writer) const
+{
+    std::uint16_t mask = 0;
+    for(std::size_t i = 0; i < SECTIONS; i++)
+    {
+        if(_owned[i])
+            mask |= 1 << i;
+    }
+    writer.writeU16(mask);
+    for(const auto &item : _owned)
+    {
+        if(item)
+            item->write(writer);
+    }
+}
+
+std::unique_ptr<ChunkColumn> ChunkColumn::read(std::int32_t x, std::int32_t z,
+                                               BinaryReader &reader)
+{
+    auto result = std::make_unique<ChunkColumn>(x, z);
+    std::uint16_t mask = reader.readU16();
+    for(std::size_t i = 0; i < SECTIONS && reader.ok(); i++)
+    {
+        if(mask & (1 << i))
+            result->getWritableSection(i).read(reader);
+    }
+    if(!reader.ok())
+        return nullptr;
+    result->markSaved();
+    return result;
+}
+
+std::size_t ChunkColumn::getMemoryUsage() const
+{
+    std::size_t result = sizeof(ChunkColumn);
+    for(const auto &item : _owned)
+    {
+        if(item)
+            result += item->getMemoryUsage();
+    }
+    return result;
+}
+
+void ChunkColumn::removeSection(std::size_t y)
+{
+    _dirty |= 1 << y;
+    _unsaved |= 1 << y;
+    _unscanned |= 1 << y;
+    _sections[y] = &EMPTY;
+    _owned[y].reset();
+}
+
+void ChunkColumn::detach(std::size_t y)
+{
+    if(_owned[y])
+        _owned[y] = std::make_shared<ChunkSection>(*_owned[y]);
+    else
+        _owned[y] = std::make_shared<ChunkSection>();
+    _sections[y] = _owned[y].get();
+}
+
+} // namespace cenisys
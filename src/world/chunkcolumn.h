@@ -0,0 +1,186 @@
+/*
+ * ChunkColumn
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_CHUNKCOLUMN_H
+#define CENISYS_CHUNKCOLUMN_H
+
+#include "world/chunksection.h"
+#include "world/scheduledticks.h"
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+
+namespace cenisys
+{
+
+//!
+//! \brief A 16x256x16 column of sections.
+//!
+//! Sections which were never written are not allocated: they read from a
+//! shared all-air section lit by the sky, so reads never branch on them.
+//! Writes allocate the section first.
+//!
+//! Every section handed out for writing is marked dirty until
+//! clearDirtySections(), so encodings of the column can be refreshed one
+//! section at a time. A new column is dirty everywhere. Sections are also
+//! marked unsaved until markSaved(), which read() does.
+//!
+//! Sections are shared with the snapshots of the column and copied on the
+//! first write after a snapshot, so a snapshot is a few pointers and never
+//! changes. Snapshots can be read by any thread.
+//!
+//! The column also keeps its scheduled block updates, which are not saved,
+//! and which sections hold randomly ticked blocks.
+//!
+class ChunkColumn
+{
+public:
+    static constexpr std::size_t SECTIONS = 16;
+    static constexpr std::size_t HEIGHT = SECTIONS * ChunkSection::SIZE;
+    static constexpr std::uint16_t ALL_SECTIONS = 0xffff;
+    //! Block ids which may be randomly ticked.
+    using BlockSet = std::bitset<256>;
+
+    ChunkColumn(std::int32_t x, std::int32_t z);
+    ChunkColumn(const ChunkColumn &other);
+    ChunkColumn &operator=(const ChunkColumn &other) = delete;
+
+    std::int32_t getX() const { return _x; }
+    std::int32_t getZ() const { return _z; }
+
+    //!
+    //! \brief The section at a height, which may be the shared empty one.
+    //!
+    const ChunkSection &getSection(std::size_t y) const
+    {
+        return *_sections[y];
+    }
+    //!
+    //! \brief The section at a height, allocated or copied if needed and
+    //! marked dirty.
+    //!
+    ChunkSection &getWritableSection(std::size_t y)
+    {
+        _dirty |= 1 << y;
+        _unsaved |= 1 << y;
+        _unscanned |= 1 << y;
+        // A snapshot released meanwhile only costs a needless copy
+        if(!_owned[y] || _owned[y].use_count() > 1)
+            detach(y);
+        return *_owned[y];
+    }
+    //! False if the section reads from the shared empty one.
+    bool hasSection(std::size_t y) const { return _sections[y] != &EMPTY; }
+    //!
+    //! \brief Release the section, which reads as empty again.
+    //!
+    void removeSection(std::size_t y);
+
+    //! Bit y is set if section y may have changed.
+    std::uint16_t getDirtySections() const { return _dirty; }
+    void clearDirtySections() { _dirty = 0; }
+    //! Bit y is set if section y may differ from the storage.
+    std::uint16_t getUnsavedSections() const { return _unsaved; }
+    void markSaved() { _unsaved = 0; }
+    void markUnsaved() { _unsaved = ALL_SECTIONS; }
+
+    //!
+    //! \brief Sections which may hold a block of a set.
+    //!
+    //! Only the palettes of the sections written since the last call are
+    //! looked at again, so the set must be the same on every call.
+    //! \return Bit y is set for section y.
+    //!
+    std::uint16_t getTickableSections(const BlockSet &blocks);
+
+    ScheduledTicks &getScheduledTicks() { return _scheduledTicks; }
+    const ScheduledTicks &getScheduledTicks() const
+    {
+        return _scheduledTicks;
+    }
+
+    //!
+    //! \brief A copy sharing the sections, which the column copies before
+    //! writing them again.
+    //!
+    std::shared_ptr<const ChunkColumn> snapshot() const;
+
+    //!
+    //! \brief Bytes taken in memory by the column and its sections.
+    //!
+    std::size_t getMemoryUsage() const;
+
+    //!
+    //! \brief Number of bytes written by write().
+    //!
+    std::size_t getSerializedSize() const;
+    //!
+    //! \brief Write the allocated sections, without the coordinates.
+    //!
+    void write(BinaryWriter &writer) const;
+    //!
+    //! \brief Read a column written by write().
+    //! \return nullptr if the data is invalid.
+    //!
+    static std::unique_ptr<ChunkColumn> read(std::int32_t x, std::int32_t z,
+                                             BinaryReader &reader);
+
+    BlockId getBlock(unsigned x, unsigned y, unsigned z) const
+    {
+        return getSection(y >> 4).getBlock(ChunkSection::index(x, y & 15, z));
+    }
+    void setBlock(unsigned x, unsigned y, unsigned z, BlockId block)
+    {
+        getWritableSection(y >> 4)
+            .setBlock(ChunkSection::index(x, y & 15, z), block);
+    }
+    std::uint8_t getMeta(unsigned x, unsigned y, unsigned z) const
+    {
+        return getSection(y >> 4).getMeta(ChunkSection::index(x, y & 15, z));
+    }
+    void setMeta(unsigned x, unsigned y, unsigned z, std::uint8_t meta)
+    {
+        getWritableSection(y >> 4)
+            .setMeta(ChunkSection::index(x, y & 15, z), meta);
+    }
+
+    //! Read by every section which was not written.
+    static const ChunkSection EMPTY;
+
+private:
+    //! Give the column its own copy of the section, or a new one.
+    void detach(std::size_t y);
+
+    std::int32_t _x;
+    std::int32_t _z;
+    std::array<const ChunkSection *, SECTIONS> _sections;
+    std::array<std::shared_ptr<ChunkSection>, SECTIONS> _owned;
+    std::uint16_t _dirty;
+    std::uint16_t _unsaved;
+    //! Sections written since getTickableSections() last looked at them.
+    std::uint16_t _unscanned;
+    std::uint16_t _tickable;
+    ScheduledTicks _scheduledTicks;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_CHUNKCOLUMN_H
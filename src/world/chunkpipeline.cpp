@@ -0,0 +1,269 @@
+/*
+ * ChunkPipeline
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkpipeline.h"
+#include "world/chunkcolumn.h"
+#include "world/worldstorage.h"
+#include <algorithm>
+
+namespace cenisys
+{
+
+constexpr std::size_t ChunkPipeline::STAGES;
+
+ChunkPipeline::ChunkPipeline(boost::asio::io_service &ioService,
+                             WorldStorage &storage, std::size_t maxRunning)
+    : _ioService(ioService), _storage(storage),
+      _maxRunning(std::max<std::size_t>(maxRunning, 1)), _runners(0),
+      _running(0)
+{
+    resetStats();
+}
+
+void ChunkPipeline::setGenerator(Generator &&generator)
+{
+    _generator = std::move(generator);
+}
+
+void ChunkPipeline::setLighter(Lighter &&lighter)
+{
+    _lighter = std::move(lighter);
+}
+
+void ChunkPipeline::setSerializer(Serializer &&serializer)
+{
+    _serializer = std::move(serializer);
+}
+
+void ChunkPipeline::request(std::int32_t x, std::int32_t z,
+                            std::uint64_t priority)
+{
+    Key key(x, z);
+    auto it = _requests.find(key);
+    if(it != _requests.end())
+    {
+        Job &job = *it->second;
+        std::lock_guard<std::mutex> lock(_queueLock);
+        if(job.queued && job.priority != priority)
+        {
+            _queue.erase({job.priority, key});
+            _queue.emplace(std::make_pair(priority, key), it->second);
+        }
+        job.priority = priority;
+        return;
+    }
+    auto job = std::make_shared<Job>();
+    job->key = key;
+    job->time = Clock::now();
+    job->cancelled = false;
+    job->priority = priority;
+    job->queued = true;
+    _requests.emplace(key, job);
+    bool startRunner = false;
+    {
+        std::lock_guard<std::mutex> lock(_queueLock);
+        _queue.emplace(std::make_pair(priority, key), job);
+        if(_runners < _maxRunning)
+        {
+            _runners++;
+            startRunner = true;
+        }
+    }
+    if(startRunner)
+        _ioService.post([this] { runNext(); });
+}
+
+void ChunkPipeline::cancel(std::int32_t x, std::int32_t z)
+{
+    auto it = _requests.find({x, z});
+    if(it == _requests.end())
+        return;
+    Job &job = *it->second;
+    // A running one is dropped by its worker before the next stage
+    job.cancelled.store(true, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(_queueLock);
+        if(job.queued)
+            _queue.erase({job.priority, it->first});
+    }
+    _requests.erase(it);
+    _stats.cancelled++;
+}
+
+void ChunkPipeline::cancelAll()
+{
+    for(const auto &item : _requests)
+        item.second->cancelled.store(true, std::memory_order_relaxed);
+    _stats.cancelled += _requests.size();
+    _requests.clear();
+    std::lock_guard<std::mutex> lock(_queueLock);
+    _queue.clear();
+}
+
+bool ChunkPipeline::isRequested(std::int32_t x, std::int32_t z) const
+{
+    return _requests.count({x, z}) != 0;
+}
+
+void ChunkPipeline::tick(const ReadyHandler &handler)
+{
+    Completion completion;
+    while(_completions.pop(completion))
+    {
+        {
+            std::lock_guard<std::mutex> lock(_queueLock);
+            _running--;
+        }
+        auto it = _requests.find(completion.job->key);
+        // Cancelled, and maybe requested again since
+        if(it == _requests.end() || it->second != completion.job)
+            continue;
+        _requests.erase(it);
+        for(std::size_t i = 0; i < STAGES; i++)
+        {
+            if(completion.stages & (1u << i))
+                record(static_cast<Stage>(i), completion.times[i]);
+        }
+        _stats.completed++;
+        if(completion.result.generated)
+            _stats.generated++;
+        handler(std::move(completion.result));
+    }
+}
+
+std::size_t ChunkPipeline::getQueued() const
+{
+    std::lock_guard<std::mutex> lock(_queueLock);
+    return _queue.size();
+}
+
+std::size_t ChunkPipeline::getRunning() const
+{
+    std::lock_guard<std::mutex> lock(_queueLock);
+    return _running;
+}
+
+void ChunkPipeline::resetStats()
+{
+    _stats.completed = 0;
+    _stats.cancelled = 0;
+    _stats.generated = 0;
+    _stats.stages.fill({0, Clock::duration::zero(), Clock::duration::zero()});
+}
+
+const char *ChunkPipeline::getStageName(Stage stage)
+{
+    switch(stage)
+    {
+    case Stage::Wait:
+        return "wait";
+    case Stage::Load:
+        return "load";
+    case Stage::Generate:
+        return "generate";
+    case Stage::Light:
+        return "light";
+    case Stage::Serialize:
+        return "serialize";
+    }
+    return "";
+}
+
+void ChunkPipeline::runNext()
+{
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(_queueLock);
+        if(_queue.empty())
+        {
+            _runners--;
+            return;
+        }
+        job = std::move(_queue.begin()->second);
+        _queue.erase(_queue.begin());
+        job->queued = false;
+        _running++;
+    }
+    Clock::time_point begin = Clock::now();
+    Clock::duration waitTime = begin - job->time;
+    _storage.load(
+        job->key.first, job->key.second,
+        [this, job, begin, waitTime](std::unique_ptr<ChunkColumn> column) {
+            Clock::duration loadTime = Clock::now() - begin;
+            // Leave the storage worker to the other loads
+            // HACK: asio cannot dispatch move-only handlers
+            auto holder = std::make_shared<std::unique_ptr<ChunkColumn>>(
+                std::move(column));
+            _ioService.post([this, job, holder, waitTime, loadTime] {
+                process(job, std::move(*holder), waitTime, loadTime);
+                runNext();
+            });
+        });
+}
+
+void ChunkPipeline::process(const std::shared_ptr<Job> &job,
+                            std::unique_ptr<ChunkColumn> column,
+                            Clock::duration waitTime,
+                            Clock::duration loadTime)
+{
+    Completion completion;
+    completion.job = job;
+    completion.times[static_cast<std::size_t>(Stage::Wait)] = waitTime;
+    completion.times[static_cast<std::size_t>(Stage::Load)] = loadTime;
+    completion.stages = 1u << static_cast<std::size_t>(Stage::Wait) |
+                        1u << static_cast<std::size_t>(Stage::Load);
+    completion.result.generated = !column;
+    auto run = [&](Stage stage, const auto &func) {
+        if(job->cancelled.load(std::memory_order_relaxed))
+            return;
+        Clock::time_point begin = Clock::now();
+        func();
+        completion.times[static_cast<std::size_t>(stage)] =
+            Clock::now() - begin;
+        completion.stages |= 1u << static_cast<std::size_t>(stage);
+    };
+    if(!column)
+    {
+        column = std::make_unique<ChunkColumn>(job->key.first,
+                                               job->key.second);
+        if(_generator)
+            run(Stage::Generate, [&] { _generator(*column); });
+        // Stored columns were lit before they were saved
+        if(_lighter)
+            run(Stage::Light, [&] { _lighter(*column); });
+    }
+    if(_serializer)
+    {
+        run(Stage::Serialize,
+            [&] { completion.result.data = _serializer(*column); });
+    }
+    completion.result.column = std::move(column);
+    _completions.push(std::move(completion));
+}
+
+void ChunkPipeline::record(Stage stage, Clock::duration time)
+{
+    StageStats &stats = _stats.stages[static_cast<std::size_t>(stage)];
+    stats.count++;
+    stats.total += time;
+    stats.max = std::max(stats.max, time);
+}
+
+} // namespace cenisys
@@ -0,0 +1,198 @@
+/*
+ * ChunkPipeline
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_CHUNKPIPELINE_H
+#define CENISYS_CHUNKPIPELINE_H
+
+#include "util/mpscqueue.h"
+#include <array>
+#include <atomic>
+#include <boost/asio/io_service.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace cenisys
+{
+
+class ChunkColumn;
+class WorldStorage;
+
+//!
+//! \brief Brings chunk columns in from the storage or the generator.
+//!
+//! A request goes through the stages in order: it waits in the queue, is
+//! loaded, generated and lit if it was not stored, then serialized. The
+//! stages after the wait run on the threads of the io_service, at most a
+//! fixed number of requests at a time. The queue is ordered by priority,
+//! which callers set to the distance to the nearest interested player.
+//!
+//! Requests, cancellation and tick() belong to a single thread, the game
+//! tick. A worker finishing a request takes the next one from the queue
+//! itself, so columns keep coming between ticks. Finished requests come
+//! back through a lock-free queue and are handed over by tick(). A
+//! cancelled request is dropped by its worker before the next stage.
+//!
+class ChunkPipeline
+{
+public:
+    enum class Stage : std::size_t
+    {
+        Wait,
+        Load,
+        Generate,
+        Light,
+        Serialize,
+    };
+    static constexpr std::size_t STAGES = 5;
+
+    using Generator = std::function<void(ChunkColumn &)>;
+    using Lighter = std::function<void(ChunkColumn &)>;
+    using Serializer =
+        std::function<std::vector<std::uint8_t>(const ChunkColumn &)>;
+
+    struct Result
+    {
+        std::unique_ptr<ChunkColumn> column;
+        //! Output of the serializer, empty without one.
+        std::vector<std::uint8_t> data;
+        //! False if the column was stored.
+        bool generated;
+    };
+    using ReadyHandler = std::function<void(Result &&)>;
+
+    struct StageStats
+    {
+        std::uint64_t count;
+        std::chrono::steady_clock::duration total;
+        std::chrono::steady_clock::duration max;
+    };
+    struct Stats
+    {
+        std::uint64_t completed;
+        std::uint64_t cancelled;
+        std::uint64_t generated;
+        std::array<StageStats, STAGES> stages;
+    };
+
+    //!
+    //! \param maxRunning Requests past the queue at the same time.
+    //!
+    ChunkPipeline(boost::asio::io_service &ioService, WorldStorage &storage,
+                  std::size_t maxRunning);
+    ChunkPipeline(const ChunkPipeline &) = delete;
+    ChunkPipeline &operator=(const ChunkPipeline &) = delete;
+
+    //!
+    //! \brief Set the stages run on the workers.
+    //!
+    //! Without a generator, missing columns come back empty. Without a
+    //! lighter or a serializer, the stage is skipped. Only call these while
+    //! nothing is running.
+    //!
+    void setGenerator(Generator &&generator);
+    void setLighter(Lighter &&lighter);
+    void setSerializer(Serializer &&serializer);
+
+    //!
+    //! \brief Request a column, or change the priority of a request.
+    //! \param priority Lower values leave the queue first.
+    //!
+    void request(std::int32_t x, std::int32_t z, std::uint64_t priority);
+    //!
+    //! \brief Drop a request. A running one finishes its current stage.
+    //!
+    void cancel(std::int32_t x, std::int32_t z);
+    void cancelAll();
+    bool isRequested(std::int32_t x, std::int32_t z) const;
+
+    //!
+    //! \brief Hand over the finished columns.
+    //!
+    void tick(const ReadyHandler &handler);
+
+    //! Requests waiting to start.
+    std::size_t getQueued() const;
+    //! Requests started and not handed over yet.
+    std::size_t getRunning() const;
+    const Stats &getStats() const { return _stats; }
+    void resetStats();
+    static const char *getStageName(Stage stage);
+
+private:
+    using Key = std::pair<std::int32_t, std::int32_t>;
+    using Clock = std::chrono::steady_clock;
+
+    //! Shared with the worker running the request.
+    struct Job
+    {
+        Key key;
+        Clock::time_point time;
+        std::atomic<bool> cancelled;
+        //! Guarded by the queue lock, like the position in the queue.
+        std::uint64_t priority;
+        bool queued;
+    };
+    struct Completion
+    {
+        std::shared_ptr<Job> job;
+        Result result;
+        std::array<Clock::duration, STAGES> times;
+        //! Bit per stage which ran.
+        unsigned stages;
+    };
+
+    //! Take the nearest queued request, until there are none left.
+    void runNext();
+    void process(const std::shared_ptr<Job> &job,
+                 std::unique_ptr<ChunkColumn> column,
+                 Clock::duration waitTime, Clock::duration loadTime);
+    void record(Stage stage, Clock::duration time);
+
+    boost::asio::io_service &_ioService;
+    WorldStorage &_storage;
+    std::size_t _maxRunning;
+    Generator _generator;
+    Lighter _lighter;
+    Serializer _serializer;
+
+    //! Requests not handed over yet, only used by the tick.
+    std::map<Key, std::shared_ptr<Job>> _requests;
+
+    //! Guards the queue and the counters after it.
+    mutable std::mutex _queueLock;
+    std::map<std::pair<std::uint64_t, Key>, std::shared_ptr<Job>> _queue;
+    //! Workers taking requests from the queue.
+    std::size_t _runners;
+    std::size_t _running;
+
+    MpscQueue<Completion> _completions;
+    Stats _stats;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_CHUNKPIPELINE_H
@@ -0,0 +1,269 @@
+/*
+ * ChunkSection
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunksection.h"
+#include "network/binarystream.h"
+#include <algorithm>
+
+namespace cenisys
+{
+
+constexpr std::size_t ChunkSection::SIZE;
+constexpr std::size_t ChunkSection::VOLUME;
+constexpr BlockId ChunkSection::AIR;
+constexpr std::uint8_t ChunkSection::MAX_LIGHT;
+constexpr unsigned ChunkSection::MAX_BITS;
+constexpr std::size_t ChunkSection::MAX_LINEAR_PALETTE;
+constexpr std::uint16_t ChunkSection::EMPTY_SLOT;
+
+ChunkSection::ChunkSection(BlockId block)
+    : _palette{block}, _uniform(0), _data(&_uniform), _meta(0),
+      _blockLight(0), _skyLight(MAX_LIGHT)
+{
+    setBits(0);
+}
+
+ChunkSection::ChunkSection(const ChunkSection &other)
+    : _palette(other._palette), _lookup(other._lookup), _words(other._words),
+      _uniform(0),
+      _data(other._bits ? _words.data() : &_uniform), _meta(other._meta),
+      _blockLight(other._blockLight), _skyLight(other._skyLight)
+{
+    setBits(other._bits);
+}
+
+ChunkSection &ChunkSection::operator=(const ChunkSection &other)
+{
+    _palette = other._palette;
+    _lookup = other._lookup;
+    _words = other._words;
+    _uniform = 0;
+    _data = other._bits ? _words.data() : &_uniform;
+    setBits(other._bits);
+    _meta = other._meta;
+    _blockLight = other._blockLight;
+    _skyLight = other._skyLight;
+    return *this;
+}
+
+void ChunkSection::fill(BlockId block)
+{
+    _palette.assign(1, block);
+    std::vector<std::uint16_t>().swap(_lookup);
+    std::vector<std::uint64_t>().swap(_words);
+    _uniform = 0;
+    _data = &_uniform;
+    setBits(0);
+}
+
+void ChunkSection::compact()
+{
+    std::vector<bool> used(_palette.size(), false);
+    for(std::size_t i = 0; i < VOLUME; i++)
+        used[(_data[i >> _wordShift] >> ((i & _entryMask) * _bits)) &
+             _valueMask] = true;
+
+    std::vector<BlockId> palette;
+    std::vector<std::uint16_t> remap(_palette.size(), 0);
+    for(std::size_t i = 0; i < _palette.size(); i++)
+    {
+        if(!used[i])
+            continue;
+        remap[i] = static_cast<std::uint16_t>(palette.size());
+        palette.push_back(_palette[i]);
+    }
+    if(palette.size() == 1)
+    {
+        fill(palette.front());
+        return;
+    }
+    unsigned bits = 1;
+    while((std::size_t(1) << bits) < palette.size())
+        bits *= 2;
+    resize(bits, remap);
+    _palette = std::move(palette);
+    rebuildLookup();
+}
+
+std::size_t ChunkSection::getMemoryUsage() const
+{
+    return sizeof(ChunkSection) + _palette.capacity() * sizeof(BlockId) +
+           _lookup.capacity() * sizeof(std::uint16_t) +
+           _words.capacity() * sizeof(std::uint64_t);
+}
+
+std::size_t ChunkSection::getSerializedSize() const
+{
+    return 1 + BinaryWriter::varSize(_palette.size()) + _palette.size() * 2 +
+           (_bits ? _words.size() * 8 : 0) + 3 * NibbleArray<VOLUME>::BYTES;
+}
+
+void ChunkSection::write(BinaryWriter &writer) const
+{
+    writer.writeU8(static_cast<std::uint8_t>(_bits));
+    writer.writeVarU64(_palette.size());
+    for(BlockId block : _palette)
+        writer.writeU16(block);
+    if(_bits)
+    {
+        for(std::uint64_t word : _words)
+            writer.writeU64(word);
+    }
+    writer.writeBytes(_meta.data(), NibbleArray<VOLUME>::BYTES);
+    writer.writeBytes(_blockLight.data(), NibbleArray<VOLUME>::BYTES);
+    writer.writeBytes(_skyLight.data(), NibbleArray<VOLUME>::BYTES);
+}
+
+bool ChunkSection::read(BinaryReader &reader)
+{
+    unsigned bits = reader.readU8();
+    std::size_t size = reader.readVarU32();
+    // The palette is compacted before it outgrows the blocks
+    if(!reader.ok() || bits > MAX_BITS || (bits & (bits - 1)) || size == 0 ||
+       size > VOLUME || (bits < MAX_BITS && size > (std::size_t(1) << bits)))
+    {
+        reader.fail();
+        return false;
+    }
+    std::vector<BlockId> palette(size);
+    for(auto &item : palette)
+        item = reader.readU16();
+    std::vector<std::uint64_t> words(VOLUME * bits / 64);
+    for(auto &item : words)
+        item = reader.readU64();
+    const std::uint8_t *nibbles =
+        reader.readBytes(3 * NibbleArray<VOLUME>::BYTES);
+    if(!nibbles)
+        return false;
+    // Every index must point into the palette
+    if(bits)
+    {
+        std::size_t entries = 64 / bits;
+        std::uint64_t mask = (std::uint64_t(1) << bits) - 1;
+        for(std::size_t i = 0; i < VOLUME; i++)
+        {
+            if(((words[i / entries] >> (i % entries * bits)) & mask) >= size)
+            {
+                reader.fail();
+                return false;
+            }
+        }
+    }
+
+    _palette = std::move(palette);
+    _words = std::move(words);
+    _uniform = 0;
+    _data = bits ? _words.data() : &_uniform;
+    setBits(bits);
+    rebuildLookup();
+    std::copy_n(nibbles, NibbleArray<VOLUME>::BYTES, _meta.data());
+    nibbles += NibbleArray<VOLUME>::BYTES;
+    std::copy_n(nibbles, NibbleArray<VOLUME>::BYTES, _blockLight.data());
+    nibbles += NibbleArray<VOLUME>::BYTES;
+    std::copy_n(nibbles, NibbleArray<VOLUME>::BYTES, _skyLight.data());
+    return true;
+}
+
+std::uint64_t ChunkSection::addToPalette(BlockId block)
+{
+    std::size_t index = _palette.size();
+    // Overwritten ids stay in the palette, drop them before it outgrows
+    // the blocks
+    if(index >= VOLUME)
+    {
+        compact();
+        index = _palette.size();
+    }
+    if(index > _valueMask)
+        resize(_bits ? _bits * 2 : 1, {});
+    _palette.push_back(block);
+    // Keep the table at most half full
+    if(_palette.size() > MAX_LINEAR_PALETTE &&
+       _palette.size() * 2 > _lookup.size())
+        rebuildLookup();
+    else if(!_lookup.empty())
+        insertLookup(index);
+    return index;
+}
+
+void ChunkSection::resize(unsigned bits,
+                          const std::vector<std::uint16_t> &remap)
+{
+    std::vector<std::uint64_t> words(VOLUME * bits / 64, 0);
+    std::size_t entries = 64 / bits;
+    for(std::size_t i = 0; i < VOLUME; i++)
+    {
+        std::uint64_t value =
+            (_data[i >> _wordShift] >> ((i & _entryMask) * _bits)) &
+            _valueMask;
+        if(!remap.empty())
+            value = remap[value];
+        words[i / entries] |= value << (i % entries * bits);
+    }
+    _words = std::move(words);
+    _data = _words.data();
+    setBits(bits);
+}
+
+void ChunkSection::rebuildLookup()
+{
+    if(_palette.size() <= MAX_LINEAR_PALETTE)
+    {
+        std::vector<std::uint16_t>().swap(_lookup);
+        return;
+    }
+    std::size_t size = 64;
+    while(size < _palette.size() * 4)
+        size *= 2;
+    _lookup.assign(size, EMPTY_SLOT);
+    for(std::size_t i = 0; i < _palette.size(); i++)
+        insertLookup(i);
+}
+
+void ChunkSection::insertLookup(std::size_t index)
+{
+    std::size_t mask = _lookup.size() - 1;
+    std::size_t slot = hash(_palette[index]) & mask;
+    while(_lookup[slot] != EMPTY_SLOT)
+        slot = (slot + 1) & mask;
+    _lookup[slot] = static_cast<std::uint16_t>(index);
+}
+
+void ChunkSection::setBits(unsigned bits)
+{
+    _bits = bits;
+    if(bits == 0)
+    {
+        // Every index lands on the first bit of the single word
+        _wordShift = 12;
+        static_assert(VOLUME == 1 << 12, "Indices must shift out");
+        _entryMask = 0;
+        _valueMask = 0;
+        return;
+    }
+    unsigned entries = 64 / bits;
+    _wordShift = 0;
+    while((1u << _wordShift) < entries)
+        _wordShift++;
+    _entryMask = entries - 1;
+    _valueMask = (std::uint64_t(1) << bits) - 1;
+}
+
+} // namespace cenisys
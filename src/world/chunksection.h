@@ -0,0 +1,218 @@
+/*
+ * ChunkSection
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_CHUNKSECTION_H
+#define CENISYS_CHUNKSECTION_H
+
+#include "world/nibblearray.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cenisys
+{
+
+class BinaryReader;
+class BinaryWriter;
+
+using BlockId = std::uint16_t;
+
+//!
+//! \brief A 16x16x16 cube of blocks.
+//!
+//! Blocks are stored as indices into a palette of the distinct ids, packed
+//! into 64-bit words with a power of two bits each, so no index straddles
+//! two words. A section holding a single id, such as air, uses no bits at
+//! all: every index reads as 0 from a word inside the section, so reads
+//! take the same path in every case and never allocate.
+//!
+//! Palettes of more than one id are searched through an open addressing
+//! table of palette indices; a linear scan mispredicts on mixed sections
+//! even with only a few ids.
+//!
+//! Metadata, block light and sky light are kept in separate nibble arrays.
+//!
+//! Blocks are indexed in YZX order, so a horizontal layer is contiguous.
+//!
+class ChunkSection
+{
+public:
+    static constexpr std::size_t SIZE = 16;
+    static constexpr std::size_t VOLUME = SIZE * SIZE * SIZE;
+    static constexpr BlockId AIR = 0;
+    static constexpr std::uint8_t MAX_LIGHT = 15;
+    //! Widest index, enough for a distinct id in every block.
+    static constexpr unsigned MAX_BITS = 16;
+    //! Larger palettes are searched through the hash table.
+    static constexpr std::size_t MAX_LINEAR_PALETTE = 1;
+
+    //!
+    //! \brief A section filled with one block, lit by the sky.
+    //!
+    explicit ChunkSection(BlockId block = AIR);
+    ChunkSection(const ChunkSection &other);
+    ChunkSection &operator=(const ChunkSection &other);
+
+    static std::size_t index(unsigned x, unsigned y, unsigned z)
+    {
+        return (y << 8) | (z << 4) | x;
+    }
+
+    BlockId getBlock(std::size_t index) const
+    {
+        return _palette[(_data[index >> _wordShift] >>
+                         ((index & _entryMask) * _bits)) &
+                        _valueMask];
+    }
+    void setBlock(std::size_t index, BlockId block)
+    {
+        std::uint64_t value = paletteIndex(block);
+        std::uint64_t &word = _data[index >> _wordShift];
+        unsigned shift = (index & _entryMask) * _bits;
+        word = (word & ~(_valueMask << shift)) | (value << shift);
+    }
+    //!
+    //! \brief Set every block, dropping the palette.
+    //!
+    void fill(BlockId block);
+
+    std::uint8_t getMeta(std::size_t index) const { return _meta.get(index); }
+    void setMeta(std::size_t index, std::uint8_t meta)
+    {
+        _meta.set(index, meta);
+    }
+    std::uint8_t getBlockLight(std::size_t index) const
+    {
+        return _blockLight.get(index);
+    }
+    void setBlockLight(std::size_t index, std::uint8_t light)
+    {
+        _blockLight.set(index, light);
+    }
+    std::uint8_t getSkyLight(std::size_t index) const
+    {
+        return _skyLight.get(index);
+    }
+    void setSkyLight(std::size_t index, std::uint8_t light)
+    {
+        _skyLight.set(index, light);
+    }
+
+    NibbleArray<VOLUME> &getMetaArray() { return _meta; }
+    const NibbleArray<VOLUME> &getMetaArray() const { return _meta; }
+    NibbleArray<VOLUME> &getBlockLightArray() { return _blockLight; }
+    const NibbleArray<VOLUME> &getBlockLightArray() const
+    {
+        return _blockLight;
+    }
+    NibbleArray<VOLUME> &getSkyLightArray() { return _skyLight; }
+    const NibbleArray<VOLUME> &getSkyLightArray() const { return _skyLight; }
+
+    //!
+    //! \brief True if every block has the same id.
+    //!
+    //! Only exact after compact(), a wider palette may still hold one id.
+    //!
+    bool isUniform() const { return _bits == 0; }
+    unsigned getBitsPerBlock() const { return _bits; }
+    const std::vector<BlockId> &getPalette() const { return _palette; }
+    //!
+    //! \brief Drop the unused palette entries and narrow the indices.
+    //!
+    void compact();
+
+    //!
+    //! \brief Bytes taken in memory, including the palette and indices.
+    //!
+    std::size_t getMemoryUsage() const;
+    //!
+    //! \brief Number of bytes written by write().
+    //!
+    std::size_t getSerializedSize() const;
+    //!
+    //! \brief Write the palette, the packed indices and the nibble arrays.
+    //!
+    void write(BinaryWriter &writer) const;
+    //!
+    //! \brief Replace the section with one written by write().
+    //! \return false if the data is invalid; the section is left unchanged.
+    //!
+    bool read(BinaryReader &reader);
+
+private:
+    std::uint64_t paletteIndex(BlockId block)
+    {
+        if(_lookup.empty())
+        {
+            for(std::size_t i = 0; i < _palette.size(); i++)
+            {
+                if(_palette[i] == block)
+                    return i;
+            }
+            return addToPalette(block);
+        }
+        std::size_t mask = _lookup.size() - 1;
+        for(std::size_t slot = hash(block) & mask;; slot = (slot + 1) & mask)
+        {
+            std::uint16_t entry = _lookup[slot];
+            if(entry == EMPTY_SLOT)
+                return addToPalette(block);
+            if(_palette[entry] == block)
+                return entry;
+        }
+    }
+    static std::size_t hash(BlockId block)
+    {
+        return (block * 0x9e3779b1u) >> 16;
+    }
+    //! \return The index of the new entry.
+    std::uint64_t addToPalette(BlockId block);
+    //!
+    //! \brief Repack the indices with another width.
+    //! \param remap New palette index of every old one, or empty to keep.
+    //!
+    void resize(unsigned bits, const std::vector<std::uint16_t> &remap);
+    void setBits(unsigned bits);
+    //! Rebuild the table, or drop it if the palette is small.
+    void rebuildLookup();
+    void insertLookup(std::size_t index);
+
+    static constexpr std::uint16_t EMPTY_SLOT = 0xffff;
+
+    std::vector<BlockId> _palette;
+    //! Palette index per slot, empty while the palette is small.
+    std::vector<std::uint16_t> _lookup;
+    std::vector<std::uint64_t> _words;
+    //! Target of the reads while no bits are used.
+    std::uint64_t _uniform;
+    //! Either _words or _uniform.
+    std::uint64_t *_data;
+    unsigned _bits;
+    unsigned _wordShift;
+    std::size_t _entryMask;
+    std::uint64_t _valueMask;
+    NibbleArray<VOLUME> _meta;
+    NibbleArray<VOLUME> _blockLight;
+    NibbleArray<VOLUME> _skyLight;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_CHUNKSECTION_H
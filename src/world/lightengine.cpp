@@ -0,0 +1,520 @@
+/*
+ * LightEngine
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/lightengine.h"
+#include "world/chunkcolumn.h"
+#include <algorithm>
+#include <array>
+
+namespace cenisys
+{
+
+namespace
+{
+
+constexpr std::uint8_t MAX_LIGHT = ChunkSection::MAX_LIGHT;
+constexpr std::uint8_t OPAQUE = ChunkSection::MAX_LIGHT;
+constexpr int HEIGHT = static_cast<int>(ChunkColumn::HEIGHT);
+
+struct Direction
+{
+    int x;
+    int y;
+    int z;
+};
+//! Down comes first, see DOWN.
+constexpr Direction DIRECTIONS[] = {{0, -1, 0}, {0, 1, 0},  {-1, 0, 0},
+                                    {1, 0, 0},  {0, 0, -1}, {0, 0, 1}};
+constexpr std::size_t DOWN = 0;
+
+struct Properties
+{
+    std::array<std::uint8_t, 256> opacity;
+    std::array<std::uint8_t, 256> emission;
+};
+
+Properties makeProperties()
+{
+    Properties result;
+    result.opacity.fill(OPAQUE);
+    result.emission.fill(0);
+    // Plants, glass, rails, torches and the other blocks light passes
+    for(BlockId block :
+        {0,   6,   20,  27,  28,  31,  32,  37,  38,  39,  40,  50,  51,
+         52,  55,  59,  63,  64,  65,  66,  68,  69,  70,  71,  72,  75,
+         76,  77,  78,  81,  83,  85,  90,  96,  101, 102, 104, 105, 106,
+         107, 111, 113, 115, 117, 119, 127, 131, 132, 138, 139, 140, 141,
+         142, 143, 147, 148, 171, 175, 244})
+    {
+        result.opacity[block] = 0;
+    }
+    result.opacity[8] = result.opacity[9] = 2;
+    result.opacity[10] = result.opacity[11] = 0;
+    result.opacity[18] = result.opacity[161] = 1;
+    result.opacity[30] = 1;
+    result.opacity[79] = 2;
+    for(BlockId block : {10, 11, 51, 89, 90, 91, 119, 124, 138})
+        result.emission[block] = 15;
+    result.emission[50] = 14;
+    result.emission[62] = 13;
+    result.emission[76] = 7;
+    result.emission[39] = result.emission[117] = result.emission[120] = 1;
+    return result;
+}
+
+const Properties PROPERTIES = makeProperties();
+
+} // namespace
+
+LightEngine::LightEngine(ColumnLookup &&lookup)
+    : _lookup(std::move(lookup)), _cached(nullptr), _cachedX(0), _cachedZ(0),
+      _cacheValid(false), _seeds(0)
+{
+}
+
+void LightEngine::blockChanged(std::int32_t x, unsigned y, std::int32_t z,
+                               BlockId previous)
+{
+    // Keeps the block before the first change, which may be undone
+    _changes.insert({Position(x, z, y), previous});
+}
+
+void LightEngine::columnLoaded(std::int32_t x, std::int32_t z)
+{
+    _cacheValid = false;
+    ChunkColumn *column = getColumn(x, z);
+    if(!column)
+        return;
+    for(std::size_t i = 2; i < 6; i++)
+    {
+        const Direction &direction = DIRECTIONS[i];
+        ChunkColumn *neighbour =
+            getColumn(x + direction.x, z + direction.z);
+        if(!neighbour)
+            continue;
+        seedBorder<false>(*column, *neighbour, x, z, direction.x,
+                          direction.z);
+        seedBorder<true>(*column, *neighbour, x, z, direction.x,
+                         direction.z);
+    }
+}
+
+LightEngine::Stats LightEngine::update()
+{
+    Stats stats{0, 0, 0};
+    _cacheValid = false;
+    std::vector<Position> changed;
+    for(const auto &item : _changes)
+    {
+        std::int32_t x, z;
+        unsigned y;
+        std::tie(x, z, y) = item.first;
+        ChunkColumn *column = getColumn(x >> 4, z >> 4);
+        if(!column || column->getBlock(x & 15, y, z & 15) == item.second)
+            continue;
+        stats.changes++;
+        // Take back whatever the old block let through or gave off
+        std::uint8_t level = getLight<false>(x, y, z);
+        if(level)
+        {
+            setLight<false>(x, y, z, 0);
+            push(_block.decrease, x, y, z, level);
+        }
+        level = getLight<true>(x, y, z);
+        if(level)
+        {
+            setLight<true>(x, y, z, 0);
+            push(_sky.decrease, x, y, z, level);
+        }
+        changed.push_back(item.first);
+    }
+    _changes.clear();
+    decrease<false>(stats);
+    decrease<true>(stats);
+
+    for(const Position &item : changed)
+    {
+        std::int32_t x, z;
+        unsigned y;
+        std::tie(x, z, y) = item;
+        BlockId block =
+            getColumn(x >> 4, z >> 4)->getBlock(x & 15, y, z & 15);
+        std::uint8_t emission = getEmission(block);
+        if(emission > getLight<false>(x, y, z))
+        {
+            setLight<false>(x, y, z, emission);
+            push(_block.increase, x, y, z, emission);
+        }
+        pullNeighbours(x, y, z);
+    }
+    increase<false>(stats);
+    increase<true>(stats);
+    _seeds = 0;
+    return stats;
+}
+
+void LightEngine::lightColumn(ChunkColumn &column)
+{
+    std::size_t top = ChunkColumn::SECTIONS;
+    while(top > 0 && !column.hasSection(top - 1))
+        top--;
+    // Empty sections under the top one may be dark, so they are allocated
+    for(std::size_t y = 0; y < top; y++)
+    {
+        ChunkSection &section = column.getWritableSection(y);
+        section.getBlockLightArray().fill(0);
+        section.getSkyLightArray().fill(0);
+    }
+    std::int32_t columnX = column.getX();
+    std::int32_t columnZ = column.getZ();
+    LightEngine engine([&column, columnX, columnZ](std::int32_t x,
+                                                   std::int32_t z) {
+        return x == columnX && z == columnZ ? &column : nullptr;
+    });
+    const std::int32_t size = static_cast<std::int32_t>(ChunkSection::SIZE);
+    std::int32_t baseX = columnX * size;
+    std::int32_t baseZ = columnZ * size;
+    const unsigned limit = static_cast<unsigned>(top * ChunkSection::SIZE);
+
+    // Straight down from the sky. Full light reaches down to the height,
+    // and some light on to the lowest lit block.
+    const std::size_t area = ChunkSection::SIZE * ChunkSection::SIZE;
+    std::array<unsigned, area> heights;
+    std::array<unsigned, area> lowest;
+    for(unsigned z = 0; z < ChunkSection::SIZE; z++)
+    {
+        for(unsigned x = 0; x < ChunkSection::SIZE; x++)
+        {
+            std::uint8_t level = MAX_LIGHT;
+            unsigned height = limit;
+            unsigned y = limit;
+            while(y > 0 && level > 0)
+            {
+                y--;
+                std::uint8_t opacity = getOpacity(column.getBlock(x, y, z));
+                if(opacity || level < MAX_LIGHT)
+                {
+                    std::uint8_t loss = std::max<std::uint8_t>(1, opacity);
+                    level = level > loss ? level - loss : 0;
+                }
+                if(level == MAX_LIGHT)
+                    height = y;
+                if(level)
+                {
+                    column.getWritableSection(y >> 4).setSkyLight(
+                        ChunkSection::index(x, y & 15, z), level);
+                }
+            }
+            heights[z * ChunkSection::SIZE + x] = height;
+            lowest[z * ChunkSection::SIZE + x] = level ? y : y + 1;
+        }
+    }
+    // Sideways into the blocks darker than their neighbours
+    for(unsigned z = 0; z < ChunkSection::SIZE; z++)
+    {
+        for(unsigned x = 0; x < ChunkSection::SIZE; x++)
+        {
+            unsigned end = heights[z * ChunkSection::SIZE + x];
+            for(std::size_t i = 2; i < 6; i++)
+            {
+                unsigned nx = x + DIRECTIONS[i].x;
+                unsigned nz = z + DIRECTIONS[i].z;
+                if(nx < ChunkSection::SIZE && nz < ChunkSection::SIZE)
+                    end = std::max(end, heights[nz * ChunkSection::SIZE + nx]);
+            }
+            for(unsigned y = lowest[z * ChunkSection::SIZE + x]; y < end; y++)
+            {
+                std::uint8_t level = column.getSection(y >> 4).getSkyLight(
+                    ChunkSection::index(x, y & 15, z));
+                if(level > 1)
+                {
+                    engine.push(engine._sky.increase, baseX + x, y,
+                                      baseZ + z, level);
+                }
+            }
+        }
+    }
+    // Emitters, skipping the sections without any
+    for(std::size_t y = 0; y < top; y++)
+    {
+        ChunkSection &section = column.getWritableSection(y);
+        const std::vector<BlockId> &palette = section.getPalette();
+        if(std::none_of(palette.begin(), palette.end(),
+                        [](BlockId block) { return getEmission(block); }))
+            continue;
+        for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+        {
+            std::uint8_t emission = getEmission(section.getBlock(i));
+            if(!emission)
+                continue;
+            section.setBlockLight(i, emission);
+            engine.push(engine._block.increase, baseX + (i & 15),
+                               static_cast<unsigned>(y * 16 + (i >> 8)),
+                               baseZ + ((i >> 4) & 15), emission);
+        }
+    }
+    Stats stats{0, 0, 0};
+    engine.increase<false>(stats);
+    engine.increase<true>(stats);
+}
+
+std::uint8_t LightEngine::getOpacity(BlockId block)
+{
+    return block < PROPERTIES.opacity.size() ? PROPERTIES.opacity[block]
+                                             : OPAQUE;
+}
+
+std::uint8_t LightEngine::getEmission(BlockId block)
+{
+    return block < PROPERTIES.emission.size() ? PROPERTIES.emission[block] : 0;
+}
+
+ChunkColumn *LightEngine::getColumn(std::int32_t x, std::int32_t z)
+{
+    if(!_cacheValid || x != _cachedX || z != _cachedZ)
+    {
+        _cached = _lookup(x, z);
+        _cachedX = x;
+        _cachedZ = z;
+        _cacheValid = true;
+    }
+    return _cached;
+}
+
+template <bool Sky>
+std::uint8_t LightEngine::getLight(std::int32_t x, unsigned y, std::int32_t z)
+{
+    ChunkColumn *column = getColumn(x >> 4, z >> 4);
+    if(!column)
+        return 0;
+    const ChunkSection &section = column->getSection(y >> 4);
+    std::size_t index = ChunkSection::index(x & 15, y & 15, z & 15);
+    return Sky ? section.getSkyLight(index) : section.getBlockLight(index);
+}
+
+template <bool Sky>
+void LightEngine::setLight(std::int32_t x, unsigned y, std::int32_t z,
+                           std::uint8_t level)
+{
+    ChunkSection &section =
+        getColumn(x >> 4, z >> 4)->getWritableSection(y >> 4);
+    std::size_t index = ChunkSection::index(x & 15, y & 15, z & 15);
+    if(Sky)
+        section.setSkyLight(index, level);
+    else
+        section.setBlockLight(index, level);
+}
+
+void LightEngine::push(Queue &queue, std::int32_t x, unsigned y,
+                       std::int32_t z, std::uint8_t level)
+{
+    queue.nodes.push_back({x, z, static_cast<std::uint16_t>(y), level});
+}
+
+void LightEngine::pullNeighbours(std::int32_t x, unsigned y, std::int32_t z)
+{
+    for(const Direction &direction : DIRECTIONS)
+    {
+        int ny = static_cast<int>(y) + direction.y;
+        if(ny < 0)
+            continue;
+        std::int32_t nx = x + direction.x;
+        std::int32_t nz = z + direction.z;
+        if(ny >= HEIGHT)
+        {
+            // Above the top there is only the sky
+            std::uint8_t opacity = getOpacity(
+                getColumn(x >> 4, z >> 4)->getBlock(x & 15, y, z & 15));
+            if(opacity >= OPAQUE)
+                continue;
+            std::uint8_t level = opacity ? MAX_LIGHT - opacity : MAX_LIGHT;
+            if(level > getLight<true>(x, y, z))
+            {
+                setLight<true>(x, y, z, level);
+                push(_sky.increase, x, y, z, level);
+            }
+            continue;
+        }
+        if(!getColumn(nx >> 4, nz >> 4))
+            continue;
+        std::uint8_t level = getLight<false>(nx, ny, nz);
+        if(level)
+            push(_block.increase, nx, ny, nz, level);
+        level = getLight<true>(nx, ny, nz);
+        if(level)
+            push(_sky.increase, nx, ny, nz, level);
+    }
+}
+
+template <bool Sky>
+void LightEngine::seedBorder(ChunkColumn &from, ChunkColumn &to,
+                             std::int32_t x, std::int32_t z, std::int32_t dx,
+                             std::int32_t dz)
+{
+    const std::int32_t size = static_cast<std::int32_t>(ChunkSection::SIZE);
+    const std::int32_t last = size - 1;
+    // Block coordinates inside the columns along the shared border
+    std::int32_t fromX = dx > 0 ? last : 0;
+    std::int32_t fromZ = dz > 0 ? last : 0;
+    std::int32_t toX = dx < 0 ? last : 0;
+    std::int32_t toZ = dz < 0 ? last : 0;
+    Queue &queue = getChannel<Sky>().increase;
+    for(std::size_t section = 0; section < ChunkColumn::SECTIONS; section++)
+    {
+        // Both read as empty and full of sky light
+        if(!from.hasSection(section) && !to.hasSection(section))
+            continue;
+        const ChunkSection &a = from.getSection(section);
+        const ChunkSection &b = to.getSection(section);
+        for(std::int32_t i = 0; i < size; i++)
+        {
+            std::int32_t ax = dx ? fromX : i, az = dz ? fromZ : i;
+            std::int32_t bx = dx ? toX : i, bz = dz ? toZ : i;
+            for(unsigned dy = 0; dy < ChunkSection::SIZE; dy++)
+            {
+                std::size_t ai = ChunkSection::index(ax, dy, az);
+                std::size_t bi = ChunkSection::index(bx, dy, bz);
+                std::uint8_t la =
+                    Sky ? a.getSkyLight(ai) : a.getBlockLight(ai);
+                std::uint8_t lb =
+                    Sky ? b.getSkyLight(bi) : b.getBlockLight(bi);
+                unsigned y = static_cast<unsigned>(section * 16 + dy);
+                if(la > lb + 1)
+                {
+                    push(queue, x * size + ax, y, z * size + az, la);
+                    _seeds++;
+                }
+                else if(lb > la + 1)
+                {
+                    push(queue, (x + dx) * size + bx, y,
+                              (z + dz) * size + bz, lb);
+                    _seeds++;
+                }
+            }
+        }
+    }
+}
+
+template <bool Sky>
+void LightEngine::decrease(Stats &stats)
+{
+    Queue &queue = getChannel<Sky>().decrease;
+    Queue &relight = getChannel<Sky>().increase;
+    while(queue.head < queue.nodes.size())
+    {
+        Node node = queue.nodes[queue.head++];
+        stats.decreased++;
+        for(std::size_t i = 0; i < 6; i++)
+        {
+            const Direction &direction = DIRECTIONS[i];
+            int y = node.y + direction.y;
+            if(y < 0 || y >= HEIGHT)
+                continue;
+            std::int32_t x = node.x + direction.x;
+            std::int32_t z = node.z + direction.z;
+            ChunkColumn *column = getColumn(x >> 4, z >> 4);
+            if(!column)
+                continue;
+            const ChunkSection &section = column->getSection(y >> 4);
+            std::size_t index = ChunkSection::index(x & 15, y & 15, z & 15);
+            std::uint8_t level = Sky ? section.getSkyLight(index)
+                                     : section.getBlockLight(index);
+            if(!level)
+                continue;
+            bool fromNode = level < node.level ||
+                            (Sky && i == DOWN && node.level == MAX_LIGHT &&
+                             level == MAX_LIGHT);
+            if(!fromNode)
+            {
+                // Lit from elsewhere, so it lights the darkened blocks again
+                push(relight, x, y, z, level);
+                continue;
+            }
+            ChunkSection &writable = column->getWritableSection(y >> 4);
+            push(queue, x, y, z, level);
+            if(Sky)
+            {
+                writable.setSkyLight(index, 0);
+                continue;
+            }
+            std::uint8_t emission = getEmission(writable.getBlock(index));
+            writable.setBlockLight(index, emission);
+            if(emission)
+                push(relight, x, y, z, emission);
+        }
+    }
+    queue.nodes.clear();
+    queue.head = 0;
+}
+
+template <bool Sky>
+void LightEngine::increase(Stats &stats)
+{
+    Queue &queue = getChannel<Sky>().increase;
+    while(queue.head < queue.nodes.size())
+    {
+        Node node = queue.nodes[queue.head++];
+        // Changed since it was queued
+        if(getLight<Sky>(node.x, node.y, node.z) != node.level)
+            continue;
+        stats.increased++;
+        for(std::size_t i = 0; i < 6; i++)
+        {
+            const Direction &direction = DIRECTIONS[i];
+            int y = node.y + direction.y;
+            if(y < 0 || y >= HEIGHT)
+                continue;
+            std::int32_t x = node.x + direction.x;
+            std::int32_t z = node.z + direction.z;
+            ChunkColumn *column = getColumn(x >> 4, z >> 4);
+            if(!column)
+                continue;
+            const ChunkSection &section = column->getSection(y >> 4);
+            std::size_t index = ChunkSection::index(x & 15, y & 15, z & 15);
+            std::uint8_t opacity = getOpacity(section.getBlock(index));
+            if(opacity >= OPAQUE)
+                continue;
+            std::uint8_t level;
+            if(Sky && i == DOWN && node.level == MAX_LIGHT && !opacity)
+                level = MAX_LIGHT;
+            else
+            {
+                std::uint8_t loss = std::max<std::uint8_t>(1, opacity);
+                if(node.level <= loss)
+                    continue;
+                level = node.level - loss;
+            }
+            std::uint8_t current = Sky ? section.getSkyLight(index)
+                                       : section.getBlockLight(index);
+            if(level <= current)
+                continue;
+            ChunkSection &writable = column->getWritableSection(y >> 4);
+            if(Sky)
+                writable.setSkyLight(index, level);
+            else
+                writable.setBlockLight(index, level);
+            push(queue, x, y, z, level);
+        }
+    }
+    queue.nodes.clear();
+    queue.head = 0;
+}
+
+} // namespace cenisys
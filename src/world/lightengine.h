@@ -0,0 +1,167 @@
+/*
+ * LightEngine
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_LIGHTENGINE_H
+#define CENISYS_LIGHTENGINE_H
+
+#include "world/chunksection.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace cenisys
+{
+
+class ChunkColumn;
+
+//!
+//! \brief Keeps the block light and the sky light of loaded columns up to
+//! date as blocks change.
+//!
+//! Changed blocks are queued and merged until update(), which first darkens
+//! everything the old blocks lit with a breadth-first search, then spreads
+//! light back in from the edge of the darkened area, from emitters and
+//! from the neighbours of the changed blocks. Only the blocks whose light
+//! changes are visited, across column borders if the neighbour is loaded.
+//!
+//! Light drops by the opacity of the block it enters, but at least by one,
+//! except for full sky light going straight down through clear blocks.
+//!
+//! Changes are applied in position order and the queues are first in,
+//! first out, so the result never depends on the order of the calls.
+//!
+class LightEngine
+{
+public:
+    //! \return The column at column coordinates, or nullptr if not loaded.
+    using ColumnLookup =
+        std::function<ChunkColumn *(std::int32_t x, std::int32_t z)>;
+
+    struct Stats
+    {
+        //! Blocks which changed since the last update.
+        std::uint64_t changes;
+        //! Blocks darkened, then lit, counted per channel.
+        std::uint64_t decreased;
+        std::uint64_t increased;
+    };
+
+    explicit LightEngine(ColumnLookup &&lookup);
+
+    //!
+    //! \brief Queue a block which was changed.
+    //! \param previous The block before the first change since the last
+    //! update.
+    //!
+    void blockChanged(std::int32_t x, unsigned y, std::int32_t z,
+                      BlockId previous);
+    //!
+    //! \brief Queue the light crossing the borders of a new column.
+    //!
+    //! The column must be lit by lightColumn() already.
+    //!
+    void columnLoaded(std::int32_t x, std::int32_t z);
+    //!
+    //! \brief Forget a column which is about to be unloaded.
+    //!
+    //! Its neighbours keep the light which came from it.
+    //!
+    void columnUnloaded(std::int32_t x, std::int32_t z) { _cacheValid = false; }
+    //!
+    //! \brief Propagate everything queued.
+    //!
+    Stats update();
+    std::size_t getPending() const { return _changes.size() + _seeds; }
+
+    //!
+    //! \brief Light a column from scratch, as if its neighbours were dark.
+    //!
+    //! Only touches the column, so it may run on any thread.
+    //!
+    static void lightColumn(ChunkColumn &column);
+
+    static std::uint8_t getOpacity(BlockId block);
+    static std::uint8_t getEmission(BlockId block);
+
+private:
+    struct Node
+    {
+        std::int32_t x;
+        std::int32_t z;
+        std::uint16_t y;
+        std::uint8_t level;
+    };
+    //! A first in, first out queue which keeps its memory.
+    struct Queue
+    {
+        std::vector<Node> nodes;
+        std::size_t head = 0;
+    };
+    //! Queues of one channel.
+    struct Channel
+    {
+        Queue decrease;
+        Queue increase;
+    };
+    using Position = std::tuple<std::int32_t, std::int32_t, unsigned>;
+
+    ChunkColumn *getColumn(std::int32_t x, std::int32_t z);
+    template <bool Sky>
+    std::uint8_t getLight(std::int32_t x, unsigned y, std::int32_t z);
+    template <bool Sky>
+    void setLight(std::int32_t x, unsigned y, std::int32_t z,
+                  std::uint8_t level);
+    template <bool Sky>
+    Channel &getChannel()
+    {
+        return Sky ? _sky : _block;
+    }
+    static void push(Queue &queue, std::int32_t x, unsigned y,
+                     std::int32_t z, std::uint8_t level);
+    //! Queue the light of the neighbours, to spread into a block.
+    void pullNeighbours(std::int32_t x, unsigned y, std::int32_t z);
+    template <bool Sky>
+    void seedBorder(ChunkColumn &from, ChunkColumn &to, std::int32_t x,
+                    std::int32_t z, std::int32_t dx, std::int32_t dz);
+    template <bool Sky>
+    void decrease(Stats &stats);
+    template <bool Sky>
+    void increase(Stats &stats);
+
+    ColumnLookup _lookup;
+    //! The last column looked up, as most steps stay inside it.
+    ChunkColumn *_cached;
+    std::int32_t _cachedX;
+    std::int32_t _cachedZ;
+    bool _cacheValid;
+
+    std::map<Position, BlockId> _changes;
+    //! Nodes queued by columnLoaded().
+    std::size_t _seeds;
+    Channel _block;
+    Channel _sky;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_LIGHTENGINE_H
@@ -0,0 +1,73 @@
+/*
+ * NibbleArray
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_NIBBLEARRAY_H
+#define CENISYS_NIBBLEARRAY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace cenisys
+{
+
+//!
+//! \brief Fixed number of 4-bit values, two per byte.
+//!
+//! Even indices are stored in the low nibble, as in the MCPE chunk format.
+//!
+template <std::size_t Size>
+class NibbleArray
+{
+public:
+    static_assert(Size % 2 == 0, "Nibbles are stored in pairs");
+    static constexpr std::size_t BYTES = Size / 2;
+
+    explicit NibbleArray(std::uint8_t value = 0) { fill(value); }
+
+    std::uint8_t get(std::size_t index) const
+    {
+        return (_data[index >> 1] >> ((index & 1) << 2)) & 0xf;
+    }
+    void set(std::size_t index, std::uint8_t value)
+    {
+        unsigned shift = (index & 1) << 2;
+        std::uint8_t &byte = _data[index >> 1];
+        byte = static_cast<std::uint8_t>((byte & ~(0xf << shift)) |
+                                         ((value & 0xf) << shift));
+    }
+    void fill(std::uint8_t value)
+    {
+        _data.fill(static_cast<std::uint8_t>((value & 0xf) * 0x11));
+    }
+
+    const std::uint8_t *data() const { return _data.data(); }
+    std::uint8_t *data() { return _data.data(); }
+
+private:
+    std::array<std::uint8_t, BYTES> _data;
+};
+
+template <std::size_t Size>
+constexpr std::size_t NibbleArray<Size>::BYTES;
+
+} // namespace cenisys
+
+#endif // CENISYS_NIBBLEARRAY_H
@@ -0,0 +1,314 @@
+/*
+ * RegionFile
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/regionfile.h"
+#include "network/binarystream.h"
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace cenisys
+{
+
+constexpr std::size_t RegionFile::SIZE;
+constexpr std::size_t RegionFile::CHUNKS;
+constexpr std::size_t RegionFile::SECTOR_SIZE;
+constexpr std::size_t RegionFile::HEADER_SECTORS;
+constexpr std::size_t RegionFile::MAX_SECTORS;
+constexpr std::uint8_t RegionFile::ZLIB;
+constexpr std::size_t RegionFile::MAX_CHUNK_SIZE;
+constexpr std::size_t RegionFile::MAP_GROWTH;
+
+RegionFile::RegionFile() : _fd(-1), _map(nullptr), _mapSize(0), _fileSize(0)
+{
+    _table.fill(0);
+    _versions.fill(0);
+}
+
+RegionFile::~RegionFile()
+{
+    close();
+}
+
+bool RegionFile::open(const boost::filesystem::path &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd == -1)
+        return false;
+    struct stat info;
+    if(fstat(fd, &info) == -1)
+    {
+        ::close(fd);
+        return false;
+    }
+    std::size_t size = static_cast<std::size_t>(info.st_size);
+    // A new file, or one cut short before its header was complete
+    if(size < HEADER_SECTORS * SECTOR_SIZE)
+    {
+        size = HEADER_SECTORS * SECTOR_SIZE;
+        if(ftruncate(fd, static_cast<off_t>(size)) == -1)
+        {
+            ::close(fd);
+            return false;
+        }
+    }
+    _fd = fd;
+    _fileSize = size;
+    if(!remap(size))
+    {
+        close();
+        return false;
+    }
+
+    _used.assign((size + SECTOR_SIZE - 1) / SECTOR_SIZE, false);
+    markSectors(0, HEADER_SECTORS, true);
+    _versions.fill(0);
+    BinaryReader reader(_map, CHUNKS * 4);
+    for(std::size_t i = 0; i < CHUNKS; i++)
+    {
+        std::uint32_t entry = reader.readU32();
+        std::size_t begin = entry >> 8;
+        std::size_t count = entry & 0xff;
+        bool valid = count && begin >= HEADER_SECTORS &&
+                     begin + count <= _used.size();
+        for(std::size_t j = begin; valid && j < begin + count; j++)
+            valid = !_used[j];
+        if(valid)
+            markSectors(begin, count, true);
+        // Clear it in the file too, the sectors may be reused
+        else if(entry)
+            writeEntry(i, 0, 0);
+        _table[i] = valid ? entry : 0;
+    }
+    return true;
+}
+
+void RegionFile::close()
+{
+    if(_map)
+        munmap(const_cast<std::uint8_t *>(_map), _mapSize);
+    _map = nullptr;
+    _mapSize = 0;
+    _fileSize = 0;
+    if(_fd != -1)
+        ::close(_fd);
+    _fd = -1;
+    _table.fill(0);
+    _used.clear();
+}
+
+bool RegionFile::hasChunk(unsigned x, unsigned z) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(_mapLock);
+    return _table[z * SIZE + x] != 0;
+}
+
+bool RegionFile::read(unsigned x, unsigned z,
+                      std::vector<std::uint8_t> &data) const
+{
+    // Held while inflating, so the sectors cannot be reused meanwhile
+    std::shared_lock<std::shared_timed_mutex> lock(_mapLock);
+    std::uint32_t entry = _table[z * SIZE + x];
+    if(!entry)
+        return false;
+    std::size_t begin = (entry >> 8) * SECTOR_SIZE;
+    std::size_t end = std::min(begin + (entry & 0xff) * SECTOR_SIZE, _fileSize);
+    BinaryReader reader(_map + begin, end - begin);
+    std::uint32_t length = reader.readU32();
+    std::uint8_t compression = reader.readU8();
+    if(!reader.ok() || length == 0 || length - 1 > reader.remaining() ||
+       compression != ZLIB)
+        return false;
+
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = const_cast<Bytef *>(reader.current());
+    stream.avail_in = length - 1;
+    if(inflateInit(&stream) != Z_OK)
+        return false;
+    data.resize(std::max<std::size_t>(length * 4, SECTOR_SIZE));
+    std::size_t used = 0;
+    int result;
+    do
+    {
+        if(used == data.size())
+        {
+            if(data.size() >= MAX_CHUNK_SIZE)
+                break;
+            data.resize(std::min(data.size() * 2, MAX_CHUNK_SIZE));
+        }
+        stream.next_out = data.data() + used;
+        stream.avail_out = static_cast<uInt>(data.size() - used);
+        result = inflate(&stream, Z_NO_FLUSH);
+        used = data.size() - stream.avail_out;
+    } while(result == Z_OK);
+    inflateEnd(&stream);
+    data.resize(used);
+    return result == Z_STREAM_END;
+}
+
+bool RegionFile::write(unsigned x, unsigned z, const std::uint8_t *data,
+                       std::size_t size, std::uint64_t version, int level)
+{
+    uLongf compressed = compressBound(static_cast<uLong>(size));
+    std::vector<std::uint8_t> buffer(5 + compressed);
+    if(compress2(buffer.data() + 5, &compressed, data,
+                 static_cast<uLong>(size), level) != Z_OK)
+        return false;
+    BinaryWriter header(buffer.data(), 5);
+    header.writeU32(static_cast<std::uint32_t>(compressed + 1));
+    header.writeU8(ZLIB);
+    std::size_t count = (5 + compressed + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if(count > MAX_SECTORS)
+        return false;
+    buffer.resize(count * SECTOR_SIZE, 0);
+    std::fill(buffer.begin() + 5 + compressed, buffer.end(), 0);
+
+    std::lock_guard<std::mutex> lock(_writeLock);
+    if(_fd == -1)
+        return false;
+    std::size_t index = z * SIZE + x;
+    // A newer version was already written
+    if(version < _versions[index])
+        return true;
+    std::size_t begin = allocate(count);
+    if(!writeAt(buffer.data(), buffer.size(), begin * SECTOR_SIZE))
+    {
+        markSectors(begin, count, false);
+        return false;
+    }
+    std::uint32_t entry = static_cast<std::uint32_t>(begin << 8 | count);
+    std::uint32_t old;
+    {
+        std::unique_lock<std::shared_timed_mutex> mapLock(_mapLock);
+        std::size_t end = (begin + count) * SECTOR_SIZE;
+        if(end > _fileSize)
+        {
+            if(!remap(end))
+            {
+                markSectors(begin, count, false);
+                return false;
+            }
+            _fileSize = end;
+        }
+        old = _table[index];
+        _table[index] = entry;
+    }
+    // The data is in place before the table points at it
+    bool result = writeEntry(index, entry,
+                             static_cast<std::uint32_t>(std::time(nullptr)));
+    if(old)
+        markSectors(old >> 8, old & 0xff, false);
+    _versions[index] = version;
+    return result;
+}
+
+std::size_t RegionFile::getSectorCount() const
+{
+    std::lock_guard<std::mutex> lock(_writeLock);
+    return _used.size();
+}
+
+std::size_t RegionFile::getUsedSectors() const
+{
+    std::lock_guard<std::mutex> lock(_writeLock);
+    return static_cast<std::size_t>(
+        std::count(_used.begin(), _used.end(), true));
+}
+
+std::size_t RegionFile::allocate(std::size_t count)
+{
+    // First fit, a free run at the end of the file is extended
+    std::size_t run = 0;
+    for(std::size_t i = HEADER_SECTORS; i < _used.size(); i++)
+    {
+        run = _used[i] ? 0 : run + 1;
+        if(run == count)
+        {
+            markSectors(i + 1 - count, count, true);
+            return i + 1 - count;
+        }
+    }
+    std::size_t begin = _used.size() - run;
+    _used.resize(begin + count, false);
+    markSectors(begin, count, true);
+    return begin;
+}
+
+void RegionFile::markSectors(std::size_t begin, std::size_t count, bool used)
+{
+    std::fill(_used.begin() + begin, _used.begin() + begin + count, used);
+}
+
+bool RegionFile::writeAt(const std::uint8_t *data, std::size_t size,
+                         std::size_t offset)
+{
+    while(size)
+    {
+        ssize_t written = pwrite(_fd, data, size, static_cast<off_t>(offset));
+        if(written == -1)
+        {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        offset += static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+bool RegionFile::writeEntry(std::size_t index, std::uint32_t entry,
+                            std::uint32_t timestamp)
+{
+    std::uint8_t bytes[4];
+    BinaryWriter writer(bytes, sizeof(bytes));
+    writer.writeU32(entry);
+    if(!writeAt(bytes, sizeof(bytes), index * 4))
+        return false;
+    BinaryWriter(bytes, sizeof(bytes)).writeU32(timestamp);
+    return writeAt(bytes, sizeof(bytes), SECTOR_SIZE + index * 4);
+}
+
+bool RegionFile::remap(std::size_t size)
+{
+    if(size <= _mapSize)
+        return true;
+    std::size_t mapSize = (size + MAP_GROWTH - 1) / MAP_GROWTH * MAP_GROWTH;
+    void *map = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, _fd, 0);
+    if(map == MAP_FAILED)
+        return false;
+    if(_map)
+        munmap(const_cast<std::uint8_t *>(_map), _mapSize);
+    _map = static_cast<const std::uint8_t *>(map);
+    _mapSize = mapSize;
+    return true;
+}
+
+} // namespace cenisys
@@ -0,0 +1,137 @@
+/*
+ * RegionFile
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_REGIONFILE_H
+#define CENISYS_REGIONFILE_H
+
+#include <array>
+#include <boost/filesystem/path.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief Stores the chunks of a 32x32 chunk region in one file.
+//!
+//! The file starts with a table giving the sectors used by every chunk,
+//! and a table of the times they were written. Each chunk is a big-endian
+//! length, a compression type and the zlib stream, padded to whole sectors.
+//!
+//! The file is read through a shared memory map, so loads inflate straight
+//! from the page cache. Writes never touch sectors a reader may be using:
+//! the chunk goes to free sectors or the end of the file, then its table
+//! entry is switched over and the old sectors are freed. Writers are
+//! serialized, readers only wait for the switch and for the map to grow.
+//!
+class RegionFile
+{
+public:
+    //! Chunks along each side of the region.
+    static constexpr std::size_t SIZE = 32;
+    static constexpr std::size_t CHUNKS = SIZE * SIZE;
+    static constexpr std::size_t SECTOR_SIZE = 4096;
+    //! The table of sectors and the table of timestamps.
+    static constexpr std::size_t HEADER_SECTORS = 2;
+    //! Largest chunk, the count is a single byte in the table.
+    static constexpr std::size_t MAX_SECTORS = 255;
+    static constexpr std::uint8_t ZLIB = 2;
+    //! Chunks inflating to more than this are treated as corrupt.
+    static constexpr std::size_t MAX_CHUNK_SIZE = 1 << 24;
+    //! The map is grown by at least this much at a time.
+    static constexpr std::size_t MAP_GROWTH = 1 << 20;
+
+    RegionFile();
+    ~RegionFile();
+    RegionFile(const RegionFile &) = delete;
+    RegionFile &operator=(const RegionFile &) = delete;
+
+    //!
+    //! \brief Open or create the file.
+    //!
+    //! Table entries pointing outside the file or at sectors already used
+    //! by another chunk are dropped.
+    //!
+    //! \return false if the file could not be opened or mapped.
+    //!
+    bool open(const boost::filesystem::path &path);
+    void close();
+    bool isOpen() const { return _fd != -1; }
+
+    //!
+    //! \param x, z Coordinates of the chunk within the region.
+    //!
+    bool hasChunk(unsigned x, unsigned z) const;
+    //!
+    //! \brief Inflate a chunk.
+    //! \return false if the chunk is not stored or is corrupt.
+    //!
+    bool read(unsigned x, unsigned z, std::vector<std::uint8_t> &data) const;
+    //!
+    //! \brief Compress and store a chunk.
+    //!
+    //! The data is compressed before any lock is taken.
+    //!
+    //! \param version Writes older than the last one of the same chunk are
+    //! dropped, so writes finishing out of order keep the newest data.
+    //! \return false if the chunk is too large or the file failed.
+    //!
+    bool write(unsigned x, unsigned z, const std::uint8_t *data,
+               std::size_t size, std::uint64_t version, int level);
+
+    //! Sectors in the file, including the free ones.
+    std::size_t getSectorCount() const;
+    //! Sectors used by the header and the chunks.
+    std::size_t getUsedSectors() const;
+
+private:
+    //! \return The first sector of a free run, appending if needed.
+    std::size_t allocate(std::size_t count);
+    void markSectors(std::size_t begin, std::size_t count, bool used);
+    bool writeAt(const std::uint8_t *data, std::size_t size,
+                 std::size_t offset);
+    bool writeEntry(std::size_t index, std::uint32_t entry,
+                    std::uint32_t timestamp);
+    //! Map at least the given size. Needs the exclusive map lock.
+    bool remap(std::size_t size);
+
+    int _fd;
+
+    //! Guards the map, the file size and the table against the readers.
+    mutable std::shared_timed_mutex _mapLock;
+    const std::uint8_t *_map;
+    std::size_t _mapSize;
+    std::size_t _fileSize;
+    //! First sector and sector count of every chunk, as in the file.
+    std::array<std::uint32_t, CHUNKS> _table;
+
+    //! Serializes the writers, and guards the rest.
+    mutable std::mutex _writeLock;
+    std::vector<bool> _used;
+    std::array<std::uint64_t, CHUNKS> _versions;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_REGIONFILE_H
@@ -0,0 +1,178 @@
+/*
+ * RegionTicker
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/regionticker.h"
+#include "util/parallelrun.h"
+#include "world/chunkcolumn.h"
+#include <algorithm>
+#include <exception>
+
+namespace cenisys
+{
+
+constexpr unsigned RegionTicker::REGION_SHIFT;
+constexpr std::int32_t RegionTicker::REGION_SIZE;
+constexpr std::chrono::microseconds RegionTicker::MIN_THREAD_WORK;
+
+void RegionTicker::Region::setBlock(std::int32_t x, unsigned y,
+                                    std::int32_t z, BlockId block)
+{
+    ChunkColumn *column = getColumn(x >> 4, z >> 4);
+    if(!column)
+    {
+        RegionTicker &owner = _owner;
+        _messages.push_back([&owner, x, y, z, block] {
+            if(owner._blockSetter)
+                owner._blockSetter(x, y, z, block);
+        });
+        return;
+    }
+    if(y >= ChunkColumn::HEIGHT)
+        return;
+    BlockId previous = column->getBlock(x & 15, y, z & 15);
+    if(previous == block)
+        return;
+    column->setBlock(x & 15, y, z & 15, block);
+    _changes.push_back({x, y, z, previous});
+}
+
+RegionTicker::RegionTicker(boost::asio::io_service &ioService)
+    : _ioService(ioService), _threads(1), _columnCount(0),
+      _stats{0, 0, 0, 0, 0, 0, 0, std::chrono::steady_clock::duration::zero()}
+{
+}
+
+void RegionTicker::setHandlers(ChangeHandler &&changes, BlockSetter &&setter)
+{
+    _changeHandler = std::move(changes);
+    _blockSetter = std::move(setter);
+}
+
+void RegionTicker::insert(ChunkColumn &column)
+{
+    std::unique_ptr<Region> &region =
+        _regions[regionOf(column.getX(), column.getZ())];
+    if(!region)
+        region.reset(new Region(*this));
+    auto result =
+        region->_columns.insert({{column.getX(), column.getZ()}, &column});
+    if(result.second)
+        _columnCount++;
+    else
+        result.first->second = &column;
+}
+
+void RegionTicker::remove(std::int32_t x, std::int32_t z)
+{
+    auto region = _regions.find(regionOf(x, z));
+    if(region == _regions.end() || !region->second->_columns.erase({x, z}))
+        return;
+    _columnCount--;
+    // Changes and messages went out at the end of the last tick
+    if(region->second->_columns.empty())
+        _regions.erase(region);
+}
+
+void RegionTicker::tick()
+{
+    if(!_ticker)
+        return;
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    // Most expensive first
+    std::vector<Region *> regions;
+    regions.reserve(_regions.size());
+    double cost = 0;
+    for(auto &item : _regions)
+    {
+        regions.push_back(item.second.get());
+        cost += item.second->_cost;
+    }
+    std::stable_sort(regions.begin(), regions.end(),
+                     [](const Region *left, const Region *right) {
+                         return left->_cost > right->_cost;
+                     });
+
+    // Waking a thread costs more than ticking a few quiet regions
+    std::size_t threads = std::min(_threads, regions.size());
+    threads = std::min(
+        threads, static_cast<std::size_t>(cost / MIN_THREAD_WORK.count()));
+    threads = std::max<std::size_t>(threads, 1);
+    // Thrown once the changes of the other regions went out
+    std::exception_ptr error;
+    try
+    {
+        ParallelRun::run(_ioService, threads, regions.size(),
+                         [this, &regions](std::size_t index) {
+                             tickRegion(*regions[index]);
+                         });
+    }
+    catch(...)
+    {
+        error = std::current_exception();
+    }
+
+    // In region order, whichever thread ticked them
+    for(auto &item : _regions)
+    {
+        Region &region = *item.second;
+        for(const Region::Change &change : region._changes)
+        {
+            if(_changeHandler)
+                _changeHandler(change.x, change.y, change.z, change.previous);
+        }
+        _stats.changes += region._changes.size();
+        region._changes.clear();
+        std::vector<Message> messages;
+        messages.swap(region._messages);
+        for(Message &message : messages)
+            message();
+        _stats.messages += messages.size();
+    }
+    _stats.ticks++;
+    if(threads > 1)
+        _stats.parallelTicks++;
+    _stats.threads = threads;
+    _stats.lastTick = std::chrono::steady_clock::now() - begin;
+    if(error)
+        std::rethrow_exception(error);
+}
+
+RegionTicker::Stats RegionTicker::getStats() const
+{
+    Stats result = _stats;
+    result.regions = _regions.size();
+    result.columns = _columnCount;
+    return result;
+}
+
+void RegionTicker::tickRegion(Region &region)
+{
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    for(auto &item : region._columns)
+        _ticker(*item.second, region);
+    double cost = std::chrono::duration<double, std::micro>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count();
+    region._cost = region._cost ? region._cost * 0.75 + cost * 0.25 : cost;
+}
+
+} // namespace cenisys
@@ -0,0 +1,192 @@
+/*
+ * RegionTicker
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_REGIONTICKER_H
+#define CENISYS_REGIONTICKER_H
+
+#include "world/chunksection.h"
+#include <boost/asio/io_service.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace cenisys
+{
+
+class ChunkColumn;
+
+//!
+//! \brief Ticks the loaded columns region by region, in parallel.
+//!
+//! The columns are grouped into square regions of REGION_SIZE columns a
+//! side. A region only touches its own columns while it is ticked, so the
+//! regions are ticked on the threads of the io_service at the same time.
+//! Anything else, such as a block set in another region, is posted as a
+//! message and runs on the tick thread once every region is done. Blocks
+//! changed within a region are reported at the same point. Both happen in
+//! region order, so a tick gives the same result on any number of threads.
+//!
+//! The tick thread ticks regions itself and is only helped when the
+//! regions took long enough in the last ticks to make it worth it. The
+//! most expensive regions go first, so no thread is left with a big one at
+//! the end.
+//!
+//! Everything but the column ticker belongs to the game tick.
+//!
+class RegionTicker
+{
+public:
+    //! Columns a side of a region, as a shift.
+    static constexpr unsigned REGION_SHIFT = 3;
+    static constexpr std::int32_t REGION_SIZE = 1 << REGION_SHIFT;
+    //! Estimated time a thread must have to tick to be worth waking.
+    static constexpr std::chrono::microseconds MIN_THREAD_WORK{200};
+
+    class Region;
+    //! Ticks a column of a region, on any thread.
+    using ColumnTicker = std::function<void(ChunkColumn &, Region &)>;
+    //! Runs on the tick thread after the regions were ticked.
+    using Message = std::function<void()>;
+    //! Told about every block a region changed, with the block before.
+    using ChangeHandler = std::function<void(
+        std::int32_t x, unsigned y, std::int32_t z, BlockId previous)>;
+    //! Sets a block outside the region which wanted it set.
+    using BlockSetter = std::function<void(std::int32_t x, unsigned y,
+                                           std::int32_t z, BlockId block)>;
+
+    //!
+    //! \brief What a column ticker can reach while its region is ticked.
+    //!
+    class Region
+    {
+    public:
+        Region(const Region &) = delete;
+        Region &operator=(const Region &) = delete;
+
+        //! \return nullptr if the column is not loaded or in another region.
+        ChunkColumn *getColumn(std::int32_t x, std::int32_t z) const
+        {
+            auto it = _columns.find({x, z});
+            return it == _columns.end() ? nullptr : it->second;
+        }
+        //!
+        //! \brief Set a block now if it is in the region, else at the end of
+        //! the tick.
+        //! \param x, y, z World coordinates.
+        //!
+        void setBlock(std::int32_t x, unsigned y, std::int32_t z,
+                      BlockId block);
+        //!
+        //! \brief Run a message on the tick thread at the end of the tick.
+        //!
+        void post(Message &&message)
+        {
+            _messages.push_back(std::move(message));
+        }
+
+    private:
+        friend class RegionTicker;
+        using Key = std::pair<std::int32_t, std::int32_t>;
+        struct Change
+        {
+            std::int32_t x;
+            unsigned y;
+            std::int32_t z;
+            BlockId previous;
+        };
+
+        explicit Region(RegionTicker &owner) : _owner(owner), _cost(0) {}
+
+        RegionTicker &_owner;
+        std::map<Key, ChunkColumn *> _columns;
+        //! Smoothed time of a tick, in microseconds.
+        double _cost;
+        std::vector<Change> _changes;
+        std::vector<Message> _messages;
+    };
+
+    struct Stats
+    {
+        std::size_t regions;
+        std::size_t columns;
+        std::uint64_t ticks;
+        //! Ticks which had help from other threads.
+        std::uint64_t parallelTicks;
+        std::uint64_t changes;
+        std::uint64_t messages;
+        //! Threads which ticked regions in the last tick.
+        std::size_t threads;
+        std::chrono::steady_clock::duration lastTick;
+    };
+
+    explicit RegionTicker(boost::asio::io_service &ioService);
+    RegionTicker(const RegionTicker &) = delete;
+    RegionTicker &operator=(const RegionTicker &) = delete;
+
+    //!
+    //! \brief Set how many threads, the tick thread included, tick regions.
+    //!
+    void setThreads(std::size_t threads) { _threads = threads ? threads : 1; }
+    std::size_t getThreads() const { return _threads; }
+
+    void setTicker(ColumnTicker &&ticker) { _ticker = std::move(ticker); }
+    void setHandlers(ChangeHandler &&changes, BlockSetter &&setter);
+
+    //!
+    //! \brief Start ticking a column, which must stay until removed.
+    //!
+    void insert(ChunkColumn &column);
+    void remove(std::int32_t x, std::int32_t z);
+
+    //!
+    //! \brief Tick every column, then report the changes and run the
+    //! messages. Does nothing without a column ticker.
+    //!
+    void tick();
+
+    Stats getStats() const;
+
+private:
+    using Key = std::pair<std::int32_t, std::int32_t>;
+
+    static Key regionOf(std::int32_t x, std::int32_t z)
+    {
+        return {x >> REGION_SHIFT, z >> REGION_SHIFT};
+    }
+    void tickRegion(Region &region);
+
+    boost::asio::io_service &_ioService;
+    std::size_t _threads;
+    ColumnTicker _ticker;
+    ChangeHandler _changeHandler;
+    BlockSetter _blockSetter;
+    std::map<Key, std::unique_ptr<Region>> _regions;
+    std::size_t _columnCount;
+    Stats _stats;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_REGIONTICKER_H
@@ -0,0 +1,121 @@
+/*
+ * ScheduledTicks
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_SCHEDULEDTICKS_H
+#define CENISYS_SCHEDULEDTICKS_H
+
+#include "world/chunksection.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+namespace cenisys
+{
+
+//!
+//! \brief The block updates scheduled in a column, by due tick.
+//!
+//! Positions are (y << 8) | (z << 4) | x in the column. A block is
+//! scheduled at most once per position: scheduling it again before it ran
+//! is ignored. Ticks due at the same time come in the order they were
+//! scheduled.
+//!
+class ScheduledTicks
+{
+public:
+    struct Tick
+    {
+        std::uint64_t due;
+        //! Breaks ties between ticks due at the same time.
+        std::uint64_t order;
+        std::uint16_t position;
+        BlockId block;
+    };
+
+    ScheduledTicks() : _order(0) {}
+
+    //!
+    //! \brief Schedule a block update.
+    //! \return false if the block was already scheduled at the position.
+    //!
+    bool schedule(std::uint16_t position, BlockId block, std::uint64_t due)
+    {
+        if(!_keys.insert(key(position, block)).second)
+            return false;
+        _heap.push_back({due, _order++, position, block});
+        std::push_heap(_heap.begin(), _heap.end(), Later());
+        return true;
+    }
+
+    //!
+    //! \brief Take the ticks due by a tick out of the queue, then run them.
+    //!
+    //! The handler may schedule again, including the tick it was given.
+    //! \return Number of ticks run.
+    //!
+    template <typename Handler>
+    std::size_t runDue(std::uint64_t now, Handler &&handler)
+    {
+        if(_heap.empty() || _heap.front().due > now)
+            return 0;
+        std::vector<Tick> due;
+        while(!_heap.empty() && _heap.front().due <= now)
+        {
+            std::pop_heap(_heap.begin(), _heap.end(), Later());
+            due.push_back(_heap.back());
+            _heap.pop_back();
+            _keys.erase(key(due.back().position, due.back().block));
+        }
+        for(const Tick &tick : due)
+            handler(tick);
+        return due.size();
+    }
+
+    std::size_t size() const { return _heap.size(); }
+    bool empty() const { return _heap.empty(); }
+    //! Only valid if not empty.
+    std::uint64_t getNextDue() const { return _heap.front().due; }
+
+private:
+    //! Puts the earliest tick on top of the heap.
+    struct Later
+    {
+        bool operator()(const Tick &left, const Tick &right) const
+        {
+            return left.due != right.due ? left.due > right.due
+                                         : left.order > right.order;
+        }
+    };
+
+    static std::uint32_t key(std::uint16_t position, BlockId block)
+    {
+        return (std::uint32_t(position) << 16) | block;
+    }
+
+    std::vector<Tick> _heap;
+    std::unordered_set<std::uint32_t> _keys;
+    std::uint64_t _order;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_SCHEDULEDTICKS_H
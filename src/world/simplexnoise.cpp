@@ -0,0 +1,344 @@
+/*
+ * SimplexNoise
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/simplexnoise.h"
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace cenisys
+{
+
+namespace
+{
+
+// Skew from the square grid to the simplex grid and back
+constexpr float F2 = 0.36602540378f;
+constexpr float G2 = 0.21132486540f;
+//! Brings the sum of the corners to [-1, 1].
+constexpr float SCALE = 45.0f;
+
+//!
+//! \brief One lane of everything, used for single samples and the tails.
+//!
+struct ScalarOps
+{
+    using Float = float;
+    using Int = std::uint32_t;
+    static constexpr std::size_t WIDTH = 1;
+
+    static Float set(float value) { return value; }
+    static Float lanes() { return 0.0f; }
+    static Float add(Float a, Float b) { return a + b; }
+    static Float sub(Float a, Float b) { return a - b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Float max(Float a, Float b) { return a > b ? a : b; }
+    static Float floor(Float a) { return std::floor(a); }
+    static Int toInt(Float a)
+    {
+        return static_cast<Int>(static_cast<std::int32_t>(a));
+    }
+    static Float toFloat(Int a)
+    {
+        return static_cast<float>(static_cast<std::int32_t>(a));
+    }
+    //! All bits set where a > b.
+    static Int greater(Float a, Float b) { return a > b ? ~Int(0) : 0; }
+    //! Negate where the top bit of the mask is set.
+    static Float negate(Float a, Int mask)
+    {
+        return mask & 0x80000000u ? -a : a;
+    }
+    //! a where the mask is not zero, b elsewhere.
+    static Float select(Int mask, Float a, Float b) { return mask ? a : b; }
+    static void store(float *out, Float a) { *out = a; }
+
+    static Int seti(std::uint32_t value) { return value; }
+    static Int addi(Int a, Int b) { return a + b; }
+    static Int muli(Int a, Int b) { return a * b; }
+    static Int andi(Int a, Int b) { return a & b; }
+    static Int xori(Int a, Int b) { return a ^ b; }
+    template <int Bits>
+    static Int shl(Int a)
+    {
+        return a << Bits;
+    }
+    template <int Bits>
+    static Int shr(Int a)
+    {
+        return a >> Bits;
+    }
+};
+
+#ifdef __SSE2__
+struct Sse2Ops
+{
+    using Float = __m128;
+    using Int = __m128i;
+    static constexpr std::size_t WIDTH = 4;
+
+    static Float set(float value) { return _mm_set1_ps(value); }
+    static Float lanes() { return _mm_setr_ps(0, 1, 2, 3); }
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+    static Float floor(Float a)
+    {
+        // Truncation rounds negative values up
+        Float result = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(
+            result, _mm_and_ps(_mm_cmpgt_ps(result, a), _mm_set1_ps(1.0f)));
+    }
+    static Int toInt(Float a) { return _mm_cvttps_epi32(a); }
+    static Float toFloat(Int a) { return _mm_cvtepi32_ps(a); }
+    static Int greater(Float a, Float b)
+    {
+        return _mm_castps_si128(_mm_cmpgt_ps(a, b));
+    }
+    static Float negate(Float a, Int mask)
+    {
+        return _mm_xor_ps(
+            a, _mm_castsi128_ps(_mm_and_si128(
+                   mask, _mm_set1_epi32(static_cast<int>(0x80000000u)))));
+    }
+    static Float select(Int mask, Float a, Float b)
+    {
+        Float zero =
+            _mm_castsi128_ps(_mm_cmpeq_epi32(mask, _mm_setzero_si128()));
+        return _mm_or_ps(_mm_andnot_ps(zero, a), _mm_and_ps(zero, b));
+    }
+    static void store(float *out, Float a) { _mm_storeu_ps(out, a); }
+
+    static Int seti(std::uint32_t value)
+    {
+        return _mm_set1_epi32(static_cast<int>(value));
+    }
+    static Int addi(Int a, Int b) { return _mm_add_epi32(a, b); }
+    static Int muli(Int a, Int b)
+    {
+        // No 32-bit multiply before SSE4.1: multiply the even and the odd
+        // lanes to 64 bits, then take the low halves
+        Int even = _mm_mul_epu32(a, b);
+        Int odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+        return _mm_unpacklo_epi32(
+            _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+    static Int andi(Int a, Int b) { return _mm_and_si128(a, b); }
+    static Int xori(Int a, Int b) { return _mm_xor_si128(a, b); }
+    template <int Bits>
+    static Int shl(Int a)
+    {
+        return _mm_slli_epi32(a, Bits);
+    }
+    template <int Bits>
+    static Int shr(Int a)
+    {
+        return _mm_srli_epi32(a, Bits);
+    }
+};
+#endif
+
+#ifdef __AVX2__
+struct Avx2Ops
+{
+    using Float = __m256;
+    using Int = __m256i;
+    static constexpr std::size_t WIDTH = 8;
+
+    static Float set(float value) { return _mm256_set1_ps(value); }
+    static Float lanes() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+    static Float floor(Float a) { return _mm256_floor_ps(a); }
+    static Int toInt(Float a) { return _mm256_cvttps_epi32(a); }
+    static Float toFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+    static Int greater(Float a, Float b)
+    {
+        return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OQ));
+    }
+    static Float negate(Float a, Int mask)
+    {
+        return _mm256_xor_ps(
+            a, _mm256_castsi256_ps(_mm256_and_si256(
+                   mask, _mm256_set1_epi32(static_cast<int>(0x80000000u)))));
+    }
+    static Float select(Int mask, Float a, Float b)
+    {
+        Float zero = _mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(mask, _mm256_setzero_si256()));
+        return _mm256_blendv_ps(a, b, zero);
+    }
+    static void store(float *out, Float a) { _mm256_storeu_ps(out, a); }
+
+    static Int seti(std::uint32_t value)
+    {
+        return _mm256_set1_epi32(static_cast<int>(value));
+    }
+    static Int addi(Int a, Int b) { return _mm256_add_epi32(a, b); }
+    static Int muli(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+    static Int andi(Int a, Int b) { return _mm256_and_si256(a, b); }
+    static Int xori(Int a, Int b) { return _mm256_xor_si256(a, b); }
+    template <int Bits>
+    static Int shl(Int a)
+    {
+        return _mm256_slli_epi32(a, Bits);
+    }
+    template <int Bits>
+    static Int shr(Int a)
+    {
+        return _mm256_srli_epi32(a, Bits);
+    }
+};
+using VectorOps = Avx2Ops;
+#elif defined(__SSE2__)
+using VectorOps = Sse2Ops;
+#else
+using VectorOps = ScalarOps;
+#endif
+
+template <typename V>
+typename V::Int hash(typename V::Int i, typename V::Int j,
+                     typename V::Int seed)
+{
+    using Int = typename V::Int;
+    Int h = V::addi(V::addi(V::muli(i, V::seti(0x27d4eb2du)),
+                            V::muli(j, V::seti(0x165667b1u))),
+                    seed);
+    h = V::xori(h, V::template shr<15>(h));
+    h = V::muli(h, V::seti(0x2c1b3c6du));
+    return V::xori(h, V::template shr<12>(h));
+}
+
+//!
+//! \brief Contribution of a corner at the offset (x, y).
+//!
+//! The low three bits of the hash pick one of the gradients (+-1, +-2) and
+//! (+-2, +-1).
+//!
+template <typename V>
+typename V::Float corner(typename V::Float x, typename V::Float y,
+                         typename V::Int hash)
+{
+    using Float = typename V::Float;
+    Float t = V::sub(V::set(0.5f), V::add(V::mul(x, x), V::mul(y, y)));
+    t = V::max(t, V::set(0.0f));
+    t = V::mul(t, t);
+    t = V::mul(t, t);
+    typename V::Int swap = V::andi(hash, V::seti(4));
+    Float u = V::select(swap, y, x);
+    Float v = V::select(swap, x, y);
+    Float gradient = V::add(V::negate(u, V::template shl<31>(hash)),
+                            V::negate(V::add(v, v), V::template shl<30>(hash)));
+    return V::mul(t, gradient);
+}
+
+template <typename V>
+typename V::Float simplex(typename V::Float x, typename V::Float y,
+                          typename V::Int seed)
+{
+    using Float = typename V::Float;
+    using Int = typename V::Int;
+    Float s = V::mul(V::add(x, y), V::set(F2));
+    Float fi = V::floor(V::add(x, s));
+    Float fj = V::floor(V::add(y, s));
+    Float t = V::mul(V::add(fi, fj), V::set(G2));
+    Float x0 = V::sub(x, V::sub(fi, t));
+    Float y0 = V::sub(y, V::sub(fj, t));
+
+    // The second corner is on the right in the lower triangle
+    Int lower = V::andi(V::greater(x0, y0), V::seti(1));
+    Int upper = V::xori(lower, V::seti(1));
+    Float x1 = V::add(V::sub(x0, V::toFloat(lower)), V::set(G2));
+    Float y1 = V::add(V::sub(y0, V::toFloat(upper)), V::set(G2));
+    Float x2 = V::add(x0, V::set(2.0f * G2 - 1.0f));
+    Float y2 = V::add(y0, V::set(2.0f * G2 - 1.0f));
+
+    Int i = V::toInt(fi);
+    Int j = V::toInt(fj);
+    Int one = V::seti(1);
+    Float n = V::add(
+        V::add(corner<V>(x0, y0, hash<V>(i, j, seed)),
+               corner<V>(x1, y1,
+                         hash<V>(V::addi(i, lower), V::addi(j, upper), seed))),
+        corner<V>(x2, y2, hash<V>(V::addi(i, one), V::addi(j, one), seed)));
+    return V::mul(n, V::set(SCALE));
+}
+
+template <typename V>
+void sampleRow(float x, float z, float step, std::size_t width,
+               std::uint32_t seed, float *out)
+{
+    typename V::Float row = V::set(z);
+    typename V::Int seeds = V::seti(seed);
+    std::size_t j = 0;
+    for(; j + V::WIDTH <= width; j += V::WIDTH)
+    {
+        typename V::Float columns = V::add(
+            V::mul(V::add(V::set(static_cast<float>(j)), V::lanes()),
+                   V::set(step)),
+            V::set(x));
+        V::store(out + j, simplex<V>(columns, row, seeds));
+    }
+    for(; j < width; j++)
+    {
+        out[j] = simplex<ScalarOps>(x + static_cast<float>(j) * step, z,
+                                    seed);
+    }
+}
+
+} // namespace
+
+SimplexNoise::SimplexNoise(std::uint32_t seed) : _seed(seed)
+{
+}
+
+float SimplexNoise::sample(float x, float z) const
+{
+    return simplex<ScalarOps>(x, z, _seed);
+}
+
+void SimplexNoise::sampleGrid(float x, float z, float step, std::size_t width,
+                              std::size_t depth, float *out) const
+{
+    for(std::size_t i = 0; i < depth; i++)
+    {
+        sampleRow<VectorOps>(x, z + static_cast<float>(i) * step, step, width,
+                             _seed, out + i * width);
+    }
+}
+
+const char *SimplexNoise::getInstructionSet()
+{
+#ifdef __AVX2__
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace cenisys
@@ -0,0 +1,68 @@
+/*
+ * SimplexNoise
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_SIMPLEXNOISE_H
+#define CENISYS_SIMPLEXNOISE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cenisys
+{
+
+//!
+//! \brief Seeded two-dimensional simplex noise.
+//!
+//! The gradient of a lattice point is picked by an integer hash of its
+//! coordinates and the seed instead of a permutation table, so a row of
+//! samples is evaluated with vector instructions and no gathers.
+//!
+//! sampleGrid() uses AVX2 or SSE2 if the build targets them, and plain code
+//! otherwise. Every path runs the same IEEE single precision operations in
+//! the same order as sample(), and the file is built without contraction
+//! into FMA, so the results are bit-identical on every instruction set.
+//!
+class SimplexNoise
+{
+public:
+    explicit SimplexNoise(std::uint32_t seed);
+
+    //! \return A value in [-1, 1].
+    float sample(float x, float z) const;
+    //!
+    //! \brief Sample a grid, row by row.
+    //! \param out Receives width * depth values, the one at (x + j * step,
+    //! z + i * step) at out[i * width + j].
+    //!
+    void sampleGrid(float x, float z, float step, std::size_t width,
+                    std::size_t depth, float *out) const;
+
+    //!
+    //! \brief Name of the instructions used by sampleGrid().
+    //!
+    static const char *getInstructionSet();
+
+private:
+    std::uint32_t _seed;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_SIMPLEXNOISE_H
@@ -0,0 +1,284 @@
+/*
+ * TerrainGenerator
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/terraingenerator.h"
+#include "world/chunkcolumn.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+
+namespace cenisys
+{
+
+namespace
+{
+
+constexpr BlockId STONE = 1;
+constexpr BlockId GRASS = 2;
+constexpr BlockId DIRT = 3;
+constexpr BlockId BEDROCK = 7;
+constexpr BlockId WATER = 9;
+constexpr BlockId SAND = 12;
+constexpr BlockId GRAVEL = 13;
+constexpr BlockId SANDSTONE = 24;
+constexpr BlockId SNOW_LAYER = 78;
+
+//! Blocks between the top block and the stone.
+constexpr unsigned FILLER_DEPTH = 3;
+constexpr unsigned MIN_HEIGHT = FILLER_DEPTH + 2;
+constexpr unsigned MOUNTAIN_HEIGHT = 96;
+//! Mountains above this are covered with snow.
+constexpr unsigned SNOW_HEIGHT = 130;
+
+std::uint64_t splitMix(std::uint64_t &state)
+{
+    std::uint64_t value = state += 0x9e3779b97f4a7c15u;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9u;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebu;
+    return value ^ (value >> 31);
+}
+
+} // namespace
+
+constexpr unsigned TerrainGenerator::SEA_LEVEL;
+constexpr std::size_t TerrainGenerator::AREA;
+
+TerrainGenerator::TerrainGenerator(std::uint64_t seed)
+    : _continent(makeLayer(seed, 3, 1.0f / 1024)),
+      _detail(makeLayer(seed, 4, 1.0f / 128)),
+      _roughness(makeLayer(seed, 2, 1.0f / 512)),
+      _temperature(makeLayer(seed, 2, 1.0f / 2048)),
+      _humidity(makeLayer(seed, 2, 1.0f / 2048))
+{
+}
+
+void TerrainGenerator::generate(ChunkColumn &column) const
+{
+    std::int32_t x = column.getX() * static_cast<std::int32_t>(
+                                         ChunkSection::SIZE);
+    std::int32_t z = column.getZ() * static_cast<std::int32_t>(
+                                         ChunkSection::SIZE);
+    std::array<float, AREA> continent, detail, roughness, temperature,
+        humidity;
+    sampleArea(_continent, x, z, continent.data());
+    sampleArea(_detail, x, z, detail.data());
+    sampleArea(_roughness, x, z, roughness.data());
+    sampleArea(_temperature, x, z, temperature.data());
+    sampleArea(_humidity, x, z, humidity.data());
+
+    std::array<unsigned, AREA> heights;
+    unsigned lowest = ChunkColumn::HEIGHT;
+    for(std::size_t i = 0; i < AREA; i++)
+    {
+        heights[i] = height(continent[i], detail[i], roughness[i]);
+        lowest = std::min(lowest, heights[i]);
+    }
+    // Sections below every filler block are stone throughout
+    std::size_t solid = (lowest - FILLER_DEPTH) / ChunkSection::SIZE;
+    for(std::size_t y = 0; y < solid; y++)
+        column.getWritableSection(y).fill(STONE);
+
+    for(unsigned dz = 0; dz < ChunkSection::SIZE; dz++)
+    {
+        for(unsigned dx = 0; dx < ChunkSection::SIZE; dx++)
+        {
+            std::size_t i = dz * ChunkSection::SIZE + dx;
+            unsigned top = heights[i];
+            Biome type = biome(top, temperature[i], humidity[i]);
+            BlockId surface = GRASS;
+            BlockId filler = DIRT;
+            switch(type)
+            {
+            case Biome::Ocean:
+                surface = filler = top + 8 < SEA_LEVEL ? GRAVEL : SAND;
+                break;
+            case Biome::Beach:
+                surface = filler = SAND;
+                break;
+            case Biome::Desert:
+                surface = SAND;
+                filler = SANDSTONE;
+                break;
+            case Biome::Mountains:
+                surface = filler = STONE;
+                break;
+            default:
+                break;
+            }
+            column.setBlock(dx, 0, dz, BEDROCK);
+            unsigned y = std::max<unsigned>(1, solid * ChunkSection::SIZE);
+            for(; y + FILLER_DEPTH < top; y++)
+                column.setBlock(dx, y, dz, STONE);
+            for(; y < top; y++)
+                column.setBlock(dx, y, dz, filler);
+            column.setBlock(dx, top, dz, surface);
+            for(y = top + 1; y <= SEA_LEVEL; y++)
+                column.setBlock(dx, y, dz, WATER);
+            if(type == Biome::Snow ||
+               (type == Biome::Mountains && top >= SNOW_HEIGHT))
+                column.setBlock(dx, top + 1, dz, SNOW_LAYER);
+        }
+    }
+}
+
+unsigned TerrainGenerator::getHeight(std::int32_t x, std::int32_t z) const
+{
+    return height(sample(_continent, x, z), sample(_detail, x, z),
+                  sample(_roughness, x, z));
+}
+
+TerrainGenerator::Biome TerrainGenerator::getBiome(std::int32_t x,
+                                                   std::int32_t z) const
+{
+    return biome(getHeight(x, z), sample(_temperature, x, z),
+                 sample(_humidity, x, z));
+}
+
+const char *TerrainGenerator::getBiomeName(Biome biome)
+{
+    switch(biome)
+    {
+    case Biome::Ocean:
+        return "ocean";
+    case Biome::Beach:
+        return "beach";
+    case Biome::Plains:
+        return "plains";
+    case Biome::Forest:
+        return "forest";
+    case Biome::Desert:
+        return "desert";
+    case Biome::Snow:
+        return "snow";
+    case Biome::Mountains:
+        return "mountains";
+    }
+    return "";
+}
+
+std::uint64_t TerrainGenerator::parseSeed(const std::string &text)
+{
+    if(!text.empty())
+    {
+        char *end;
+        errno = 0;
+        long long value = std::strtoll(text.c_str(), &end, 10);
+        if(*end == '\0' && errno == 0)
+            return static_cast<std::uint64_t>(value);
+    }
+    // FNV-1a
+    std::uint64_t hash = 0xcbf29ce484222325u;
+    for(char c : text)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3u;
+    }
+    return hash;
+}
+
+TerrainGenerator::Layer TerrainGenerator::makeLayer(std::uint64_t &seed,
+                                                    std::size_t octaves,
+                                                    float frequency)
+{
+    Layer layer;
+    for(std::size_t i = 0; i < octaves; i++)
+    {
+        layer.octaves.emplace_back(
+            static_cast<std::uint32_t>(splitMix(seed) >> 32));
+    }
+    layer.frequency = frequency;
+    return layer;
+}
+
+float TerrainGenerator::sample(const Layer &layer, std::int32_t x,
+                               std::int32_t z)
+{
+    float sum = 0.0f;
+    float weight = 1.0f;
+    float total = 0.0f;
+    float frequency = layer.frequency;
+    for(const SimplexNoise &octave : layer.octaves)
+    {
+        sum += octave.sample(static_cast<float>(x) * frequency,
+                             static_cast<float>(z) * frequency) *
+               weight;
+        total += weight;
+        weight *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return sum / total;
+}
+
+void TerrainGenerator::sampleArea(const Layer &layer, std::int32_t x,
+                                  std::int32_t z, float *out)
+{
+    std::array<float, AREA> octave;
+    std::fill(out, out + AREA, 0.0f);
+    float weight = 1.0f;
+    float total = 0.0f;
+    float frequency = layer.frequency;
+    for(const SimplexNoise &noise : layer.octaves)
+    {
+        noise.sampleGrid(static_cast<float>(x) * frequency,
+                         static_cast<float>(z) * frequency, frequency,
+                         ChunkSection::SIZE, ChunkSection::SIZE,
+                         octave.data());
+        for(std::size_t i = 0; i < AREA; i++)
+            out[i] += octave[i] * weight;
+        total += weight;
+        weight *= 0.5f;
+        frequency *= 2.0f;
+    }
+    for(std::size_t i = 0; i < AREA; i++)
+        out[i] /= total;
+}
+
+unsigned TerrainGenerator::height(float continent, float detail,
+                                  float roughness)
+{
+    float rough = (roughness + 1.0f) * 0.5f;
+    float value = 68.0f + continent * 48.0f +
+                  detail * (4.0f + 60.0f * rough * rough);
+    value = std::min(std::max(value, static_cast<float>(MIN_HEIGHT)),
+                     static_cast<float>(ChunkColumn::HEIGHT - 2));
+    return static_cast<unsigned>(value);
+}
+
+TerrainGenerator::Biome TerrainGenerator::biome(unsigned height,
+                                                float temperature,
+                                                float humidity)
+{
+    if(height < SEA_LEVEL)
+        return Biome::Ocean;
+    if(height >= MOUNTAIN_HEIGHT)
+        return Biome::Mountains;
+    if(temperature < -0.25f)
+        return Biome::Snow;
+    if(height <= SEA_LEVEL + 2)
+        return Biome::Beach;
+    if(temperature > 0.2f && humidity < 0.0f)
+        return Biome::Desert;
+    if(humidity > 0.1f)
+        return Biome::Forest;
+    return Biome::Plains;
+}
+
+} // namespace cenisys
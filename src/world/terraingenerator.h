@@ -0,0 +1,110 @@
+/*
+ * TerrainGenerator
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_TERRAINGENERATOR_H
+#define CENISYS_TERRAINGENERATOR_H
+
+#include "world/simplexnoise.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cenisys
+{
+
+class ChunkColumn;
+
+//!
+//! \brief Fills columns with terrain, the same for the same seed.
+//!
+//! The height of every block column comes from three noise layers: the
+//! continents, the local detail and how rough the detail is. The biome is
+//! picked from the height, the temperature and the humidity, so it never
+//! causes steps in the terrain. Each layer is sampled for a whole column
+//! at once with SimplexNoise::sampleGrid().
+//!
+//! Generation only reads the generator, so one is shared by every thread.
+//!
+class TerrainGenerator
+{
+public:
+    enum class Biome : std::uint8_t
+    {
+        Ocean,
+        Beach,
+        Plains,
+        Forest,
+        Desert,
+        Snow,
+        Mountains,
+    };
+
+    //! Water fills everything up to this height.
+    static constexpr unsigned SEA_LEVEL = 62;
+
+    explicit TerrainGenerator(std::uint64_t seed);
+
+    //!
+    //! \brief Fill an empty column.
+    //!
+    void generate(ChunkColumn &column) const;
+
+    //!
+    //! \brief Height of the top block of a block column.
+    //!
+    unsigned getHeight(std::int32_t x, std::int32_t z) const;
+    Biome getBiome(std::int32_t x, std::int32_t z) const;
+    static const char *getBiomeName(Biome biome);
+
+    //!
+    //! \brief A seed from a number, or the hash of any other text.
+    //!
+    static std::uint64_t parseSeed(const std::string &text);
+
+private:
+    //! Octaves of noise, each at twice the frequency and half the weight.
+    struct Layer
+    {
+        std::vector<SimplexNoise> octaves;
+        float frequency;
+    };
+    static constexpr std::size_t AREA = 256;
+
+    static Layer makeLayer(std::uint64_t &seed, std::size_t octaves,
+                           float frequency);
+    //! \return A value in [-1, 1].
+    static float sample(const Layer &layer, std::int32_t x, std::int32_t z);
+    //! Sample the 16x16 block columns starting at (x, z).
+    static void sampleArea(const Layer &layer, std::int32_t x,
+                           std::int32_t z, float *out);
+    static unsigned height(float continent, float detail, float roughness);
+    static Biome biome(unsigned height, float temperature, float humidity);
+
+    Layer _continent;
+    Layer _detail;
+    Layer _roughness;
+    Layer _temperature;
+    Layer _humidity;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_TERRAINGENERATOR_H
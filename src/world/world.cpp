@@ -0,0 +1,599 @@
+/*
+ * World
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/world.h"
+#include "command/commandsender.h"
+#include "config/configsection.h"
+#include "world/chunkcolumn.h"
+#include "world/lightengine.h"
+#include "world/terraingenerator.h"
+#include <boost/locale/format.hpp>
+#include <boost/locale/message.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace cenisys
+{
+
+constexpr double World::MAX_COORDINATE;
+constexpr std::size_t World::MAX_BLOCK_UPDATES;
+constexpr unsigned World::EVICTION_INTERVAL;
+constexpr double World::REACH;
+constexpr unsigned World::DEFAULT_AUTOSAVE;
+
+World::World(Server &server)
+    : _server(server), _storage(server.getIoService()), _open(false),
+      _columns(_storage, 0), _viewDistance(0), _viewersMoved(false),
+      _columnsUnsent(false), _ticksToEviction(EVICTION_INTERVAL),
+      _evictionRate(0),
+      _lighting([this](std::int32_t x, std::int32_t z) {
+          return _columns.get(x, z);
+      }),
+      _regions(server.getIoService()),
+      _blockTicks(
+          [this](std::int32_t x, std::int32_t z) { return _columns.get(x, z); },
+          [this](std::int32_t x, unsigned y, std::int32_t z, BlockId block) {
+              setBlock(x, y, z, block);
+          }),
+      _entities(server.getIoService()), _lightStats{0, 0, 0},
+      _saveRequested(false), _snapshotTime(0), _autosaveInterval(0),
+      _ticksToAutosave(0)
+{
+    _server.registerStartupTask("world", {}, [this] { start(); });
+    // After the last packets were handed to the world
+    _server.registerShutdownTask("world", {"network"}, [this] { stop(); });
+    _regions.setHandlers(
+        [this](std::int32_t x, unsigned y, std::int32_t z, BlockId previous) {
+            blockChanged(x, y, z, previous);
+        },
+        [this](std::int32_t x, unsigned y, std::int32_t z, BlockId block) {
+            setBlock(x, y, z, block);
+        });
+    _regions.setTicker(
+        [this](ChunkColumn &column, RegionTicker::Region &region) {
+            _blockTicks.tickColumn(column, region);
+            if(_columnTicker)
+                _columnTicker(column, region);
+        });
+}
+
+World::~World()
+{
+    _server.unregisterStartupTask("world");
+    _server.unregisterShutdownTask("world");
+}
+
+const ChunkColumn *World::getColumn(std::int32_t x, std::int32_t z) const
+{
+    return _columns.get(x, z);
+}
+
+BlockId World::getBlock(std::int32_t x, unsigned y, std::int32_t z) const
+{
+    const ChunkColumn *column = getColumn(x >> 4, z >> 4);
+    if(!column || y >= ChunkColumn::HEIGHT)
+        return ChunkSection::AIR;
+    return column->getBlock(x & 15, y, z & 15);
+}
+
+bool World::setBlock(std::int32_t x, unsigned y, std::int32_t z,
+                     BlockId block)
+{
+    ChunkColumn *column = _columns.get(x >> 4, z >> 4);
+    if(!column || y >= ChunkColumn::HEIGHT)
+        return false;
+    BlockId previous = column->getBlock(x & 15, y, z & 15);
+    if(previous == block)
+        return true;
+    column->setBlock(x & 15, y, z & 15, block);
+    blockChanged(x, y, z, previous);
+    return true;
+}
+
+void World::blockChanged(std::int32_t x, unsigned y, std::int32_t z,
+                         BlockId previous)
+{
+    _columns.markUsed(x >> 4, z >> 4);
+    _lighting.blockChanged(x, y, z, previous);
+    _blockTicks.blockChanged(x, y, z);
+    _changedBlocks[{x >> 4, z >> 4}].push_back(
+        static_cast<std::uint16_t>((y << 8) | ((z & 15) << 4) | (x & 15)));
+}
+
+void World::setViewer(std::uint64_t id, double x, double y, double z)
+{
+    // Also rejects NaN
+    if(!(std::abs(x) < MAX_COORDINATE && std::abs(z) < MAX_COORDINATE))
+        return;
+    Key key(static_cast<std::int32_t>(std::floor(x)) >> 4,
+            static_cast<std::int32_t>(std::floor(z)) >> 4);
+    auto result = _viewers.insert({id, {x, y, z, key, {}}});
+    Viewer &viewer = result.first->second;
+    viewer.x = x;
+    viewer.y = y;
+    viewer.z = z;
+    if(result.second || viewer.column != key)
+    {
+        viewer.column = key;
+        _viewersMoved = true;
+        _columnsUnsent = true;
+    }
+}
+
+void World::removeViewer(std::uint64_t id)
+{
+    if(_viewers.erase(id))
+        _viewersMoved = true;
+}
+
+bool World::inReach(std::uint64_t id, std::int32_t x, unsigned y,
+                    std::int32_t z) const
+{
+    auto it = _viewers.find(id);
+    if(it == _viewers.end())
+        return false;
+    const Viewer &viewer = it->second;
+    // From the middle of the block; false for a viewer at NaN height
+    double dx = x + 0.5 - viewer.x;
+    double dy = y + 0.5 - viewer.y;
+    double dz = z + 0.5 - viewer.z;
+    return dx * dx + dy * dy + dz * dz <= REACH * REACH;
+}
+
+void World::setSenders(ColumnSender &&columns, BlockSender &&blocks)
+{
+    _columnSender = std::move(columns);
+    _blockSender = std::move(blocks);
+    _columnsUnsent = true;
+}
+
+void World::setUnloadHandler(UnloadHandler &&handler)
+{
+    _unloadHandler = std::move(handler);
+}
+
+void World::setLoadHandler(LoadHandler &&handler)
+{
+    _loadHandler = std::move(handler);
+}
+
+void World::setSerializer(ChunkPipeline::Serializer &&serializer)
+{
+    _pipeline->setSerializer(std::move(serializer));
+}
+
+void World::setColumnTicker(RegionTicker::ColumnTicker &&ticker)
+{
+    _columnTicker = std::move(ticker);
+}
+
+bool World::inView(const Key &viewer, const Key &column) const
+{
+    std::int64_t dx = column.first - viewer.first;
+    std::int64_t dz = column.second - viewer.second;
+    return dx * dx + dz * dz <= std::int64_t(_viewDistance) * _viewDistance;
+}
+
+void World::start()
+{
+    std::shared_ptr<ConfigSection> config = _server.getConfig("cenisys");
+    ConfigSection::Path path = ConfigSection::Path() / "world";
+    boost::filesystem::path directory =
+        _server.getDataDir() / "worlds" /
+        config->getString(path / "name", "world");
+    if(!_storage.open(directory, config->getUInt(path / "max-io", 4)))
+    {
+        throw std::runtime_error("Cannot create world directory " +
+                                 directory.string());
+    }
+    _viewDistance = static_cast<std::int32_t>(
+        config->getUInt(path / "view-distance", 4));
+    _columns.setBudget(
+        static_cast<std::size_t>(config->getUInt(path / "memory-budget", 512))
+        << 20);
+    _lastEviction = std::chrono::steady_clock::now();
+    _regions.setThreads(config->getUInt(
+        path / "tick-threads",
+        static_cast<unsigned>(_server.getThreadCount())));
+    _entities.setThreads(_regions.getThreads());
+    _blockTicks.setRandomTicks(config->getUInt(
+        path / "random-ticks", BlockTicker::DEFAULT_RANDOM_TICKS));
+    _autosaveInterval = static_cast<unsigned>(
+        std::chrono::seconds(
+            config->getUInt(path / "autosave", DEFAULT_AUTOSAVE)) /
+        Server::TICK_INTERVAL);
+    _ticksToAutosave = _autosaveInterval;
+    if(!_pipeline)
+    {
+        _pipeline = std::make_unique<ChunkPipeline>(
+            _server.getIoService(), _storage,
+            config->getUInt(path / "chunk-jobs",
+                            static_cast<unsigned>(_server.getThreadCount())));
+        // Without a seed, every world of the same name looks the same
+        _generator = std::make_unique<TerrainGenerator>(
+            TerrainGenerator::parseSeed(config->getString(
+                path / "seed", directory.filename().string())));
+        _pipeline->setGenerator(
+            [this](ChunkColumn &column) { _generator->generate(column); });
+        _pipeline->setLighter(LightEngine::lightColumn);
+    }
+    _open = true;
+    _tickHandler = _server.registerTickHandler([this] { tick(); });
+    _statsCommand = _server.registerCommand(
+        "chunks",
+        boost::locale::translate("Show the loaded columns and chunk "
+                                 "pipeline statistics"),
+        [this](CommandSender &sender, const std::string &command) {
+            showStats(sender);
+        });
+    _saveCommand = _server.registerCommand(
+        "save-all",
+        boost::locale::translate("Save the changed columns in the "
+                                 "background"),
+        [this](CommandSender &sender, const std::string &command) {
+            saveAll(sender);
+        });
+    _server.log(Server::LogLevel::Info,
+                boost::locale::format(
+                    boost::locale::translate("Opened world {1}")) %
+                    directory);
+}
+
+void World::stop()
+{
+    if(!_open)
+        return;
+    _open = false;
+    _server.unregisterCommand(_statsCommand);
+    _server.unregisterCommand(_saveCommand);
+    _server.unregisterTickHandler(_tickHandler);
+    // The running requests see the cancellation before their next stage
+    _pipeline->cancelAll();
+    _requested.clear();
+    // The columns the running save and the write-backs fail to write go
+    // into the last one
+    _storage.flush();
+    takeBackFailed();
+    checkSave();
+    save();
+    _storage.close();
+    checkSave();
+}
+
+void World::tick()
+{
+    if(_viewersMoved)
+    {
+        _viewersMoved = false;
+        updateRequests();
+    }
+    _pipeline->tick([this](ChunkPipeline::Result &&result) {
+        Key key(result.column->getX(), result.column->getZ());
+        _requested.erase(key);
+        if(_loadHandler && !result.data.empty())
+            _loadHandler(*result.column, std::move(result.data));
+        _regions.insert(*result.column);
+        _columns.insert(std::move(result.column));
+        auto references = _references.find(key);
+        if(references != _references.end())
+            _columns.setReferences(key.first, key.second, references->second);
+        _lighting.columnLoaded(key.first, key.second);
+        _columnsUnsent = true;
+    });
+    // Changes and messages of the regions come in before the light
+    _blockTicks.nextTick();
+    _regions.tick();
+    _entities.tick();
+    // Everything changed during the tick, in one pass
+    LightEngine::Stats stats = _lighting.update();
+    _lightStats.changes += stats.changes;
+    _lightStats.decreased += stats.decreased;
+    _lightStats.increased += stats.increased;
+    sendChanges();
+    if(_columnsUnsent && _columnSender)
+    {
+        _columnsUnsent = false;
+        sendColumns();
+    }
+    if(--_ticksToEviction == 0)
+    {
+        _ticksToEviction = EVICTION_INTERVAL;
+        evictColumns();
+    }
+    checkSave();
+    bool saveRequested = _saveRequested.exchange(false);
+    if(_autosaveInterval && --_ticksToAutosave == 0)
+    {
+        _ticksToAutosave = _autosaveInterval;
+        saveRequested = true;
+    }
+    if(saveRequested)
+        save();
+}
+
+void World::updateRequests()
+{
+    // Squared distance to the nearest viewer of every visible column
+    std::map<Key, std::uint64_t> visible;
+    std::map<Key, std::size_t> references;
+    std::int32_t range = _viewDistance;
+    for(const auto &item : _viewers)
+    {
+        const Key &center = item.second.column;
+        for(std::int32_t dz = -range; dz <= range; dz++)
+        {
+            for(std::int32_t dx = -range; dx <= range; dx++)
+            {
+                if(dx * dx + dz * dz > range * range)
+                    continue;
+                auto distance = static_cast<std::uint64_t>(dx * dx + dz * dz);
+                Key key(center.first + dx, center.second + dz);
+                auto result = visible.insert({key, distance});
+                if(result.first->second > distance)
+                    result.first->second = distance;
+                references[key]++;
+            }
+        }
+    }
+    for(const auto &item : _references)
+    {
+        if(!references.count(item.first))
+            _columns.setReferences(item.first.first, item.first.second, 0);
+    }
+    for(const auto &item : references)
+        _columns.setReferences(item.first.first, item.first.second,
+                               item.second);
+    _references = std::move(references);
+    for(auto it = _requested.begin(); it != _requested.end();)
+    {
+        if(visible.count(*it))
+        {
+            ++it;
+            continue;
+        }
+        _pipeline->cancel(it->first, it->second);
+        it = _requested.erase(it);
+    }
+    for(const auto &item : visible)
+    {
+        if(_columns.contains(item.first.first, item.first.second))
+            continue;
+        _pipeline->request(item.first.first, item.first.second, item.second);
+        _requested.insert(item.first);
+    }
+}
+
+void World::sendChanges()
+{
+    if(!_blockSender)
+    {
+        _changedBlocks.clear();
+        return;
+    }
+    std::vector<std::uint64_t> viewers;
+    for(auto &item : _changedBlocks)
+    {
+        viewers.clear();
+        for(const auto &viewer : _viewers)
+        {
+            if(viewer.second.sent.count(item.first))
+                viewers.push_back(viewer.first);
+        }
+        if(viewers.empty())
+            continue;
+        ChunkColumn &column =
+            *_columns.get(item.first.first, item.first.second);
+        std::vector<std::uint16_t> &blocks = item.second;
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+        if(blocks.size() > MAX_BLOCK_UPDATES)
+            _columnSender(column, viewers);
+        else
+            _blockSender(column, blocks, viewers);
+    }
+    _changedBlocks.clear();
+}
+
+void World::sendColumns()
+{
+    // Viewers of every column to send, so it is only looked up once
+    std::map<Key, std::vector<std::uint64_t>> pending;
+    std::int32_t range = _viewDistance;
+    for(auto &item : _viewers)
+    {
+        Viewer &viewer = item.second;
+        for(auto it = viewer.sent.begin(); it != viewer.sent.end();)
+        {
+            if(inView(viewer.column, *it))
+                ++it;
+            else
+                it = viewer.sent.erase(it);
+        }
+        for(std::int32_t dz = -range; dz <= range; dz++)
+        {
+            for(std::int32_t dx = -range; dx <= range; dx++)
+            {
+                Key key(viewer.column.first + dx, viewer.column.second + dz);
+                if(!inView(viewer.column, key) ||
+                   !_columns.contains(key.first, key.second) ||
+                   !viewer.sent.insert(key).second)
+                    continue;
+                pending[key].push_back(item.first);
+            }
+        }
+    }
+    for(const auto &item : pending)
+    {
+        _columnSender(*_columns.get(item.first.first, item.first.second),
+                      item.second);
+    }
+}
+
+void World::evictColumns()
+{
+    takeBackFailed();
+    _columns.updateMemory();
+    std::size_t evicted = _columns.evict([this](const ChunkColumn &column) {
+        Key key(column.getX(), column.getZ());
+        _lighting.columnUnloaded(key.first, key.second);
+        _regions.remove(key.first, key.second);
+        for(auto &item : _viewers)
+            item.second.sent.erase(key);
+        if(_unloadHandler)
+            _unloadHandler(key.first, key.second);
+    });
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    double seconds =
+        std::chrono::duration<double>(now - _lastEviction).count();
+    _lastEviction = now;
+    if(seconds > 0)
+        _evictionRate = _evictionRate * 0.5 + evicted / seconds * 0.5;
+}
+
+void World::takeBackFailed()
+{
+    _columns.takeBackFailed([this](ChunkColumn &column) {
+        Key key(column.getX(), column.getZ());
+        _regions.insert(column);
+        auto references = _references.find(key);
+        if(references != _references.end())
+            _columns.setReferences(key.first, key.second, references->second);
+        _lighting.columnLoaded(key.first, key.second);
+        _columnsUnsent = true;
+    });
+}
+
+bool World::save()
+{
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    if(!_columns.save())
+        return false;
+    _saveStart = begin;
+    _snapshotTime = std::chrono::steady_clock::now() - begin;
+    return true;
+}
+
+void World::checkSave()
+{
+    if(!_columns.finishSave())
+        return;
+    ChunkCache::SaveStats stats = _columns.getSaveStats();
+    if(!stats.total)
+        return;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    _server.log(
+        stats.failed ? Server::LogLevel::Warning : Server::LogLevel::Info,
+        boost::locale::format(boost::locale::translate(
+            "Saved {1} columns in {2,num=fixed,p=1} ms, {3} failed; the "
+            "snapshots took {4,num=fixed,p=2} ms")) %
+            stats.written %
+            Milliseconds(std::chrono::steady_clock::now() - _saveStart)
+                .count() %
+            stats.failed % Milliseconds(_snapshotTime).count());
+}
+
+void World::saveAll(CommandSender &sender)
+{
+    if(_columns.isSaving())
+    {
+        ChunkCache::SaveStats stats = _columns.getSaveStats();
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "Already saving: {1} of {2} columns written, {3} failed")) %
+            stats.written % stats.total % stats.failed);
+        return;
+    }
+    _saveRequested = true;
+    sender.sendMessage(boost::locale::translate(
+        "Saving the changed columns from the next tick"));
+}
+
+void World::showStats(CommandSender &sender)
+{
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Columns: {1} loaded, {2} queued, {3} running, {4} viewers")) %
+        _columns.size() % _pipeline->getQueued() % _pipeline->getRunning() %
+        _viewers.size());
+    ChunkCache::Stats cache = _columns.getStats();
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Memory: {1,num=fixed,p=1} of {2,num=fixed,p=1} MiB, {3} "
+            "columns seen; {4} evicted, {5,num=fixed,p=1} per second")) %
+        (cache.bytes / 1048576.0) % (_columns.getBudget() / 1048576.0) %
+        cache.referenced % cache.evicted % _evictionRate);
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Written back: {1} columns, {2} pending, {3} failed")) %
+        cache.writtenBack % cache.writing % cache.failed);
+    RegionTicker::Stats regions = _regions.getStats();
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Regions: {1} of {2} columns, {3} threads in {4,num=fixed,p=2} "
+            "ms; {5} of {6} ticks parallel, {7} changes, {8} messages")) %
+        regions.regions % regions.columns % regions.threads %
+        std::chrono::duration<double, std::milli>(regions.lastTick).count() %
+        regions.parallelTicks % regions.ticks % regions.changes %
+        regions.messages);
+    BlockTicker::Stats blocks = _blockTicks.getStats();
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Block ticks: {1} random in {2} sections, {3} sections skipped; "
+            "{4} scheduled, {5} duplicates, {6} run")) %
+        blocks.randomTicks % blocks.sectionsTicked % blocks.sectionsSkipped %
+        blocks.scheduled % blocks.duplicates % blocks.scheduledRun);
+    EntityManager::Stats entities = _entities.getStats();
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Entities: {1} in {2} archetypes, {3} spawned, {4} despawned; "
+            "{5} threads in {6,num=fixed,p=2} ms")) %
+        entities.entities % entities.archetypes % entities.spawned %
+        entities.despawned % entities.threads %
+        std::chrono::duration<double, std::milli>(entities.lastTick).count());
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Light: {1} block changes, {2} blocks darkened, {3} lit")) %
+        _lightStats.changes % _lightStats.decreased % _lightStats.increased);
+    const ChunkPipeline::Stats &stats = _pipeline->getStats();
+    sender.sendMessage(
+        boost::locale::format(boost::locale::translate(
+            "Requests: {1} completed, {2} generated, {3} cancelled")) %
+        stats.completed % stats.generated % stats.cancelled);
+    for(std::size_t i = 0; i < ChunkPipeline::STAGES; i++)
+    {
+        const ChunkPipeline::StageStats &stage = stats.stages[i];
+        if(!stage.count)
+            continue;
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        sender.sendMessage(
+            boost::locale::format(boost::locale::translate(
+                "{1}: {2} times, {3,num=fixed,p=2} ms mean, "
+                "{4,num=fixed,p=2} ms max")) %
+            ChunkPipeline::getStageName(static_cast<ChunkPipeline::Stage>(i)) %
+            stage.count % (Milliseconds(stage.total).count() / stage.count) %
+            Milliseconds(stage.max).count());
+    }
+}
+
+} // namespace cenisys
@@ -0,0 +1,282 @@
+/*
+ * World
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_WORLD_H
+#define CENISYS_WORLD_H
+
+#include "entity/entitymanager.h"
+#include "server/server.h"
+#include "world/blockticker.h"
+#include "world/chunkcache.h"
+#include "world/chunkpipeline.h"
+#include "world/lightengine.h"
+#include "world/regionticker.h"
+#include "world/worldstorage.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cenisys
+{
+
+class ChunkColumn;
+class CommandSender;
+class TerrainGenerator;
+
+//!
+//! \brief The loaded columns of the world, and who is looking at them.
+//!
+//! The world is opened and closed by the startup and shutdown tasks named
+//! "world", in the directory worlds/<name> under the data directory. The
+//! network is started after it and stopped before it, so no packet reaches
+//! the world while it is closed.
+//!
+//! Every viewer, such as a player, sees the columns within the view
+//! distance around it. Those not loaded yet are requested from the chunk
+//! pipeline, the nearest to a viewer first, and requests no viewer can see
+//! anymore are cancelled.
+//!
+//! The columns are kept in a ChunkCache within the memory budget set by
+//! world/memory-budget, in MiB. Columns no viewer sees are evicted once a
+//! second if it is exceeded, and written back if they changed.
+//!
+//! Changed columns are saved every world/autosave seconds, by the command
+//! save-all and when the world is closed. The columns are snapshotted
+//! between two ticks, which only copies pointers to their sections, and the
+//! snapshots are written by the storage workers while the game goes on.
+//! Columns which could not be written are saved again the next time.
+//!
+//! Every tick, the loaded columns are ticked by the RegionTicker on up to
+//! world/tick-threads threads, by default as many as the server has. They
+//! run their scheduled block updates and world/random-ticks random block
+//! ticks per section through the BlockTicker. Then the EntityManager moves
+//! the entities on as many threads.
+//!
+//! The light of the blocks changed during a tick is updated at its end.
+//! Then the viewers which were sent a column get the blocks changed in it,
+//! or the whole column again if too many changed, and the loaded columns
+//! they see but were not sent yet.
+//!
+//! Everything but the storage belongs to the game tick, and to the commands,
+//! which run between two ticks.
+//!
+class World
+{
+public:
+    //! Viewers further out are ignored.
+    static constexpr double MAX_COORDINATE = 3.0e7;
+    //! Columns with more blocks changed in a tick are sent again whole.
+    static constexpr std::size_t MAX_BLOCK_UPDATES = 64;
+    //! Ticks between two checks of the memory budget.
+    static constexpr unsigned EVICTION_INTERVAL = 20;
+    //! Distance in blocks up to which a viewer reaches blocks.
+    static constexpr double REACH = 8;
+
+    //! Sends a column to viewers.
+    using ColumnSender = std::function<void(
+        ChunkColumn &column, const std::vector<std::uint64_t> &viewers)>;
+    //!
+    //! \brief Sends changed blocks of a column to viewers.
+    //!
+    //! The blocks are sorted (y << 8) | (z << 4) | x indices in the column.
+    //!
+    using BlockSender = std::function<void(
+        const ChunkColumn &column, const std::vector<std::uint16_t> &blocks,
+        const std::vector<std::uint64_t> &viewers)>;
+    //! Seconds between two autosaves, unless set by world/autosave.
+    static constexpr unsigned DEFAULT_AUTOSAVE = 300;
+
+    //! Called before a column is unloaded.
+    using UnloadHandler = std::function<void(std::int32_t x, std::int32_t z)>;
+    //!
+    //! \brief Called with a column the pipeline loaded, and what the
+    //! serializer made of it.
+    //!
+    using LoadHandler = std::function<void(ChunkColumn &column,
+                                           std::vector<std::uint8_t> &&data)>;
+
+    explicit World(Server &server);
+    ~World();
+
+    //!
+    //! \brief The storage, which outlives the world being open.
+    //!
+    WorldStorage &getStorage() { return _storage; }
+
+    //! \return nullptr if the column is not loaded.
+    const ChunkColumn *getColumn(std::int32_t x, std::int32_t z) const;
+    std::size_t getColumnCount() const { return _columns.size(); }
+    const ChunkCache &getChunkCache() const { return _columns; }
+
+    //! \return Air if the column is not loaded.
+    BlockId getBlock(std::int32_t x, unsigned y, std::int32_t z) const;
+    //!
+    //! \brief Change a block. The light follows at the end of the tick.
+    //! \return false if the column is not loaded.
+    //!
+    bool setBlock(std::int32_t x, unsigned y, std::int32_t z, BlockId block);
+
+    //!
+    //! \brief Add or move a viewer.
+    //! \param x, y, z Position in blocks.
+    //!
+    void setViewer(std::uint64_t id, double x, double y, double z);
+    void removeViewer(std::uint64_t id);
+    //!
+    //! \brief Whether a block is within the reach of a viewer.
+    //! \return false if there is no such viewer.
+    //!
+    bool inReach(std::uint64_t id, std::int32_t x, unsigned y,
+                 std::int32_t z) const;
+
+    //!
+    //! \brief Set how the viewers are sent what they see, or stop sending.
+    //!
+    void setSenders(ColumnSender &&columns, BlockSender &&blocks);
+    void setUnloadHandler(UnloadHandler &&handler);
+    void setLoadHandler(LoadHandler &&handler);
+    //!
+    //! \brief Have the chunk pipeline serialize the columns it loads.
+    //!
+    //! Must be called while the world is open and no column is requested,
+    //! such as before the network opens.
+    //!
+    void setSerializer(ChunkPipeline::Serializer &&serializer);
+    //!
+    //! \brief Set what is done to every loaded column on every tick, after
+    //! its block updates.
+    //!
+    void setColumnTicker(RegionTicker::ColumnTicker &&ticker);
+
+    EntityManager &getEntities() { return _entities; }
+
+private:
+    using Key = std::pair<std::int32_t, std::int32_t>;
+
+    struct Viewer
+    {
+        //! Position in blocks.
+        double x, y, z;
+        //! Column the viewer is in.
+        Key column;
+        //! Columns sent to the viewer which are still in view.
+        std::set<Key> sent;
+    };
+
+    bool inView(const Key &viewer, const Key &column) const;
+    //!
+    //! \brief Update the light and tell the viewers about a changed block.
+    //!
+    void blockChanged(std::int32_t x, unsigned y, std::int32_t z,
+                      BlockId previous);
+    void start();
+    void stop();
+    void tick();
+    void updateRequests();
+    void sendChanges();
+    void sendColumns();
+    void evictColumns();
+    //!
+    //! \brief Load the evicted columns which could not be written again.
+    //!
+    void takeBackFailed();
+    //!
+    //! \brief Start writing the changed columns, unless a save is running.
+    //! \return false if a save is already running.
+    //!
+    bool save();
+    //!
+    //! \brief Report a save once it completed, and have the columns it
+    //! could not write saved again.
+    //!
+    void checkSave();
+    //!
+    //! \brief Have the next tick save, and report the running save.
+    //!
+    //! Only touches atomics, as the columns belong to the tick.
+    //!
+    void saveAll(CommandSender &sender);
+    //!
+    //! \brief Show the statistics of the columns and of what ticks them.
+    //!
+    //! The command runs between two ticks, so it reads them directly even
+    //! though they belong to the tick.
+    //!
+    void showStats(CommandSender &sender);
+
+    Server &_server;
+    WorldStorage _storage;
+    //! Kept until the workers are joined, like the storage.
+    std::unique_ptr<ChunkPipeline> _pipeline;
+    std::unique_ptr<TerrainGenerator> _generator;
+    bool _open;
+
+    ChunkCache _columns;
+    std::map<std::uint64_t, Viewer> _viewers;
+    //! Number of viewers seeing every column in view, loaded or not.
+    std::map<Key, std::size_t> _references;
+    std::int32_t _viewDistance;
+    bool _viewersMoved;
+    //! Viewers moved or columns arrived since columns were last sent.
+    bool _columnsUnsent;
+    //! Blocks changed during the tick, per column.
+    std::map<Key, std::vector<std::uint16_t>> _changedBlocks;
+    ColumnSender _columnSender;
+    BlockSender _blockSender;
+    UnloadHandler _unloadHandler;
+    LoadHandler _loadHandler;
+    unsigned _ticksToEviction;
+    std::chrono::steady_clock::time_point _lastEviction;
+    //! Evictions per second, smoothed over the last checks.
+    double _evictionRate;
+    //! Columns requested from the pipeline.
+    std::set<Key> _requested;
+    LightEngine _lighting;
+    RegionTicker _regions;
+    BlockTicker _blockTicks;
+    EntityManager _entities;
+    RegionTicker::ColumnTicker _columnTicker;
+    LightEngine::Stats _lightStats;
+    //! Set by save-all, for the next tick.
+    std::atomic<bool> _saveRequested;
+    std::chrono::steady_clock::time_point _saveStart;
+    //! Time the tick spent taking the snapshots.
+    std::chrono::steady_clock::duration _snapshotTime;
+    //! In ticks, or 0 for no autosave.
+    unsigned _autosaveInterval;
+    unsigned _ticksToAutosave;
+
+    Server::RegisteredTickHandler _tickHandler;
+    Server::RegisteredCommandHandler _statsCommand;
+    Server::RegisteredCommandHandler _saveCommand;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_WORLD_H
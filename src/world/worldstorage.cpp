@@ -0,0 +1,241 @@
+/*
+ * WorldStorage
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/worldstorage.h"
+#include "network/binarystream.h"
+#include "world/chunkcolumn.h"
+#include "world/regionfile.h"
+#include <algorithm>
+#include <boost/filesystem/operations.hpp>
+#include <string>
+#include <vector>
+
+namespace cenisys
+{
+
+constexpr int WorldStorage::COMPRESSION_LEVEL;
+
+WorldStorage::WorldStorage(boost::asio::io_service &ioService)
+    : _ioService(ioService), _open(false), _maxRunning(1), _runners(0),
+      _running(0), _version(0)
+{
+}
+
+WorldStorage::~WorldStorage()
+{
+    close();
+}
+
+bool WorldStorage::open(const boost::filesystem::path &directory,
+                        std::size_t maxRunning)
+{
+    close();
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(directory / "region", ec);
+    if(ec)
+        return false;
+    _regionDir = directory / "region";
+    std::lock_guard<std::mutex> lock(_lock);
+    _maxRunning = std::max<std::size_t>(maxRunning, 1);
+    _open = true;
+    return true;
+}
+
+void WorldStorage::close()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    if(!_open)
+        return;
+    _open = false;
+    finishRequests(lock);
+    lock.unlock();
+
+    std::lock_guard<std::mutex> regionsLock(_regionsLock);
+    _regions.clear();
+}
+
+void WorldStorage::flush()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    finishRequests(lock);
+}
+
+bool WorldStorage::isOpen() const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _open;
+}
+
+void WorldStorage::load(std::int32_t x, std::int32_t z,
+                        LoadHandler &&handler)
+{
+    std::shared_ptr<const ChunkColumn> pending;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        auto it = _pendingSaves.find({x, z});
+        if(it != _pendingSaves.end())
+            pending = it->second.column;
+    }
+    auto job = [this, x, z, pending, handler] {
+        if(pending)
+        {
+            handler(std::make_unique<ChunkColumn>(*pending));
+            return;
+        }
+        RegionFile *region = getRegion(x >> 5, z >> 5, false);
+        std::vector<std::uint8_t> data;
+        if(!region || !region->read(x & 31, z & 31, data))
+        {
+            handler(nullptr);
+            return;
+        }
+        BinaryReader reader(data.data(), data.size());
+        handler(ChunkColumn::read(x, z, reader));
+    };
+    if(!submit(std::move(job)))
+        handler(nullptr);
+}
+
+void WorldStorage::save(std::shared_ptr<const ChunkColumn> column,
+                        SaveHandler &&handler)
+{
+    Key key(column->getX(), column->getZ());
+    std::uint64_t version;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        if(!_open)
+        {
+            handler(false);
+            return;
+        }
+        version = ++_version;
+        _pendingSaves[key] = {version, column};
+    }
+    auto job = [this, key, version, column, handler] {
+        std::vector<std::uint8_t> data(column->getSerializedSize());
+        BinaryWriter writer(data.data(), data.size());
+        column->write(writer);
+        RegionFile *region = getRegion(key.first >> 5, key.second >> 5, true);
+        bool result = region && region->write(key.first & 31, key.second & 31,
+                                              data.data(), data.size(),
+                                              version, COMPRESSION_LEVEL);
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            // Kept if it failed, as the disk holds older blocks
+            auto it = _pendingSaves.find(key);
+            if(result && it != _pendingSaves.end() &&
+               it->second.version == version)
+                _pendingSaves.erase(it);
+        }
+        handler(result);
+    };
+    // Closed in the meantime
+    if(!submit(std::move(job)))
+    {
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _pendingSaves.erase(key);
+        }
+        handler(false);
+    }
+}
+
+std::size_t WorldStorage::getQueued() const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _queue.size();
+}
+
+std::size_t WorldStorage::getRunning() const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _running;
+}
+
+bool WorldStorage::submit(std::function<void()> &&job)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(!_open)
+        return false;
+    _queue.push_back(std::move(job));
+    if(_runners < _maxRunning)
+    {
+        _runners++;
+        _ioService.post([this] { runNext(); });
+    }
+    return true;
+}
+
+void WorldStorage::finishRequests(std::unique_lock<std::mutex> &lock)
+{
+    while(!_queue.empty())
+    {
+        std::function<void()> job = std::move(_queue.front());
+        _queue.pop_front();
+        _running++;
+        lock.unlock();
+        job();
+        lock.lock();
+        _running--;
+    }
+    _idle.wait(lock, [this] { return _running == 0; });
+}
+
+void WorldStorage::runNext()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    if(_queue.empty())
+    {
+        _runners--;
+        return;
+    }
+    std::function<void()> job = std::move(_queue.front());
+    _queue.pop_front();
+    _running++;
+    lock.unlock();
+    job();
+    lock.lock();
+    _running--;
+    _idle.notify_all();
+    lock.unlock();
+    // Post again instead of looping, so other handlers get a turn
+    _ioService.post([this] { runNext(); });
+}
+
+RegionFile *WorldStorage::getRegion(std::int32_t x, std::int32_t z,
+                                    bool create)
+{
+    std::lock_guard<std::mutex> lock(_regionsLock);
+    auto it = _regions.find({x, z});
+    if(it != _regions.end())
+        return it->second.get();
+    boost::filesystem::path path =
+        _regionDir /
+        ("r." + std::to_string(x) + "." + std::to_string(z) + ".region");
+    if(!create && !boost::filesystem::exists(path))
+        return nullptr;
+    auto region = std::make_unique<RegionFile>();
+    if(!region->open(path))
+        return nullptr;
+    return _regions.emplace(Key(x, z), std::move(region))
+        .first->second.get();
+}
+
+} // namespace cenisys
@@ -0,0 +1,154 @@
+/*
+ * WorldStorage
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_WORLDSTORAGE_H
+#define CENISYS_WORLDSTORAGE_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/filesystem/path.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace cenisys
+{
+
+class ChunkColumn;
+class RegionFile;
+
+//!
+//! \brief Loads and saves the chunk columns of a world directory.
+//!
+//! Columns are kept in region files under the region subdirectory, opened
+//! when first needed. Requests run on the threads of the io_service, at
+//! most a fixed number at a time; the rest wait in a queue, so a burst of
+//! saves cannot take every worker from the game.
+//!
+//! A load issued while a save of the same column is pending gets the saved
+//! column, not the one still on disk. So does one after the save failed,
+//! until the column is saved again.
+//!
+//! The object must outlive the io_service, which may still hold runners
+//! posted before close() ran their requests.
+//!
+class WorldStorage
+{
+public:
+    //! Called with nullptr if the column is not stored or cannot be read.
+    using LoadHandler = std::function<void(std::unique_ptr<ChunkColumn>)>;
+    using SaveHandler = std::function<void(bool)>;
+
+    static constexpr int COMPRESSION_LEVEL = 6;
+
+    explicit WorldStorage(boost::asio::io_service &ioService);
+    ~WorldStorage();
+    WorldStorage(const WorldStorage &) = delete;
+    WorldStorage &operator=(const WorldStorage &) = delete;
+
+    //!
+    //! \brief Open a world directory, creating it if needed.
+    //! \param maxRunning Requests run at the same time.
+    //! \return false if the directory could not be created.
+    //!
+    bool open(const boost::filesystem::path &directory,
+              std::size_t maxRunning);
+    //!
+    //! \brief Finish every request and close the region files.
+    //!
+    //! Queued requests are run on the calling thread, since the workers may
+    //! be busy shutting down themselves.
+    //!
+    void close();
+    //!
+    //! \brief Finish every request, and keep the storage open.
+    //!
+    //! Queued requests are run on the calling thread, like by close().
+    //!
+    void flush();
+    bool isOpen() const;
+
+    //!
+    //! \brief Load a column.
+    //! \param handler Called from a worker thread, or right away if the
+    //! storage is closed.
+    //!
+    void load(std::int32_t x, std::int32_t z, LoadHandler &&handler);
+    //!
+    //! \brief Save a column.
+    //!
+    //! The column must not change until the handler is called; callers
+    //! keep editing a copy.
+    //!
+    //! \param handler Called from a worker thread with false if the column
+    //! could not be written, or right away if the storage is closed.
+    //!
+    void save(std::shared_ptr<const ChunkColumn> column,
+              SaveHandler &&handler);
+
+    //! Requests waiting for a worker.
+    std::size_t getQueued() const;
+    //! Requests being run.
+    std::size_t getRunning() const;
+
+private:
+    using Key = std::pair<std::int32_t, std::int32_t>;
+    struct PendingSave
+    {
+        std::uint64_t version;
+        std::shared_ptr<const ChunkColumn> column;
+    };
+
+    //! \return false if the storage is closed.
+    bool submit(std::function<void()> &&job);
+    //!
+    //! \brief Run the queued requests and wait for the running ones.
+    //!
+    void finishRequests(std::unique_lock<std::mutex> &lock);
+    void runNext();
+    //! \return nullptr if the file does not exist and create is false.
+    RegionFile *getRegion(std::int32_t x, std::int32_t z, bool create);
+
+    boost::asio::io_service &_ioService;
+
+    boost::filesystem::path _regionDir;
+    std::map<Key, std::unique_ptr<RegionFile>> _regions;
+    std::mutex _regionsLock;
+
+    bool _open;
+    std::size_t _maxRunning;
+    std::deque<std::function<void()>> _queue;
+    //! Runners posted to the io_service.
+    std::size_t _runners;
+    std::size_t _running;
+    std::uint64_t _version;
+    std::map<Key, PendingSave> _pendingSaves;
+    mutable std::mutex _lock;
+    std::condition_variable _idle;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_WORLDSTORAGE_H
@@ -0,0 +1,144 @@
+/*
+ * Tests for the batch compressor.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/batchcompressor.h"
+#include "network/binarystream.h"
+#include "network/mcpepackets.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+
+cenisys::PacketBuffer makePacket(std::size_t size, std::uint8_t seed)
+{
+    cenisys::PacketBuffer result = cenisys::PacketBuffer::allocate(size);
+    for(std::size_t i = 0; i < size; i++)
+        result.data()[i] = static_cast<std::uint8_t>(seed + i % 7);
+    return result;
+}
+
+//!
+//! \brief Unpack a batch into its packets.
+//!
+std::vector<std::vector<std::uint8_t>>
+unpack(const cenisys::PacketBuffer &batch)
+{
+    cenisys::BinaryReader reader(batch.data(), batch.size());
+    BOOST_REQUIRE_EQUAL(reader.readU8(), cenisys::mcpe::GAME_PACKET);
+    BOOST_REQUIRE_EQUAL(reader.readU8(), cenisys::mcpe::BATCH_PACKET);
+    std::uint32_t size = reader.readVarU32();
+    const std::uint8_t *compressed = reader.readBytes(size);
+    BOOST_REQUIRE(compressed);
+    BOOST_REQUIRE_EQUAL(reader.remaining(), 0u);
+
+    std::vector<std::uint8_t> data(1 << 20);
+    uLongf length = data.size();
+    BOOST_REQUIRE_EQUAL(uncompress(data.data(), &length, compressed, size),
+                        Z_OK);
+    std::vector<std::vector<std::uint8_t>> result;
+    cenisys::BinaryReader packets(data.data(), length);
+    while(packets.remaining() > 0)
+    {
+        std::uint32_t packetSize = packets.readVarU32();
+        const std::uint8_t *packet = packets.readBytes(packetSize);
+        BOOST_REQUIRE(packet);
+        result.emplace_back(packet, packet + packetSize);
+    }
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(batch_compressor)
+
+BOOST_AUTO_TEST_CASE(round_trip_at_every_level)
+{
+    boost::asio::io_service ioService;
+    cenisys::BatchCompressor compressor(ioService, 1);
+    std::vector<cenisys::PacketBuffer> packets = {
+        makePacket(1, 1), makePacket(300, 2), makePacket(0, 3),
+        makePacket(70000, 4)};
+    for(int level = cenisys::BatchCompressor::MIN_LEVEL;
+        level <= cenisys::BatchCompressor::MAX_LEVEL; level++)
+    {
+        auto unpacked = unpack(compressor.compressNow(packets, level));
+        BOOST_REQUIRE_EQUAL(unpacked.size(), packets.size());
+        for(std::size_t i = 0; i < packets.size(); i++)
+        {
+            BOOST_CHECK(unpacked[i] == std::vector<std::uint8_t>(
+                                           packets[i].data(),
+                                           packets[i].data() +
+                                               packets[i].size()));
+        }
+    }
+    BOOST_CHECK(unpack(compressor.compressNow({}, 6)).empty());
+}
+
+BOOST_AUTO_TEST_CASE(compressed_in_parallel)
+{
+    constexpr std::size_t count = 200;
+    boost::asio::io_service ioService;
+    cenisys::BatchCompressor compressor(ioService, 4);
+    std::mutex lock;
+    std::vector<cenisys::PacketBuffer> batches;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        compressor.compress(
+            {makePacket(1000, static_cast<std::uint8_t>(i))},
+            [&](const cenisys::PacketBuffer &batch) {
+                std::lock_guard<std::mutex> guard(lock);
+                batches.push_back(batch);
+            });
+    }
+    // Nothing ran yet, so the level must have dropped
+    BOOST_CHECK_EQUAL(compressor.getPending(), count);
+    BOOST_CHECK_EQUAL(compressor.getLevel(),
+                      cenisys::BatchCompressor::MIN_LEVEL);
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; i++)
+        threads.emplace_back([&] { ioService.run(); });
+    for(auto &thread : threads)
+        thread.join();
+    BOOST_REQUIRE_EQUAL(batches.size(), count);
+    BOOST_CHECK_EQUAL(compressor.getPending(), 0u);
+    for(const auto &item : batches)
+        BOOST_CHECK_EQUAL(unpack(item).size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(level_follows_queue_depth)
+{
+    using cenisys::BatchCompressor;
+    BOOST_CHECK_EQUAL(BatchCompressor::levelForDepth(0, 4),
+                      BatchCompressor::MAX_LEVEL);
+    BOOST_CHECK_EQUAL(BatchCompressor::levelForDepth(3, 4),
+                      BatchCompressor::MAX_LEVEL);
+    BOOST_CHECK_EQUAL(BatchCompressor::levelForDepth(4, 4),
+                      BatchCompressor::MAX_LEVEL - 1);
+    BOOST_CHECK_EQUAL(BatchCompressor::levelForDepth(1000, 4),
+                      BatchCompressor::MIN_LEVEL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
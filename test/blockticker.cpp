@@ -0,0 +1,243 @@
+/*
+ * Tests for the scheduled block updates and random ticks.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/randombatch.h"
+#include "world/blockticker.h"
+#include "world/chunkcolumn.h"
+#include "world/regionticker.h"
+#include "world/scheduledticks.h"
+#include <algorithm>
+#include <boost/asio/io_service.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using cenisys::BlockId;
+using cenisys::BlockTicker;
+using cenisys::ChunkColumn;
+using cenisys::RegionTicker;
+using cenisys::ScheduledTicks;
+
+namespace
+{
+
+constexpr BlockId STONE = 1;
+constexpr BlockId GRASS = 2;
+constexpr BlockId DIRT = 3;
+constexpr BlockId SAND = 12;
+constexpr unsigned FLOOR = 20;
+
+//!
+//! \brief Two columns of dirt on stone, ticked like the world does.
+//!
+struct Floor
+{
+    Floor()
+        : regions(ioService),
+          ticker(
+              [this](std::int32_t x, std::int32_t z) -> ChunkColumn * {
+                  auto it = columns.find({x, z});
+                  return it == columns.end() ? nullptr : it->second.get();
+              },
+              [this](std::int32_t x, unsigned y, std::int32_t z,
+                     BlockId block) { set(x, y, z, block); })
+    {
+        for(std::int32_t x = 0; x < 2; x++)
+        {
+            auto column = std::make_unique<ChunkColumn>(x, 0);
+            column->getWritableSection(0).fill(STONE);
+            for(unsigned z = 0; z < 16; z++)
+            {
+                for(unsigned bx = 0; bx < 16; bx++)
+                    column->setBlock(bx, FLOOR, z, DIRT);
+            }
+            regions.insert(*column);
+            columns[{x, 0}] = std::move(column);
+        }
+        regions.setTicker(
+            [this](ChunkColumn &column, RegionTicker::Region &region) {
+                ticker.tickColumn(column, region);
+            });
+        regions.setHandlers(
+            [this](std::int32_t x, unsigned y, std::int32_t z, BlockId) {
+                ticker.blockChanged(x, y, z);
+            },
+            [this](std::int32_t x, unsigned y, std::int32_t z,
+                   BlockId block) { set(x, y, z, block); });
+    }
+
+    BlockId get(std::int32_t x, unsigned y, std::int32_t z)
+    {
+        return columns.at({x >> 4, z >> 4})->getBlock(x & 15, y, z & 15);
+    }
+    void set(std::int32_t x, unsigned y, std::int32_t z, BlockId block)
+    {
+        columns.at({x >> 4, z >> 4})->setBlock(x & 15, y, z & 15, block);
+        ticker.blockChanged(x, y, z);
+    }
+    void tick()
+    {
+        ticker.nextTick();
+        regions.tick();
+    }
+    std::size_t count(BlockId block)
+    {
+        std::size_t result = 0;
+        for(std::int32_t z = 0; z < 16; z++)
+        {
+            for(std::int32_t x = 0; x < 32; x++)
+                result += get(x, FLOOR, z) == block;
+        }
+        return result;
+    }
+
+    //! Never run, so the regions are ticked on this thread.
+    boost::asio::io_service ioService;
+    std::map<std::pair<std::int32_t, std::int32_t>,
+             std::unique_ptr<ChunkColumn>>
+        columns;
+    RegionTicker regions;
+    BlockTicker ticker;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(block_ticker)
+
+BOOST_AUTO_TEST_CASE(scheduled_ticks_run_once_when_due)
+{
+    ScheduledTicks ticks;
+    BOOST_CHECK(ticks.schedule(1, SAND, 5));
+    BOOST_CHECK(ticks.schedule(2, SAND, 3));
+    BOOST_CHECK(!ticks.schedule(1, SAND, 2));
+    BOOST_CHECK(ticks.schedule(1, GRASS, 3));
+    BOOST_CHECK_EQUAL(ticks.size(), 3u);
+    BOOST_CHECK_EQUAL(ticks.getNextDue(), 3u);
+
+    std::vector<std::pair<std::uint16_t, BlockId>> run;
+    auto handler = [&](const ScheduledTicks::Tick &tick) {
+        run.emplace_back(tick.position, tick.block);
+    };
+    BOOST_CHECK_EQUAL(ticks.runDue(2, handler), 0u);
+    // Due together, so in the order they were scheduled
+    BOOST_CHECK_EQUAL(ticks.runDue(4, handler), 2u);
+    BOOST_REQUIRE_EQUAL(run.size(), 2u);
+    BOOST_CHECK(run[0] == std::make_pair(std::uint16_t(2), SAND));
+    BOOST_CHECK(run[1] == std::make_pair(std::uint16_t(1), GRASS));
+    BOOST_CHECK(ticks.schedule(2, SAND, 6));
+    BOOST_CHECK_EQUAL(ticks.runDue(10, handler), 2u);
+    BOOST_CHECK(run[2] == std::make_pair(std::uint16_t(1), SAND));
+    BOOST_CHECK(ticks.empty());
+}
+
+BOOST_AUTO_TEST_CASE(random_batches_repeat_by_seed)
+{
+    constexpr std::size_t COUNT = 4 * cenisys::RandomBatch::LANES;
+    cenisys::RandomBatch first(42), second(42), other(43);
+    std::uint32_t a[COUNT], b[COUNT], c[COUNT];
+    first.fill(a, COUNT);
+    second.fill(b, COUNT);
+    other.fill(c, COUNT);
+    BOOST_CHECK(std::equal(a, a + COUNT, b));
+    BOOST_CHECK(!std::equal(a, a + COUNT, c));
+    std::size_t bits = 0;
+    for(std::uint32_t value : a)
+    {
+        BOOST_CHECK_NE(value, 0u);
+        for(; value; value &= value - 1)
+            bits++;
+    }
+    // About half the bits set
+    BOOST_CHECK_GT(bits, COUNT * 12);
+    BOOST_CHECK_LT(bits, COUNT * 20);
+}
+
+BOOST_AUTO_TEST_CASE(only_sections_with_ticked_blocks_are_tickable)
+{
+    const ChunkColumn::BlockSet &ticked = BlockTicker::getRandomlyTicked();
+    ChunkColumn column(0, 0);
+    column.getWritableSection(0).fill(STONE);
+    column.setBlock(1, 70, 1, GRASS);
+    BOOST_CHECK_EQUAL(column.getTickableSections(ticked), 1 << 4);
+    column.setBlock(1, 2, 3, GRASS);
+    BOOST_CHECK_EQUAL(column.getTickableSections(ticked), (1 << 4) | 1);
+    column.getWritableSection(4).fill(DIRT);
+    BOOST_CHECK_EQUAL(column.getTickableSections(ticked), 1);
+    column.removeSection(0);
+    BOOST_CHECK_EQUAL(column.getTickableSections(ticked), 0);
+}
+
+BOOST_AUTO_TEST_CASE(grass_spreads_across_columns)
+{
+    Floor floor;
+    for(std::int32_t z = 0; z < 16; z++)
+        floor.set(15, FLOOR, z, GRASS);
+    floor.ticker.setRandomTicks(BlockTicker::MAX_RANDOM_TICKS);
+    for(int i = 0; i < 3000; i++)
+        floor.tick();
+    BlockTicker::Stats stats = floor.ticker.getStats();
+    BOOST_CHECK_GT(floor.count(GRASS), 32u);
+    std::size_t crossed = 0;
+    for(std::int32_t z = 0; z < 16; z++)
+        crossed += floor.get(16, FLOOR, z) == GRASS;
+    BOOST_CHECK_GT(crossed, 0u);
+    // Only the sections of the floor, never the stone below
+    BOOST_CHECK_GT(stats.sectionsTicked, 0u);
+    BOOST_CHECK_EQUAL(stats.randomTicks,
+                      stats.sectionsTicked * BlockTicker::MAX_RANDOM_TICKS);
+    BOOST_CHECK_GE(stats.sectionsSkipped, 3000u);
+
+    // Covered grass dies
+    for(std::int32_t z = 0; z < 16; z++)
+    {
+        for(std::int32_t x = 0; x < 32; x++)
+            floor.set(x, FLOOR + 1, z, STONE);
+    }
+    for(int i = 0; i < 4000; i++)
+        floor.tick();
+    BOOST_CHECK_EQUAL(floor.count(GRASS), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(sand_falls_when_unsupported)
+{
+    Floor floor;
+    floor.set(3, FLOOR + 1, 3, STONE);
+    floor.set(3, FLOOR + 3, 3, SAND);
+    floor.set(3, FLOOR + 2, 3, SAND);
+    floor.tick();
+    floor.tick();
+    BOOST_CHECK_EQUAL(floor.get(3, FLOOR + 2, 3), SAND);
+
+    floor.set(3, FLOOR + 1, 3, cenisys::ChunkSection::AIR);
+    for(int i = 0; i < 8; i++)
+        floor.tick();
+    BOOST_CHECK_EQUAL(floor.get(3, FLOOR + 1, 3), SAND);
+    BOOST_CHECK_EQUAL(floor.get(3, FLOOR + 2, 3), SAND);
+    BOOST_CHECK_EQUAL(floor.get(3, FLOOR + 3, 3), cenisys::ChunkSection::AIR);
+    BlockTicker::Stats stats = floor.ticker.getStats();
+    BOOST_CHECK_GE(stats.scheduledRun, 4u);
+    // Placing both sand blocks scheduled the upper one twice
+    BOOST_CHECK_GE(stats.duplicates, 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,278 @@
+/*
+ * Tests for the chunk cache.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tempdirectoryfixture.h"
+#include "world/chunkcache.h"
+#include "world/chunkcolumn.h"
+#include "world/worldstorage.h"
+#include <boost/asio/io_service.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+using cenisys::ChunkCache;
+using cenisys::ChunkColumn;
+using cenisys::WorldStorage;
+
+namespace
+{
+
+struct StorageFixture : cenisys::TempDirectoryFixture
+{
+    StorageFixture() : storage(ioService)
+    {
+        BOOST_REQUIRE(storage.open(directory, 1));
+    }
+    ~StorageFixture() { storage.close(); }
+
+    //! A column with one section of stone, saved unless told otherwise.
+    std::unique_ptr<ChunkColumn> makeColumn(std::int32_t x, std::int32_t z,
+                                            bool saved = true)
+    {
+        auto result = std::make_unique<ChunkColumn>(x, z);
+        result->getWritableSection(0).fill(1);
+        if(saved)
+            result->markSaved();
+        return result;
+    }
+
+    //! Bytes of the columns made by makeColumn().
+    std::size_t columnBytes() { return makeColumn(0, 0)->getMemoryUsage(); }
+
+    boost::asio::io_service ioService;
+    WorldStorage storage;
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(chunk_cache, StorageFixture)
+
+BOOST_AUTO_TEST_CASE(referenced_columns_stay)
+{
+    ChunkCache cache(storage, 0);
+    for(std::int32_t x = 0; x < 4; x++)
+        cache.insert(makeColumn(x, 0));
+    cache.setReferences(1, 0, 2);
+    cache.setReferences(2, 0, 1);
+    BOOST_CHECK_EQUAL(cache.getStats().bytes, 4 * columnBytes());
+
+    std::set<std::int32_t> evicted;
+    auto handler = [&](const ChunkColumn &column) {
+        evicted.insert(column.getX());
+    };
+    BOOST_CHECK_EQUAL(cache.evict(handler), 2u);
+    BOOST_CHECK(evicted == std::set<std::int32_t>({0, 3}));
+    BOOST_CHECK(cache.contains(1, 0));
+    BOOST_CHECK(cache.contains(2, 0));
+    BOOST_CHECK_EQUAL(cache.getStats().bytes, 2 * columnBytes());
+
+    // Out of view, then evicted
+    cache.setReferences(2, 0, 0);
+    BOOST_CHECK_EQUAL(cache.getStats().referenced, 1u);
+    BOOST_CHECK_EQUAL(cache.evict(handler), 1u);
+    BOOST_CHECK(!cache.contains(2, 0));
+    BOOST_CHECK_EQUAL(cache.getStats().evicted, 3u);
+    // Saved columns are not written again
+    BOOST_CHECK_EQUAL(cache.getStats().writtenBack, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(used_columns_get_another_round)
+{
+    ChunkCache cache(storage, 2 * columnBytes());
+    for(std::int32_t x = 0; x < 4; x++)
+        cache.insert(makeColumn(x, 0));
+    std::vector<std::int32_t> evicted;
+    auto handler = [&](const ChunkColumn &column) {
+        evicted.push_back(column.getX());
+    };
+    // Everything is new, so the hand goes around once first
+    BOOST_CHECK_EQUAL(cache.evict(handler), 2u);
+    BOOST_CHECK(evicted == std::vector<std::int32_t>({0, 1}));
+
+    // The hand stopped at 2, which was used since
+    cache.markUsed(2, 0);
+    cache.insert(makeColumn(4, 0));
+    BOOST_CHECK_EQUAL(cache.evict(handler), 1u);
+    BOOST_CHECK_EQUAL(evicted.back(), 3);
+    BOOST_CHECK(cache.contains(2, 0));
+    BOOST_CHECK(cache.contains(4, 0));
+
+    // Within the budget, nothing goes
+    BOOST_CHECK_EQUAL(cache.evict(handler), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(changed_columns_are_written_back)
+{
+    ChunkCache cache(storage, 0);
+    cache.insert(makeColumn(5, 6, false));
+    cache.insert(makeColumn(7, 6));
+    cache.get(7, 6)->setBlock(1, 2, 3, 4);
+    cache.insert(makeColumn(9, 6));
+    BOOST_CHECK_EQUAL(cache.evict([](const ChunkColumn &) {}), 3u);
+    BOOST_CHECK_EQUAL(cache.getStats().writtenBack, 2u);
+
+    // Loaded back while or after being written
+    std::promise<std::unique_ptr<ChunkColumn>> loaded;
+    storage.load(7, 6, [&](std::unique_ptr<ChunkColumn> column) {
+        loaded.set_value(std::move(column));
+    });
+    ioService.run();
+    std::unique_ptr<ChunkColumn> column = loaded.get_future().get();
+    BOOST_REQUIRE(column);
+    BOOST_CHECK_EQUAL(column->getBlock(1, 2, 3), 4);
+    BOOST_CHECK_EQUAL(cache.getStats().writing, 0u);
+    BOOST_CHECK_EQUAL(cache.getStats().failed, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(failed_write_backs_are_taken_back)
+{
+    ChunkCache cache(storage, 0);
+    cache.insert(makeColumn(3, 4, false));
+    cache.insert(makeColumn(5, 4, false));
+    // A directory where the region file goes fails every write
+    boost::filesystem::path region = directory / "region" / "r.0.0.region";
+    boost::filesystem::create_directories(region);
+    BOOST_CHECK_EQUAL(cache.evict([](const ChunkColumn &) {}), 2u);
+    ioService.run();
+    BOOST_CHECK_EQUAL(cache.getStats().failed, 2u);
+    BOOST_CHECK_EQUAL(cache.getStats().writing, 0u);
+
+    // Still loaded with the evicted blocks
+    std::unique_ptr<ChunkColumn> reloaded;
+    storage.load(5, 4, [&](std::unique_ptr<ChunkColumn> column) {
+        reloaded = std::move(column);
+    });
+    ioService.reset();
+    ioService.run();
+    BOOST_REQUIRE(reloaded);
+    BOOST_CHECK_EQUAL(reloaded->getBlock(0, 0, 0), 1);
+    reloaded->markSaved();
+    cache.insert(std::move(reloaded));
+
+    std::vector<std::int32_t> loaded;
+    auto handler = [&](ChunkColumn &column) {
+        loaded.push_back(column.getX());
+    };
+    BOOST_CHECK_EQUAL(cache.takeBackFailed(handler), 2u);
+    BOOST_CHECK(loaded == std::vector<std::int32_t>({3}));
+    BOOST_REQUIRE(cache.contains(3, 4));
+    BOOST_CHECK_NE(cache.get(3, 4)->getUnsavedSections(), 0);
+    BOOST_CHECK_NE(cache.get(5, 4)->getUnsavedSections(), 0);
+
+    boost::filesystem::remove(region);
+    BOOST_CHECK_EQUAL(cache.evict([](const ChunkColumn &) {}), 2u);
+    ioService.reset();
+    ioService.run();
+    BOOST_CHECK_EQUAL(cache.getStats().failed, 2u);
+    BOOST_CHECK_EQUAL(cache.takeBackFailed([](ChunkColumn &) {}), 0u);
+
+    // On disk this time
+    storage.close();
+    BOOST_REQUIRE(storage.open(directory, 1));
+    std::size_t found = 0;
+    for(std::int32_t x : {3, 5})
+    {
+        storage.load(x, 4, [&](std::unique_ptr<ChunkColumn> column) {
+            found += column && column->getBlock(0, 0, 0) == 1;
+        });
+    }
+    ioService.reset();
+    ioService.run();
+    BOOST_CHECK_EQUAL(found, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(failed_saves_are_saved_again)
+{
+    ChunkCache cache(storage, 1 << 30);
+    cache.insert(makeColumn(1, 2, false));
+    // A directory where the region file goes fails every write
+    boost::filesystem::path region = directory / "region" / "r.0.0.region";
+    boost::filesystem::create_directories(region);
+    BOOST_CHECK(cache.save());
+    BOOST_CHECK_EQUAL(cache.get(1, 2)->getUnsavedSections(), 0);
+    BOOST_CHECK(cache.isSaving());
+    BOOST_CHECK(!cache.finishSave());
+    BOOST_CHECK(!cache.save());
+
+    // As when the world closes, the running save completes first
+    storage.flush();
+    BOOST_CHECK(!cache.isSaving());
+    BOOST_CHECK_EQUAL(cache.getSaveStats().failed, 1u);
+    boost::filesystem::remove(region);
+    BOOST_CHECK(cache.finishSave());
+    BOOST_CHECK(!cache.finishSave());
+    BOOST_CHECK_NE(cache.get(1, 2)->getUnsavedSections(), 0);
+    BOOST_CHECK(cache.save());
+    storage.flush();
+    BOOST_CHECK(cache.finishSave());
+    BOOST_CHECK_EQUAL(cache.getSaveStats().written, 1u);
+    BOOST_CHECK_EQUAL(cache.getSaveStats().failed, 0u);
+
+    std::promise<std::unique_ptr<ChunkColumn>> loaded;
+    storage.load(1, 2, [&](std::unique_ptr<ChunkColumn> column) {
+        loaded.set_value(std::move(column));
+    });
+    ioService.run();
+    std::unique_ptr<ChunkColumn> column = loaded.get_future().get();
+    BOOST_REQUIRE(column);
+    BOOST_CHECK_EQUAL(column->getBlock(0, 0, 0), 1);
+}
+
+BOOST_AUTO_TEST_CASE(columns_evicted_while_saving_are_written_back)
+{
+    ChunkCache cache(storage, 0);
+    cache.insert(makeColumn(1, 2, false));
+    cache.insert(makeColumn(3, 2));
+    boost::filesystem::path region = directory / "region" / "r.0.0.region";
+    boost::filesystem::create_directories(region);
+    BOOST_CHECK(cache.save());
+    // Marked saved, but the save has not failed yet
+    BOOST_CHECK_EQUAL(cache.evict([](const ChunkColumn &) {}), 2u);
+    BOOST_CHECK_EQUAL(cache.getStats().writtenBack, 1u);
+
+    storage.flush();
+    BOOST_CHECK_EQUAL(cache.getSaveStats().failed, 1u);
+    BOOST_CHECK(cache.finishSave());
+    BOOST_CHECK_EQUAL(cache.getStats().failed, 1u);
+    std::vector<std::int32_t> loaded;
+    auto handler = [&](ChunkColumn &column) {
+        loaded.push_back(column.getX());
+    };
+    BOOST_CHECK_EQUAL(cache.takeBackFailed(handler), 1u);
+    BOOST_CHECK(loaded == std::vector<std::int32_t>({1}));
+    BOOST_REQUIRE(cache.contains(1, 2));
+    BOOST_CHECK_NE(cache.get(1, 2)->getUnsavedSections(), 0);
+    BOOST_CHECK_EQUAL(cache.get(1, 2)->getBlock(0, 0, 0), 1);
+
+    // Once written, the save does not hold on to it anymore
+    boost::filesystem::remove(region);
+    BOOST_CHECK(cache.save());
+    storage.flush();
+    BOOST_CHECK(cache.finishSave());
+    BOOST_CHECK_EQUAL(cache.evict([](const ChunkColumn &) {}), 1u);
+    BOOST_CHECK_EQUAL(cache.getStats().writtenBack, 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,220 @@
+/*
+ * Tests for the chunk packet cache.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/batchcompressor.h"
+#include "network/binarystream.h"
+#include "network/chunkpacketcache.h"
+#include "network/mcpepackets.h"
+#include "world/chunkcolumn.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using cenisys::ChunkColumn;
+using cenisys::ChunkPacketCache;
+using cenisys::ChunkSection;
+
+namespace
+{
+
+constexpr cenisys::BlockId STONE = 1;
+
+//! A column of stone up to y 63.
+ChunkColumn makeColumn()
+{
+    ChunkColumn result(3, -2);
+    for(std::size_t y = 0; y < 4; y++)
+        result.getWritableSection(y).fill(STONE);
+    return result;
+}
+
+//!
+//! \brief The payload of the full chunk packet in a batch.
+//!
+std::string unpack(const ChunkPacketCache::Batch &batch)
+{
+    cenisys::BinaryReader reader(batch.data.data(), batch.data.size());
+    BOOST_REQUIRE_EQUAL(reader.readU8(), cenisys::mcpe::GAME_PACKET);
+    BOOST_REQUIRE_EQUAL(reader.readU8(), cenisys::mcpe::BATCH_PACKET);
+    std::uint32_t size = reader.readVarU32();
+    const std::uint8_t *compressed = reader.readBytes(size);
+    BOOST_REQUIRE(compressed);
+
+    std::vector<std::uint8_t> data(batch.uncompressed);
+    uLongf length = data.size();
+    BOOST_REQUIRE_EQUAL(uncompress(data.data(), &length, compressed, size),
+                        Z_OK);
+    BOOST_REQUIRE_EQUAL(length, batch.uncompressed);
+    cenisys::BinaryReader packets(data.data(), length);
+    std::uint32_t packetSize = packets.readVarU32();
+    cenisys::BinaryReader packetReader(packets.readBytes(packetSize),
+                                       packetSize);
+    cenisys::mcpe::FullChunkDataPacket packet;
+    BOOST_REQUIRE(cenisys::mcpe::decodePacket(packetReader, packet));
+    BOOST_CHECK_EQUAL(packet.chunkX, 3);
+    BOOST_CHECK_EQUAL(packet.chunkZ, -2);
+    return packet.payload.to_string();
+}
+
+std::string toString(const std::vector<std::uint8_t> &payload)
+{
+    return std::string(payload.begin(), payload.end());
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(chunk_packet_cache)
+
+BOOST_AUTO_TEST_CASE(payload_layout)
+{
+    ChunkColumn column(0, 0);
+    column.setBlock(1, 18, 3, 5);
+    column.setMeta(1, 18, 3, 7);
+    column.setMeta(1, 19, 3, 2);
+    column.getWritableSection(1).setBlockLight(ChunkSection::index(1, 2, 3),
+                                               9);
+    std::vector<std::uint8_t> payload = ChunkPacketCache::encode(column);
+    BOOST_REQUIRE_EQUAL(payload.size(),
+                        1 + 2 * ChunkPacketCache::SECTION_BYTES +
+                            ChunkPacketCache::TAIL_BYTES);
+    BOOST_CHECK_EQUAL(payload[0], 2);
+
+    // Blocks, metadata, sky light and block light in XZY order
+    const std::uint8_t *section = &payload[1 + ChunkPacketCache::SECTION_BYTES];
+    std::size_t index = (1 << 8) | (3 << 4) | 2;
+    BOOST_CHECK_EQUAL(section[0], 0);
+    BOOST_CHECK_EQUAL(section[1 + index], 5);
+    BOOST_CHECK_EQUAL(section[1 + index + 1], 0);
+    const std::uint8_t *meta = section + 1 + ChunkSection::VOLUME;
+    BOOST_CHECK_EQUAL(meta[index >> 1], 7 | (2 << 4));
+    const std::uint8_t *sky = meta + ChunkSection::VOLUME / 2;
+    BOOST_CHECK_EQUAL(sky[0], 0xff);
+    const std::uint8_t *light = sky + ChunkSection::VOLUME / 2;
+    BOOST_CHECK_EQUAL(light[index >> 1], 9);
+    BOOST_CHECK_EQUAL(light[0], 0);
+
+    // Height above the block, then the biomes
+    const std::uint8_t *tail =
+        &payload[1 + 2 * ChunkPacketCache::SECTION_BYTES];
+    BOOST_CHECK_EQUAL(tail[((3 << 4) | 1) * 2], 19);
+    BOOST_CHECK_EQUAL(tail[0], 0);
+    BOOST_CHECK_EQUAL(tail[512], ChunkPacketCache::DEFAULT_BIOME);
+    BOOST_CHECK_EQUAL(tail[768], 0);
+    BOOST_CHECK_EQUAL(tail[769], 0);
+}
+
+BOOST_AUTO_TEST_CASE(sends_hit_until_a_section_changes)
+{
+    boost::asio::io_service ioService;
+    cenisys::BatchCompressor compressor(ioService, 1);
+    ChunkPacketCache cache(compressor);
+    ChunkColumn column = makeColumn();
+
+    const ChunkPacketCache::Batch &first = cache.get(column);
+    BOOST_CHECK_EQUAL(column.getDirtySections(), 0);
+    const std::uint8_t *data = first.data.data();
+    BOOST_CHECK(unpack(first) == toString(ChunkPacketCache::encode(column)));
+    const ChunkPacketCache::Batch &second = cache.get(column);
+    BOOST_CHECK(second.data.data() == data);
+    BOOST_CHECK_EQUAL(cache.getStats().hits, 1u);
+    BOOST_CHECK_EQUAL(cache.getStats().misses, 1u);
+    BOOST_CHECK_EQUAL(cache.getStats().sectionsEncoded, 4u);
+
+    // Only the changed section is encoded again
+    column.setBlock(4, 40, 4, ChunkSection::AIR);
+    BOOST_CHECK(unpack(cache.get(column)) ==
+                toString(ChunkPacketCache::encode(column)));
+    BOOST_CHECK_EQUAL(cache.getStats().misses, 2u);
+    BOOST_CHECK_EQUAL(cache.getStats().sectionsEncoded, 5u);
+
+    // A new top section moves everything after the sections
+    column.setBlock(4, 100, 4, STONE);
+    BOOST_CHECK(unpack(cache.get(column)) ==
+                toString(ChunkPacketCache::encode(column)));
+    BOOST_CHECK_EQUAL(cache.getStats().sectionsEncoded, 12u);
+}
+
+BOOST_AUTO_TEST_CASE(seeded_columns_are_recompressed_off_the_tick)
+{
+    boost::asio::io_service ioService;
+    cenisys::BatchCompressor compressor(ioService, 1);
+    ChunkPacketCache cache(compressor);
+    ChunkColumn column = makeColumn();
+    // As the pipeline hands it over
+    cache.seed(column, ChunkPacketCache::encode(column));
+    BOOST_CHECK_EQUAL(column.getDirtySections(), 0);
+    BOOST_CHECK_EQUAL(cache.getStats().seeded, 1u);
+
+    const ChunkPacketCache::Batch &batch = cache.get(column);
+    BOOST_CHECK_EQUAL(cache.getStats().misses, 1u);
+    BOOST_CHECK_EQUAL(cache.getStats().sectionsEncoded, 0u);
+    std::string payload = unpack(batch);
+    BOOST_CHECK(payload == toString(ChunkPacketCache::encode(column)));
+    std::size_t fast = batch.data.size();
+
+    ioService.run();
+    cache.tick();
+    BOOST_CHECK_EQUAL(cache.getStats().recompressed, 1u);
+    BOOST_CHECK(unpack(cache.get(column)) == payload);
+    BOOST_CHECK_EQUAL(cache.getStats().hits, 1u);
+    BOOST_CHECK_EQUAL(cache.getStats().bytes,
+                      payload.size() + cache.get(column).data.size());
+    BOOST_CHECK_LE(cache.get(column).data.size(), fast);
+
+    // A batch made before a change is dropped
+    column.setBlock(4, 40, 4, ChunkSection::AIR);
+    cache.get(column);
+    column.setBlock(4, 41, 4, ChunkSection::AIR);
+    cache.get(column);
+    ioService.reset();
+    ioService.run();
+    cache.tick();
+    BOOST_CHECK_EQUAL(cache.getStats().recompressed, 2u);
+    BOOST_CHECK(unpack(cache.get(column)) ==
+                toString(ChunkPacketCache::encode(column)));
+}
+
+BOOST_AUTO_TEST_CASE(memory_is_released)
+{
+    boost::asio::io_service ioService;
+    cenisys::BatchCompressor compressor(ioService, 1);
+    ChunkPacketCache cache(compressor);
+    ChunkColumn column = makeColumn();
+    const ChunkPacketCache::Batch &batch = cache.get(column);
+    BOOST_CHECK_EQUAL(cache.getStats().columns, 1u);
+    BOOST_CHECK_EQUAL(cache.getStats().bytes,
+                      1 + 4 * ChunkPacketCache::SECTION_BYTES +
+                          ChunkPacketCache::TAIL_BYTES + batch.data.size());
+    // Mostly stone, so it compresses well
+    BOOST_CHECK_LT(batch.data.size(), batch.uncompressed / 10);
+
+    cache.remove(column.getX(), column.getZ());
+    BOOST_CHECK_EQUAL(cache.getStats().columns, 0u);
+    BOOST_CHECK_EQUAL(cache.getStats().bytes, 0u);
+    // A column loaded again is encoded from scratch
+    ChunkColumn reloaded = makeColumn();
+    reloaded.clearDirtySections();
+    cache.get(reloaded);
+    BOOST_CHECK_EQUAL(cache.getStats().sectionsEncoded, 8u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,162 @@
+/*
+ * Tests for the chunk pipeline.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tempdirectoryfixture.h"
+#include "world/chunkcolumn.h"
+#include "world/chunkpipeline.h"
+#include "world/worldstorage.h"
+#include <boost/asio/io_service.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using cenisys::ChunkColumn;
+using cenisys::ChunkPipeline;
+
+namespace
+{
+
+//! Runs everything on the test thread, one io_service run per step.
+struct PipelineFixture : cenisys::TempDirectoryFixture
+{
+    PipelineFixture()
+        : storage(ioService), pipeline(ioService, storage, 1), generated(0)
+    {
+        storage.open(directory, 4);
+        pipeline.setGenerator([this](ChunkColumn &column) {
+            generated++;
+            column.setBlock(0, 0, 0, 7);
+        });
+    }
+    ~PipelineFixture() { storage.close(); }
+
+    //! Finish the running requests, then hand them over.
+    void step()
+    {
+        ioService.run();
+        ioService.reset();
+        pipeline.tick([this](ChunkPipeline::Result &&result) {
+            results.push_back(std::move(result));
+        });
+    }
+
+    boost::asio::io_service ioService;
+    cenisys::WorldStorage storage;
+    ChunkPipeline pipeline;
+    int generated;
+    std::vector<ChunkPipeline::Result> results;
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(chunk_pipeline, PipelineFixture)
+
+BOOST_AUTO_TEST_CASE(nearest_first)
+{
+    pipeline.request(0, 0, 10);
+    pipeline.request(1, 0, 1);
+    pipeline.request(2, 0, 5);
+    pipeline.request(3, 0, 20);
+    // Moving closer
+    pipeline.request(3, 0, 0);
+    BOOST_CHECK_EQUAL(pipeline.getQueued(), 4u);
+    // Only one runs at a time, each taking the next when it is done
+    step();
+    BOOST_CHECK_EQUAL(pipeline.getQueued(), 0u);
+    BOOST_CHECK_EQUAL(pipeline.getRunning(), 0u);
+
+    std::vector<std::int32_t> order;
+    for(const auto &item : results)
+    {
+        BOOST_CHECK(item.generated);
+        BOOST_CHECK_EQUAL(item.column->getBlock(0, 0, 0), 7);
+        order.push_back(item.column->getX());
+    }
+    std::vector<std::int32_t> expected{3, 1, 2, 0};
+    BOOST_CHECK_EQUAL_COLLECTIONS(order.begin(), order.end(),
+                                  expected.begin(), expected.end());
+    const ChunkPipeline::Stats &stats = pipeline.getStats();
+    BOOST_CHECK_EQUAL(stats.completed, 4u);
+    BOOST_CHECK_EQUAL(stats.generated, 4u);
+    auto stage = [&](ChunkPipeline::Stage stage) {
+        return stats.stages[static_cast<std::size_t>(stage)].count;
+    };
+    BOOST_CHECK_EQUAL(stage(ChunkPipeline::Stage::Wait), 4u);
+    BOOST_CHECK_EQUAL(stage(ChunkPipeline::Stage::Load), 4u);
+    BOOST_CHECK_EQUAL(stage(ChunkPipeline::Stage::Generate), 4u);
+    // No lighter or serializer was set
+    BOOST_CHECK_EQUAL(stage(ChunkPipeline::Stage::Light), 0u);
+    BOOST_CHECK_EQUAL(stage(ChunkPipeline::Stage::Serialize), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(cancelled_requests_are_dropped)
+{
+    pipeline.request(0, 0, 0);
+    pipeline.request(1, 0, 1);
+    // Start the first one, then cancel both
+    ioService.poll_one();
+    BOOST_CHECK_EQUAL(pipeline.getRunning(), 1u);
+    BOOST_CHECK_EQUAL(pipeline.getQueued(), 1u);
+    pipeline.cancel(0, 0);
+    pipeline.cancel(1, 0);
+    BOOST_CHECK(!pipeline.isRequested(0, 0));
+    BOOST_CHECK_EQUAL(pipeline.getQueued(), 0u);
+
+    // Requested again while the cancelled one is still running
+    pipeline.request(0, 0, 0);
+    step();
+    BOOST_CHECK_EQUAL(pipeline.getRunning(), 0u);
+    BOOST_REQUIRE_EQUAL(results.size(), 1u);
+    BOOST_CHECK_EQUAL(results[0].column->getX(), 0);
+    // The cancelled run stopped before generating
+    BOOST_CHECK_EQUAL(generated, 1);
+    BOOST_CHECK_EQUAL(pipeline.getStats().cancelled, 2u);
+    BOOST_CHECK_EQUAL(pipeline.getStats().completed, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(stored_columns_are_loaded)
+{
+    auto stored = std::make_shared<ChunkColumn>(-3, 4);
+    stored->setBlock(1, 1, 1, 9);
+    storage.save(stored, [](bool result) { BOOST_CHECK(result); });
+    ioService.run();
+    ioService.reset();
+
+    pipeline.setLighter(
+        [](ChunkColumn &column) { column.setBlock(2, 2, 2, 8); });
+    pipeline.setSerializer([](const ChunkColumn &column) {
+        return std::vector<std::uint8_t>{
+            static_cast<std::uint8_t>(column.getBlock(1, 1, 1))};
+    });
+    pipeline.request(-3, 4, 0);
+    step();
+    BOOST_REQUIRE_EQUAL(results.size(), 1u);
+    const ChunkPipeline::Result &result = results[0];
+    BOOST_CHECK(!result.generated);
+    BOOST_CHECK_EQUAL(generated, 0);
+    // Stored columns are not lit again
+    BOOST_CHECK_EQUAL(result.column->getBlock(2, 2, 2), 0);
+    BOOST_REQUIRE_EQUAL(result.data.size(), 1u);
+    BOOST_CHECK_EQUAL(result.data[0], 9);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,210 @@
+/*
+ * Tests for the paletted chunk storage.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/binarystream.h"
+#include "world/chunkcolumn.h"
+#include "world/chunksection.h"
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <vector>
+
+using cenisys::BlockId;
+using cenisys::ChunkSection;
+
+BOOST_AUTO_TEST_SUITE(chunk_section)
+
+BOOST_AUTO_TEST_CASE(uniform_until_written)
+{
+    ChunkSection section;
+    BOOST_CHECK(section.isUniform());
+    BOOST_CHECK_EQUAL(section.getBlock(1234), ChunkSection::AIR);
+    BOOST_CHECK_EQUAL(section.getSkyLight(1234), ChunkSection::MAX_LIGHT);
+    BOOST_CHECK_EQUAL(section.getBlockLight(1234), 0);
+
+    // Writing the same id keeps the fast path
+    section.setBlock(17, ChunkSection::AIR);
+    BOOST_CHECK(section.isUniform());
+
+    section.setBlock(17, 1);
+    BOOST_CHECK_EQUAL(section.getBitsPerBlock(), 1u);
+    BOOST_CHECK_EQUAL(section.getBlock(17), 1);
+    BOOST_CHECK_EQUAL(section.getBlock(16), ChunkSection::AIR);
+    BOOST_CHECK_EQUAL(section.getBlock(18), ChunkSection::AIR);
+
+    ChunkSection stone(1);
+    BOOST_CHECK(stone.isUniform());
+    BOOST_CHECK_EQUAL(stone.getBlock(4095), 1);
+}
+
+BOOST_AUTO_TEST_CASE(matches_a_plain_array)
+{
+    std::mt19937 random(1);
+    ChunkSection section;
+    std::vector<BlockId> reference(ChunkSection::VOLUME, ChunkSection::AIR);
+    // Grow the palette in steps, through every index width
+    for(BlockId ids : {2, 3, 5, 16, 200, 4000})
+    {
+        for(int i = 0; i < 20000; i++)
+        {
+            std::size_t index = random() % ChunkSection::VOLUME;
+            BlockId block = static_cast<BlockId>(random() % ids);
+            section.setBlock(index, block);
+            reference[index] = block;
+        }
+        for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+            BOOST_REQUIRE_EQUAL(section.getBlock(i), reference[i]);
+    }
+    BOOST_CHECK_EQUAL(section.getBitsPerBlock(), ChunkSection::MAX_BITS);
+
+    ChunkSection copy(section);
+    section.fill(7);
+    for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+    {
+        BOOST_REQUIRE_EQUAL(copy.getBlock(i), reference[i]);
+        BOOST_REQUIRE_EQUAL(section.getBlock(i), 7);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_narrows_the_palette)
+{
+    ChunkSection section;
+    for(BlockId block = 1; block <= 20; block++)
+        section.setBlock(block, block);
+    BOOST_CHECK_EQUAL(section.getBitsPerBlock(), 8u);
+    for(BlockId block = 4; block <= 20; block++)
+        section.setBlock(block, ChunkSection::AIR);
+    section.compact();
+    BOOST_CHECK_EQUAL(section.getPalette().size(), 4u);
+    BOOST_CHECK_EQUAL(section.getBitsPerBlock(), 2u);
+    for(BlockId block = 1; block <= 3; block++)
+        BOOST_CHECK_EQUAL(section.getBlock(block), block);
+    BOOST_CHECK_EQUAL(section.getBlock(4), ChunkSection::AIR);
+
+    for(BlockId block = 1; block <= 3; block++)
+        section.setBlock(block, ChunkSection::AIR);
+    section.compact();
+    BOOST_CHECK(section.isUniform());
+    BOOST_CHECK_EQUAL(section.getBlock(2), ChunkSection::AIR);
+}
+
+BOOST_AUTO_TEST_CASE(stale_ids_are_dropped)
+{
+    ChunkSection section;
+    // Every id but the last is overwritten right away
+    for(std::size_t i = 0; i < 3 * ChunkSection::VOLUME; i++)
+        section.setBlock(5, static_cast<BlockId>(i + 1));
+    BOOST_CHECK_LE(section.getPalette().size(), ChunkSection::VOLUME + 1);
+    BOOST_CHECK_EQUAL(section.getBlock(5), 3 * ChunkSection::VOLUME);
+    BOOST_CHECK_EQUAL(section.getBlock(4), ChunkSection::AIR);
+}
+
+BOOST_AUTO_TEST_CASE(nibbles_are_independent)
+{
+    ChunkSection section;
+    section.setMeta(10, 5);
+    section.setMeta(11, 12);
+    section.setBlockLight(10, 14);
+    section.setSkyLight(11, 3);
+    BOOST_CHECK_EQUAL(section.getMeta(10), 5);
+    BOOST_CHECK_EQUAL(section.getMeta(11), 12);
+    BOOST_CHECK_EQUAL(section.getMeta(12), 0);
+    BOOST_CHECK_EQUAL(section.getBlockLight(10), 14);
+    BOOST_CHECK_EQUAL(section.getBlockLight(11), 0);
+    BOOST_CHECK_EQUAL(section.getSkyLight(10), ChunkSection::MAX_LIGHT);
+    BOOST_CHECK_EQUAL(section.getSkyLight(11), 3);
+    // Even indices go to the low nibble
+    BOOST_CHECK_EQUAL(section.getMetaArray().data()[5], 0xc5);
+}
+
+BOOST_AUTO_TEST_CASE(column_allocates_on_write)
+{
+    cenisys::ChunkColumn column(3, -4);
+    BOOST_CHECK(!column.hasSection(4));
+    BOOST_CHECK_EQUAL(column.getBlock(1, 70, 2), ChunkSection::AIR);
+    BOOST_CHECK(!column.hasSection(4));
+
+    column.setBlock(1, 70, 2, 9);
+    column.setMeta(1, 70, 2, 3);
+    BOOST_CHECK(column.hasSection(4));
+    BOOST_CHECK_EQUAL(column.getBlock(1, 70, 2), 9);
+    BOOST_CHECK_EQUAL(column.getMeta(1, 70, 2), 3);
+    BOOST_CHECK_EQUAL(column.getBlock(1, 71, 2), ChunkSection::AIR);
+
+    cenisys::ChunkColumn copy(column);
+    column.removeSection(4);
+    BOOST_CHECK_EQUAL(column.getBlock(1, 70, 2), ChunkSection::AIR);
+    BOOST_CHECK_EQUAL(copy.getBlock(1, 70, 2), 9);
+}
+
+BOOST_AUTO_TEST_CASE(columns_round_trip)
+{
+    std::mt19937 random(3);
+    cenisys::ChunkColumn column(-7, 12);
+    for(int i = 0; i < 5000; i++)
+    {
+        unsigned x = random() % 16, y = random() % 96, z = random() % 16;
+        column.setBlock(x, y, z, static_cast<BlockId>(random() % 40));
+        column.setMeta(x, y, z, random() % 16);
+    }
+    column.getWritableSection(10).setSkyLight(99, 4);
+    column.getWritableSection(12);
+
+    std::vector<std::uint8_t> data(column.getSerializedSize());
+    cenisys::BinaryWriter writer(data.data(), data.size());
+    column.write(writer);
+    BOOST_REQUIRE(writer.ok());
+    BOOST_CHECK_EQUAL(writer.size(), data.size());
+
+    cenisys::BinaryReader reader(data.data(), data.size());
+    auto copy = cenisys::ChunkColumn::read(-7, 12, reader);
+    BOOST_REQUIRE(copy);
+    BOOST_CHECK_EQUAL(reader.remaining(), 0u);
+    for(std::size_t y = 0; y < cenisys::ChunkColumn::SECTIONS; y++)
+        BOOST_CHECK_EQUAL(copy->hasSection(y), column.hasSection(y));
+    for(unsigned y = 0; y < cenisys::ChunkColumn::HEIGHT; y++)
+    {
+        for(unsigned z = 0; z < 16; z++)
+        {
+            for(unsigned x = 0; x < 16; x++)
+            {
+                BOOST_REQUIRE_EQUAL(copy->getBlock(x, y, z),
+                                    column.getBlock(x, y, z));
+                BOOST_REQUIRE_EQUAL(copy->getMeta(x, y, z),
+                                    column.getMeta(x, y, z));
+            }
+        }
+    }
+    BOOST_CHECK_EQUAL(copy->getSection(10).getSkyLight(99), 4);
+
+    // Indices past the palette are rejected
+    cenisys::ChunkSection section;
+    section.setBlock(0, 1);
+    data.assign(section.getSerializedSize(), 0);
+    cenisys::BinaryWriter sectionWriter(data.data(), data.size());
+    section.write(sectionWriter);
+    // Drop the second palette entry, still used by the first block
+    data[1] = 1;
+    data.erase(data.begin() + 4, data.begin() + 6);
+    cenisys::BinaryReader bad(data.data(), data.size());
+    BOOST_CHECK(!section.read(bad));
+    BOOST_CHECK_EQUAL(section.getBlock(0), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,209 @@
+/*
+ * Tests for the entities and their systems.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entity/entity.h"
+#include "entity/entitymanager.h"
+#include <boost/asio/io_service.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using cenisys::BoundingBox;
+using cenisys::Entity;
+using cenisys::EntityManager;
+using cenisys::Vector3;
+
+namespace
+{
+
+//! Runs an io_service on a few threads until destroyed.
+struct Workers
+{
+    Workers(boost::asio::io_service &service, std::size_t count)
+        : ioService(service),
+          work(std::make_unique<boost::asio::io_service::work>(service))
+    {
+        for(std::size_t i = 0; i < count; i++)
+            threads.emplace_back([this] { ioService.run(); });
+    }
+    ~Workers()
+    {
+        work.reset();
+        for(auto &item : threads)
+            item.join();
+    }
+
+    boost::asio::io_service &ioService;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::vector<std::thread> threads;
+};
+
+//! Entities thrown in every direction, some falling, some with a box.
+void populate(EntityManager &entities, std::size_t count)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        EntityManager::Components components = EntityManager::VELOCITY;
+        if(i % 3)
+            components |= EntityManager::GRAVITY;
+        if(i % 4 == 0)
+            components |= EntityManager::BOUNDING_BOX;
+        Entity entity = entities.spawn(
+            {double(i % 100), 64 + double(i % 7), double(i / 100)},
+            components);
+        entity.setVelocity(
+            {(i % 11) * 0.1 - 0.5, (i % 5) * 0.2, (i % 13) * 0.05});
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(entity_manager)
+
+BOOST_AUTO_TEST_CASE(handles_outlive_removed_entities)
+{
+    boost::asio::io_service ioService;
+    EntityManager entities(ioService);
+    Entity first = entities.spawn({1, 2, 3}, EntityManager::HEALTH);
+    Entity second = entities.spawn({4, 5, 6}, 0);
+    BOOST_CHECK(first.isValid());
+    BOOST_CHECK(!Entity().isValid());
+    BOOST_CHECK(first.getLocation() == (Vector3{1, 2, 3}));
+    BOOST_CHECK_EQUAL(first.getHealth(), EntityManager::DEFAULT_HEALTH);
+    BOOST_CHECK(!second.isDamageable());
+    BOOST_CHECK_EQUAL(entities.size(), 2u);
+
+    first.remove();
+    BOOST_CHECK(!first.isValid());
+    BOOST_CHECK(!entities.getEntity(first.getEntityId()).isValid());
+    BOOST_CHECK(!first.teleport({0, 0, 0}));
+    BOOST_CHECK_EQUAL(first.getHealth(), 0);
+    // The second entity took the row of the first
+    BOOST_CHECK(second.getLocation() == (Vector3{4, 5, 6}));
+
+    // The storage is reused under another id
+    Entity third = entities.spawn({7, 8, 9}, EntityManager::HEALTH);
+    BOOST_CHECK_NE(third.getEntityId(), first.getEntityId());
+    BOOST_CHECK(!first.isValid());
+    BOOST_CHECK(entities.getEntity(third.getEntityId()) == third);
+    BOOST_CHECK_EQUAL(entities.size(), 2u);
+    BOOST_CHECK_EQUAL(entities.getStats().spawned, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(components_move_between_archetypes)
+{
+    boost::asio::io_service ioService;
+    EntityManager entities(ioService);
+    Entity still = entities.spawn({0, 10, 0}, EntityManager::HEALTH);
+    Entity other = entities.spawn({5, 10, 5}, EntityManager::HEALTH);
+    still.setHealth(7);
+    still.setSize(0.5, 2);
+    BOOST_CHECK_EQUAL(entities.getComponents(still.getEntityId()),
+                      EntityManager::HEALTH | EntityManager::BOUNDING_BOX);
+    BoundingBox box = still.getBoundingBox();
+    BOOST_CHECK(box.min == (Vector3{-0.25, 10, -0.25}));
+    BOOST_CHECK(box.max == (Vector3{0.25, 12, 0.25}));
+
+    still.setGravity(true);
+    BOOST_CHECK(still.hasGravity());
+    BOOST_CHECK(still.getVelocity() == (Vector3{0, 0, 0}));
+    // Kept through every move
+    BOOST_CHECK_EQUAL(still.getHealth(), 7);
+    BOOST_CHECK(still.getBoundingBox().max == box.max);
+    BOOST_CHECK(other.getLocation() == (Vector3{5, 10, 5}));
+    BOOST_CHECK_EQUAL(entities.getStats().archetypes, 2u);
+
+    still.teleport({10, 20, 10});
+    BOOST_CHECK(still.getBoundingBox().min == (Vector3{9.75, 20, 9.75}));
+    still.setGravity(false);
+    BOOST_CHECK(!still.hasGravity());
+    BOOST_CHECK_EQUAL(entities.getComponents(still.getEntityId()),
+                      EntityManager::HEALTH | EntityManager::BOUNDING_BOX |
+                          EntityManager::VELOCITY);
+}
+
+BOOST_AUTO_TEST_CASE(systems_move_and_despawn)
+{
+    boost::asio::io_service ioService;
+    EntityManager entities(ioService);
+    Entity falling = entities.spawn(
+        {0, 0, 0}, EntityManager::GRAVITY | EntityManager::VELOCITY |
+                       EntityManager::BOUNDING_BOX);
+    falling.setSize(1, 1);
+    Entity sliding = entities.spawn({0, 0, 0}, EntityManager::VELOCITY);
+    sliding.setVelocity({1, 0, 0});
+    Entity dying = entities.spawn({0, 0, 0}, EntityManager::HEALTH);
+
+    entities.tick();
+    BOOST_CHECK(sliding.getLocation() == (Vector3{1, 0, 0}));
+    BOOST_CHECK_CLOSE(sliding.getVelocity().x, EntityManager::DRAG, 1e-9);
+    BOOST_CHECK_CLOSE(falling.getVelocity().y,
+                      -EntityManager::GRAVITY_ACCELERATION *
+                          EntityManager::DRAG,
+                      1e-9);
+    entities.tick();
+    BOOST_CHECK_LT(falling.getLocation().y, 0);
+    BOOST_CHECK_EQUAL(falling.getBoundingBox().min.y,
+                      falling.getLocation().y);
+
+    dying.setHealth(0);
+    entities.tick();
+    BOOST_CHECK(!dying.isValid());
+    // Falls out of the world eventually
+    for(int i = 0; i < 100 && falling.isValid(); i++)
+        entities.tick();
+    BOOST_CHECK(!falling.isValid());
+    BOOST_CHECK(sliding.isValid());
+    BOOST_CHECK_EQUAL(entities.getStats().despawned, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_ticks_match_serial)
+{
+    constexpr std::size_t COUNT = 5 * EntityManager::BATCH_SIZE + 17;
+    boost::asio::io_service serialService;
+    EntityManager serial(serialService);
+    populate(serial, COUNT);
+    boost::asio::io_service parallelService;
+    EntityManager parallel(parallelService);
+    parallel.setThreads(4);
+    populate(parallel, COUNT);
+    Workers workers(parallelService, 3);
+    for(int i = 0; i < 50; i++)
+    {
+        serial.tick();
+        parallel.tick();
+    }
+    BOOST_CHECK_EQUAL(serial.size(), parallel.size());
+    BOOST_CHECK_GT(parallel.getStats().threads, 1u);
+    for(std::uint64_t index = 0; index < COUNT; index++)
+    {
+        // The same ids, as both spawned the same
+        std::uint64_t id = (std::uint64_t(1) << 32) | index;
+        BOOST_REQUIRE_EQUAL(serial.isValid(id), parallel.isValid(id));
+        BOOST_REQUIRE(serial.getPosition(id) == parallel.getPosition(id));
+        BOOST_REQUIRE(serial.getBoundingBox(id).min ==
+                      parallel.getBoundingBox(id).min);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
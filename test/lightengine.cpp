@@ -0,0 +1,234 @@
+/*
+ * Tests for the light engine.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "world/lightengine.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+
+using cenisys::BlockId;
+using cenisys::ChunkColumn;
+using cenisys::ChunkSection;
+using cenisys::LightEngine;
+
+namespace
+{
+
+constexpr BlockId STONE = 1;
+constexpr BlockId GLASS = 20;
+constexpr BlockId TORCH = 50;
+constexpr BlockId WATER = 9;
+constexpr BlockId GLOWSTONE = 89;
+
+using Columns = std::map<std::pair<std::int32_t, std::int32_t>,
+                         std::unique_ptr<ChunkColumn>>;
+
+//! Loads the columns around the origin, lit as the world would.
+struct World
+{
+    explicit World(std::int32_t radius = 1)
+        : engine([this](std::int32_t x, std::int32_t z) {
+              auto it = columns.find({x, z});
+              return it == columns.end() ? nullptr : it->second.get();
+          })
+    {
+        for(std::int32_t z = -radius; z <= radius; z++)
+        {
+            for(std::int32_t x = -radius; x <= radius; x++)
+            {
+                auto column = std::make_unique<ChunkColumn>(x, z);
+                for(unsigned y = 0; y < 4; y++)
+                {
+                    for(unsigned i = 0; i < 256; i++)
+                        column->setBlock(i & 15, y, i >> 4, STONE);
+                }
+                load(std::move(column));
+            }
+        }
+        engine.update();
+    }
+
+    void load(std::unique_ptr<ChunkColumn> column)
+    {
+        LightEngine::lightColumn(*column);
+        std::int32_t x = column->getX(), z = column->getZ();
+        columns[{x, z}] = std::move(column);
+        engine.columnLoaded(x, z);
+    }
+
+    ChunkColumn &at(std::int32_t x, std::int32_t z)
+    {
+        return *columns.at({x >> 4, z >> 4});
+    }
+    void set(std::int32_t x, unsigned y, std::int32_t z, BlockId block)
+    {
+        ChunkColumn &column = at(x, z);
+        BlockId previous = column.getBlock(x & 15, y, z & 15);
+        column.setBlock(x & 15, y, z & 15, block);
+        engine.blockChanged(x, y, z, previous);
+    }
+    std::uint8_t blockLight(std::int32_t x, unsigned y, std::int32_t z)
+    {
+        return at(x, z).getSection(y >> 4).getBlockLight(
+            ChunkSection::index(x & 15, y & 15, z & 15));
+    }
+    std::uint8_t skyLight(std::int32_t x, unsigned y, std::int32_t z)
+    {
+        return at(x, z).getSection(y >> 4).getSkyLight(
+            ChunkSection::index(x & 15, y & 15, z & 15));
+    }
+
+    Columns columns;
+    LightEngine engine;
+};
+
+//! Count of blocks lit differently in two worlds with the same blocks.
+std::size_t countDifferences(World &a, World &b)
+{
+    std::size_t result = 0;
+    for(const auto &item : a.columns)
+    {
+        const ChunkColumn &first = *item.second;
+        const ChunkColumn &second = *b.columns.at(item.first);
+        for(std::size_t y = 0; y < ChunkColumn::SECTIONS; y++)
+        {
+            const ChunkSection &s1 = first.getSection(y);
+            const ChunkSection &s2 = second.getSection(y);
+            for(std::size_t i = 0; i < ChunkSection::VOLUME; i++)
+            {
+                if(s1.getBlockLight(i) != s2.getBlockLight(i) ||
+                   s1.getSkyLight(i) != s2.getSkyLight(i))
+                    result++;
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(light_engine)
+
+BOOST_AUTO_TEST_CASE(torches_light_across_borders)
+{
+    World world;
+    BOOST_CHECK_EQUAL(world.skyLight(5, 4, 5), 15);
+    BOOST_CHECK_EQUAL(world.skyLight(5, 3, 5), 0);
+
+    world.set(8, 10, 8, TORCH);
+    world.engine.update();
+    BOOST_CHECK_EQUAL(world.blockLight(8, 10, 8), 14);
+    BOOST_CHECK_EQUAL(world.blockLight(13, 10, 8), 9);
+    BOOST_CHECK_EQUAL(world.blockLight(8, 12, 11), 9);
+    // Into the neighbouring column
+    BOOST_CHECK_EQUAL(world.blockLight(-3, 10, 8), 3);
+    BOOST_CHECK_EQUAL(world.blockLight(-6, 10, 8), 0);
+    // Not into the stone
+    BOOST_CHECK_EQUAL(world.blockLight(8, 3, 8), 0);
+
+    world.set(8, 10, 8, ChunkSection::AIR);
+    LightEngine::Stats stats = world.engine.update();
+    BOOST_CHECK_EQUAL(stats.changes, 1u);
+    BOOST_CHECK_EQUAL(world.blockLight(8, 10, 8), 0);
+    BOOST_CHECK_EQUAL(world.blockLight(13, 10, 8), 0);
+    BOOST_CHECK_EQUAL(world.blockLight(-3, 10, 8), 0);
+}
+
+BOOST_AUTO_TEST_CASE(roofs_block_the_sky)
+{
+    World world;
+    for(std::int32_t z = -2; z <= 2; z++)
+    {
+        for(std::int32_t x = -2; x <= 2; x++)
+            world.set(x, 20, z, STONE);
+    }
+    world.engine.update();
+    // Lit from the sides only
+    BOOST_CHECK_EQUAL(world.skyLight(0, 19, 0), 12);
+    BOOST_CHECK_EQUAL(world.skyLight(0, 4, 0), 12);
+    BOOST_CHECK_EQUAL(world.skyLight(-2, 19, 0), 14);
+    BOOST_CHECK_EQUAL(world.skyLight(0, 21, 0), 15);
+
+    // Glass lets the sky through, water dims it
+    world.set(0, 20, 0, GLASS);
+    world.set(1, 20, 0, WATER);
+    world.engine.update();
+    BOOST_CHECK_EQUAL(world.skyLight(0, 10, 0), 15);
+    BOOST_CHECK_EQUAL(world.skyLight(1, 20, 0), 13);
+
+    for(std::int32_t z = -2; z <= 2; z++)
+    {
+        for(std::int32_t x = -2; x <= 2; x++)
+            world.set(x, 20, z, ChunkSection::AIR);
+    }
+    world.engine.update();
+    BOOST_CHECK_EQUAL(world.skyLight(0, 19, 0), 15);
+    BOOST_CHECK_EQUAL(world.skyLight(1, 4, 0), 15);
+}
+
+BOOST_AUTO_TEST_CASE(changes_in_a_tick_are_merged)
+{
+    World world;
+    world.set(3, 8, 3, STONE);
+    world.set(3, 8, 3, GLOWSTONE);
+    world.set(3, 8, 3, ChunkSection::AIR);
+    world.set(4, 8, 3, TORCH);
+    world.set(4, 8, 3, GLOWSTONE);
+    BOOST_CHECK_EQUAL(world.engine.getPending(), 2u);
+    LightEngine::Stats stats = world.engine.update();
+    // The first block was put back
+    BOOST_CHECK_EQUAL(stats.changes, 1u);
+    BOOST_CHECK_EQUAL(world.blockLight(4, 8, 3), 15);
+    BOOST_CHECK_EQUAL(world.blockLight(3, 8, 3), 14);
+    BOOST_CHECK_EQUAL(world.engine.getPending(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(updates_match_lighting_from_scratch)
+{
+    std::mt19937 random(7);
+    const BlockId blocks[] = {ChunkSection::AIR, STONE, STONE, GLASS,
+                              WATER,             TORCH, GLOWSTONE};
+    World world;
+    for(int tick = 0; tick < 20; tick++)
+    {
+        for(int i = 0; i < 40; i++)
+        {
+            std::int32_t x = static_cast<std::int32_t>(random() % 24) - 12;
+            std::int32_t z = static_cast<std::int32_t>(random() % 24) - 12;
+            unsigned y = 4 + random() % 24;
+            world.set(x, y, z, blocks[random() % 7]);
+        }
+        world.engine.update();
+    }
+
+    // The same blocks, lit from nothing
+    World fresh(0);
+    fresh.columns.clear();
+    for(const auto &item : world.columns)
+        fresh.load(std::make_unique<ChunkColumn>(*item.second));
+    fresh.engine.update();
+    BOOST_CHECK_EQUAL(countDifferences(world, fresh), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
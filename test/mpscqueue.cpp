@@ -0,0 +1,78 @@
+/*
+ * Tests for the lock-free queue.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/mpscqueue.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(mpsc_queue)
+
+BOOST_AUTO_TEST_CASE(fifo)
+{
+    cenisys::MpscQueue<int> queue;
+    int value;
+    BOOST_CHECK(!queue.pop(value));
+    queue.push(1);
+    queue.push(2);
+    BOOST_REQUIRE(queue.pop(value));
+    BOOST_CHECK_EQUAL(value, 1);
+    BOOST_REQUIRE(queue.pop(value));
+    BOOST_CHECK_EQUAL(value, 2);
+    BOOST_CHECK(!queue.pop(value));
+}
+
+BOOST_AUTO_TEST_CASE(many_producers)
+{
+    constexpr int producers = 4;
+    constexpr int count = 100000;
+    cenisys::MpscQueue<int> queue;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < producers; i++)
+    {
+        threads.emplace_back([&queue, i] {
+            for(int j = 0; j < count; j++)
+                queue.push(i * count + j);
+        });
+    }
+
+    // Elements of one producer must come out in order
+    std::vector<int> last(producers, -1);
+    int received = 0;
+    while(received < producers * count)
+    {
+        int value;
+        if(!queue.pop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        int producer = value / count;
+        BOOST_REQUIRE_LT(last[producer], value % count);
+        last[producer] = value % count;
+        received++;
+    }
+    for(auto &thread : threads)
+        thread.join();
+    int value;
+    BOOST_CHECK(!queue.pop(value));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+/*
+ * Tests for the packet buffer pool and the arena.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/packetbuffer.h"
+#include "util/arena.h"
+#include "util/mpscqueue.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(packet_buffer)
+
+BOOST_AUTO_TEST_CASE(blocks_are_recycled)
+{
+    // A single block, so the recycled one is the only choice
+    cenisys::BufferPool pool(256, 1, 1);
+    std::uint8_t *first;
+    {
+        cenisys::PacketBuffer buffer = pool.allocate(100);
+        BOOST_CHECK_EQUAL(buffer.size(), 100u);
+        BOOST_CHECK_EQUAL(buffer.capacity(), 256u);
+        first = buffer.data();
+        cenisys::PacketBuffer copy = buffer;
+        BOOST_CHECK(copy.data() == first);
+        BOOST_CHECK_EQUAL(pool.getStats().inUse, 1u);
+    }
+    BOOST_CHECK_EQUAL(pool.getStats().inUse, 0u);
+
+    cenisys::PacketBuffer buffer = pool.allocate(10);
+    BOOST_CHECK(buffer.data() == first);
+    cenisys::BufferPool::Stats stats = pool.getStats();
+    BOOST_CHECK_EQUAL(stats.allocations, 2u);
+    BOOST_CHECK_EQUAL(stats.hits, 1u);
+    BOOST_CHECK_EQUAL(stats.fallbacks, 0u);
+    BOOST_CHECK_EQUAL(stats.blocks, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(falls_back_to_the_heap)
+{
+    cenisys::BufferPool pool(64, 2, 2);
+    cenisys::PacketBuffer large = pool.allocate(65);
+    BOOST_CHECK_EQUAL(large.size(), 65u);
+    std::vector<cenisys::PacketBuffer> buffers;
+    for(int i = 0; i < 3; i++)
+        buffers.push_back(pool.allocate(64));
+    for(const auto &item : buffers)
+        std::memset(item.data(), 0xff, item.size());
+
+    cenisys::BufferPool::Stats stats = pool.getStats();
+    BOOST_CHECK_EQUAL(stats.fallbacks, 2u);
+    BOOST_CHECK_EQUAL(stats.inUse, 2u);
+    BOOST_CHECK_EQUAL(stats.highWater, 2u);
+    BOOST_CHECK_EQUAL(stats.blocks, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(released_from_other_threads)
+{
+    constexpr std::size_t count = 100000;
+    cenisys::BufferPool pool(128, 64, 256);
+    cenisys::MpscQueue<cenisys::PacketBuffer> queue;
+    std::thread consumer([&] {
+        std::size_t received = 0;
+        cenisys::PacketBuffer buffer;
+        while(received < count)
+        {
+            if(!queue.pop(buffer))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            BOOST_REQUIRE_EQUAL(buffer.data()[0],
+                                static_cast<std::uint8_t>(received));
+            buffer = cenisys::PacketBuffer();
+            received++;
+        }
+    });
+    for(std::size_t i = 0; i < count; i++)
+    {
+        cenisys::PacketBuffer buffer = pool.allocate(1);
+        buffer.data()[0] = static_cast<std::uint8_t>(i);
+        queue.push(std::move(buffer));
+    }
+    consumer.join();
+
+    cenisys::BufferPool::Stats stats = pool.getStats();
+    BOOST_CHECK_EQUAL(stats.inUse, 0u);
+    BOOST_CHECK_EQUAL(stats.allocations, count);
+    BOOST_CHECK_LE(stats.blocks, 256u);
+    BOOST_CHECK_GT(stats.hits, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(arena_reuses_its_chunks)
+{
+    cenisys::Arena arena(1024);
+    std::uint8_t *first = arena.allocateArray<std::uint8_t>(1);
+    std::uint64_t *aligned = arena.allocateArray<std::uint64_t>(2);
+    BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(aligned) %
+                          alignof(std::uint64_t),
+                      0u);
+    arena.allocate(4096);
+    BOOST_CHECK_EQUAL(arena.getCapacity(), 1024u + 4096u);
+
+    arena.reset();
+    BOOST_CHECK_EQUAL(arena.getUsed(), 0u);
+    BOOST_CHECK_EQUAL(arena.getCapacity(), 1024u);
+    BOOST_CHECK(arena.allocateArray<std::uint8_t>(1) == first);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+/*
+ * Tests for the packet capture files.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/packetcapture.h"
+#include "tempdirectoryfixture.h"
+#include <boost/filesystem/operations.hpp>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+using Type = cenisys::PacketCaptureRecord::Type;
+
+struct CaptureFixture : cenisys::TempDirectoryFixture
+{
+    CaptureFixture() : file(directory / "capture") {}
+
+    boost::filesystem::path file;
+};
+
+cenisys::PacketBuffer makePacket(std::size_t size)
+{
+    cenisys::PacketBuffer result = cenisys::PacketBuffer::allocate(size);
+    for(std::size_t i = 0; i < size; i++)
+        result.data()[i] = static_cast<std::uint8_t>(i * 31);
+    return result;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(packet_capture, CaptureFixture)
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    using std::chrono::microseconds;
+    Clock::time_point start = Clock::now();
+    cenisys::PacketBuffer small = makePacket(3);
+    // Larger than the write buffer, so it is flushed in the middle
+    cenisys::PacketBuffer large =
+        makePacket(cenisys::PacketCaptureFile::BUFFER_SIZE + 100);
+    {
+        cenisys::PacketCaptureFile capture;
+        BOOST_REQUIRE(capture.open(file));
+        capture.openSession(start, 7);
+        capture.receive(start + microseconds(150), 7, small);
+        capture.endTick(start + microseconds(50000));
+        // Stamped before the previous record, as other shards may be
+        capture.receive(start + microseconds(49000), 300, large);
+        capture.closeSession(start + microseconds(60000), 7);
+        capture.close();
+        BOOST_CHECK_EQUAL(capture.getRecords(), 5u);
+        BOOST_CHECK_EQUAL(capture.getBytes(),
+                          boost::filesystem::file_size(file));
+    }
+
+    cenisys::PacketCaptureReader reader;
+    BOOST_REQUIRE(reader.open(file));
+    cenisys::PacketCaptureRecord record;
+    std::vector<cenisys::PacketCaptureRecord> records;
+    while(reader.next(record))
+        records.push_back(record);
+    BOOST_CHECK(!reader.fail());
+    BOOST_REQUIRE_EQUAL(records.size(), 5u);
+
+    BOOST_CHECK(records[0].type == Type::Open);
+    BOOST_CHECK_EQUAL(records[0].session, 7u);
+    BOOST_CHECK_EQUAL(records[0].time.count(), 0);
+    BOOST_CHECK(records[1].type == Type::Receive);
+    BOOST_CHECK_EQUAL(records[1].time.count(), 150);
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+        records[1].packet.data(),
+        records[1].packet.data() + records[1].packet.size(), small.data(),
+        small.data() + small.size());
+    BOOST_CHECK(records[2].type == Type::Tick);
+    BOOST_CHECK_EQUAL(records[2].time.count(), 50000);
+    BOOST_CHECK(records[3].type == Type::Receive);
+    BOOST_CHECK_EQUAL(records[3].session, 300u);
+    BOOST_CHECK_EQUAL(records[3].time.count(), 50000);
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+        records[3].packet.data(),
+        records[3].packet.data() + records[3].packet.size(), large.data(),
+        large.data() + large.size());
+    BOOST_CHECK(records[4].type == Type::Close);
+    BOOST_CHECK_EQUAL(records[4].time.count(), 60000);
+}
+
+BOOST_AUTO_TEST_CASE(truncated)
+{
+    {
+        cenisys::PacketCaptureFile capture;
+        BOOST_REQUIRE(capture.open(file));
+        capture.receive(Clock::now(), 1, makePacket(100));
+    }
+    boost::filesystem::resize_file(file,
+                                   boost::filesystem::file_size(file) - 1);
+    cenisys::PacketCaptureReader reader;
+    BOOST_REQUIRE(reader.open(file));
+    cenisys::PacketCaptureRecord record;
+    BOOST_CHECK(!reader.next(record));
+    BOOST_CHECK(reader.fail());
+}
+
+BOOST_AUTO_TEST_CASE(not_a_capture)
+{
+    {
+        boost::filesystem::ofstream out(file);
+        out << "hello";
+    }
+    cenisys::PacketCaptureReader reader;
+    BOOST_CHECK(!reader.open(file));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+/*
+ * Tests for the packet schema codecs.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/mcpepackets.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+//! A packet using every kind of codec.
+struct TestPacket
+{
+    static constexpr std::uint8_t ID = 0x7f;
+    std::int32_t number;
+    std::uint64_t large;
+    boost::string_ref name;
+    std::vector<cenisys::mcpe::BlockPosition> positions;
+    std::vector<boost::string_ref> names;
+};
+
+} // namespace
+
+namespace cenisys
+{
+namespace mcpe
+{
+
+template <>
+struct PacketSchema<TestPacket>
+    : Fields<CENISYS_PACKET_FIELD(TestPacket, VarInt32, number),
+             CENISYS_PACKET_FIELD(TestPacket, VarUInt64, large),
+             CENISYS_PACKET_FIELD(TestPacket, String, name),
+             CENISYS_PACKET_FIELD(TestPacket, Vector<BlockPositionCodec>,
+                                  positions),
+             CENISYS_PACKET_FIELD(TestPacket, Vector<String>, names)>
+{
+};
+
+} // namespace mcpe
+} // namespace cenisys
+
+namespace
+{
+
+//!
+//! \brief Encode, check the size, decode and compare, then make sure every
+//! truncated copy is rejected.
+//!
+template <typename Packet>
+void checkRoundTrip(const Packet &packet)
+{
+    cenisys::BufferPool pool(256, 4, 4);
+    cenisys::PacketBuffer buffer = cenisys::mcpe::encodePacket(pool, packet);
+    BOOST_REQUIRE_EQUAL(buffer.size(), cenisys::mcpe::packetSize(packet));
+    BOOST_REQUIRE_EQUAL(buffer.data()[0], static_cast<int>(Packet::ID));
+
+    cenisys::BinaryReader reader(buffer.data(), buffer.size());
+    Packet decoded{};
+    BOOST_REQUIRE(cenisys::mcpe::decodePacket(reader, decoded));
+    BOOST_CHECK_EQUAL(reader.remaining(), 0u);
+    BOOST_CHECK(cenisys::mcpe::packetsEqual(packet, decoded));
+
+    for(std::size_t size = 0; size < buffer.size(); size++)
+    {
+        cenisys::BinaryReader truncated(buffer.data(), size);
+        Packet partial{};
+        BOOST_CHECK(!cenisys::mcpe::decodePacket(truncated, partial));
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(packet_codec)
+
+BOOST_AUTO_TEST_CASE(game_packets_round_trip)
+{
+    checkRoundTrip(cenisys::mcpe::LoginPacket{
+        cenisys::mcpe::PROTOCOL_VERSION, 0, "chain and client data"});
+    checkRoundTrip(cenisys::mcpe::PlayStatusPacket{
+        cenisys::mcpe::PlayStatusPacket::PlayerSpawn});
+    checkRoundTrip(cenisys::mcpe::DisconnectPacket{false, "Server closed"});
+    checkRoundTrip(cenisys::mcpe::TextPacket{
+        cenisys::mcpe::TextPacket::Chat, "Steve", "Hello world"});
+    checkRoundTrip(cenisys::mcpe::SetTimePacket{-6000, true});
+    checkRoundTrip(cenisys::mcpe::MovePlayerPacket{
+        (1ull << 40) + 1, {128.5f, 64.0f, -3.25f}, 10.0f, 90.0f, 45.0f,
+        cenisys::mcpe::MovePlayerPacket::Normal, true});
+    checkRoundTrip(cenisys::mcpe::RemoveBlockPacket{{-1, 255, 1000000}});
+    checkRoundTrip(cenisys::mcpe::UpdateBlockPacket{{7, 64, -7}, 1, 0xb0});
+}
+
+BOOST_AUTO_TEST_CASE(every_codec_round_trips)
+{
+    checkRoundTrip(TestPacket{std::numeric_limits<std::int32_t>::min(),
+                              std::numeric_limits<std::uint64_t>::max(),
+                              "",
+                              {{0, 0, 0}, {-300, 70000, 300}},
+                              {"a", "", std::string(200, 'x')}});
+    checkRoundTrip(TestPacket{std::numeric_limits<std::int32_t>::max(),
+                              0,
+                              "name",
+                              {},
+                              {}});
+}
+
+BOOST_AUTO_TEST_CASE(varint_encoding)
+{
+    std::uint8_t data[16];
+    cenisys::BinaryWriter writer(data, sizeof(data));
+    cenisys::mcpe::VarInt32::write(writer, -1);
+    cenisys::mcpe::VarUInt32::write(writer, 300);
+    BOOST_REQUIRE_EQUAL(writer.size(), 3u);
+    BOOST_CHECK_EQUAL(data[0], 0x01);
+    BOOST_CHECK_EQUAL(data[1], 0xac);
+    BOOST_CHECK_EQUAL(data[2], 0x02);
+
+    // Six bytes are too many for 32 bits
+    std::uint8_t tooLong[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x00};
+    cenisys::BinaryReader reader(tooLong, sizeof(tooLong));
+    reader.readVarU32();
+    BOOST_CHECK(!reader.ok());
+}
+
+BOOST_AUTO_TEST_CASE(strings_point_into_the_packet)
+{
+    std::uint8_t data[] = {0x0a, 0x01, 0x01, 'A', 0x02, 'h', 'i'};
+    cenisys::BinaryReader reader(data, sizeof(data));
+    cenisys::mcpe::TextPacket packet;
+    BOOST_REQUIRE(cenisys::mcpe::decodePacket(reader, packet));
+    BOOST_CHECK(packet.source == "A");
+    BOOST_CHECK(packet.message == "hi");
+    BOOST_CHECK(reinterpret_cast<const std::uint8_t *>(
+                    packet.message.data()) == data + 5);
+}
+
+BOOST_AUTO_TEST_CASE(rejects_invalid_data)
+{
+    // Wrong id
+    std::uint8_t status[] = {0x03, 0x00, 0x00, 0x00, 0x00};
+    cenisys::BinaryReader reader(status, sizeof(status));
+    cenisys::mcpe::PlayStatusPacket packet;
+    BOOST_CHECK(!cenisys::mcpe::decodePacket(reader, packet));
+
+    // A count far beyond the data must not allocate
+    std::uint8_t vector[] = {0x7f, 0x00, 0x00, 0x00,
+                             0xff, 0xff, 0xff, 0xff, 0x0f};
+    cenisys::BinaryReader vectorReader(vector, sizeof(vector));
+    TestPacket test;
+    BOOST_CHECK(!cenisys::mcpe::decodePacket(vectorReader, test));
+    BOOST_CHECK(test.positions.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,122 @@
+/*
+ * Tests for the game packet dispatcher.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/batchcompressor.h"
+#include "network/mcpepackets.h"
+#include "network/packetdispatcher.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+cenisys::mcpe::TextPacket makeText(const char *message)
+{
+    cenisys::mcpe::TextPacket result;
+    result.type = cenisys::mcpe::TextPacket::Chat;
+    result.source = "Steve";
+    result.message = message;
+    return result;
+}
+
+//!
+//! \brief Wrap an encoded packet into a game packet without batching.
+//!
+cenisys::PacketBuffer wrap(const cenisys::PacketBuffer &packet)
+{
+    cenisys::PacketBuffer result =
+        cenisys::PacketBuffer::allocate(packet.size() + 1);
+    result.data()[0] = cenisys::mcpe::GAME_PACKET;
+    std::copy(packet.data(), packet.data() + packet.size(),
+              result.data() + 1);
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(packet_dispatcher)
+
+BOOST_AUTO_TEST_CASE(batches_are_unpacked)
+{
+    cenisys::BufferPool pool(256, 16, 64);
+    cenisys::PacketDispatcher dispatcher;
+    std::vector<std::string> messages;
+    dispatcher.registerHandler<cenisys::mcpe::TextPacket>(
+        [&](std::uint64_t session, const cenisys::mcpe::TextPacket &packet) {
+            BOOST_CHECK_EQUAL(session, 42u);
+            messages.push_back(packet.message.to_string());
+        });
+
+    boost::asio::io_service ioService;
+    cenisys::BatchCompressor compressor(ioService, 1);
+    cenisys::PacketBuffer batch = compressor.compressNow(
+        {cenisys::mcpe::encodePacket(pool, makeText("a")),
+         cenisys::mcpe::encodePacket(pool, makeText("b")),
+         cenisys::mcpe::encodePacket(pool,
+                                     cenisys::mcpe::SetTimePacket{0, true})},
+        6);
+    BOOST_CHECK(dispatcher.dispatch(42, batch));
+    BOOST_CHECK(dispatcher.dispatch(
+        42, wrap(cenisys::mcpe::encodePacket(pool, makeText("c")))));
+
+    BOOST_CHECK(messages == std::vector<std::string>({"a", "b", "c"}));
+    BOOST_CHECK_EQUAL(dispatcher.getUnhandled(), 1u);
+    BOOST_CHECK_EQUAL(dispatcher.getMalformed(), 0u);
+    BOOST_CHECK_EQUAL(
+        dispatcher.getStats(cenisys::mcpe::BATCH_PACKET).count, 1u);
+    BOOST_CHECK_EQUAL(
+        dispatcher
+            .getStats(static_cast<std::uint8_t>(cenisys::mcpe::TextPacket::ID))
+            .count,
+        3u);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_packets)
+{
+    cenisys::BufferPool pool(256, 16, 64);
+    cenisys::PacketDispatcher dispatcher;
+    dispatcher.registerHandler<cenisys::mcpe::TextPacket>(
+        [&](std::uint64_t session, const cenisys::mcpe::TextPacket &packet) {
+            BOOST_FAIL("Truncated packet handled");
+        });
+
+    cenisys::PacketBuffer text =
+        wrap(cenisys::mcpe::encodePacket(pool, makeText("hello")));
+    text.resize(text.size() - 2);
+    BOOST_CHECK(!dispatcher.dispatch(1, text));
+
+    // A batch whose compressed data is garbage
+    const std::uint8_t garbage[] = {cenisys::mcpe::GAME_PACKET,
+                                    cenisys::mcpe::BATCH_PACKET, 3, 1, 2, 3};
+    BOOST_CHECK(!dispatcher.dispatch(
+        1, cenisys::PacketBuffer::copy(garbage, sizeof(garbage))));
+
+    const std::uint8_t raknet[] = {0x84, 0, 0};
+    BOOST_CHECK(!dispatcher.dispatch(
+        1, cenisys::PacketBuffer::copy(raknet, sizeof(raknet))));
+    BOOST_CHECK_EQUAL(dispatcher.getMalformed(), 3u);
+
+    dispatcher.resetStats();
+    BOOST_CHECK_EQUAL(dispatcher.getMalformed(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
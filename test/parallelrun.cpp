@@ -0,0 +1,104 @@
+/*
+ * Tests for parallel runs.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/parallelrun.h"
+#include <atomic>
+#include <boost/asio/io_service.hpp>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using cenisys::ParallelRun;
+
+namespace
+{
+
+//! Runs an io_service on a few threads until destroyed.
+struct Workers
+{
+    Workers(boost::asio::io_service &service, std::size_t count)
+        : ioService(service),
+          work(std::make_unique<boost::asio::io_service::work>(service))
+    {
+        for(std::size_t i = 0; i < count; i++)
+            threads.emplace_back([this] { ioService.run(); });
+    }
+    ~Workers()
+    {
+        work.reset();
+        for(auto &item : threads)
+            item.join();
+    }
+
+    boost::asio::io_service &ioService;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::vector<std::thread> threads;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(parallel_run)
+
+BOOST_AUTO_TEST_CASE(every_job_runs_once)
+{
+    boost::asio::io_service ioService;
+    Workers workers(ioService, 3);
+    std::vector<std::atomic<unsigned>> runs(64);
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+    ParallelRun::run(ioService, 4, runs.size(), [&](std::size_t index) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        runs[index]++;
+        std::lock_guard<std::mutex> guard(lock);
+        threads.insert(std::this_thread::get_id());
+    });
+    for(const auto &item : runs)
+        BOOST_CHECK_EQUAL(item.load(), 1u);
+    BOOST_CHECK_GT(threads.size(), 1u);
+    BOOST_CHECK(threads.count(std::this_thread::get_id()));
+
+    // Nothing to do, not even for the helpers
+    ParallelRun::run(ioService, 4, 0, [](std::size_t index) {
+        BOOST_ERROR("no job to run");
+    });
+}
+
+BOOST_AUTO_TEST_CASE(first_error_is_thrown_after_every_job)
+{
+    boost::asio::io_service ioService;
+    Workers workers(ioService, 3);
+    std::atomic<unsigned> runs{0};
+    auto job = [&runs](std::size_t index) {
+        runs++;
+        if(index % 8 == 0)
+            throw std::runtime_error("job failed");
+    };
+    BOOST_CHECK_THROW(ParallelRun::run(ioService, 4, 32, job),
+                      std::runtime_error);
+    // The others still ran
+    BOOST_CHECK_EQUAL(runs.load(), 32u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
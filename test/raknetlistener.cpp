@@ -0,0 +1,279 @@
+/*
+ * Loopback tests for the RakNet listener.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/raknetlistener.h"
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/test/unit_test.hpp>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+class RecordingHandler : public cenisys::RakNetSessionHandler
+{
+public:
+    void open(cenisys::RakNetSession &session)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        opened++;
+        _wait.notify_all();
+    }
+    void receive(cenisys::RakNetSession &session,
+                 const cenisys::PacketBuffer &packet)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        received.emplace_back(packet.data(), packet.data() + packet.size());
+        _wait.notify_all();
+    }
+    void close(cenisys::RakNetSession &session)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        closed++;
+    }
+
+    bool waitForReceive(std::size_t count)
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        return _wait.wait_for(lock, std::chrono::seconds(5), [&] {
+            return received.size() >= count;
+        });
+    }
+
+    std::size_t opened = 0;
+    std::size_t closed = 0;
+    std::vector<std::vector<std::uint8_t>> received;
+
+private:
+    std::mutex _lock;
+    std::condition_variable _wait;
+};
+
+struct LoopbackFixture
+{
+    LoopbackFixture() : client(ioService)
+    {
+        cenisys::RakNetListener::Options options;
+        options.endpoint = boost::asio::ip::udp::endpoint(
+            boost::asio::ip::address_v4::loopback(), 0);
+        options.guid = 0x0123456789abcdef;
+        options.motd = "Test";
+        options.maxSessions = 4;
+        options.maxMtu = 1400;
+        options.timeout = std::chrono::seconds(10);
+        options.reusePort = false;
+        options.segmentationOffload = true;
+        listener = std::make_shared<cenisys::RakNetListener>(ioService,
+                                                             options, handler);
+        listener->start();
+        client.open(boost::asio::ip::udp::v4());
+        client.bind(boost::asio::ip::udp::endpoint(
+            boost::asio::ip::address_v4::loopback(), 0));
+        server = listener->getLocalEndpoint();
+        work = std::make_unique<boost::asio::io_service::work>(ioService);
+        thread = std::thread([this] { ioService.run(); });
+    }
+    ~LoopbackFixture()
+    {
+        ioService.post([this] { listener->stop(); });
+        work.reset();
+        thread.join();
+    }
+
+    std::vector<std::uint8_t> request(const std::vector<std::uint8_t> &data)
+    {
+        client.send_to(boost::asio::buffer(data), server);
+        std::vector<std::uint8_t> reply(2048);
+        boost::asio::ip::udp::endpoint from;
+        reply.resize(client.receive_from(boost::asio::buffer(reply), from));
+        return reply;
+    }
+
+    boost::asio::io_service ioService;
+    RecordingHandler handler;
+    std::shared_ptr<cenisys::RakNetListener> listener;
+    boost::asio::ip::udp::socket client;
+    boost::asio::ip::udp::endpoint server;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::thread thread;
+};
+
+std::vector<std::uint8_t> openConnectionRequest1(std::size_t size)
+{
+    std::vector<std::uint8_t> result(size);
+    cenisys::BinaryWriter writer(result.data(), result.size());
+    writer.writeU8(cenisys::raknet::OpenConnectionRequest1);
+    cenisys::raknet::writeMagic(writer);
+    writer.writeU8(cenisys::raknet::PROTOCOL_VERSION);
+    return result;
+}
+
+std::vector<std::uint8_t>
+openConnectionRequest2(const boost::asio::ip::udp::endpoint &server)
+{
+    std::vector<std::uint8_t> result(64);
+    cenisys::BinaryWriter writer(result.data(), result.size());
+    writer.writeU8(cenisys::raknet::OpenConnectionRequest2);
+    cenisys::raknet::writeMagic(writer);
+    cenisys::raknet::writeAddress(writer, server);
+    writer.writeU16(1400);
+    writer.writeU64(42);
+    result.resize(writer.size());
+    return result;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(raknet_listener, LoopbackFixture)
+
+BOOST_AUTO_TEST_CASE(unconnected_ping)
+{
+    std::vector<std::uint8_t> ping(33);
+    cenisys::BinaryWriter writer(ping.data(), ping.size());
+    writer.writeU8(cenisys::raknet::UnconnectedPing);
+    writer.writeU64(1234);
+    cenisys::raknet::writeMagic(writer);
+    writer.writeU64(42);
+
+    std::vector<std::uint8_t> pong = request(ping);
+    cenisys::BinaryReader reader(pong.data(), pong.size());
+    BOOST_CHECK_EQUAL(reader.readU8(), cenisys::raknet::UnconnectedPong);
+    BOOST_CHECK_EQUAL(reader.readU64(), 1234u);
+    BOOST_CHECK_EQUAL(reader.readU64(), 0x0123456789abcdefu);
+    BOOST_CHECK(cenisys::raknet::readMagic(reader));
+    std::size_t length = reader.readU16();
+    const std::uint8_t *name = reader.readBytes(length);
+    BOOST_REQUIRE(reader.ok());
+    BOOST_CHECK_EQUAL(std::string(name, name + length),
+                      "MCPE;Test;100;1.0.0;0;4");
+}
+
+BOOST_AUTO_TEST_CASE(incompatible_protocol)
+{
+    std::vector<std::uint8_t> data = openConnectionRequest1(100);
+    data[17] = cenisys::raknet::PROTOCOL_VERSION + 1;
+    std::vector<std::uint8_t> reply = request(data);
+    BOOST_REQUIRE(!reply.empty());
+    BOOST_CHECK_EQUAL(reply[0], cenisys::raknet::IncompatibleProtocolVersion);
+}
+
+BOOST_AUTO_TEST_CASE(handshake_and_connected_datagram)
+{
+    std::vector<std::uint8_t> reply1 = request(openConnectionRequest1(1000));
+    cenisys::BinaryReader reader1(reply1.data(), reply1.size());
+    BOOST_CHECK_EQUAL(reader1.readU8(), cenisys::raknet::OpenConnectionReply1);
+    BOOST_CHECK(cenisys::raknet::readMagic(reader1));
+    BOOST_CHECK_EQUAL(reader1.readU64(), 0x0123456789abcdefu);
+    reader1.readU8();
+    BOOST_CHECK_EQUAL(reader1.readU16(),
+                      1000 + cenisys::raknet::UDP_HEADER_SIZE);
+
+    std::vector<std::uint8_t> reply2 = request(openConnectionRequest2(server));
+    cenisys::BinaryReader reader2(reply2.data(), reply2.size());
+    BOOST_CHECK_EQUAL(reader2.readU8(), cenisys::raknet::OpenConnectionReply2);
+    BOOST_CHECK(cenisys::raknet::readMagic(reader2));
+    BOOST_CHECK_EQUAL(reader2.readU64(), 0x0123456789abcdefu);
+    BOOST_CHECK(cenisys::raknet::readAddress(reader2) ==
+                client.local_endpoint());
+    BOOST_CHECK_EQUAL(reader2.readU16(), 1400);
+    BOOST_CHECK(reader2.ok());
+    BOOST_CHECK_EQUAL(handler.opened, 1u);
+    BOOST_CHECK_EQUAL(listener->getSessionCount(), 1u);
+
+    // A reliable ordered game packet in datagram 0
+    std::vector<std::uint8_t> datagram = {0x84, 0x00, 0x00, 0x00, 0x60, 0x00,
+                                          0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                          0x00, 0x00, 0xfe, 0x42};
+    std::vector<std::uint8_t> ack = request(datagram);
+    std::vector<std::uint8_t> expected = {0xc0, 0x00, 0x01, 0x01,
+                                          0x00, 0x00, 0x00};
+    BOOST_CHECK(ack == expected);
+    BOOST_REQUIRE(handler.waitForReceive(1));
+    expected = {0xfe, 0x42};
+    BOOST_CHECK(handler.received[0] == expected);
+}
+
+BOOST_AUTO_TEST_CASE(batched_flush)
+{
+    // Four full datagrams and a shorter one, which can go out as one buffer
+    std::vector<std::size_t> sizes = {1000, 1000, 1000, 1000, 300};
+    boost::asio::ip::udp::endpoint target = client.local_endpoint();
+    std::promise<void> flushed;
+    ioService.post([&] {
+        std::vector<std::uint8_t> data(1000);
+        for(std::size_t i = 0; i < sizes.size(); i++)
+        {
+            data[0] = static_cast<std::uint8_t>(i);
+            listener->sendTo(target, data.data(), sizes[i]);
+        }
+        listener->flush();
+        flushed.set_value();
+    });
+    flushed.get_future().get();
+
+    for(std::size_t i = 0; i < sizes.size(); i++)
+    {
+        std::vector<std::uint8_t> reply(2048);
+        boost::asio::ip::udp::endpoint from;
+        reply.resize(client.receive_from(boost::asio::buffer(reply), from));
+        BOOST_REQUIRE_EQUAL(reply.size(), sizes[i]);
+        BOOST_CHECK_EQUAL(reply[0], i);
+    }
+    cenisys::RakNetListener::SendStats stats = listener->getSendStats();
+    BOOST_CHECK_EQUAL(stats.flushes, 1u);
+    BOOST_CHECK_EQUAL(stats.datagrams, sizes.size());
+#if defined(HAVE_SENDMMSG)
+    BOOST_CHECK_EQUAL(stats.syscalls, 1u);
+    if(listener->isSegmentationEnabled())
+        BOOST_CHECK_EQUAL(stats.segmented, sizes.size());
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(shared_port)
+{
+    boost::asio::io_service other;
+    cenisys::RakNetListener::Options options;
+    options.endpoint = server;
+    options.guid = 1;
+    options.maxSessions = 4;
+    options.maxMtu = 1400;
+    options.timeout = std::chrono::seconds(10);
+    options.reusePort = true;
+    options.segmentationOffload = true;
+    // The first listener did not allow sharing the port
+    BOOST_CHECK_THROW(
+        cenisys::RakNetListener(other, options, handler),
+        boost::system::system_error);
+
+    options.endpoint = boost::asio::ip::udp::endpoint(
+        boost::asio::ip::address_v4::loopback(), 0);
+    options.sessionCount = std::make_shared<std::atomic<std::size_t>>(0);
+    cenisys::RakNetListener first(other, options, handler);
+    options.endpoint = first.getLocalEndpoint();
+    cenisys::RakNetListener second(other, options, handler);
+    BOOST_CHECK(second.getLocalEndpoint() == first.getLocalEndpoint());
+    BOOST_CHECK_EQUAL(first.getSessionCount(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,172 @@
+/*
+ * Tests for the region ticker.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "world/regionticker.h"
+#include <boost/asio/io_service.hpp>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using cenisys::BlockId;
+using cenisys::ChunkColumn;
+using cenisys::RegionTicker;
+
+namespace
+{
+
+constexpr std::int32_t SIZE = RegionTicker::REGION_SIZE;
+
+//! Runs an io_service on a few threads until destroyed.
+struct Workers
+{
+    Workers(boost::asio::io_service &service, std::size_t count)
+        : ioService(service),
+          work(std::make_unique<boost::asio::io_service::work>(service))
+    {
+        for(std::size_t i = 0; i < count; i++)
+            threads.emplace_back([this] { ioService.run(); });
+    }
+    ~Workers()
+    {
+        work.reset();
+        for(auto &item : threads)
+            item.join();
+    }
+
+    boost::asio::io_service &ioService;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::vector<std::thread> threads;
+};
+
+using Block = std::tuple<std::int32_t, unsigned, std::int32_t, BlockId>;
+
+//!
+//! \brief Columns along x in four regions, each setting a block in itself
+//! and one in the next region.
+//!
+struct Row
+{
+    explicit Row(boost::asio::io_service &ioService) : ticker(ioService)
+    {
+        for(std::int32_t x = 0; x < 4 * SIZE; x += SIZE / 2)
+        {
+            columns.push_back(std::make_unique<ChunkColumn>(x, 0));
+            ticker.insert(*columns.back());
+        }
+        ticker.setTicker([](ChunkColumn &column, RegionTicker::Region &region) {
+            std::int32_t x = column.getX() * 16;
+            region.setBlock(x + 1, 2, 3, static_cast<BlockId>(column.getX()));
+            region.setBlock(x + SIZE * 16, 4, 0, 7);
+        });
+        ticker.setHandlers(
+            [this](std::int32_t x, unsigned y, std::int32_t z,
+                   BlockId previous) {
+                changes.emplace_back(x, y, z, previous);
+            },
+            [this](std::int32_t x, unsigned y, std::int32_t z, BlockId block) {
+                deferred.emplace_back(x, y, z, block);
+            });
+    }
+
+    RegionTicker ticker;
+    std::vector<std::unique_ptr<ChunkColumn>> columns;
+    std::vector<Block> changes;
+    std::vector<Block> deferred;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(region_ticker)
+
+BOOST_AUTO_TEST_CASE(changes_come_in_region_order)
+{
+    boost::asio::io_service ioService;
+    Workers workers(ioService, 3);
+    Row serial(ioService);
+    serial.ticker.tick();
+    BOOST_CHECK_EQUAL(serial.ticker.getStats().regions, 4u);
+    BOOST_CHECK_EQUAL(serial.ticker.getStats().columns, 8u);
+    BOOST_CHECK_EQUAL(serial.ticker.getStats().threads, 1u);
+    // Column 0 sets air, which is no change
+    BOOST_CHECK_EQUAL(serial.changes.size(), 7u);
+    BOOST_CHECK(serial.changes[0] == Block(SIZE / 2 * 16 + 1, 2, 3, 0));
+    BOOST_CHECK_EQUAL(serial.columns[1]->getBlock(1, 2, 3), SIZE / 2);
+    // Other regions are only set at the end, loaded or not
+    BOOST_REQUIRE_EQUAL(serial.deferred.size(), 8u);
+    BOOST_CHECK(serial.deferred[0] == Block(SIZE * 16, 4, 0, 7));
+    BOOST_CHECK_EQUAL(serial.columns[2]->getBlock(0, 4, 0), 0);
+    BOOST_CHECK_EQUAL(serial.ticker.getStats().messages, 8u);
+
+    // The same on every thread
+    Row parallel(ioService);
+    parallel.ticker.setThreads(4);
+    parallel.ticker.setTicker(
+        [](ChunkColumn &column, RegionTicker::Region &region) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::int32_t x = column.getX() * 16;
+            region.setBlock(x + 1, 2, 3, static_cast<BlockId>(column.getX()));
+            region.setBlock(x + SIZE * 16, 4, 0, 7);
+        });
+    parallel.ticker.tick();
+    parallel.changes.clear();
+    parallel.deferred.clear();
+    for(auto &item : parallel.columns)
+        item->setBlock(1, 2, 3, 0);
+    parallel.ticker.tick();
+    BOOST_CHECK_GT(parallel.ticker.getStats().threads, 1u);
+    BOOST_CHECK_EQUAL(parallel.ticker.getStats().parallelTicks, 1u);
+    BOOST_CHECK(parallel.changes == serial.changes);
+    BOOST_CHECK(parallel.deferred == serial.deferred);
+}
+
+BOOST_AUTO_TEST_CASE(cheap_ticks_stay_on_the_tick_thread)
+{
+    // Nothing runs the io_service, so help would never come
+    boost::asio::io_service ioService;
+    Row row(ioService);
+    row.ticker.setThreads(4);
+    row.ticker.setTicker([](ChunkColumn &, RegionTicker::Region &) {});
+    for(int i = 0; i < 10; i++)
+        row.ticker.tick();
+    BOOST_CHECK_EQUAL(row.ticker.getStats().ticks, 10u);
+    BOOST_CHECK_EQUAL(row.ticker.getStats().parallelTicks, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(empty_regions_are_dropped)
+{
+    boost::asio::io_service ioService;
+    Row row(ioService);
+    row.ticker.remove(0, 0);
+    row.ticker.remove(0, 0);
+    BOOST_CHECK_EQUAL(row.ticker.getStats().columns, 7u);
+    BOOST_CHECK_EQUAL(row.ticker.getStats().regions, 4u);
+    row.ticker.remove(SIZE / 2, 0);
+    BOOST_CHECK_EQUAL(row.ticker.getStats().regions, 3u);
+    row.ticker.tick();
+    BOOST_CHECK_EQUAL(row.changes.size(), 6u);
+    BOOST_CHECK_EQUAL(row.deferred.size(), 6u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
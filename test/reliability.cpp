@@ -0,0 +1,379 @@
+/*
+ * Tests for the RakNet reliability layer over a simulated network.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/reliability.h"
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace
+{
+
+using Clock = cenisys::Reliability::Clock;
+
+//!
+//! \brief Two connections joined by a lossy, reordering link.
+//!
+//! Everything is driven by a seeded generator and a simulated clock, so a
+//! run is fully reproducible.
+//!
+class Simulation
+{
+public:
+    struct Link
+    {
+        double loss = 0;
+        double duplicate = 0;
+        //! Chance of an extra random delay, which reorders datagrams.
+        double reorder = 0;
+        Clock::duration latency = std::chrono::milliseconds(20);
+    };
+
+    Simulation(const Link &link, std::uint32_t seed)
+        : _link(link), _random(seed), _now(), _sent(0), _pool(2048, 64, 4096),
+          a(_pool, 1492, _now, output(1),
+            [this](const cenisys::PacketBuffer &packet) {
+                receivedByA.emplace_back(packet.data(),
+                                         packet.data() + packet.size());
+            }),
+          b(_pool, 1492, _now, output(0),
+            [this](const cenisys::PacketBuffer &packet) {
+                receivedByB.emplace_back(packet.data(),
+                                         packet.data() + packet.size());
+            })
+    {
+    }
+
+    //!
+    //! \brief Run until the condition holds or the time runs out.
+    //!
+    template <typename Fn>
+    bool runUntil(Fn &&done, Clock::duration limit = std::chrono::seconds(60))
+    {
+        Clock::time_point end = _now + limit;
+        while(_now < end)
+        {
+            if(done())
+                return true;
+            step();
+        }
+        return done();
+    }
+
+    void step()
+    {
+        _now += std::chrono::milliseconds(5);
+        for(auto it = _inFlight.begin(); it != _inFlight.end();)
+        {
+            if(it->arrival <= _now)
+            {
+                Datagram datagram = std::move(*it);
+                it = _inFlight.erase(it);
+                (datagram.to == 0 ? a : b)
+                    .receive(datagram.data.data(), datagram.data.size(), _now);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        a.update(_now);
+        b.update(_now);
+    }
+
+    std::size_t getSentDatagrams() const { return _sent; }
+    Clock::time_point now() const { return _now; }
+
+    std::vector<std::vector<std::uint8_t>> receivedByA;
+    std::vector<std::vector<std::uint8_t>> receivedByB;
+
+private:
+    struct Datagram
+    {
+        int to;
+        Clock::time_point arrival;
+        std::vector<std::uint8_t> data;
+    };
+
+    cenisys::Reliability::Callback output(int to)
+    {
+        return [this, to](const std::uint8_t *data, std::size_t size) {
+            _sent++;
+            std::uniform_real_distribution<double> chance;
+            if(chance(_random) < _link.loss)
+                return;
+            int copies = chance(_random) < _link.duplicate ? 2 : 1;
+            for(int i = 0; i < copies; i++)
+            {
+                Clock::duration delay = _link.latency;
+                if(chance(_random) < _link.reorder)
+                    delay += std::chrono::milliseconds(_random() % 100);
+                _inFlight.push_back(
+                    {to, _now + delay, std::vector<std::uint8_t>(
+                                           data, data + size)});
+            }
+        };
+    }
+
+    Link _link;
+    std::mt19937 _random;
+    Clock::time_point _now;
+    std::size_t _sent;
+    std::vector<Datagram> _inFlight;
+    cenisys::BufferPool _pool;
+
+public:
+    cenisys::Reliability a;
+    cenisys::Reliability b;
+};
+
+//! A packet which tells its index and can be verified.
+std::vector<std::uint8_t> makePacket(std::uint32_t index)
+{
+    std::vector<std::uint8_t> packet(4 + index * 37 % 3000);
+    for(std::size_t i = 0; i < packet.size(); i++)
+        packet[i] = static_cast<std::uint8_t>(index + i);
+    packet[0] = static_cast<std::uint8_t>(index >> 24);
+    packet[1] = static_cast<std::uint8_t>(index >> 16);
+    packet[2] = static_cast<std::uint8_t>(index >> 8);
+    packet[3] = static_cast<std::uint8_t>(index);
+    return packet;
+}
+
+std::uint32_t packetIndex(const std::vector<std::uint8_t> &packet)
+{
+    return static_cast<std::uint32_t>(packet[0]) << 24 |
+           static_cast<std::uint32_t>(packet[1]) << 16 |
+           static_cast<std::uint32_t>(packet[2]) << 8 | packet[3];
+}
+
+void sendPackets(cenisys::Reliability &reliability, std::uint32_t count,
+                 cenisys::raknet::Reliability type)
+{
+    for(std::uint32_t i = 0; i < count; i++)
+    {
+        std::vector<std::uint8_t> packet = makePacket(i);
+        BOOST_REQUIRE(reliability.send(packet.data(), packet.size(), type));
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(reliability)
+
+BOOST_AUTO_TEST_CASE(ordered_under_loss_and_reordering)
+{
+    Simulation::Link link;
+    link.loss = 0.2;
+    link.reorder = 0.2;
+    Simulation simulation(link, 1);
+    constexpr std::uint32_t count = 2000;
+    sendPackets(simulation.a, count,
+                cenisys::raknet::Reliability::ReliableOrdered);
+
+    BOOST_REQUIRE(simulation.runUntil(
+        [&] { return simulation.receivedByB.size() >= count; }));
+    // Nothing more may arrive after everything was delivered
+    simulation.runUntil([] { return false; }, std::chrono::seconds(5));
+    BOOST_REQUIRE_EQUAL(simulation.receivedByB.size(), count);
+    for(std::uint32_t i = 0; i < count; i++)
+        BOOST_REQUIRE(simulation.receivedByB[i] == makePacket(i));
+    BOOST_CHECK_EQUAL(simulation.a.getDatagramsInFlight(), 0u);
+    BOOST_CHECK_EQUAL(simulation.a.getQueuedPackets(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(reliable_without_duplicates)
+{
+    Simulation::Link link;
+    link.loss = 0.1;
+    link.duplicate = 0.1;
+    link.reorder = 0.3;
+    Simulation simulation(link, 2);
+    constexpr std::uint32_t count = 1000;
+    sendPackets(simulation.a, count, cenisys::raknet::Reliability::Reliable);
+
+    simulation.runUntil([] { return false; }, std::chrono::seconds(30));
+    BOOST_REQUIRE_EQUAL(simulation.receivedByB.size(), count);
+    std::set<std::uint32_t> indices;
+    for(const auto &packet : simulation.receivedByB)
+    {
+        BOOST_REQUIRE(packet == makePacket(packetIndex(packet)));
+        indices.insert(packetIndex(packet));
+    }
+    BOOST_CHECK_EQUAL(indices.size(), count);
+}
+
+BOOST_AUTO_TEST_CASE(sequenced_only_moves_forward)
+{
+    Simulation::Link link;
+    link.loss = 0.2;
+    link.reorder = 0.5;
+    Simulation simulation(link, 3);
+    constexpr std::uint32_t count = 500;
+    for(std::uint32_t i = 0; i < count; i++)
+    {
+        std::vector<std::uint8_t> packet = makePacket(i);
+        packet.resize(4);
+        simulation.a.send(packet.data(), packet.size(),
+                          cenisys::raknet::Reliability::UnreliableSequenced);
+        simulation.step();
+    }
+    simulation.runUntil([] { return false; }, std::chrono::seconds(1));
+
+    BOOST_CHECK(!simulation.receivedByB.empty());
+    BOOST_CHECK_LT(simulation.receivedByB.size(), count);
+    for(std::size_t i = 1; i < simulation.receivedByB.size(); i++)
+    {
+        BOOST_REQUIRE_LT(packetIndex(simulation.receivedByB[i - 1]),
+                         packetIndex(simulation.receivedByB[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(both_directions)
+{
+    Simulation::Link link;
+    link.loss = 0.3;
+    Simulation simulation(link, 4);
+    constexpr std::uint32_t count = 300;
+    sendPackets(simulation.a, count,
+                cenisys::raknet::Reliability::ReliableOrdered);
+    sendPackets(simulation.b, count,
+                cenisys::raknet::Reliability::ReliableOrdered);
+
+    BOOST_REQUIRE(simulation.runUntil([&] {
+        return simulation.receivedByA.size() >= count &&
+               simulation.receivedByB.size() >= count;
+    }));
+    for(std::uint32_t i = 0; i < count; i++)
+    {
+        BOOST_REQUIRE(simulation.receivedByA[i] == makePacket(i));
+        BOOST_REQUIRE(simulation.receivedByB[i] == makePacket(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(runs_are_deterministic)
+{
+    Simulation::Link link;
+    link.loss = 0.25;
+    link.duplicate = 0.05;
+    link.reorder = 0.25;
+    std::size_t sent[2];
+    for(auto &item : sent)
+    {
+        Simulation simulation(link, 5);
+        sendPackets(simulation.a, 500,
+                    cenisys::raknet::Reliability::ReliableOrdered);
+        BOOST_REQUIRE(simulation.runUntil(
+            [&] { return simulation.receivedByB.size() >= 500; }));
+        item = simulation.getSentDatagrams();
+    }
+    BOOST_CHECK_EQUAL(sent[0], sent[1]);
+}
+
+BOOST_AUTO_TEST_CASE(acks_are_coalesced_into_ranges)
+{
+    std::vector<std::vector<std::uint8_t>> output;
+    Clock::time_point now;
+    cenisys::BufferPool pool(2048, 16, 16);
+    cenisys::Reliability receiver(
+        pool, 1492, now,
+        [&](const std::uint8_t *data, std::size_t size) {
+            output.emplace_back(data, data + size);
+        },
+        [](const cenisys::PacketBuffer &packet) {});
+    // Datagrams 0-4 and 7, each with an unreliable packet
+    for(std::uint8_t sequence : {0, 1, 2, 3, 4, 7})
+    {
+        std::uint8_t datagram[] = {0x84, sequence, 0x00, 0x00,
+                                   0x00, 0x00,     0x08, 0x2a};
+        receiver.receive(datagram, sizeof(datagram), now);
+    }
+    receiver.update(now);
+
+    BOOST_REQUIRE_EQUAL(output.size(), 2u);
+    std::vector<std::uint8_t> ack = {0xc0, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+                                     0x04, 0x00, 0x00, 0x01, 0x07, 0x00, 0x00};
+    BOOST_CHECK(output[0] == ack);
+    std::vector<std::uint8_t> nack = {0xa0, 0x00, 0x01, 0x00, 0x05,
+                                      0x00, 0x00, 0x06, 0x00, 0x00};
+    BOOST_CHECK(output[1] == nack);
+
+    const cenisys::Reliability::Stats &stats = receiver.getStats();
+    BOOST_CHECK_EQUAL(stats.datagramsReceived, 6u);
+    BOOST_CHECK_EQUAL(stats.datagramsLost, 2u);
+    BOOST_CHECK_EQUAL(stats.bytesReceived, 6 * 8u);
+    BOOST_CHECK_EQUAL(stats.bytesSent, ack.size() + nack.size());
+    BOOST_CHECK_EQUAL(stats.datagramsSent, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(stats_count_resends_and_losses)
+{
+    Simulation::Link link;
+    link.loss = 0.2;
+    Simulation lossy(link, 7);
+    Simulation clean(Simulation::Link(), 7);
+    for(Simulation *simulation : {&lossy, &clean})
+    {
+        sendPackets(simulation->a, 500,
+                    cenisys::raknet::Reliability::ReliableOrdered);
+        BOOST_REQUIRE(simulation->runUntil(
+            [&] { return simulation->receivedByB.size() >= 500; }));
+        // Let the last acknowledgements arrive
+        simulation->runUntil([] { return false; }, std::chrono::seconds(1));
+    }
+
+    const cenisys::Reliability::Stats &sent = lossy.a.getStats();
+    const cenisys::Reliability::Stats &received = lossy.b.getStats();
+    BOOST_CHECK_GT(sent.datagramsResent, 0u);
+    BOOST_CHECK_GT(received.datagramsLost, 0u);
+    BOOST_CHECK_LT(received.datagramsReceived, sent.datagramsSent);
+    BOOST_CHECK_EQUAL(clean.a.getStats().datagramsResent, 0u);
+    BOOST_CHECK_EQUAL(clean.b.getStats().datagramsLost, 0u);
+    BOOST_CHECK_EQUAL(clean.b.getStats().datagramsReceived,
+                      clean.a.getStats().datagramsSent);
+    BOOST_CHECK_EQUAL(clean.a.getStats().bytesSent +
+                          clean.b.getStats().bytesSent,
+                      clean.a.getStats().bytesReceived +
+                          clean.b.getStats().bytesReceived);
+}
+
+BOOST_AUTO_TEST_CASE(resend_timeout_follows_rtt)
+{
+    Simulation::Link link;
+    link.latency = std::chrono::milliseconds(40);
+    Simulation simulation(link, 6);
+    sendPackets(simulation.a, 200, cenisys::raknet::Reliability::Reliable);
+    BOOST_REQUIRE(simulation.runUntil(
+        [&] { return simulation.receivedByB.size() >= 200; }));
+    simulation.runUntil([] { return false; }, std::chrono::seconds(1));
+
+    auto rtt = std::chrono::duration_cast<std::chrono::milliseconds>(
+        simulation.a.getRoundTripTime());
+    BOOST_CHECK_GE(rtt.count(), 80);
+    BOOST_CHECK_LE(rtt.count(), 100);
+    BOOST_CHECK(simulation.a.getResendTimeout() >
+                simulation.a.getRoundTripTime());
+    BOOST_CHECK(simulation.a.getResendTimeout() < std::chrono::seconds(1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,257 @@
+/*
+ * Tests for the shutdown sequence.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "command/commandsender.h"
+#include "server/server.h"
+#include "tempdirectoryfixture.h"
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/locale/generator.hpp>
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+class CaptureConsole : public cenisys::ConsoleBackend
+{
+public:
+    void attach(cenisys::Console &console) {}
+    void detach() {}
+    void log(const boost::locale::format &content)
+    {
+        std::lock_guard<std::mutex> lock(_linesLock);
+        _lines.push_back(content.str());
+    }
+
+    bool contains(const std::string &text)
+    {
+        std::lock_guard<std::mutex> lock(_linesLock);
+        for(const auto &item : _lines)
+        {
+            if(item.find(text) != std::string::npos)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::string> _lines;
+    std::mutex _linesLock;
+};
+
+class TestSender : public cenisys::CommandSender
+{
+public:
+    TestSender(cenisys::Server &server) : _server(server) {}
+    cenisys::Server &getServer() { return _server; }
+    void sendMessage(const boost::locale::format &content) {}
+
+private:
+    cenisys::Server &_server;
+};
+
+struct ServerFixture : cenisys::TempDirectoryFixture
+{
+    ServerFixture()
+    {
+        std::locale::global(localeGen(""));
+        boost::filesystem::create_directories(directory / "config");
+        boost::filesystem::ofstream config(directory / "config" /
+                                           "cenisys.yml");
+        config << "console:\n"
+                  "  enable: false\n"
+                  "network:\n"
+                  "  enable: false\n"
+                  "threads: 2\n"
+                  "shutdown:\n"
+                  "  timeout: 0.5\n";
+    }
+
+    boost::locale::generator localeGen;
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(server_shutdown, ServerFixture)
+
+BOOST_AUTO_TEST_CASE(clean_stop)
+{
+    CaptureConsole console;
+    cenisys::Server server(directory, localeGen);
+    server.registerConsole(console);
+    server.registerStartupTask("test", {}, [&server] { server.terminate(); });
+    BOOST_CHECK_EQUAL(server.run(), 0);
+    BOOST_CHECK(console.contains("Server successfully terminated."));
+}
+
+BOOST_AUTO_TEST_CASE(failed_startup_is_reported)
+{
+    CaptureConsole console;
+    cenisys::Server server(directory, localeGen);
+    server.registerConsole(console);
+    server.registerStartupTask(
+        "test", {}, [] { throw std::runtime_error("cannot start"); });
+    BOOST_CHECK_EQUAL(server.run(), 2);
+    BOOST_CHECK(console.contains("Failed to start the server."));
+}
+
+BOOST_AUTO_TEST_CASE(hung_handler_is_abandoned)
+{
+    CaptureConsole console;
+    auto server = std::make_unique<cenisys::Server>(directory, localeGen);
+    server->registerConsole(console);
+    std::promise<void> started, hanging, release;
+    std::shared_future<void> released = release.get_future().share();
+    server->registerStartupTask("test", {},
+                                [&started] { started.set_value(); });
+    server->registerCommand(
+        "hang", boost::locale::translate("Hang forever"),
+        [&](cenisys::CommandSender &sender, const std::string &command) {
+            hanging.set_value();
+            released.wait();
+        });
+
+    int result = -1;
+    std::thread runner([&] { result = server->run(); });
+    started.get_future().wait();
+    TestSender sender(*server);
+    std::thread caller([&] {
+        server->processEvent([&] { server->dispatchCommand(sender, "hang"); });
+    });
+    hanging.get_future().wait();
+
+    auto begin = std::chrono::steady_clock::now();
+    server->terminate();
+    runner.join();
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    BOOST_CHECK_EQUAL(result, 1);
+    BOOST_CHECK(elapsed < std::chrono::seconds(2));
+    BOOST_CHECK(console.contains("command hang"));
+
+    release.set_value();
+    caller.join();
+    server.reset();
+}
+
+BOOST_AUTO_TEST_CASE(events_posted_before_the_stop_run)
+{
+    CaptureConsole console;
+    cenisys::Server server(directory, localeGen);
+    server.registerConsole(console);
+    std::promise<void> started, busy, release;
+    server.registerStartupTask("test", {},
+                               [&started] { started.set_value(); });
+
+    int result = -1;
+    std::thread runner([&] { result = server.run(); });
+    started.get_future().wait();
+    // Holds the state so the others queue up behind it, then stops with
+    // its thread free to take the state right away
+    std::thread holder([&] {
+        server.processEvent([&] {
+            busy.set_value();
+            release.get_future().wait();
+            server.terminate();
+        });
+    });
+    busy.get_future().wait();
+    std::atomic<std::size_t> ran{0};
+    std::vector<std::thread> callers;
+    for(std::size_t i = 0; i < 4; i++)
+        callers.emplace_back([&] { server.processEvent([&] { ran++; }); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    release.set_value();
+    runner.join();
+    holder.join();
+    for(auto &item : callers)
+        item.join();
+
+    BOOST_CHECK_EQUAL(result, 0);
+    BOOST_CHECK_EQUAL(ran.load(), 4u);
+    BOOST_CHECK(!console.contains("Dropped"));
+}
+
+BOOST_AUTO_TEST_CASE(events_posted_while_stopping_are_reported)
+{
+    CaptureConsole console;
+    cenisys::Server server(directory, localeGen);
+    server.registerConsole(console);
+    server.registerStartupTask("test", {}, [&server] { server.terminate(); });
+    bool ran = false;
+    server.registerShutdownTask("test", {}, [&] {
+        std::thread caller([&] { server.processEvent([&] { ran = true; }); });
+        caller.join();
+    });
+    BOOST_CHECK_EQUAL(server.run(), 0);
+    BOOST_CHECK(!ran);
+    BOOST_CHECK(console.contains("Dropped 1 event while stopping."));
+}
+
+BOOST_AUTO_TEST_CASE(commands_never_run_during_ticks)
+{
+    cenisys::Server server(directory, localeGen);
+    std::promise<void> started;
+    server.registerStartupTask("test", {},
+                               [&started] { started.set_value(); });
+    // Plain tick state, as the world keeps it
+    bool ticking = false;
+    std::size_t ticks = 0;
+    server.registerTickHandler([&] {
+        ticking = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ticks++;
+        ticking = false;
+    });
+    std::atomic<std::size_t> overlaps{0};
+    std::size_t observed = 0;
+    server.registerCommand(
+        "observe", boost::locale::translate("Look at the tick"),
+        [&](cenisys::CommandSender &sender, const std::string &command) {
+            if(ticking)
+                overlaps++;
+            observed = ticks;
+        });
+
+    int result = -1;
+    std::thread runner([&] { result = server.run(); });
+    started.get_future().wait();
+    TestSender sender(server);
+    while(observed < 5)
+    {
+        server.processEvent(
+            [&] { server.dispatchCommand(sender, "observe"); });
+    }
+    server.terminate();
+    runner.join();
+
+    BOOST_CHECK_EQUAL(result, 0);
+    BOOST_CHECK_EQUAL(overlaps, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,184 @@
+/*
+ * Tests for the task graph.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server/taskgraph.h"
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using cenisys::TaskGraph;
+
+namespace
+{
+
+//!
+//! \brief Runs a graph with every task run where it is scheduled.
+//!
+//! So the tasks run in order of scheduling, and the handler is called
+//! before asyncRun() returns.
+//!
+struct InlineRun
+{
+    explicit InlineRun(const TaskGraph &graph) : calls(0)
+    {
+        graph.asyncRun([](std::function<void()> &&job) { job(); },
+                       [this](const TaskGraph::Result &value) {
+                           calls++;
+                           result = value;
+                       });
+    }
+
+    std::size_t calls;
+    TaskGraph::Result result;
+};
+
+//! Adds a task which records that it ran.
+void addTask(TaskGraph &graph, std::vector<std::string> &order,
+             const std::string &name,
+             const std::vector<std::string> &dependencies)
+{
+    BOOST_REQUIRE(graph.addTask(name, dependencies,
+                                [&order, name] { order.push_back(name); }));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(task_graph)
+
+BOOST_AUTO_TEST_CASE(diamond_runs_in_order)
+{
+    TaskGraph graph;
+    std::vector<std::string> order;
+    addTask(graph, order, "start", {});
+    addTask(graph, order, "fast", {"start"});
+    BOOST_REQUIRE(graph.addTask("slow", {"start"}, [&order] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        order.push_back("slow");
+    }));
+    addTask(graph, order, "end", {"fast", "slow"});
+    BOOST_CHECK(!graph.addTask("end", {}, [] {}));
+
+    InlineRun run(graph);
+    BOOST_CHECK_EQUAL(run.calls, 1u);
+    BOOST_CHECK(run.result.failedTask.empty());
+    BOOST_CHECK(!run.result.error);
+    std::vector<std::string> expected{"start", "fast", "slow", "end"};
+    BOOST_CHECK(order == expected);
+    BOOST_REQUIRE_EQUAL(run.result.tasks.size(), 4u);
+    for(std::size_t i = 0; i < expected.size(); i++)
+        BOOST_CHECK_EQUAL(run.result.tasks[i].name, expected[i]);
+    // The slow branch finished last, so it held up the end
+    std::vector<std::string> path{"start", "slow", "end"};
+    BOOST_CHECK(run.result.criticalPath == path);
+    BOOST_CHECK(run.result.duration >= std::chrono::milliseconds(10));
+
+    // Without the slow branch, the fast one is what the end waited for
+    BOOST_CHECK(graph.removeTask("slow"));
+    BOOST_CHECK(!graph.removeTask("slow"));
+    BOOST_REQUIRE(graph.removeTask("end"));
+    addTask(graph, order, "end", {"fast"});
+    order.clear();
+    InlineRun again(graph);
+    expected = {"start", "fast", "end"};
+    BOOST_CHECK(order == expected);
+    BOOST_CHECK(again.result.criticalPath == expected);
+}
+
+BOOST_AUTO_TEST_CASE(empty_graph_completes)
+{
+    TaskGraph graph;
+    InlineRun run(graph);
+    BOOST_CHECK_EQUAL(run.calls, 1u);
+    BOOST_CHECK(!run.result.error);
+    BOOST_CHECK(run.result.tasks.empty());
+    BOOST_CHECK(run.result.criticalPath.empty());
+}
+
+BOOST_AUTO_TEST_CASE(cycle_runs_nothing)
+{
+    TaskGraph graph;
+    std::vector<std::string> order;
+    addTask(graph, order, "free", {});
+    addTask(graph, order, "first", {"second"});
+    addTask(graph, order, "second", {"first"});
+
+    InlineRun run(graph);
+    BOOST_CHECK_EQUAL(run.calls, 1u);
+    BOOST_CHECK(order.empty());
+    BOOST_CHECK(run.result.tasks.empty());
+    BOOST_CHECK(run.result.failedTask == "first" ||
+                run.result.failedTask == "second");
+    BOOST_REQUIRE(run.result.error);
+    BOOST_CHECK_THROW(std::rethrow_exception(run.result.error),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(unknown_dependency_runs_nothing)
+{
+    TaskGraph graph;
+    std::vector<std::string> order;
+    addTask(graph, order, "free", {});
+    addTask(graph, order, "lost", {"free", "missing"});
+
+    InlineRun run(graph);
+    BOOST_CHECK_EQUAL(run.calls, 1u);
+    BOOST_CHECK(order.empty());
+    BOOST_CHECK_EQUAL(run.result.failedTask, "lost");
+    BOOST_REQUIRE(run.result.error);
+    try
+    {
+        std::rethrow_exception(run.result.error);
+    }
+    catch(const std::invalid_argument &e)
+    {
+        BOOST_CHECK_NE(std::string(e.what()).find("missing"),
+                       std::string::npos);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(failed_task_stops_its_dependents)
+{
+    TaskGraph graph;
+    std::vector<std::string> order;
+    addTask(graph, order, "start", {});
+    BOOST_REQUIRE(graph.addTask("broken", {"start"}, [&order] {
+        order.push_back("broken");
+        throw std::runtime_error("broken");
+    }));
+    addTask(graph, order, "after", {"broken"});
+    addTask(graph, order, "end", {"after"});
+
+    InlineRun run(graph);
+    BOOST_CHECK_EQUAL(run.calls, 1u);
+    std::vector<std::string> expected{"start", "broken"};
+    BOOST_CHECK(order == expected);
+    // The failed task still counts as finished
+    BOOST_CHECK_EQUAL(run.result.tasks.size(), 2u);
+    BOOST_CHECK_EQUAL(run.result.failedTask, "broken");
+    BOOST_REQUIRE(run.result.error);
+    BOOST_CHECK_THROW(std::rethrow_exception(run.result.error),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
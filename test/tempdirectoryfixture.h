@@ -0,0 +1,54 @@
+/*
+ * TempDirectoryFixture
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CENISYS_TEMPDIRECTORYFIXTURE_H
+#define CENISYS_TEMPDIRECTORYFIXTURE_H
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+namespace cenisys
+{
+
+//!
+//! \brief Creates an empty directory for a test, and removes it with
+//! everything in it afterwards.
+//!
+//! Fixtures deriving from it are done with the directory before it is
+//! removed.
+//!
+struct TempDirectoryFixture
+{
+    TempDirectoryFixture()
+        : directory(boost::filesystem::temp_directory_path() /
+                    boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(directory);
+    }
+    ~TempDirectoryFixture() { boost::filesystem::remove_all(directory); }
+    TempDirectoryFixture(const TempDirectoryFixture &) = delete;
+    TempDirectoryFixture &operator=(const TempDirectoryFixture &) = delete;
+
+    boost::filesystem::path directory;
+};
+
+} // namespace cenisys
+
+#endif // CENISYS_TEMPDIRECTORYFIXTURE_H
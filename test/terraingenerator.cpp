@@ -0,0 +1,177 @@
+/*
+ * Tests for the noise and the terrain generator.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "world/simplexnoise.h"
+#include "world/terraingenerator.h"
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using cenisys::BlockId;
+using cenisys::ChunkColumn;
+using cenisys::ChunkSection;
+using cenisys::SimplexNoise;
+using cenisys::TerrainGenerator;
+
+namespace
+{
+
+//! True if every block id matches.
+bool sameBlocks(const ChunkColumn &a, const ChunkColumn &b)
+{
+    for(unsigned y = 0; y < ChunkColumn::HEIGHT; y++)
+    {
+        for(unsigned z = 0; z < ChunkSection::SIZE; z++)
+        {
+            for(unsigned x = 0; x < ChunkSection::SIZE; x++)
+            {
+                if(a.getBlock(x, y, z) != b.getBlock(x, y, z))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(terrain_generator)
+
+BOOST_AUTO_TEST_CASE(grid_matches_single_samples)
+{
+    for(std::uint32_t seed : {0u, 1u, 0xdeadbeefu})
+    {
+        SimplexNoise noise(seed);
+        // Not a multiple of the vector width, so the tail is covered
+        const std::size_t width = 37;
+        const std::size_t depth = 5;
+        // Exact coordinates, however this file contracts their arithmetic
+        const float x = -3.703125f, z = 12.25f, step = 0.171875f;
+        std::vector<float> grid(width * depth);
+        noise.sampleGrid(x, z, step, width, depth, grid.data());
+        for(std::size_t i = 0; i < depth; i++)
+        {
+            for(std::size_t j = 0; j < width; j++)
+            {
+                float expected =
+                    noise.sample(x + static_cast<float>(j) * step,
+                                 z + static_cast<float>(i) * step);
+                BOOST_CHECK_EQUAL(grid[i * width + j], expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(noise_is_the_same_on_every_build)
+{
+    // From a plain x86-64 build; FMA contraction changes the second and third
+    SimplexNoise noise(0xdeadbeefu);
+    BOOST_CHECK_EQUAL(noise.sample(0.5f, 0.25f), 0.712755382f);
+    BOOST_CHECK_EQUAL(noise.sample(-3.7f, 12.25f), -0.0752993301f);
+    BOOST_CHECK_EQUAL(noise.sample(1000.125f, -2000.75f), -0.136861667f);
+    BOOST_CHECK_EQUAL(noise.sample(-0.3f, -0.9f), 0.185037926f);
+}
+
+BOOST_AUTO_TEST_CASE(noise_depends_on_the_seed)
+{
+    SimplexNoise a(42), b(42), c(43);
+    std::vector<float> first(64 * 64), second(64 * 64), third(64 * 64);
+    a.sampleGrid(-100.0f, 50.0f, 0.37f, 64, 64, first.data());
+    b.sampleGrid(-100.0f, 50.0f, 0.37f, 64, 64, second.data());
+    c.sampleGrid(-100.0f, 50.0f, 0.37f, 64, 64, third.data());
+    BOOST_CHECK(first == second);
+    BOOST_CHECK(first != third);
+    float low = 0, high = 0;
+    for(float value : first)
+    {
+        BOOST_CHECK(value >= -1.0f && value <= 1.0f);
+        low = std::min(low, value);
+        high = std::max(high, value);
+    }
+    // Not flat either
+    BOOST_CHECK_LT(low, -0.5f);
+    BOOST_CHECK_GT(high, 0.5f);
+}
+
+BOOST_AUTO_TEST_CASE(generation_is_deterministic)
+{
+    TerrainGenerator generator(TerrainGenerator::parseSeed("test"));
+    TerrainGenerator same(TerrainGenerator::parseSeed("test"));
+    TerrainGenerator other(TerrainGenerator::parseSeed("other"));
+    ChunkColumn a(3, -5), b(3, -5), c(3, -5);
+    generator.generate(a);
+    same.generate(b);
+    other.generate(c);
+    BOOST_CHECK(sameBlocks(a, b));
+    BOOST_CHECK(!sameBlocks(a, c));
+}
+
+BOOST_AUTO_TEST_CASE(columns_follow_the_height_map)
+{
+    TerrainGenerator generator(1234);
+    for(std::int32_t cx : {0, -7, 40})
+    {
+        ChunkColumn column(cx, -cx);
+        generator.generate(column);
+        for(unsigned dz = 0; dz < ChunkSection::SIZE; dz++)
+        {
+            for(unsigned dx = 0; dx < ChunkSection::SIZE; dx++)
+            {
+                std::int32_t x = cx * 16 + static_cast<std::int32_t>(dx);
+                std::int32_t z = -cx * 16 + static_cast<std::int32_t>(dz);
+                unsigned top = generator.getHeight(x, z);
+                BOOST_REQUIRE_LT(top + 1, ChunkColumn::HEIGHT);
+                BOOST_CHECK_EQUAL(column.getBlock(dx, 0, dz), 7);
+                BlockId surface = column.getBlock(dx, top, dz);
+                BOOST_CHECK_NE(surface, ChunkSection::AIR);
+                BOOST_CHECK_NE(surface, 9);
+                if(top < TerrainGenerator::SEA_LEVEL)
+                {
+                    BOOST_CHECK(generator.getBiome(x, z) ==
+                                TerrainGenerator::Biome::Ocean);
+                    BOOST_CHECK_EQUAL(
+                        column.getBlock(dx, TerrainGenerator::SEA_LEVEL, dz),
+                        9);
+                }
+                BOOST_CHECK_EQUAL(column.getBlock(dx, top + 2, dz),
+                                  top + 2 <= TerrainGenerator::SEA_LEVEL
+                                      ? 9
+                                      : ChunkSection::AIR);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(seeds_from_text)
+{
+    BOOST_CHECK_EQUAL(TerrainGenerator::parseSeed("12345"), 12345u);
+    BOOST_CHECK_EQUAL(TerrainGenerator::parseSeed("-1"),
+                      std::numeric_limits<std::uint64_t>::max());
+    BOOST_CHECK_EQUAL(TerrainGenerator::parseSeed("world"),
+                      TerrainGenerator::parseSeed("world"));
+    BOOST_CHECK_NE(TerrainGenerator::parseSeed("world"),
+                   TerrainGenerator::parseSeed("World"));
+    BOOST_CHECK_NE(TerrainGenerator::parseSeed("12a"), 12u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
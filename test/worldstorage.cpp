@@ -0,0 +1,288 @@
+/*
+ * Tests for the region files and the world storage.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tempdirectoryfixture.h"
+#include "world/chunkcolumn.h"
+#include "world/regionfile.h"
+#include "world/worldstorage.h"
+#include <atomic>
+#include <boost/asio/io_service.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using cenisys::ChunkColumn;
+using cenisys::ChunkSection;
+using cenisys::RegionFile;
+using cenisys::TempDirectoryFixture;
+using cenisys::WorldStorage;
+
+namespace
+{
+
+//! Data which compresses poorly, taking the given number of sectors.
+std::vector<std::uint8_t> makeData(std::size_t sectors, std::uint32_t seed)
+{
+    std::vector<std::uint8_t> result(sectors * RegionFile::SECTOR_SIZE - 64);
+    for(auto &item : result)
+    {
+        seed = seed * 1103515245 + 12345;
+        item = static_cast<std::uint8_t>(seed >> 16);
+    }
+    return result;
+}
+
+//! Runs an io_service on a few threads until destroyed.
+struct Workers
+{
+    Workers(boost::asio::io_service &service, std::size_t count)
+        : ioService(service),
+          work(std::make_unique<boost::asio::io_service::work>(service))
+    {
+        for(std::size_t i = 0; i < count; i++)
+            threads.emplace_back([this] { ioService.run(); });
+    }
+    ~Workers()
+    {
+        work.reset();
+        for(auto &item : threads)
+            item.join();
+    }
+
+    boost::asio::io_service &ioService;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::vector<std::thread> threads;
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(world_storage, TempDirectoryFixture)
+
+BOOST_AUTO_TEST_CASE(region_reuses_freed_sectors)
+{
+    boost::filesystem::path path = directory / "r.0.0.region";
+    std::vector<std::uint8_t> big = makeData(3, 1);
+    std::vector<std::uint8_t> small = makeData(1, 2);
+    std::vector<std::uint8_t> data;
+    {
+        RegionFile region;
+        BOOST_REQUIRE(region.open(path));
+        BOOST_CHECK(!region.hasChunk(3, 4));
+        BOOST_CHECK(!region.read(3, 4, data));
+
+        BOOST_REQUIRE(region.write(3, 4, big.data(), big.size(), 1, 6));
+        BOOST_REQUIRE(region.write(31, 31, small.data(), small.size(), 1, 6));
+        BOOST_CHECK(region.read(3, 4, data));
+        BOOST_CHECK(data == big);
+
+        // Shrinking frees sectors, which the next write takes again
+        BOOST_REQUIRE(region.write(3, 4, small.data(), small.size(), 2, 6));
+        std::size_t sectors = region.getSectorCount();
+        BOOST_CHECK_EQUAL(region.getUsedSectors(),
+                          RegionFile::HEADER_SECTORS + 2);
+        BOOST_REQUIRE(region.write(0, 0, small.data(), small.size(), 1, 6));
+        BOOST_CHECK_EQUAL(region.getSectorCount(), sectors);
+
+        // Stale versions are dropped
+        BOOST_CHECK(region.write(3, 4, big.data(), big.size(), 1, 6));
+        BOOST_CHECK(region.read(3, 4, data));
+        BOOST_CHECK(data == small);
+    }
+
+    RegionFile region;
+    BOOST_REQUIRE(region.open(path));
+    BOOST_CHECK(region.read(0, 0, data));
+    BOOST_CHECK(data == small);
+    BOOST_CHECK(region.read(31, 31, data));
+    BOOST_CHECK(data == small);
+    BOOST_CHECK(!region.hasChunk(1, 0));
+}
+
+BOOST_AUTO_TEST_CASE(region_drops_broken_entries)
+{
+    boost::filesystem::path path = directory / "r.0.0.region";
+    std::vector<std::uint8_t> chunk = makeData(1, 3);
+    {
+        RegionFile region;
+        BOOST_REQUIRE(region.open(path));
+        BOOST_REQUIRE(region.write(0, 0, chunk.data(), chunk.size(), 0, 6));
+    }
+    {
+        // Point a second chunk at the same sector, and a third past the end
+        boost::filesystem::fstream file(path, std::ios::in | std::ios::out |
+                                                  std::ios::binary);
+        char entry[4];
+        file.read(entry, 4);
+        file.seekp(4);
+        file.write(entry, 4);
+        entry[2] = 100;
+        file.write(entry, 4);
+    }
+    RegionFile region;
+    BOOST_REQUIRE(region.open(path));
+    std::vector<std::uint8_t> data;
+    BOOST_CHECK(region.read(0, 0, data));
+    BOOST_CHECK(data == chunk);
+    BOOST_CHECK(!region.hasChunk(1, 0));
+    BOOST_CHECK(!region.hasChunk(2, 0));
+}
+
+BOOST_AUTO_TEST_CASE(storage_round_trips_columns)
+{
+    // The workers are joined before the storage is destroyed
+    boost::asio::io_service ioService;
+    WorldStorage storage(ioService);
+    Workers workers(ioService, 4);
+    BOOST_REQUIRE(storage.open(directory / "world", 2));
+
+    std::atomic<std::size_t> running(0), maxRunning(0);
+    std::vector<std::future<bool>> saves;
+    for(std::int32_t x = -40; x < 40; x += 3)
+    {
+        auto column = std::make_shared<ChunkColumn>(x, -x);
+        column->setBlock(1, 2, 3, static_cast<cenisys::BlockId>(x + 100));
+        auto promise = std::make_shared<std::promise<bool>>();
+        saves.push_back(promise->get_future());
+        storage.save(column, [&, promise](bool result) {
+            std::size_t now = ++running;
+            std::size_t max = maxRunning;
+            while(now > max && !maxRunning.compare_exchange_weak(max, now))
+                ;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            running--;
+            promise->set_value(result);
+        });
+    }
+    for(auto &item : saves)
+        BOOST_CHECK(item.get());
+    BOOST_CHECK_LE(maxRunning, 2u);
+    BOOST_CHECK(
+        boost::filesystem::exists(directory / "world" / "region" /
+                                  "r.-2.1.region"));
+
+    // Loaded straight from the files, after reopening
+    storage.close();
+    BOOST_REQUIRE(storage.open(directory / "world", 2));
+    for(std::int32_t x = -40; x < 40; x += 3)
+    {
+        std::promise<std::unique_ptr<ChunkColumn>> promise;
+        storage.load(x, -x, [&](std::unique_ptr<ChunkColumn> column) {
+            promise.set_value(std::move(column));
+        });
+        std::unique_ptr<ChunkColumn> column = promise.get_future().get();
+        BOOST_REQUIRE(column);
+        BOOST_CHECK_EQUAL(column->getX(), x);
+        BOOST_CHECK_EQUAL(column->getBlock(1, 2, 3), x + 100);
+    }
+    std::promise<std::unique_ptr<ChunkColumn>> missing;
+    storage.load(1000, 1000, [&](std::unique_ptr<ChunkColumn> column) {
+        missing.set_value(std::move(column));
+    });
+    BOOST_CHECK(!missing.get_future().get());
+    storage.close();
+}
+
+BOOST_AUTO_TEST_CASE(pending_saves_are_visible)
+{
+    // No threads, so nothing runs until the io_service does
+    boost::asio::io_service ioService;
+    WorldStorage storage(ioService);
+    BOOST_REQUIRE(storage.open(directory, 1));
+
+    auto first = std::make_shared<ChunkColumn>(5, 5);
+    first->setBlock(0, 0, 0, 1);
+    auto second = std::make_shared<ChunkColumn>(5, 5);
+    second->setBlock(0, 0, 0, 2);
+    std::vector<bool> results;
+    storage.save(first, [&](bool result) { results.push_back(result); });
+    storage.save(second, [&](bool result) { results.push_back(result); });
+    cenisys::BlockId loaded = 0;
+    storage.load(5, 5, [&](std::unique_ptr<ChunkColumn> column) {
+        loaded = column ? column->getBlock(0, 0, 0) : 0;
+    });
+    BOOST_CHECK_EQUAL(storage.getQueued(), 3u);
+    ioService.run();
+    BOOST_CHECK_EQUAL(loaded, 2);
+    BOOST_CHECK_EQUAL(results.size(), 2u);
+
+    // Queued requests are finished by close()
+    storage.load(5, 5, [&](std::unique_ptr<ChunkColumn> column) {
+        loaded = column ? column->getBlock(0, 0, 0) + 10 : 0;
+    });
+    storage.close();
+    BOOST_CHECK_EQUAL(loaded, 12);
+    storage.save(first, [&](bool result) { results.push_back(result); });
+    BOOST_REQUIRE_EQUAL(results.size(), 3u);
+    BOOST_CHECK(!results.back());
+}
+
+BOOST_AUTO_TEST_CASE(snapshots_keep_the_saved_blocks)
+{
+    boost::asio::io_service ioService;
+    WorldStorage storage(ioService);
+    BOOST_REQUIRE(storage.open(directory, 1));
+
+    ChunkColumn column(2, 3);
+    column.markSaved();
+    column.setBlock(0, 0, 0, 1);
+    column.setBlock(0, 20, 0, 1);
+    std::shared_ptr<const ChunkColumn> snapshot = column.snapshot();
+    BOOST_CHECK(&snapshot->getSection(0) == &column.getSection(0));
+    BOOST_CHECK_EQUAL(snapshot->getUnsavedSections(), 3);
+    column.markSaved();
+
+    // Written while the column goes on changing
+    std::vector<bool> results;
+    storage.save(snapshot, [&](bool result) { results.push_back(result); });
+    column.setBlock(0, 0, 0, 2);
+    column.setBlock(0, 40, 0, 2);
+    BOOST_CHECK(&snapshot->getSection(0) != &column.getSection(0));
+    BOOST_CHECK(&snapshot->getSection(1) == &column.getSection(1));
+    BOOST_CHECK_EQUAL(column.getUnsavedSections(), 5);
+    ioService.run();
+    BOOST_REQUIRE_EQUAL(results.size(), 1u);
+    BOOST_CHECK(results[0]);
+    BOOST_CHECK_EQUAL(snapshot->getBlock(0, 0, 0), 1);
+    BOOST_CHECK_EQUAL(snapshot->getBlock(0, 40, 0), ChunkSection::AIR);
+
+    storage.close();
+    BOOST_REQUIRE(storage.open(directory, 1));
+    std::promise<std::unique_ptr<ChunkColumn>> promise;
+    storage.load(2, 3, [&](std::unique_ptr<ChunkColumn> loaded) {
+        promise.set_value(std::move(loaded));
+    });
+    ioService.reset();
+    ioService.run();
+    std::unique_ptr<ChunkColumn> loaded = promise.get_future().get();
+    BOOST_REQUIRE(loaded);
+    BOOST_CHECK_EQUAL(loaded->getBlock(0, 0, 0), 1);
+    BOOST_CHECK_EQUAL(loaded->getBlock(0, 20, 0), 1);
+    BOOST_CHECK_EQUAL(loaded->getBlock(0, 40, 0), ChunkSection::AIR);
+    BOOST_CHECK_EQUAL(column.getBlock(0, 0, 0), 2);
+    storage.close();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,703 @@
+/*
+ * Load generator which connects simulated players to a server.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/batchcompressor.h"
+#include "network/binarystream.h"
+#include "network/mcpepackets.h"
+#include "network/packetbuffer.h"
+#include "network/raknet.h"
+#include "network/reliability.h"
+#include <algorithm>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    boost::asio::ip::udp::endpoint server;
+    std::size_t clients;
+    std::size_t threads;
+    double duration;
+    //! Time over which the clients connect.
+    double ramp;
+    std::size_t mtu;
+    //! Actions per second of every client.
+    double moveRate;
+    double chatRate;
+    double breakRate;
+    double pingRate;
+    int compressionLevel;
+    double timeout;
+};
+
+struct Stats
+{
+    std::size_t connected = 0;
+    std::size_t failed = 0;
+    std::size_t disconnected = 0;
+    std::size_t moves = 0;
+    std::size_t chats = 0;
+    std::size_t breaks = 0;
+    std::size_t gamePackets = 0;
+    std::size_t datagramsSent = 0;
+    std::size_t datagramsReceived = 0;
+    std::size_t bytesSent = 0;
+    std::size_t bytesReceived = 0;
+    //! Round trips of connected pings, in microseconds.
+    std::vector<std::uint32_t> roundTrips;
+
+    Stats &operator+=(const Stats &other)
+    {
+        connected += other.connected;
+        failed += other.failed;
+        disconnected += other.disconnected;
+        moves += other.moves;
+        chats += other.chats;
+        breaks += other.breaks;
+        gamePackets += other.gamePackets;
+        datagramsSent += other.datagramsSent;
+        datagramsReceived += other.datagramsReceived;
+        bytesSent += other.bytesSent;
+        bytesReceived += other.bytesReceived;
+        roundTrips.insert(roundTrips.end(), other.roundTrips.begin(),
+                          other.roundTrips.end());
+        return *this;
+    }
+};
+
+//!
+//! \brief Everything shared by the clients of one thread.
+//!
+struct Context
+{
+    Context(const Options &options, Clock::time_point epoch)
+        : options(options), epoch(epoch), pool(2048, 256, 65536),
+          compressor(ioService, 1)
+    {
+    }
+
+    const Options &options;
+    Clock::time_point epoch;
+    boost::asio::io_service ioService;
+    cenisys::BufferPool pool;
+    cenisys::BatchCompressor compressor;
+    Stats stats;
+};
+
+//!
+//! \brief A simulated player.
+//!
+//! Goes through the offline handshake, logs in and then moves, chats and
+//! breaks blocks at random times.
+//!
+class Bot
+{
+public:
+    Bot(Context &context, std::size_t index, Clock::time_point start)
+        : _context(context), _index(index), _random(index),
+          _socket(context.ioService), _state(State::Waiting),
+          _start(start), _guid(0x10000000000ull + index)
+    {
+        _position = {static_cast<float>(index % 64),
+                     64, static_cast<float>(index / 64)};
+    }
+
+    bool isDone() const
+    {
+        return _state == State::Closed || _state == State::Failed;
+    }
+
+    void update(Clock::time_point now)
+    {
+        switch(_state)
+        {
+        case State::Waiting:
+            if(now >= _start)
+                open(now);
+            break;
+        case State::Handshake1:
+        case State::Handshake2:
+            if(now - _lastReceive > seconds(5))
+                fail();
+            else if(now - _lastSend > std::chrono::milliseconds(500))
+                sendOfflineRequest(now);
+            break;
+        case State::Connecting:
+        case State::Playing:
+            if(now - _lastReceive > seconds(_context.options.timeout))
+            {
+                if(_state == State::Playing)
+                    _context.stats.disconnected++;
+                else
+                    _context.stats.failed++;
+                close();
+                return;
+            }
+            if(_state == State::Playing)
+                act(now);
+            _reliability->update(now);
+            break;
+        case State::Closed:
+        case State::Failed:
+            break;
+        }
+    }
+
+    //!
+    //! \brief Disconnect politely at the end of the run.
+    //!
+    void stop(Clock::time_point now)
+    {
+        if(_state == State::Connecting || _state == State::Playing)
+        {
+            std::uint8_t id = cenisys::raknet::DisconnectionNotification;
+            _reliability->send(&id, 1,
+                               cenisys::raknet::Reliability::ReliableOrdered);
+            _reliability->update(now);
+        }
+        if(!isDone())
+            close();
+    }
+
+private:
+    enum class State
+    {
+        Waiting,
+        Handshake1,
+        Handshake2,
+        Connecting,
+        Playing,
+        Closed,
+        Failed,
+    };
+
+    static Clock::duration seconds(double value)
+    {
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(value));
+    }
+
+    void open(Clock::time_point now)
+    {
+        boost::system::error_code ec;
+        _socket.open(_context.options.server.protocol(), ec);
+        if(!ec)
+            _socket.non_blocking(true, ec);
+        if(ec)
+        {
+            fail();
+            return;
+        }
+        _state = State::Handshake1;
+        _lastReceive = now;
+        sendOfflineRequest(now);
+        asyncReceive();
+    }
+
+    void fail()
+    {
+        _context.stats.failed++;
+        _state = State::Failed;
+        boost::system::error_code ec;
+        _socket.close(ec);
+    }
+
+    void close()
+    {
+        _state = State::Closed;
+        boost::system::error_code ec;
+        _socket.close(ec);
+    }
+
+    void asyncReceive()
+    {
+        _socket.async_receive(
+            boost::asio::null_buffers(),
+            [this](const boost::system::error_code &ec, std::size_t) {
+                if(ec || isDone())
+                    return;
+                receiveAll();
+                asyncReceive();
+            });
+    }
+
+    void receiveAll()
+    {
+        std::uint8_t buffer[2048];
+        for(;;)
+        {
+            boost::system::error_code ec;
+            boost::asio::ip::udp::endpoint from;
+            std::size_t size = _socket.receive_from(
+                boost::asio::buffer(buffer), from, 0, ec);
+            if(ec || isDone())
+                break;
+            _context.stats.datagramsReceived++;
+            _context.stats.bytesReceived += size;
+            handleDatagram(buffer, size, Clock::now());
+        }
+    }
+
+    void sendDatagram(const std::uint8_t *data, std::size_t size)
+    {
+        boost::system::error_code ec;
+        _socket.send_to(boost::asio::buffer(data, size),
+                        _context.options.server, 0, ec);
+        _context.stats.datagramsSent++;
+        _context.stats.bytesSent += size;
+    }
+
+    void sendOfflineRequest(Clock::time_point now)
+    {
+        std::uint8_t buffer[cenisys::raknet::MAX_MTU];
+        cenisys::BinaryWriter writer(buffer, sizeof(buffer));
+        if(_state == State::Handshake1)
+        {
+            writer.writeU8(cenisys::raknet::OpenConnectionRequest1);
+            cenisys::raknet::writeMagic(writer);
+            writer.writeU8(cenisys::raknet::PROTOCOL_VERSION);
+            // Padded to the MTU being tried
+            writer.skip(_context.options.mtu -
+                        cenisys::raknet::UDP_HEADER_SIZE - writer.size());
+        }
+        else
+        {
+            writer.writeU8(cenisys::raknet::OpenConnectionRequest2);
+            cenisys::raknet::writeMagic(writer);
+            cenisys::raknet::writeAddress(writer, _context.options.server);
+            writer.writeU16(static_cast<std::uint16_t>(_mtu));
+            writer.writeU64(_guid);
+        }
+        if(writer.ok())
+            sendDatagram(writer.data(), writer.size());
+        _lastSend = now;
+    }
+
+    void handleDatagram(const std::uint8_t *data, std::size_t size,
+                        Clock::time_point now)
+    {
+        if(size == 0)
+            return;
+        _lastReceive = now;
+        if(data[0] & cenisys::raknet::Valid)
+        {
+            if(_reliability)
+                _reliability->receive(data, size, now);
+            return;
+        }
+        cenisys::BinaryReader reader(data + 1, size - 1);
+        if(data[0] == cenisys::raknet::OpenConnectionReply1 &&
+           _state == State::Handshake1)
+        {
+            cenisys::raknet::readMagic(reader);
+            reader.readU64(); // Server GUID
+            reader.readU8();  // Security
+            _mtu = reader.readU16();
+            if(!reader.ok())
+                return;
+            _state = State::Handshake2;
+            sendOfflineRequest(now);
+        }
+        else if(data[0] == cenisys::raknet::OpenConnectionReply2 &&
+                _state == State::Handshake2)
+        {
+            _state = State::Connecting;
+            _reliability = std::make_unique<cenisys::Reliability>(
+                _context.pool, _mtu, now,
+                [this](const std::uint8_t *data, std::size_t size) {
+                    sendDatagram(data, size);
+                },
+                [this](const cenisys::PacketBuffer &packet) {
+                    handlePacket(packet, Clock::now());
+                });
+            std::uint8_t buffer[32];
+            cenisys::BinaryWriter writer(buffer, sizeof(buffer));
+            writer.writeU8(cenisys::raknet::ConnectionRequest);
+            writer.writeU64(_guid);
+            writer.writeU64(timestamp(now));
+            writer.writeU8(0); // No security
+            _reliability->send(writer.data(), writer.size(),
+                               cenisys::raknet::Reliability::Reliable);
+        }
+        else if(data[0] == cenisys::raknet::NoFreeIncomingConnections ||
+                data[0] == cenisys::raknet::IncompatibleProtocolVersion)
+        {
+            fail();
+        }
+    }
+
+    void handlePacket(const cenisys::PacketBuffer &packet,
+                      Clock::time_point now)
+    {
+        if(packet.size() == 0)
+            return;
+        cenisys::BinaryReader reader(packet.data() + 1, packet.size() - 1);
+        switch(packet.data()[0])
+        {
+        case cenisys::raknet::ConnectionRequestAccepted:
+            if(_state == State::Connecting)
+                login(now);
+            break;
+        case cenisys::raknet::ConnectedPing:
+        {
+            std::uint8_t buffer[17];
+            cenisys::BinaryWriter writer(buffer, sizeof(buffer));
+            writer.writeU8(cenisys::raknet::ConnectedPong);
+            writer.writeU64(reader.readU64());
+            writer.writeU64(timestamp(now));
+            _reliability->send(writer.data(), writer.size(),
+                               cenisys::raknet::Reliability::Unreliable);
+            break;
+        }
+        case cenisys::raknet::ConnectedPong:
+        {
+            std::uint64_t sent = reader.readU64();
+            std::uint64_t current = timestamp(now);
+            if(reader.ok() && sent <= current)
+            {
+                _context.stats.roundTrips.push_back(
+                    static_cast<std::uint32_t>(current - sent));
+            }
+            break;
+        }
+        case cenisys::raknet::DisconnectionNotification:
+            _context.stats.disconnected++;
+            close();
+            break;
+        case cenisys::raknet::GamePacket:
+            _context.stats.gamePackets++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void login(Clock::time_point now)
+    {
+        std::uint8_t buffer[256];
+        cenisys::BinaryWriter writer(buffer, sizeof(buffer));
+        writer.writeU8(cenisys::raknet::NewIncomingConnection);
+        cenisys::raknet::writeAddress(writer, _context.options.server);
+        boost::asio::ip::udp::endpoint unused(boost::asio::ip::udp::v4(), 0);
+        for(int i = 0; i < 10; i++)
+            cenisys::raknet::writeAddress(writer, unused);
+        writer.writeU64(timestamp(now));
+        writer.writeU64(timestamp(now));
+        _reliability->send(writer.data(), writer.size(),
+                           cenisys::raknet::Reliability::ReliableOrdered);
+
+        std::string payload = "loadgen-" + std::to_string(_index);
+        sendGame(cenisys::mcpe::LoginPacket{
+            cenisys::mcpe::PROTOCOL_VERSION, 0, payload});
+        _state = State::Playing;
+        _context.stats.connected++;
+        _nextMove = now + nextInterval(_context.options.moveRate);
+        _nextChat = now + nextInterval(_context.options.chatRate);
+        _nextBreak = now + nextInterval(_context.options.breakRate);
+        _nextPing = now + nextInterval(_context.options.pingRate);
+    }
+
+    void act(Clock::time_point now)
+    {
+        if(now >= _nextMove)
+        {
+            std::uniform_real_distribution<float> step(-0.2f, 0.2f);
+            _position.x += step(_random);
+            _position.z += step(_random);
+            _yaw = std::fmod(_yaw + 5, 360);
+            sendGame(cenisys::mcpe::MovePlayerPacket{
+                         _index, _position, 0, _yaw, _yaw,
+                         cenisys::mcpe::MovePlayerPacket::Normal, true},
+                     cenisys::raknet::Reliability::UnreliableSequenced);
+            _context.stats.moves++;
+            _nextMove = now + nextInterval(_context.options.moveRate);
+        }
+        if(now >= _nextChat)
+        {
+            std::string message = "Hello from bot " + std::to_string(_index);
+            sendGame(cenisys::mcpe::TextPacket{
+                cenisys::mcpe::TextPacket::Chat, "", message});
+            _context.stats.chats++;
+            _nextChat = now + nextInterval(_context.options.chatRate);
+        }
+        if(now >= _nextBreak)
+        {
+            std::uniform_int_distribution<int> offset(-4, 4);
+            sendGame(cenisys::mcpe::RemoveBlockPacket{
+                {static_cast<std::int32_t>(_position.x) + offset(_random),
+                 static_cast<std::uint32_t>(63 + offset(_random)),
+                 static_cast<std::int32_t>(_position.z) + offset(_random)}});
+            _context.stats.breaks++;
+            _nextBreak = now + nextInterval(_context.options.breakRate);
+        }
+        if(now >= _nextPing)
+        {
+            std::uint8_t buffer[9];
+            cenisys::BinaryWriter writer(buffer, sizeof(buffer));
+            writer.writeU8(cenisys::raknet::ConnectedPing);
+            writer.writeU64(timestamp(now));
+            _reliability->send(writer.data(), writer.size(),
+                               cenisys::raknet::Reliability::Unreliable);
+            _nextPing = now + nextInterval(_context.options.pingRate);
+        }
+    }
+
+    //!
+    //! \brief Send a game packet in a batch, like the client does.
+    //!
+    template <typename Packet>
+    void sendGame(const Packet &packet,
+                  cenisys::raknet::Reliability reliability =
+                      cenisys::raknet::Reliability::ReliableOrdered)
+    {
+        cenisys::PacketBuffer batch = _context.compressor.compressNow(
+            {cenisys::mcpe::encodePacket(_context.pool, packet)},
+            _context.options.compressionLevel);
+        _reliability->send(batch, reliability);
+    }
+
+    //!
+    //! \brief Random time until the next action, about 1 / rate.
+    //!
+    Clock::duration nextInterval(double rate)
+    {
+        if(rate <= 0)
+            return std::chrono::hours(24 * 365);
+        std::exponential_distribution<double> interval(rate);
+        return seconds(interval(_random));
+    }
+
+    std::uint64_t timestamp(Clock::time_point now) const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   now - _context.epoch)
+            .count();
+    }
+
+    Context &_context;
+    std::uint64_t _index;
+    std::mt19937 _random;
+    boost::asio::ip::udp::socket _socket;
+    State _state;
+    Clock::time_point _start;
+    Clock::time_point _lastSend;
+    Clock::time_point _lastReceive;
+    std::uint64_t _guid;
+    std::size_t _mtu;
+    std::unique_ptr<cenisys::Reliability> _reliability;
+    cenisys::mcpe::Vector3 _position;
+    float _yaw = 0;
+    Clock::time_point _nextMove;
+    Clock::time_point _nextChat;
+    Clock::time_point _nextBreak;
+    Clock::time_point _nextPing;
+};
+
+//!
+//! \brief Runs a share of the clients on its own thread.
+//!
+class Worker
+{
+public:
+    Worker(const Options &options, Clock::time_point epoch)
+        : _context(options, epoch), _timer(_context.ioService)
+    {
+    }
+
+    void addBot(std::size_t index, Clock::time_point start)
+    {
+        _bots.push_back(std::make_unique<Bot>(_context, index, start));
+    }
+
+    void run(Clock::time_point end)
+    {
+        _end = end;
+        asyncUpdate();
+        _context.ioService.run();
+    }
+
+    const Stats &getStats() const { return _context.stats; }
+
+private:
+    void asyncUpdate()
+    {
+        _timer.expires_from_now(cenisys::Reliability::TIMER_RESOLUTION);
+        _timer.async_wait([this](const boost::system::error_code &ec) {
+            if(ec)
+                return;
+            Clock::time_point now = Clock::now();
+            if(now >= _end)
+            {
+                // Closing the sockets lets the io_service run out of work
+                for(const auto &item : _bots)
+                    item->stop(now);
+                return;
+            }
+            for(const auto &item : _bots)
+                item->update(now);
+            asyncUpdate();
+        });
+    }
+
+    Context _context;
+    boost::asio::steady_timer _timer;
+    std::vector<std::unique_ptr<Bot>> _bots;
+    Clock::time_point _end;
+};
+
+double percentile(const std::vector<std::uint32_t> &sorted, double fraction)
+{
+    if(sorted.empty())
+        return 0;
+    std::size_t index =
+        static_cast<std::size_t>(fraction * (sorted.size() - 1));
+    return sorted[index] / 1000.0;
+}
+
+void report(const Options &options, Stats &stats, double seconds)
+{
+    std::sort(stats.roundTrips.begin(), stats.roundTrips.end());
+    std::size_t packets = stats.moves + stats.chats + stats.breaks;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "clients:    " << stats.connected << " of "
+              << options.clients << " connected, " << stats.failed
+              << " failed, " << stats.disconnected << " disconnected"
+              << std::endl;
+    std::cout << "sent:       " << packets / seconds << " packets/s ("
+              << stats.moves / seconds << " moves, " << stats.chats / seconds
+              << " chats, " << stats.breaks / seconds << " breaks), "
+              << stats.datagramsSent / seconds << " datagrams/s, "
+              << stats.bytesSent / seconds / 1024 << " KiB/s" << std::endl;
+    std::cout << "received:   " << stats.gamePackets / seconds
+              << " game packets/s, " << stats.datagramsReceived / seconds
+              << " datagrams/s, " << stats.bytesReceived / seconds / 1024
+              << " KiB/s" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "round trip: p50 " << percentile(stats.roundTrips, 0.5)
+              << " ms, p90 " << percentile(stats.roundTrips, 0.9)
+              << " ms, p99 " << percentile(stats.roundTrips, 0.99)
+              << " ms, max " << percentile(stats.roundTrips, 1) << " ms ("
+              << stats.roundTrips.size() << " samples)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::string address;
+    unsigned short port;
+    boost::program_options::options_description desc(
+        "Usage: cenisys-loadgen [options]");
+    namespace po = boost::program_options;
+    desc.add_options()("help,h", "display this help and exit")(
+        "address,a", po::value(&address)->default_value("127.0.0.1"),
+        "server address")(
+        "port,p", po::value(&port)->default_value(19132), "server port")(
+        "clients,n", po::value(&options.clients)->default_value(100),
+        "number of simulated players")(
+        "threads,t",
+        po::value(&options.threads)
+            ->default_value(std::max(1u, std::thread::hardware_concurrency())),
+        "number of client threads")(
+        "duration,d", po::value(&options.duration)->default_value(30),
+        "seconds to run")(
+        "ramp", po::value(&options.ramp)->default_value(5),
+        "seconds over which the clients connect")(
+        "mtu", po::value(&options.mtu)->default_value(1400), "MTU to ask for")(
+        "move-rate", po::value(&options.moveRate)->default_value(20),
+        "moves per second of every client")(
+        "chat-rate", po::value(&options.chatRate)->default_value(0.1),
+        "chat messages per second of every client")(
+        "break-rate", po::value(&options.breakRate)->default_value(0.5),
+        "broken blocks per second of every client")(
+        "ping-rate", po::value(&options.pingRate)->default_value(1),
+        "latency probes per second of every client")(
+        "compression-level",
+        po::value(&options.compressionLevel)->default_value(1),
+        "zlib level of the batches sent")(
+        "timeout", po::value(&options.timeout)->default_value(10),
+        "seconds of silence before a client counts as disconnected");
+    po::variables_map vm;
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+        options.server = boost::asio::ip::udp::endpoint(
+            boost::asio::ip::address::from_string(address), port);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if(vm.count("help"))
+    {
+        std::cout << desc;
+        return 0;
+    }
+    options.threads = std::max<std::size_t>(1, options.threads);
+    options.mtu = std::max(cenisys::raknet::MIN_MTU,
+                           std::min(cenisys::raknet::MAX_MTU, options.mtu));
+
+    Clock::time_point epoch = Clock::now();
+    Clock::time_point end =
+        epoch + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(options.duration));
+    std::vector<std::unique_ptr<Worker>> workers;
+    for(std::size_t i = 0; i < options.threads; i++)
+        workers.push_back(std::make_unique<Worker>(options, epoch));
+    for(std::size_t i = 0; i < options.clients; i++)
+    {
+        auto delay = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(options.ramp * i / options.clients));
+        workers[i % workers.size()]->addBot(i, epoch + delay);
+    }
+
+    std::vector<std::thread> threads;
+    for(const auto &item : workers)
+        threads.emplace_back([&item, end] { item->run(end); });
+    for(auto &item : threads)
+        item.join();
+
+    Stats total;
+    for(const auto &item : workers)
+        total += item->getStats();
+    report(options, total,
+           std::chrono::duration<double>(Clock::now() - epoch).count());
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * World pre-generation throughput tool.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "world/chunkcolumn.h"
+#include "world/simplexnoise.h"
+#include "world/terraingenerator.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using cenisys::TerrainGenerator;
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t BIOMES =
+    static_cast<std::size_t>(TerrainGenerator::Biome::Mountains) + 1;
+
+struct Stats
+{
+    std::size_t columns = 0;
+    std::size_t sections = 0;
+    Clock::duration time = Clock::duration::zero();
+    //! Columns by the biome at their centre.
+    std::array<std::size_t, BIOMES> biomes{};
+};
+
+//! Columns within the radius, nearest first, as a server would ask.
+std::vector<std::pair<std::int32_t, std::int32_t>> spiral(std::int32_t radius)
+{
+    std::vector<std::pair<std::int32_t, std::int32_t>> result;
+    for(std::int32_t z = -radius; z <= radius; z++)
+    {
+        for(std::int32_t x = -radius; x <= radius; x++)
+        {
+            if(x * x + z * z <= radius * radius)
+                result.emplace_back(x, z);
+        }
+    }
+    std::stable_sort(result.begin(), result.end(),
+                     [](const auto &a, const auto &b) {
+                         return a.first * a.first + a.second * a.second <
+                                b.first * b.first + b.second * b.second;
+                     });
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string seed;
+    std::int32_t radius;
+    std::size_t threads;
+    boost::program_options::options_description desc(
+        "Usage: cenisys-pregen [options]");
+    namespace po = boost::program_options;
+    desc.add_options()("help,h", "display this help and exit")(
+        "seed,s", po::value(&seed)->default_value("world"),
+        "world seed, a number or any text")(
+        "radius,r", po::value(&radius)->default_value(32),
+        "radius in columns around the origin")(
+        "threads,t",
+        po::value(&threads)->default_value(
+            std::max(1u, std::thread::hardware_concurrency())),
+        "number of generator threads");
+    po::variables_map vm;
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if(vm.count("help"))
+    {
+        std::cout << desc;
+        return 0;
+    }
+    threads = std::max<std::size_t>(1, threads);
+    radius = std::max(0, radius);
+
+    TerrainGenerator generator(TerrainGenerator::parseSeed(seed));
+    auto columns = spiral(radius);
+    std::atomic<std::size_t> next(0);
+    std::vector<Stats> stats(threads);
+    Clock::time_point begin = Clock::now();
+    std::vector<std::thread> workers;
+    for(std::size_t i = 0; i < threads; i++)
+    {
+        workers.emplace_back([&, i] {
+            Stats &local = stats[i];
+            for(std::size_t index = next++; index < columns.size();
+                index = next++)
+            {
+                Clock::time_point start = Clock::now();
+                cenisys::ChunkColumn column(columns[index].first,
+                                            columns[index].second);
+                generator.generate(column);
+                local.time += Clock::now() - start;
+                local.columns++;
+                for(std::size_t y = 0; y < cenisys::ChunkColumn::SECTIONS;
+                    y++)
+                {
+                    if(column.hasSection(y))
+                        local.sections++;
+                }
+                // The biome map is cheap next to the blocks
+                local.biomes[static_cast<std::size_t>(generator.getBiome(
+                    column.getX() * 16 + 8, column.getZ() * 16 + 8))]++;
+            }
+        });
+    }
+    for(auto &item : workers)
+        item.join();
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+
+    Stats total;
+    for(const auto &item : stats)
+    {
+        total.columns += item.columns;
+        total.sections += item.sections;
+        total.time += item.time;
+        for(std::size_t i = 0; i < BIOMES; i++)
+            total.biomes[i] += item.biomes[i];
+    }
+    double perColumn =
+        std::chrono::duration<double, std::milli>(total.time).count() /
+        std::max<std::size_t>(1, total.columns);
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "generated:  " << total.columns << " columns ("
+              << total.sections << " sections) in " << seconds << " s on "
+              << threads << " threads, noise using "
+              << cenisys::SimplexNoise::getInstructionSet() << std::endl;
+    std::cout << "throughput: " << total.columns / seconds << " columns/s, "
+              << perColumn << " ms per column per thread" << std::endl;
+    std::cout << "biomes:    ";
+    for(std::size_t i = 0; i < BIOMES; i++)
+    {
+        std::cout << " " << TerrainGenerator::getBiomeName(
+                                static_cast<TerrainGenerator::Biome>(i))
+                  << " " << 100.0 * total.biomes[i] / total.columns << "%";
+    }
+    std::cout << std::endl;
+    return 0;
+}
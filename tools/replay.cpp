@@ -0,0 +1,305 @@
+/*
+ * Replays captured traffic against a running world.
+ * Copyright (C) 2016 iTX Technologies
+ *
+ * This file is part of Cenisys.
+ *
+ * Cenisys is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cenisys is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Cenisys.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/networkmanager.h"
+#include "network/packetcapture.h"
+#include "network/packetdispatcher.h"
+#include "server/server.h"
+#include "world/world.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/locale/generator.hpp>
+#include <boost/program_options.hpp>
+#include <boost/scope_exit.hpp>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void interrupt(int signal) { interrupted = 1; }
+
+struct Options
+{
+    std::string capture;
+    //! Wait for the recorded time of every record.
+    bool realtime;
+    std::size_t repeat;
+};
+
+struct Stats
+{
+    std::size_t sessions = 0;
+    std::size_t packets = 0;
+    std::size_t bytes = 0;
+    //! Time of every tick, with the packets handled on it, in microseconds.
+    std::vector<double> ticks;
+    Clock::duration busy = Clock::duration::zero();
+    //! Part of the busy time spent in the packet handlers.
+    Clock::duration dispatch = Clock::duration::zero();
+};
+
+double toMicroseconds(Clock::duration duration)
+{
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+    if(sorted.empty())
+        return 0;
+    return sorted[static_cast<std::size_t>(fraction * (sorted.size() - 1))];
+}
+
+//!
+//! \brief Run a game tick with the records since the previous one.
+//!
+//! As the network does, the packets and closed sessions are handed to the
+//! world first, then every tick handler runs.
+//!
+void tick(cenisys::Server &server, cenisys::PacketDispatcher &dispatcher,
+          const std::vector<cenisys::PacketCaptureRecord> &records,
+          Stats &stats)
+{
+    server.processEvent([&] {
+        Clock::time_point start = Clock::now();
+        for(const auto &item : records)
+        {
+            switch(item.type)
+            {
+            case cenisys::PacketCaptureRecord::Type::Receive:
+                dispatcher.dispatch(item.session, item.packet);
+                stats.packets++;
+                stats.bytes += item.packet.size();
+                break;
+            case cenisys::PacketCaptureRecord::Type::Close:
+                server.getWorld().removeViewer(item.session);
+                break;
+            default:
+                break;
+            }
+        }
+        Clock::time_point dispatched = Clock::now();
+        server.runTickHandlers();
+        Clock::time_point end = Clock::now();
+        stats.ticks.push_back(toMicroseconds(end - start));
+        stats.busy += end - start;
+        stats.dispatch += dispatched - start;
+    });
+}
+
+//!
+//! \brief Run one pass over the capture.
+//! \return false if the capture cannot be read or the replay was
+//! interrupted.
+//!
+bool replay(const Options &options, cenisys::Server &server,
+            cenisys::PacketDispatcher &dispatcher, Stats &stats)
+{
+    cenisys::PacketCaptureReader reader;
+    if(!reader.open(options.capture))
+    {
+        std::cerr << options.capture << ": not a capture" << std::endl;
+        return false;
+    }
+    Clock::time_point epoch = Clock::now();
+    std::vector<cenisys::PacketCaptureRecord> records;
+    cenisys::PacketCaptureRecord record;
+    while(!interrupted && reader.next(record))
+    {
+        if(options.realtime)
+            std::this_thread::sleep_until(epoch + record.time);
+        if(record.type == cenisys::PacketCaptureRecord::Type::Open)
+            stats.sessions++;
+        if(record.type != cenisys::PacketCaptureRecord::Type::Tick)
+        {
+            records.push_back(std::move(record));
+            continue;
+        }
+        tick(server, dispatcher, records, stats);
+        records.clear();
+    }
+    if(interrupted)
+        return false;
+    if(!records.empty())
+        tick(server, dispatcher, records, stats);
+    if(reader.fail())
+    {
+        std::cerr << options.capture << ": stopped at a corrupt record"
+                  << std::endl;
+    }
+    return true;
+}
+
+void report(const cenisys::PacketDispatcher &dispatcher, Stats &stats,
+            double seconds)
+{
+    std::sort(stats.ticks.begin(), stats.ticks.end());
+    double busy = std::chrono::duration<double>(stats.busy).count();
+    double dispatch = std::chrono::duration<double>(stats.dispatch).count();
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "replayed:  " << stats.packets << " packets ("
+              << stats.bytes / 1024.0 << " KiB) from " << stats.sessions
+              << " sessions over " << stats.ticks.size() << " ticks in "
+              << seconds * 1000 << " ms" << std::endl;
+    std::cout << "handlers:  " << (dispatch > 0 ? stats.packets / dispatch : 0)
+              << " packets/s while busy, " << dispatcher.getUnhandled()
+              << " unhandled, " << dispatcher.getMalformed() << " malformed"
+              << std::endl;
+    std::cout << "tick time: p50 " << percentile(stats.ticks, 0.5)
+              << " us, p90 " << percentile(stats.ticks, 0.9) << " us, p99 "
+              << percentile(stats.ticks, 0.99) << " us, max "
+              << percentile(stats.ticks, 1) << " us, "
+              << (busy > 0 ? 100 * dispatch / busy : 0)
+              << "% in the packet handlers" << std::endl;
+    std::cout << std::endl
+              << "  id      count    total ms    mean us     max us"
+              << std::endl;
+    for(int id = 0; id < 256; id++)
+    {
+        const cenisys::PacketDispatcher::HandlerStats &item =
+            dispatcher.getStats(static_cast<std::uint8_t>(id));
+        if(!item.count)
+            continue;
+        std::cout << "  0x" << std::hex << std::setw(2) << std::setfill('0')
+                  << id << std::dec << std::setfill(' ') << std::setw(11)
+                  << item.count << std::setprecision(3) << std::setw(12)
+                  << toMicroseconds(item.total) / 1000 << std::setw(11)
+                  << toMicroseconds(item.total) / item.count << std::setw(11)
+                  << toMicroseconds(item.max) << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    boost::program_options::options_description desc(
+        "Usage: cenisys-replay [options] capture");
+    namespace po = boost::program_options;
+    desc.add_options()("help,h", "display this help and exit")(
+        "capture", po::value(&options.capture), "file written by netcapture")(
+        "realtime,r", po::bool_switch(&options.realtime),
+        "keep the recorded timing instead of replaying as fast as possible")(
+        "repeat,n", po::value(&options.repeat)->default_value(1),
+        "number of passes, only the last one is reported");
+    po::positional_options_description positional;
+    positional.add("capture", 1);
+    po::variables_map vm;
+    try
+    {
+        po::store(po::command_line_parser(argc, argv)
+                      .options(desc)
+                      .positional(positional)
+                      .run(),
+                  vm);
+        po::notify(vm);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if(vm.count("help") || options.capture.empty())
+    {
+        std::cout << desc;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    // A world of its own, with neither a console nor a network
+    boost::filesystem::path dataDir = boost::filesystem::temp_directory_path() /
+                                      boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dataDir / "config");
+    {
+        boost::filesystem::ofstream config(dataDir / "config" /
+                                           "cenisys.yml");
+        config << "console:\n"
+                  "  enable: false\n"
+                  "network:\n"
+                  "  enable: false\n";
+    }
+    BOOST_SCOPE_EXIT_ALL(&) { boost::filesystem::remove_all(dataDir); };
+    // The server formats its log messages with the global locale
+    boost::locale::generator localeGen;
+    std::locale::global(localeGen(""));
+    cenisys::Server server(dataDir, localeGen);
+    // The ticks follow the capture instead of the clock
+    server.unregisterStartupTask("tick");
+    // Only the replay stops the server, as events wait for a running one
+    std::signal(SIGINT, interrupt);
+    std::signal(SIGTERM, interrupt);
+    std::promise<void> started;
+    std::atomic<bool> open{false};
+    server.registerStartupTask("replay", {"world"}, [&] {
+        open = true;
+        started.set_value();
+    });
+    int status = 0;
+    std::thread runner([&] {
+        status = server.run();
+        if(!open)
+            started.set_value();
+    });
+    started.get_future().wait();
+    if(!open)
+    {
+        runner.join();
+        std::cerr << "cannot start the world" << std::endl;
+        return 1;
+    }
+
+    cenisys::PacketDispatcher dispatcher;
+    cenisys::NetworkManager::registerGameHandlers(dispatcher,
+                                                  server.getWorld());
+    Stats stats;
+    double seconds = 0;
+    bool replayed = true;
+    // Earlier passes warm up the caches, the allocator and the world
+    std::size_t passes = std::max<std::size_t>(options.repeat, 1);
+    for(std::size_t i = 0; replayed && i < passes; i++)
+    {
+        dispatcher.resetStats();
+        stats = Stats();
+        Clock::time_point start = Clock::now();
+        replayed = replay(options, server, dispatcher, stats);
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    server.terminate();
+    runner.join();
+    if(!replayed)
+        return 1;
+    report(dispatcher, stats, seconds);
+    return status;
+}